@@ -11,6 +11,8 @@
 #include <math.h>
 
 #include "2dmatrix.h"
+#include "mtxview.h"
+#include "../instrument/instrument.h"
 
 /**
  * @brief Create a matrix of equally spaced points
@@ -72,11 +74,14 @@ double val(matrix *A, int row, int col)
 
         return NAN;
     }
+    if(A->layout == MTX_COLMAJOR)
+        return A->array[col][row];
     return A->array[row][col];
 }
 
 /**
- * Set the value of a particular element of a matrix.
+ * Set the value of a particular element of a matrix. If the matrix shares its
+ * storage with others, it gets its own copy first.
  *
  * @param A The matrix to set the value in
  * @param value The value to set
@@ -89,7 +94,66 @@ void setval(matrix *A, double value, int row, int col)
         //fprintf(stderr, "Error: index out of bounds. (%d, %d)\n", row, col);
         return;
     }
-    A->array[row][col] = value;
+    UnshareMatrix(A);
+    if(A->layout == MTX_COLMAJOR)
+        A->array[col][row] = value;
+    else
+        A->array[row][col] = value;
+}
+
+/* Number of rows in a row-major matrix, or columns in a column-major one */
+static int nLines(matrix *A, int layout)
+{
+    return (layout == MTX_COLMAJOR) ? A->cols : A->rows;
+}
+
+/* Bytes used by a matrix and its storage, for the instrumentation counters */
+#define MTXBYTES(A) (sizeof(matrix) + nLines((A), (A)->layout)*sizeof(double*) + \
+                     (A)->rows*(A)->cols*sizeof(double))
+
+/* Allocate storage for a matrix with the given layout. The row (or column)
+ * pointers are returned in array. Returns 0 on success. */
+static int AllocStorage(matrix *A, int layout, double ***array, double **data)
+{
+    int i, n = nLines(A, layout), m = A->rows*A->cols/n;
+
+    *array = (double**) calloc(n, sizeof(double*));
+    /* All of the rows are allocated together so that views can step from one
+     * row to the next with a fixed stride. */
+    *data = (double*) calloc((size_t) A->rows*A->cols, sizeof(double));
+    if(!*array || !*data) {
+        fprintf(stderr, "Memory allocation error: %s\n", strerror(errno));
+        fprintf(stderr, "Attempted to create a %dx%d matrix and failed.\n", A->rows, A->cols);
+        free(*array);
+        free(*data);
+        return 1;
+    }
+
+    for(i=0; i<n; i++)
+        (*array)[i] = *data + (size_t) i*m;
+
+    return 0;
+}
+
+/* Swap in new storage for a matrix, letting go of the old storage. If the old
+ * storage is shared, it is only freed if this was the last matrix using it. */
+static void ReplaceStorage(matrix *A, int layout, double **array, double *data)
+{
+    PROF_ALLOC(MTXOBJ_MATRIX, sizeof(matrix) + nLines(A, layout)*sizeof(double*) + A->rows*A->cols*sizeof(double));
+
+    /* Another matrix might have unshared itself at the same time, in which
+     * case the old storage could now be unused. */
+    if(!A->refs || __atomic_sub_fetch(A->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        PROF_FREE(MTXOBJ_MATRIX, MTXBYTES(A));
+        free(A->data);
+        free(A->array);
+        free(A->refs);
+    }
+
+    A->array = array;
+    A->data = data;
+    A->refs = NULL;
+    A->layout = layout;
 }
 
 /**
@@ -103,9 +167,25 @@ void setval(matrix *A, double value, int row, int col)
  * @returns The new matrix
  */
 matrix* CreateMatrix(int row, int col)
+{
+    return CreateMatrixLayout(row, col, MTX_ROWMAJOR);
+}
+
+/**
+ * @brief Make a matrix with a particular memory layout
+ *
+ * Column-major matricies are laid out the same way as Fortran arrays, and
+ * their columns are contiguous in memory.
+ *
+ * @param row The number of rows
+ * @param col Number of columns
+ * @param layout Either MTX_ROWMAJOR or MTX_COLMAJOR
+ * @returns The new matrix, with all values set to zero, or NULL if it couldn't
+ *      be allocated
+ */
+matrix* CreateMatrixLayout(int row, int col, int layout)
 {
     matrix *A;
-    int i;
     A = NULL;
 
     if((row == 0) || (col == 0)) {
@@ -117,29 +197,22 @@ matrix* CreateMatrix(int row, int col)
     if(!A) {
         fprintf(stderr, "Memory allocation error: %s\n", strerror(errno));
         fprintf(stderr, "Attempted to create a %dx%d matrix and failed.\n", row, col);
+        return A;
     }
 
     A->array = NULL;
-    A->rows = 0;
-    A->cols = 0;
-
-    A->array = (double**) calloc(row, sizeof(double*));
-    if(!A->array) {
-        fprintf(stderr, "Memory allocation error: %s\n", strerror(errno));
-        fprintf(stderr, "Attempted to create a %dx%d matrix and failed.\n", row, col);
-        return A;
-    }
+    A->data = NULL;
+    A->refs = NULL;
+    A->rows = row;
+    A->cols = col;
+    A->layout = (layout == MTX_COLMAJOR) ? MTX_COLMAJOR : MTX_ROWMAJOR;
 
-    for(i=0; i<row; i++) {
-        A->array[i] = (double*) calloc(col, sizeof(double));
-        if(!A->array[i]) {
-            fprintf(stderr, "Failed to allocate %lu bytes: %s\n", (unsigned long) sizeof(double)*col, strerror(errno));
-            return A;
-        }
+    if(AllocStorage(A, A->layout, &A->array, &A->data)) {
+        free(A);
+        return NULL;
     }
 
-    A->rows = row;
-    A->cols = col;
+    PROF_ALLOC(MTXOBJ_MATRIX, MTXBYTES(A));
 
     return A;
 }
@@ -174,15 +247,126 @@ matrix* CreateOnesMatrix(int rows, int cols)
  */
 matrix* CopyMatrix(matrix *source)
 {
-    int i, j;
     matrix *dest;
-    dest = CreateMatrix(nRows(source), nCols(source));
-    for(i=0; i<nRows(source); i++) {
-        for(j=0; j<nCols(source); j++) {
-            setval(dest, val(source, i, j), i, j);
+    PROF_BEGIN(MTXOP_COPYMATRIX);
+    dest = CreateMatrixLayout(nRows(source), nCols(source), source->layout);
+    memcpy(dest->data, source->data, sizeof(double)*nRows(source)*nCols(source));
+    PROF_END(MTXOP_COPYMATRIX, 0);
+    return dest;
+}
+
+/**
+ * @brief Share a matrix without copying it.
+ *
+ * The returned matrix uses the same storage as the source until one of them
+ * is modified through setval, addval, mtxneg, Map or one of the *into
+ * functions. At that point the modified matrix gets its own copy of the data,
+ * so changes never show up in the other. Each one must still be passed to
+ * DestroyMatrix, and the storage is freed along with the last of them.
+ *
+ * Writing through the array or data pointers directly, or through a view,
+ * bypasses this. Call UnshareMatrix first if you need to do that.
+ *
+ * Different threads may share, modify and destroy matricies that share
+ * storage. The first time an unshared matrix is shared, though, the call must
+ * not race with other uses of that same matrix.
+ *
+ * @param A The matrix to share
+ * @return A new matrix with the same contents as A
+ */
+matrix* ShareMatrix(matrix *A)
+{
+    matrix *B;
+
+    if(!A->refs) {
+        A->refs = (int*) malloc(sizeof(int));
+        if(!A->refs) {
+            fprintf(stderr, "Memory allocation error: %s\n", strerror(errno));
+            return NULL;
         }
+        *A->refs = 1;
     }
-    return dest;
+
+    B = (matrix*) malloc(sizeof(matrix));
+    if(!B) {
+        fprintf(stderr, "Memory allocation error: %s\n", strerror(errno));
+        return NULL;
+    }
+
+    __atomic_add_fetch(A->refs, 1, __ATOMIC_RELAXED);
+    *B = *A;
+
+    return B;
+}
+
+/**
+ * @brief Give a matrix its own copy of any storage it shares with others.
+ *
+ * Does nothing if the matrix isn't shared. Called automatically by all of the
+ * functions that modify a matrix in place.
+ *
+ * @param A The matrix to unshare
+ */
+void UnshareMatrix(matrix *A)
+{
+    double **array, *data;
+
+    if(!A->refs)
+        return;
+
+    /* If this is the only one left, it can keep the storage */
+    if(__atomic_load_n(A->refs, __ATOMIC_ACQUIRE) == 1) {
+        free(A->refs);
+        A->refs = NULL;
+        return;
+    }
+
+    if(AllocStorage(A, A->layout, &array, &data))
+        return;
+    memcpy(data, A->data, (size_t) A->rows*A->cols*sizeof(double));
+    ReplaceStorage(A, A->layout, array, data);
+}
+
+/**
+ * @brief Make a copy of a matrix with a particular memory layout
+ * @param A The matrix to copy
+ * @param layout Either MTX_ROWMAJOR or MTX_COLMAJOR
+ * @returns A new matrix with the same values as A
+ */
+matrix* ConvertLayout(matrix *A, int layout)
+{
+    matrix *B;
+    B = CreateMatrixLayout(nRows(A), nCols(A), layout);
+    if(!B)
+        return NULL;
+    return CopyViewInto(ViewMatrix(A), B);
+}
+
+/**
+ * @brief Rearrange the elements of a matrix in memory to use a different
+ * layout. The values of the elements don't change.
+ *
+ * If the matrix shares its storage with others, it gets its own copy and the
+ * others aren't affected.
+ *
+ * @param A The matrix to rearrange
+ * @param layout Either MTX_ROWMAJOR or MTX_COLMAJOR
+ */
+void mtxsetlayout(matrix *A, int layout)
+{
+    matrix B;
+
+    layout = (layout == MTX_COLMAJOR) ? MTX_COLMAJOR : MTX_ROWMAJOR;
+    if(A->layout == layout)
+        return;
+
+    B = *A;
+    B.refs = NULL;
+    B.layout = layout;
+    if(AllocStorage(&B, layout, &B.array, &B.data))
+        return;
+    CopyViewInto(ViewMatrix(A), &B);
+    ReplaceStorage(A, layout, B.array, B.data);
 }
 
 /**
@@ -191,11 +375,18 @@ matrix* CopyMatrix(matrix *source)
  */
 void DestroyMatrix(matrix *A)
 {
-    int i;
-
-    for(i=0; i<A->rows; i++) {
-        free(A->array[i]);
+    /* Storage shared with other matricies is freed along with the last one */
+    if(A->refs) {
+        if(__atomic_sub_fetch(A->refs, 1, __ATOMIC_ACQ_REL) > 0) {
+            free(A);
+            return;
+        }
+        free(A->refs);
     }
+
+    PROF_FREE(MTXOBJ_MATRIX, MTXBYTES(A));
+
+    free(A->data);
     free(A->array);
     free(A);
 }
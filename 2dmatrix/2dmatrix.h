@@ -6,6 +6,10 @@
 #ifndef _2DMATRIX_H
 #define _2DMATRIX_H
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 ///Maximum number of rows to allow
 #define MAXROWS 800000
 ///Maximum number of columns
@@ -26,20 +30,38 @@
  */
 #define addval(A, VAL, I, J) setval((A), (VAL) + val((A), (I), (J)), (I), (J))
 
+///Layout where the elements of each row are next to each other in memory
+#define MTX_ROWMAJOR 0
+///Layout where the elements of each column are next to each other in memory,
+///as in Fortran
+#define MTX_COLMAJOR 1
+
 /**
  * @struct matrix
  * @brief A data structure for holding two-dimensional matricies
  * @var matrix::array
- * A pointer to the raw data
+ * Pointers to the start of each row, or of each column if the matrix is
+ * column-major
+ * @var matrix::data
+ * The raw data, all in a single block. For a row-major matrix, element (i, j)
+ * is at data[i*cols + j]. For a column-major one, it is at data[j*rows + i].
+ * @var matrix::refs
+ * Number of matricies sharing array and data, or NULL if they aren't shared.
+ * Set up by ShareMatrix and updated atomically.
  * @var matrix::rows
  * Number of rows in the matrix
  * @var matrix::cols
  * Number of columns
+ * @var matrix::layout
+ * Either MTX_ROWMAJOR or MTX_COLMAJOR
  */
 typedef struct {
     double **array;
+    double *data;
+    int *refs;
     int rows;
     int cols;
+    int layout;
 } matrix;
 
 void DestroyMatrix(matrix*);
@@ -48,18 +70,29 @@ int nRows(matrix*);
 double val(matrix*, int, int);
 void setval(matrix*, double, int, int);
 matrix* CreateMatrix(int, int);
+matrix* CreateMatrixLayout(int, int, int);
 matrix* CreateOnesMatrix(int, int);
 matrix* linspace(double, double, int);
 matrix* CopyMatrix(matrix*);
+matrix* ShareMatrix(matrix*);
+void UnshareMatrix(matrix*);
+matrix* ConvertLayout(matrix*, int);
+void mtxsetlayout(matrix*, int);
 
 matrix* CalcMinor(matrix*, int, int);
 double CalcDeterminant(matrix*);
 double mtxextrm(matrix*);
 matrix* mtxtrn(matrix*);
+void mtxtrnflip(matrix*);
 matrix* mtxmul(matrix*, matrix*);
 matrix* mtxmulconst(matrix*, double k);
 matrix* mtxadd(matrix*, matrix*);
 matrix* mtxsub(matrix*, matrix*);
+matrix* mtxtrninto(matrix*, matrix*);
+matrix* mtxmulinto(matrix*, matrix*, matrix*);
+matrix* mtxmulconstinto(matrix*, double, matrix*);
+matrix* mtxaddinto(matrix*, matrix*, matrix*);
+matrix* mtxsubinto(matrix*, matrix*, matrix*);
 matrix* mtxneg(matrix*);
 matrix* CalcAdj(matrix*);
 matrix* CalcInv(matrix*);
@@ -72,11 +105,15 @@ void Map(matrix*, double (*func)(double));
 
 matrix* ParseMatrix(char*);
 void mtxprnt(matrix*);
-void mtxprntfile(matrix*, char*);
-void mtxprntfilehdr(matrix*, char*, char*);
+int mtxprntfile(matrix*, char*);
+int mtxprntfilehdr(matrix*, char*, char*);
 matrix* mtxloadcsv(char*, int);
 
 //#define val(MATRIX, ROW, COL) (MATRIX)->array[(int) (ROW)][(int) (COL)]
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif
 
@@ -7,9 +7,14 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <errno.h>
 
 #include "xstrtok.h"
 #include "2dmatrix.h"
+#include "../instrument/instrument.h"
+
+///Number of lines mtxloadcsv makes room for before it has to grow its buffer
+#define CSVLINES 1024
 
 /**
  * @brief Print out a matrix
@@ -39,10 +44,12 @@ void mtxprnt(matrix *A)
  * @brief Print a matrix out to some random file
  * @param A The matrix to print
  * @param filename The filename to print to
+ * @returns 0 on success, or -1 if the file couldn't be written, with errno
+ *      set to say why
  */
-void mtxprntfile(matrix *A, char *filename)
+int mtxprntfile(matrix *A, char *filename)
 {
-    mtxprntfilehdr(A, filename, NULL);
+    return mtxprntfilehdr(A, filename, NULL);
 }
 
 /**
@@ -50,14 +57,23 @@ void mtxprntfile(matrix *A, char *filename)
  * @param A The matrix to print
  * @param filename The filename to print to
  * @param header Optional header
+ * @returns 0 on success, or -1 if the file couldn't be written, with errno
+ *      set to say why
  */
-void mtxprntfilehdr(matrix *A, char *filename, char *header)
+int mtxprntfilehdr(matrix *A, char *filename, char *header)
 {
-    int i, j;
+    int i, j, err;
     FILE *file;
 
     file = fopen(filename, "w");
+    if(!file) {
+        err = errno;
+        fprintf(stderr, "Error: Unable to open %s: %s\n", filename, strerror(err));
+        errno = err;
+        return -1;
+    }
 
+    PROF_BEGIN(MTXOP_PRNTFILE);
     if(header)
         fprintf(file, "%s", header);
     for(i=0; i<nRows(A); i++) {
@@ -66,49 +82,98 @@ void mtxprntfilehdr(matrix *A, char *filename, char *header)
         }
         fprintf(file, "%e\n", val(A, i, nCols(A)-1));
     }
-    fclose(file);
+    err = ferror(file) ? errno : 0;
+    if(fclose(file) && !err)
+        err = errno;
+    PROF_END(MTXOP_PRNTFILE, 0);
+
+    if(err) {
+        fprintf(stderr, "Error: Unable to write %s: %s\n", filename, strerror(err));
+        errno = err;
+        return -1;
+    }
+    return 0;
 }
 
 /**
  * @brief Load a matrix from a CSV file.
+ *
+ * Safe to call from several threads at once. Lines longer than LINELENGTH
+ * characters are split, and only the first MAXROWS lines are read.
+ *
  * @param filename The filename to load data from.
  * @param row0 Number of the first row to load.
- * @return A matrix containing all the values in the CSV file.
+ * @return A matrix containing all the values in the CSV file, or NULL if the
+ *      file couldn't be opened or read, with errno set to say why.
  */
 matrix* mtxloadcsv(char* filename, int row0)
 {
     matrix *A;
-    int maxlines = MAXROWS,
+    int maxlines = CSVLINES,
         maxchars = LINELENGTH,
         i, j,
         ncols = 1, /* Assume there's at least one column */
         nrows = 0;
     const char *delim = ",";
-    char **buffer;
-    char *number;
-    FILE *fp; /* TODO: Actually open/read the file */
+    char *buffer, *tmp, *line;
+    char *number, *save;
+    FILE *fp;
+    int err;
 
-    /* Make a buffer to store all of the characters read from the file */
-    buffer = (char**) calloc(sizeof(char*), maxlines);
-    for(i=0; i<maxlines; i++)
-        buffer[i] = (char*) calloc(sizeof(char), maxchars);
-
-    /* Load in all the lines (up to the specified limits) */
     fp = fopen(filename, "r");
-    for(i=0; i<maxlines; i++) {
-        if(fgets(buffer[i], maxchars, fp) == NULL) {
-            nrows = i;
-            break;
+    if(!fp) {
+        err = errno;
+        fprintf(stderr, "Error: Unable to open %s: %s\n", filename, strerror(err));
+        errno = err;
+        return NULL;
+    }
+    PROF_BEGIN(MTXOP_LOADCSV);
+
+    /* Read the lines into one buffer, LINELENGTH characters apart, doubling it
+     * whenever it fills up. */
+    buffer = (char*) malloc((size_t) maxlines*maxchars);
+    while(buffer) {
+        if(nrows == maxlines) {
+            if(maxlines == MAXROWS) {
+                if(fgetc(fp) != EOF)
+                    fprintf(stderr, "Maximum number of lines exceeded. Current limit is %d lines.\n",
+                            maxlines);
+                break;
+            }
+            maxlines = (2*maxlines < MAXROWS) ? 2*maxlines : MAXROWS;
+            tmp = (char*) realloc(buffer, (size_t) maxlines*maxchars);
+            if(!tmp) {
+                free(buffer);
+                buffer = NULL;
+                break;
+            }
+            buffer = tmp;
         }
+        if(fgets(buffer + (size_t) nrows*maxchars, maxchars, fp) == NULL)
+            break;
+        nrows++;
     }
-    if(i==0)
-        fprintf(stderr, "Maximum number of lines exceeded. Current limit is %d lines.\n", maxlines);
+    err = errno;
     fclose(fp);
+    if(!buffer) {
+        fprintf(stderr, "Memory allocation error: %s\n", strerror(err));
+        PROF_END(MTXOP_LOADCSV, 0);
+        errno = err;
+        return NULL;
+    }
+    if(row0 < 0 || row0 >= nrows) {
+        fprintf(stderr, "Error: %s doesn't have a row %d.\n", filename, row0);
+        free(buffer);
+        PROF_END(MTXOP_LOADCSV, 0);
+        errno = EINVAL;
+        return NULL;
+    }
 
     /* Check the first line to see how many values there are. */
+    line = buffer + (size_t) row0*maxchars;
     i=0;
-    while(buffer[row0][i]) {
-        if(buffer[row0][i] == delim[0])
+    while(line[i]) {
+        if(line[i] == delim[0])
             ncols++;
         i++;
     }
@@ -117,10 +182,16 @@ matrix* mtxloadcsv(char* filename, int row0)
 
     /* Make a matrix that's hopefully the right size */
     A = CreateMatrix(nrows, ncols);
+    if(!A) {
+        free(buffer);
+        PROF_END(MTXOP_LOADCSV, 0);
+        errno = ENOMEM;
+        return NULL;
+    }
     /* Start putting values into it */
     for(i=0; i<nrows; i++) {
         /* Get the first value and store it */
-        number = xstrtok(buffer[i+row0], delim);
+        number = xstrtok_r(buffer + (size_t) (i+row0)*maxchars, delim, &save);
             if(number[0] == '\0')
                 setval(A, NAN, i, 0);
             else
@@ -128,7 +199,7 @@ matrix* mtxloadcsv(char* filename, int row0)
 
         /* Get the rest */
         j = 1;
-        while((number = xstrtok(NULL, delim))) {
+        while((number = xstrtok_r(NULL, delim, &save))) {
             if(number[0] == '\0' || number[0] == '\n')
                 setval(A, NAN, i, j);
             else {
@@ -142,11 +213,9 @@ matrix* mtxloadcsv(char* filename, int row0)
             setval(A, NAN, i, j);
     }
 
-    for(i=0; i<maxlines; i++)
-        free(buffer[i]);
     free(buffer);
-    free(number);
 
+    PROF_END(MTXOP_LOADCSV, 0);
     return A;
 }
 
@@ -167,6 +236,7 @@ matrix* ParseMatrix(char* raw)
     matrix *out;
     int i, j;
     int nrows, ncols;
+    PROF_BEGIN(MTXOP_PARSEMATRIX);
 
     processed = calloc(sizeof(char), MAXROWS*LINELENGTH);
     tmp = processed;
@@ -232,6 +302,7 @@ matrix* ParseMatrix(char* raw)
     free(rows);
     free(values);
 
+    PROF_END(MTXOP_PARSEMATRIX, 0);
     return out;
 }
 
@@ -9,21 +9,37 @@
 #include <stdio.h>
 
 #include "2dmatrix.h"
+#include "mtxview.h"
+#include "../instrument/instrument.h"
+
+///Number of elements above which mtxextrm is multithreaded
+#define PARALLELSIZE 1e5
 
 /**
  * Determine the element of a matrix with the largest magnitude and return it.
+ *
+ * The elements are read straight from storage, in several threads for large
+ * matricies. If more than one element has the largest magnitude, the first
+ * one in memory is returned.
+ *
  * @param A Matrix to search
  * @returns Value of the largest (or smallest) element.
  */
 double mtxextrm(matrix *x)
 {
-    double extrm = 0;
-    int i, j;
-
-    for(i=0; i<nRows(x); i++) {
-        for(j=0; j<nCols(x); j++) {
-            if(fabs(extrm) < fabs(val(x, i, j)))
-                extrm = val(x, i, j);
+    long n = (long) nRows(x)*nCols(x), i;
+    double extrm = 0, m = 0;
+
+    /* Find the largest magnitude first, and then the first element with it */
+    #pragma omp parallel for reduction(max:m) if(n > PARALLELSIZE)
+    for(i=0; i<n; i++)
+        if(fabs(x->data[i]) > m)
+            m = fabs(x->data[i]);
+
+    for(i=0; i<n && m > 0; i++) {
+        if(fabs(x->data[i]) == m) {
+            extrm = x->data[i];
+            break;
         }
     }
 
@@ -38,26 +54,43 @@ double mtxextrm(matrix *x)
 matrix* mtxtrn(matrix *x)
 {
     matrix *xt;
-    int rows = nRows(x);
-    int cols = nCols(x);
-    int i, j;
-
-    xt = NULL;
-/*
-    if(nRows(x) != nCols(x)) {
-        fprintf(stderr, "ERROR!");
-        return xt;
-    }
-*/
+    xt = CreateMatrixLayout(nCols(x), nRows(x), x->layout);
+    return mtxtrninto(x, xt);
+}
 
-    xt = CreateMatrix(cols, rows);
+/**
+ * @brief Transpose a matrix in place without moving any data
+ *
+ * A row-major matrix and its transpose stored column-major are the same thing
+ * in memory, so this just swaps the dimensions and flips the layout.
+ *
+ * @param x The matrix to transpose
+ */
+void mtxtrnflip(matrix *x)
+{
+    int rows = x->rows;
+    x->rows = x->cols;
+    x->cols = rows;
+    x->layout = (x->layout == MTX_COLMAJOR) ? MTX_ROWMAJOR : MTX_COLMAJOR;
+}
 
-    for(i=0; i<cols; i++) {
-        for(j=0; j<rows; j++) {
-            setval(xt, val(x, j, i), i, j);
-        }
+/**
+ * @brief Transpose a matrix into an existing matrix
+ * @param x The matrix to transpose
+ * @param xt Matrix to store the transpose in. Must not be x.
+ * @return xt, or NULL if the dimensions don't agree
+ */
+matrix* mtxtrninto(matrix *x, matrix *xt)
+{
+    if(x == xt) {
+        fprintf(stderr, "Error: Incompatible matrix dimensions.\n");
+        return NULL;
     }
 
+    PROF_BEGIN(MTXOP_MTXTRN);
+    xt = CopyViewInto(ViewTranspose(ViewMatrix(x)), xt);
+    PROF_END(MTXOP_MTXTRN, 0);
+
     return xt;
 }
 
@@ -72,36 +105,35 @@ matrix* mtxtrn(matrix *x)
  */
 matrix* mtxmul(matrix *A, matrix *B)
 {
-    int Ar, Ac, Br, Bc;
-    int i, j, k;
     matrix *C;
 
-    C = NULL;
-
-    Ar = nRows(A);
-    Ac = nCols(A);
-    Br = nRows(B);
-    Bc = nCols(B);
-
     /* If the matricies dimensions aren't correct, return NULL */
-    if(Ac != Br) {
+    if(nCols(A) != nRows(B)) {
         fprintf(stderr, "Error: Incompatible matrix dimensions.\n");
-        return C;
+        return NULL;
     }
 
     /* Allocate Memory */
-    C = CreateMatrix(Ar, Bc);
-
-    /* Cik = AijBjk */
-    for(i=0; i<Ar; i++) {
-        for(k=0; k<Bc; k++) {
-            for(j=0; j<Ac; j++) {
-                C->array[i][k] += A->array[i][j] * B->array[j][k];
-            }
-        }
+    C = CreateMatrix(nRows(A), nCols(B));
+    return mtxmulinto(A, B, C);
+}
+
+/**
+ * @brief Multiply two matricies, storing the result in an existing matrix
+ * @param A The first matrix to multiply
+ * @param B The second one
+ * @param C Matrix to store A*B in. Must not be A or B.
+ * @return C, or NULL if the dimensions don't agree
+ * @see mtxmulview
+ */
+matrix* mtxmulinto(matrix *A, matrix *B, matrix *C)
+{
+    if(C == A || C == B) {
+        fprintf(stderr, "Error: Incompatible matrix dimensions.\n");
+        return NULL;
     }
 
-    return C;
+    return mtxmulview(ViewMatrix(A), ViewMatrix(B), C);
 }
 
 /**
@@ -113,74 +145,158 @@ matrix* mtxmul(matrix *A, matrix *B)
  */
 matrix* mtxmulconst(matrix *A, double k)
 {
-    int Ar, Ac;
-    int i, j;
     matrix *C;
+    C = CreateMatrix(nRows(A), nCols(A));
+    return mtxmulconstinto(A, k, C);
+}
 
-    Ar = nRows(A);
-    Ac = nCols(A);
+/**
+ * @brief Multiply a matrix by a constant, storing the result in an existing
+ * matrix
+ * @param A The matrix to multiply
+ * @param k The scalar
+ * @param C Matrix to store k*A in. May be A itself.
+ * @return C, or NULL if the dimensions don't agree
+ */
+matrix* mtxmulconstinto(matrix *A, double k, matrix *C)
+{
+    int i, j, n;
+    mtxview a, c;
 
-    C = CreateMatrix(Ar, Ac);
+    if(nRows(C) != nRows(A) || nCols(C) != nCols(A)) {
+        fprintf(stderr, "Error: Incompatible matrix dimensions.\n");
+        return NULL;
+    }
 
-    for(i=0; i<Ar; i++) {
-        for(j=0; j<Ac; j++) {
-            setval(C, k*val(A, i, j), i, j);
-        }
+    UnshareMatrix(C);
+    PROF_BEGIN(MTXOP_MTXMULCONST);
+    if(C->layout == A->layout) {
+        n = nRows(A)*nCols(A);
+        for(i=0; i<n; i++)
+            C->data[i] = k*A->data[i];
+    } else {
+        a = ViewMatrix(A);
+        c = ViewMatrix(C);
+        for(i=0; i<nRows(A); i++)
+            for(j=0; j<nCols(A); j++)
+                valView(c, i, j) = k*valView(a, i, j);
     }
+    PROF_END(MTXOP_MTXMULCONST, (double) nRows(A)*nCols(A));
 
     return C;
 }
 
 /**
  * @brief Add two matricies.
- * Todo: Add error checking to make sure the dimensions agree.
+ *
+ * If one of them has a single row or column where the other has more, that
+ * row or column is repeated to match, so a row vector can be added to every
+ * row of a matrix, or a row and a column can be combined into a full table.
+ *
  * @param A Some random matrix
- * @param B Another random matrix with the same dimensions as A
- * @return A+B
+ * @param B Another random matrix with the same dimensions as A, or one that
+ *      can be broadcast to match
+ * @return A+B, or NULL if the dimensions don't agree
  */
 matrix* mtxadd(matrix *A, matrix *B)
 {
-    int rows = nRows(A);
-    int cols = nCols(A);
-
     matrix *C;
-
-    int i, j;
-
-    C = CreateMatrix(rows, cols);
-
-    for(i=0; i<rows; i++) {
-        for(j=0; j<cols; j++) {
-            setval(C, val(A, i, j) + val(B, i, j), i, j);
-        }
+    C = CreateMatrixLayout((nRows(A) == 1) ? nRows(B) : nRows(A),
+                           (nCols(A) == 1) ? nCols(B) : nCols(A), A->layout);
+    if(!mtxaddinto(A, B, C)) {
+        DestroyMatrix(C);
+        return NULL;
     }
+    return C;
+}
+
+/**
+ * @brief Add two matricies, storing the result in an existing matrix
+ *
+ * A and B are broadcast to the size of C, as with mtxadd.
+ *
+ * @param A Some random matrix
+ * @param B Another random matrix with the same dimensions as A
+ * @param C Matrix to store A+B in. May be A or B.
+ * @return C, or NULL if the dimensions don't agree
+ */
+matrix* mtxaddinto(matrix *A, matrix *B, matrix *C)
+{
+    int rows = nRows(C);
+    int cols = nCols(C);
+    int i, n;
+
+    /* Anything other than three matricies of the same size and layout goes
+     * through the strided kernel */
+    if(nRows(A) != rows || nCols(A) != cols ||
+       nRows(B) != rows || nCols(B) != cols ||
+       A->layout != C->layout || B->layout != C->layout)
+        return mtxaddview(ViewMatrix(A), ViewMatrix(B), C);
+
+    UnshareMatrix(C);
+    PROF_BEGIN(MTXOP_MTXADD);
+    n = rows*cols;
+    for(i=0; i<n; i++)
+        C->data[i] = A->data[i] + B->data[i];
+    PROF_END(MTXOP_MTXADD, (double) rows*cols);
 
     return C;
 }
 
 /**
  * @brief Subtract two matricies.
- * Todo: Add error checking to make sure the dimensions agree.
+ *
+ * If one of them has a single row or column where the other has more, that
+ * row or column is repeated to match, so a row vector can be subtracted from
+ * every row of a matrix, or a row and a column can be combined into a full
+ * table.
+ *
  * @param A Some random matrix
- * @param B Another random matrix with the same dimensions as A
- * @return A-B
+ * @param B Another random matrix with the same dimensions as A, or one that
+ *      can be broadcast to match
+ * @return A-B, or NULL if the dimensions don't agree
  */
 matrix* mtxsub(matrix *A, matrix *B)
 {
-    int rows = nRows(A);
-    int cols = nCols(A);
-
     matrix *C;
-
-    int i, j;
-
-    C = CreateMatrix(rows, cols);
-
-    for(i=0; i<rows; i++) {
-        for(j=0; j<cols; j++) {
-            setval(C, val(A, i, j) - val(B, i, j), i, j);
-        }
+    C = CreateMatrixLayout((nRows(A) == 1) ? nRows(B) : nRows(A),
+                           (nCols(A) == 1) ? nCols(B) : nCols(A), A->layout);
+    if(!mtxsubinto(A, B, C)) {
+        DestroyMatrix(C);
+        return NULL;
     }
+    return C;
+}
+
+/**
+ * @brief Subtract two matricies, storing the result in an existing matrix
+ *
+ * A and B are broadcast to the size of C, as with mtxsub.
+ *
+ * @param A Some random matrix
+ * @param B Another random matrix with the same dimensions as A
+ * @param C Matrix to store A-B in. May be A or B.
+ * @return C, or NULL if the dimensions don't agree
+ */
+matrix* mtxsubinto(matrix *A, matrix *B, matrix *C)
+{
+    int rows = nRows(C);
+    int cols = nCols(C);
+    int i, n;
+
+    /* Anything other than three matricies of the same size and layout goes
+     * through the strided kernel */
+    if(nRows(A) != rows || nCols(A) != cols ||
+       nRows(B) != rows || nCols(B) != cols ||
+       A->layout != C->layout || B->layout != C->layout)
+        return mtxsubview(ViewMatrix(A), ViewMatrix(B), C);
+
+    UnshareMatrix(C);
+    PROF_BEGIN(MTXOP_MTXSUB);
+    n = rows*cols;
+    for(i=0; i<n; i++)
+        C->data[i] = A->data[i] - B->data[i];
+    PROF_END(MTXOP_MTXSUB, (double) rows*cols);
 
     return C;
 }
@@ -191,61 +307,36 @@ matrix* mtxsub(matrix *A, matrix *B)
  * @return A pointer to the same matrix A that was passed to this function*/
 matrix* mtxneg(matrix *A)
 {
-    int i, j;
-    for(i=0; i<nRows(A); i++) {
-        for(j=0; j<nCols(A); j++) {
-            setval(A, -1*val(A, i, j), i, j);
-        }
-    }
+    int i, n = nRows(A)*nCols(A);
+    UnshareMatrix(A);
+    for(i=0; i<n; i++)
+        A->data[i] = -A->data[i];
     return A;
 }
 
 /**
  * @brief Calculate the minor of the row,col element of a matrix.
- *
- * Code here courtesy of http://www.daniweb.com/software-development/c/code/216687
  * @param A The matrix to calculate stuff for
  * @param row The row of the element
  * @param col The column the element is in
  * @return The value of the minor
  */
 matrix* CalcMinor(matrix* A, int row, int col) {
-    int i, j, a, b;
-    int order;
-    matrix *minor;
-
-    minor = NULL;
-    order = nRows(A);
+    mtxcatview minor;
 
-    if(order <= 1)
-        return NULL;
-    if(row >= order || col >= order)
+    if(nRows(A) <= 1)
         return NULL;
-    if( !(minor = CreateMatrix(order-1, order-1)) )
+    if(row >= nRows(A) || col >= nRows(A))
         return NULL;
 
-    a = b = 0;
-
-    for(i=0; i<order; i++) {
-        if(i != row) {
-            b = 0;
-            for(j=0; j<order; j++) {
-                if(j != col) {
-                    setval(minor, val(A, i, j), a, b);
-                    b++;
-                }
-            }
-        a++;
-        }
-    }
-
-    return minor;
+    minor = ViewMinor(A, row, col);
+    return CopyCatView(&minor);
 }
 
 /**
  * @brief Calculate the determinant of a matrix
  *
- * Borrowed from the same site as CalcMinor
+ * Borrowed from http://www.daniweb.com/software-development/c/code/216687
  * @param p The matrix to calculate the determiant of. Must be square.
  * @return The determinant of p
  * @see CalcMinor
@@ -274,7 +365,7 @@ double CalcDeterminant(matrix *p)
             return 0;
         }
 
-        result += ( pow(-1, i) * p->array[0][i] * CalcDeterminant(minor));
+        result += ( pow(-1, i) * val(p, 0, i) * CalcDeterminant(minor));
 
         DestroyMatrix(minor);
     }
@@ -322,12 +413,14 @@ matrix* CalcInv(matrix* A)
     matrix *inv, *adj;
     int i, j;
     double det;
+    PROF_BEGIN(MTXOP_CALCINV);
 
     inv = CreateMatrix(nRows(A), nRows(A));
 
     /* If someone sticks a 1x1 matrix in here, do this. */
     if(nRows(A) == 1 && nCols(A) == 1) {
         setval(inv, 1/val(A, 0, 0), 0, 0);
+        PROF_END(MTXOP_CALCINV, 1);
         return inv;
     }
 
@@ -340,6 +433,9 @@ matrix* CalcInv(matrix* A)
         }
     }
 
+    /* Cofactor expansion: n^2 determinants of order n-1, each costing about
+     * (n-1)! multiplications, plus one determinant of order n. */
+    PROF_END(MTXOP_CALCINV, (nRows(A)+1)*tgamma(nRows(A)+1));
     return inv;
 }
 
@@ -354,18 +450,16 @@ matrix* CalcInv(matrix* A)
  */
 void Map(matrix* A, double (*func)(double))
 {
-    int i, j;
-    for(i=0; i<nRows(A); i++) {
-        for(j=0; j<nCols(A); j++) {
-            setval(A, (*func)(val(A, i, j)), i, j);
-        }
-    }
+    int i, n = nRows(A)*nCols(A);
+    UnshareMatrix(A);
+    for(i=0; i<n; i++)
+        A->data[i] = (*func)(A->data[i]);
 }
 
 /**
  * @brief Make an agumented matrix from the two arguments
- * This is used to set up a matrix for the equation solver. Basically, matrix
- * B is stuck on the end of A like this: [A | B].
+ * Basically, matrix B is stuck on the end of A like this: [A | B]. Use
+ * ConcatView instead to work with [A | B] without copying.
  * @param A The first matrix
  * @param B Second matrix
  * @returns A matrix composed of the first matrix on the left and the second
@@ -373,19 +467,9 @@ void Map(matrix* A, double (*func)(double))
  */
 matrix* AugmentMatrix(matrix *A, matrix *B)
 {
-    int i, j;
-    matrix *C;
-    C = CreateMatrix(nRows(A), nCols(A)+nCols(B));
-    for(i=0; i<nRows(A); i++) {
-        for(j=0; j<nCols(A); j++) {
-            setval(C, val(A, i, j), i, j);
-        }
-        for(j=0; j<nCols(B); j++) {
-            setval(C, val(B, i, j), i, j+nCols(A));
-        }
-    }
-
-    return C;
+    mtxcatview C;
+    C = ConcatView(ViewMatrix(A), ViewMatrix(B));
+    return CopyCatView(&C);
 }
 
 /**
@@ -396,15 +480,7 @@ matrix* AugmentMatrix(matrix *A, matrix *B)
  */
 matrix* ExtractColumn(matrix* A, int col)
 {
-    matrix *B;
-    int i;
-    B = CreateMatrix(nRows(A), 1);
-
-    for(i=0; i<nRows(A); i++) {
-	setval(B, val(A, i, col), i, 0);
-    }
-
-    return B;
+    return CopyView(ViewColumn(A, col));
 }
 
 /**
@@ -415,15 +491,7 @@ matrix* ExtractColumn(matrix* A, int col)
  */
 matrix* ExtractRow(matrix* A, int row)
 {
-    matrix *B;
-    int i;
-    B = CreateMatrix(1, nCols(A));
-
-    for(i=0; i<nCols(A); i++) {
-	setval(B, val(A, row, i), 0, i);
-    }
-
-    return B;
+    return CopyView(ViewRow(A, row));
 }
 
 /**
@@ -0,0 +1,275 @@
+/**
+ * @file cholesky.c
+ * Cholesky (LL^T) and LDL^T factorizations for symmetric positive definite
+ * matricies, and the corresponding solvers.
+ *
+ * The factorizations are done in place. Only the lower triangle of the input
+ * matrix is referenced, and on return it is overwritten with the factor. The
+ * strict upper triangle is left untouched.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "2dmatrix.h"
+#include "mtxsolver.h"
+#include "triangular.h"
+#include "../instrument/instrument.h"
+
+///Block size used by the blocked factorization
+#define CHOLBLOCK 64
+
+/**
+ * @brief Blocked right-looking factorization shared by LL^T and LDL^T.
+ *
+ * Each step factors a CHOLBLOCK wide diagonal block, solves for the panel of L
+ * below it, and then subtracts the panel's contribution from the trailing
+ * submatrix. All inner loops are dot products along rows, which are contiguous
+ * in memory.
+ *
+ * @param A Matrix to factor in place
+ * @param ldl Nonzero for LDL^T, zero for LL^T
+ * @returns 0 on success, or k if the leading minor of order k is not positive
+ *      definite (LL^T) or is singular (LDL^T)
+ */
+static int FactorBlocked(matrix *A, int ldl)
+{
+    int n = nRows(A);
+    int kb, nb, i, j, k, kend;
+    double **a = A->array;
+    double s, w[CHOLBLOCK];
+
+    for(kb=0; kb<n; kb+=CHOLBLOCK) {
+        nb = (n-kb < CHOLBLOCK) ? n-kb : CHOLBLOCK;
+        kend = kb+nb;
+
+        /* Diagonal block and the panel below it. Row i of the panel is solved
+         * against the rows of the diagonal block as they are finished. */
+        for(j=kb; j<kend; j++) {
+            s = a[j][j];
+            for(k=kb; k<j; k++)
+                s -= a[j][k]*a[j][k] * (ldl ? a[k][k] : 1);
+
+            if(ldl) {
+                if(s == 0 || !isfinite(s))
+                    return j+1;
+                a[j][j] = s;
+            } else {
+                if(s <= 0 || !isfinite(s))
+                    return j+1;
+                a[j][j] = sqrt(s);
+            }
+
+            for(i=j+1; i<n; i++) {
+                s = a[i][j];
+                for(k=kb; k<j; k++)
+                    s -= a[i][k]*a[j][k] * (ldl ? a[k][k] : 1);
+                a[i][j] = s/a[j][j];
+            }
+        }
+
+        /* Symmetric rank-nb update of the trailing submatrix */
+        for(i=kend; i<n; i++) {
+            for(k=kb; k<kend; k++)
+                w[k-kb] = ldl ? a[i][k]*a[k][k] : a[i][k];
+            for(j=kend; j<=i; j++) {
+                s = 0;
+                for(k=kb; k<kend; k++)
+                    s += w[k-kb]*a[j][k];
+                a[i][j] -= s;
+            }
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Factor a symmetric positive definite matrix as L*L^T in place.
+ * @param A Square matrix. Only the lower triangle is used, and it is replaced
+ *      with L.
+ * @returns 0 on success, or k if the leading minor of order k is not positive
+ *      definite. In that case A is left partially factored.
+ */
+int CholeskyFactor(matrix *A)
+{
+    int info, layout;
+
+    if(nRows(A) != nCols(A)) {
+        fprintf(stderr, "CholeskyFactor(): Matrix must be square.\n");
+        return -1;
+    }
+
+    PROF_BEGIN(MTXOP_CHOLESKY);
+    /* The factorization works on rows, so column-major input is rearranged
+     * for the duration. */
+    layout = A->layout;
+    mtxsetlayout(A, MTX_ROWMAJOR);
+    UnshareMatrix(A);
+    info = FactorBlocked(A, 0);
+    mtxsetlayout(A, layout);
+
+    PROF_END(MTXOP_CHOLESKY, nRows(A)*(double)nRows(A)*nRows(A)/3.0);
+    return info;
+}
+
+/**
+ * @brief Factor a symmetric matrix as L*D*L^T in place, without pivoting.
+ *
+ * This avoids the square roots of the Cholesky factorization and also works
+ * for symmetric quasi-definite matricies.
+ *
+ * @param A Square matrix. Only the lower triangle is used. On return, the
+ *      strict lower triangle holds the unit lower triangular L and the
+ *      diagonal holds D.
+ * @returns 0 on success, or k if the k-th pivot is zero.
+ */
+int LDLFactor(matrix *A)
+{
+    int info, layout;
+
+    if(nRows(A) != nCols(A)) {
+        fprintf(stderr, "LDLFactor(): Matrix must be square.\n");
+        return -1;
+    }
+
+    PROF_BEGIN(MTXOP_LDL);
+    /* The factorization works on rows, so column-major input is rearranged
+     * for the duration. */
+    layout = A->layout;
+    mtxsetlayout(A, MTX_ROWMAJOR);
+    UnshareMatrix(A);
+    info = FactorBlocked(A, 1);
+    mtxsetlayout(A, layout);
+
+    PROF_END(MTXOP_LDL, nRows(A)*(double)nRows(A)*nRows(A)/3.0);
+    return info;
+}
+
+/**
+ * @brief Solve L*L^T*X = B, or L*D*L^T*X = B, using a factored matrix.
+ *
+ * Both triangular solves are done by trsm straight out of the lower triangle
+ * of the factor, so L is never copied or transposed.
+ *
+ * @param L The factored matrix
+ * @param B Right-hand sides, one per column. Overwritten with the solution.
+ * @param ldl Nonzero if L came from LDLFactor
+ */
+static void SolveFactored(matrix *L, matrix *B, int ldl)
+{
+    int n = nRows(L), m = nCols(B), i, j;
+    trimatrix T;
+    mtxview l = ViewMatrix(L), b;
+
+    T = ViewTriangle(l, TRI_LOWER, ldl ? TRI_UNIT : TRI_NONUNIT);
+
+    /* Forward substitution: L*Y = B */
+    trsm(TRI_LEFT, 1, T, B);
+
+    /* Diagonal scaling: D*Z = Y */
+    if(ldl) {
+        UnshareMatrix(B);
+        b = ViewMatrix(B);
+        for(i=0; i<n; i++)
+            for(j=0; j<m; j++)
+                valView(b, i, j) /= valView(l, i, i);
+    }
+
+    /* Back substitution: L^T*X = Z */
+    trsm(TRI_LEFT, 1, TransposeTriangle(T), B);
+}
+
+/**
+ * @brief Solve A*X = B in place using the output of CholeskyFactor.
+ * @param L Cholesky factor of A
+ * @param B Matrix of right-hand sides. Overwritten with X.
+ */
+void CholeskySolve(matrix *L, matrix *B)
+{
+    if(nRows(B) != nRows(L)) {
+        fprintf(stderr, "CholeskySolve(): Incompatible matrix dimensions.\n");
+        return;
+    }
+    SolveFactored(L, B, 0);
+}
+
+/**
+ * @brief Solve A*X = B in place using the output of LDLFactor.
+ * @param LD LDL^T factorization of A
+ * @param B Matrix of right-hand sides. Overwritten with X.
+ */
+void LDLSolve(matrix *LD, matrix *B)
+{
+    if(nRows(B) != nRows(LD)) {
+        fprintf(stderr, "LDLSolve(): Incompatible matrix dimensions.\n");
+        return;
+    }
+    SolveFactored(LD, B, 1);
+}
+
+/**
+ * @brief Calculate the determinant of A from its Cholesky factor.
+ * @param L Output of CholeskyFactor
+ * @returns det(A), which is the square of the product of the diagonal of L
+ */
+double CholeskyDeterminant(matrix *L)
+{
+    int i;
+    double det = 1;
+    for(i=0; i<nRows(L); i++)
+        det *= L->array[i][i];
+    return det*det;
+}
+
+/**
+ * @brief Calculate the determinant of A from its LDL^T factorization.
+ * @param LD Output of LDLFactor
+ * @returns det(A), which is the product of the elements of D
+ */
+double LDLDeterminant(matrix *LD)
+{
+    int i;
+    double det = 1;
+    for(i=0; i<nRows(LD); i++)
+        det *= LD->array[i][i];
+    return det;
+}
+
+/**
+ * @brief Solve a symmetric positive definite system of equations.
+ *
+ * This is the equivalent of SolveMatrixEquation for SPD matricies, and takes
+ * roughly half the time.
+ *
+ * @param A An nxn symmetric positive definite matrix
+ * @param B An nxm matrix of right-hand sides
+ * @returns An nxm matrix containing the solution, or NULL if A is not
+ *      positive definite or the dimensions don't agree.
+ */
+matrix* SolveSPDEquation(matrix *A, matrix *B)
+{
+    matrix *L, *X;
+    int info;
+
+    if(nRows(A) != nCols(A) || nRows(B) != nRows(A)) {
+        fprintf(stderr, "Error: Incompatible matrix dimensions.\n");
+        return NULL;
+    }
+
+    L = CopyMatrix(A);
+    info = CholeskyFactor(L);
+    if(info) {
+        fprintf(stderr, "SolveSPDEquation(): Matrix is not positive definite (leading minor %d).\n", info);
+        DestroyMatrix(L);
+        return NULL;
+    }
+
+    X = CopyMatrix(B);
+    CholeskySolve(L, X);
+    DestroyMatrix(L);
+
+    return X;
+}
+
@@ -0,0 +1,195 @@
+/**
+ * @file lu.c
+ * LU factorization with partial pivoting, kept so that it can be solved with
+ * again or updated.
+ *
+ * The factorization is stored in place, LAPACK style: the unit lower
+ * triangular L below the diagonal and U on and above it, with the row swaps
+ * in a separate array of ints.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "2dmatrix.h"
+#include "mtxsolver.h"
+#include "triangular.h"
+#include "../instrument/instrument.h"
+
+///Number of columns factored at a time before updating the rest of the matrix
+#define LUBLOCK 64
+///Number of elements above which the trailing update is multithreaded
+#define PARALLELSIZE 1e5
+
+/* Swap the contents of rows i and j of a row-major matrix */
+static void SwapRows(matrix *A, int i, int j)
+{
+    int k;
+    double t, *a = A->array[i], *b = A->array[j];
+
+    for(k=0; k<A->cols; k++) {
+        t = a[k];
+        a[k] = b[k];
+        b[k] = t;
+    }
+}
+
+/* Subtract L21*U12 from the trailing block A22, where the panel holds columns
+ * kb to kend-1. Each row of A22 is updated from rows of U12 four at a time. */
+static void UpdateTrailing(matrix *A, int kb, int kend)
+{
+    int i, j, k, n = A->rows;
+
+    #pragma omp parallel for private(j, k) if((double) (n-kend)*(n-kend) > PARALLELSIZE) schedule(static)
+    for(i=kend; i<n; i++) {
+        double *a = A->array[i];
+        for(k=kb; k+3<kend; k+=4) {
+            const double *u0 = A->array[k], *u1 = A->array[k+1],
+                         *u2 = A->array[k+2], *u3 = A->array[k+3];
+            double l0 = a[k], l1 = a[k+1], l2 = a[k+2], l3 = a[k+3];
+            #pragma omp simd
+            for(j=kend; j<n; j++)
+                a[j] -= l0*u0[j] + l1*u1[j] + l2*u2[j] + l3*u3[j];
+        }
+        for(; k<kend; k++) {
+            const double *u0 = A->array[k];
+            double l0 = a[k];
+            #pragma omp simd
+            for(j=kend; j<n; j++)
+                a[j] -= l0*u0[j];
+        }
+    }
+}
+
+/* Blocked right-looking factorization of a row-major matrix */
+static int FactorBlocked(matrix *A, int *perm)
+{
+    int n = A->rows, i, j, k, p, kb, kend;
+    double l, *a, *u;
+
+    for(kb=0; kb<n; kb+=LUBLOCK) {
+        kend = (n-kb < LUBLOCK) ? n : kb+LUBLOCK;
+
+        /* Factor the panel, swapping whole rows as the pivots are chosen */
+        for(k=kb; k<kend; k++) {
+            p = k;
+            for(i=k+1; i<n; i++)
+                if(fabs(A->array[i][k]) > fabs(A->array[p][k]))
+                    p = i;
+            perm[k] = p;
+            if(A->array[p][k] == 0)
+                return k+1;
+            if(p != k)
+                SwapRows(A, p, k);
+
+            u = A->array[k];
+            for(i=k+1; i<n; i++) {
+                a = A->array[i];
+                l = a[k] /= u[k];
+                for(j=k+1; j<kend; j++)
+                    a[j] -= l*u[j];
+            }
+        }
+
+        /* U12 = L11^-1 * A12 */
+        for(k=kb; k<kend; k++) {
+            u = A->array[k];
+            for(i=k+1; i<kend; i++) {
+                a = A->array[i];
+                l = a[k];
+                #pragma omp simd
+                for(j=kend; j<n; j++)
+                    a[j] -= l*u[j];
+            }
+        }
+
+        UpdateTrailing(A, kb, kend);
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Factor a square matrix as P*A = L*U in place
+ *
+ * Uses partial pivoting. Unlike SolveMatrixEquation, the factors are kept, so
+ * further right-hand sides can be solved for with LUSolve in O(n^2) time each,
+ * and the factors can be updated with LUUpdate when A changes by a rank-one
+ * term.
+ *
+ * @param A Matrix to factor, in either layout. On return, it holds the unit
+ *      lower triangular L below the diagonal and U on and above it.
+ * @param perm Array of nRows(A) ints. Row i was swapped with row perm[i] at
+ *      step i.
+ * @returns 0 on success, or k if the k-th pivot is zero
+ */
+int LUFactor(matrix *A, int *perm)
+{
+    int n = nRows(A), info, layout;
+
+    if(nCols(A) != n) {
+        fprintf(stderr, "Error: Incompatible matrix dimensions.\n");
+        return -1;
+    }
+
+    PROF_BEGIN(MTXOP_LUFACTOR);
+    /* The factorization works on rows, so column-major input is rearranged
+     * for the duration. */
+    layout = A->layout;
+    mtxsetlayout(A, MTX_ROWMAJOR);
+    UnshareMatrix(A);
+    info = FactorBlocked(A, perm);
+    mtxsetlayout(A, layout);
+    PROF_END(MTXOP_LUFACTOR, 2.0/3.0*n*n*n);
+
+    return info;
+}
+
+/**
+ * @brief Solve A*X = B in place using the factors from LUFactor
+ * @param LU The factored matrix
+ * @param perm Row swaps from LUFactor
+ * @param B Right-hand sides, one per column, in either layout. Overwritten
+ *      with the solution.
+ */
+void LUSolve(matrix *LU, int *perm, matrix *B)
+{
+    int n = nRows(LU), i, layout = B->layout;
+    mtxview lu = ViewMatrix(LU);
+
+    if(nRows(B) != n) {
+        fprintf(stderr, "Error: Incompatible matrix dimensions.\n");
+        return;
+    }
+
+    mtxsetlayout(B, MTX_ROWMAJOR);
+    UnshareMatrix(B);
+    for(i=0; i<n; i++)
+        if(perm[i] != i)
+            SwapRows(B, i, perm[i]);
+    mtxsetlayout(B, layout);
+
+    trsm(TRI_LEFT, 1, ViewTriangle(lu, TRI_LOWER, TRI_UNIT), B);
+    trsm(TRI_LEFT, 1, ViewTriangle(lu, TRI_UPPER, TRI_NONUNIT), B);
+}
+
+/**
+ * @brief Calculate the determinant of A from its LU factorization
+ * @param LU Output of LUFactor
+ * @param perm Row swaps from LUFactor
+ * @returns det(A)
+ */
+double LUDeterminant(matrix *LU, int *perm)
+{
+    int i;
+    double det = 1;
+
+    for(i=0; i<nRows(LU); i++) {
+        det *= val(LU, i, i);
+        if(perm[i] != i)
+            det = -det;
+    }
+    return det;
+}
+
@@ -3,70 +3,121 @@
  * Set of functions to solve matrix equations
  */
 
+#include <stdio.h>
 #include <math.h>
 
 #include "2dmatrix.h"
 #include "mtxsolver.h"
+#include "triangular.h"
+#include "mtxview.h"
+#include "../instrument/instrument.h"
 
-void SwapRows(matrix*, int, int);
-int FindPivot(matrix*, int);
+/* Code from http://compprog.wordpress.com/2007/12/11/gaussian-elimination/
+ * The elimination works on a view of [A | B] so that the coefficient matrix
+ * and the right hand sides don't have to be copied into one matrix first. */
 
-/* Code from http://compprog.wordpress.com/2007/12/11/gaussian-elimination/ */
-
-void ForwardSubstitution(matrix* a) {
+static void ForwardCat(mtxcatview *a)
+{
     int i, j, k, max;
-    int n = nRows(a);
-    double t;
+    int n = a->rows;
+    double t, f;
     for (i = 0; i < n; ++i) {
         max = i;
         for (j = i + 1; j < n; ++j)
-            if (fabs(val(a, j, i)) > fabs(val(a, max, i)))
+            if (fabs(valCatView(a, j, i)) > fabs(valCatView(a, max, i)))
                 max = j;
 
-        for (j = 0; j < n + 1; ++j) {
-            t = val(a, max, j);
-            setval(a, val(a, i, j), max, j);
-            setval(a, t, i, j);
+        if (max != i) {
+            for (j = i; j < a->cols; ++j) {
+                t = valCatView(a, max, j);
+                valCatView(a, max, j) = valCatView(a, i, j);
+                valCatView(a, i, j) = t;
+            }
         }
 
-        for (j = n; j >= i; --j)
-            for (k = i + 1; k < n; ++k)
-                setval(a, val(a, k, j) - val(a, k, i)/val(a, i, i) * val(a, i, j), k, j);
-
+        for (k = i + 1; k < n; ++k) {
+            f = valCatView(a, k, i)/valCatView(a, i, i);
+            for (j = a->cols - 1; j >= i; --j)
+                valCatView(a, k, j) -= f * valCatView(a, i, j);
+        }
     }
 }
 
-void ReverseElimination(matrix *a) {
-    int i, j;
+/* Split an augmented matrix back into its coefficient and constant parts. */
+static mtxcatview SplitAugmented(matrix *a)
+{
     int n = nRows(a);
-    for (i = n - 1; i >= 0; --i) {
-        setval(a, val(a, i, n)/val(a, i, i), i, n);
-        setval(a, 1, i, i);
-        for (j = i - 1; j >= 0; --j) {
-            setval(a, val(a, j, n) - val(a, j, i) * val(a, i, n), j, n);
-            setval(a, 0, j, i);
-        }
+    return ConcatView(ViewBlock(a, 0, 0, n, n),
+                      ViewBlock(a, 0, n, n, nCols(a) - n));
+}
+
+/**
+ * @brief Forward elimination with partial pivoting on an augmented matrix
+ * [A | B], leaving A upper triangular.
+ * @param a The augmented matrix. Modified in place.
+ */
+void ForwardSubstitution(matrix* a) {
+    mtxcatview c;
+
+    /* The views write straight into the storage, so it can't be shared */
+    UnshareMatrix(a);
+    c = SplitAugmented(a);
+    ForwardCat(&c);
+}
+
+/**
+ * @brief Back substitution on an augmented matrix [U | B] from
+ * ForwardSubstitution. Afterwards, the last columns hold the solution.
+ * @param a The augmented matrix. Modified in place.
+ */
+void ReverseElimination(matrix *a) {
+    int i, j, n = nRows(a);
+    matrix *X;
+
+    UnshareMatrix(a);
+    X = CreateMatrix(n, nCols(a) - n);
+    CopyViewInto(ViewBlock(a, 0, n, n, nCols(a) - n), X);
+    trsm(TRI_LEFT, 1, ViewTriangle(ViewBlock(a, 0, 0, n, n), TRI_UPPER,
+                                   TRI_NONUNIT), X);
+
+    for(i=0; i<n; i++) {
+        for(j=0; j<n; j++)
+            setval(a, (i == j) ? 1 : 0, i, j);
+        for(j=n; j<nCols(a); j++)
+            setval(a, val(X, i, j-n), i, j);
     }
+    DestroyMatrix(X);
 }
 
 /**
  * @brief Gaussian Elimination
  *
  * Solve an matrix equation of the form Ax=B, where x is the vector of
- * unknowns.
+ * unknowns. A copy of B is eliminated together with a copy of A through a
+ * concatenated view, and ends up holding the solution, so the augmented matrix
+ * is never built.
  *
- * @param A An nxm matrix that represents the coefficients on the x vector
- * @param B An nx1 matrix
- * @returns An nx1 matrix representing the solution to the equation
+ * @param A An nxn matrix that represents the coefficients on the x vector
+ * @param B An nxm matrix of right hand sides
+ * @returns An nxm matrix representing the solution to the equation
  */
 matrix* SolveMatrixEquation(matrix *A, matrix *B)
 {
     matrix *C, *u;
-    C = AugmentMatrix(A, B);
-    ForwardSubstitution(C);
-    ReverseElimination(C);
-    u = ExtractColumn(C, nCols(A));
+    mtxcatview aug;
+
+    if(nRows(A) != nCols(A) || nRows(B) != nRows(A)) {
+        fprintf(stderr, "Error: Incompatible matrix dimensions.\n");
+        return NULL;
+    }
+
+    PROF_BEGIN(MTXOP_SOLVE);
+    C = CopyMatrix(A);
+    u = CopyMatrix(B);
+    aug = ConcatView(ViewMatrix(C), ViewMatrix(u));
+    ForwardCat(&aug);
+    trsm(TRI_LEFT, 1, ViewTriangle(ViewMatrix(C), TRI_UPPER, TRI_NONUNIT), u);
     DestroyMatrix(C);
+    PROF_END(MTXOP_SOLVE, 2.0/3.0*nRows(A)*nRows(A)*nRows(A));
     return u;
 }
-
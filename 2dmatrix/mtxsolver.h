@@ -2,9 +2,46 @@
 #define MTXSOLVER_H
 
 #include "2dmatrix.h"
+#include "../vector/vector.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 void ForwardSubstitution(matrix*);
 void ReverseElimination(matrix*);
 matrix* SolveMatrixEquation(matrix*, matrix*);
 
+int CholeskyFactor(matrix*);
+int LDLFactor(matrix*);
+void CholeskySolve(matrix*, matrix*);
+void LDLSolve(matrix*, matrix*);
+double CholeskyDeterminant(matrix*);
+double LDLDeterminant(matrix*);
+matrix* SolveSPDEquation(matrix*, matrix*);
+
+matrix* QRFactor(matrix*);
+void QRApplyQ(matrix*, matrix*, matrix*);
+void QRApplyQt(matrix*, matrix*, matrix*);
+matrix* QRSolve(matrix*, matrix*, matrix*);
+matrix* SolveLeastSquares(matrix*, matrix*);
+matrix* QRFormQ(matrix*, matrix*);
+matrix* QRFormR(matrix*);
+matrix* QRSolveFormed(matrix*, matrix*, matrix*);
+
+int LUFactor(matrix*, int*);
+void LUSolve(matrix*, int*, matrix*);
+double LUDeterminant(matrix*, int*);
+
+int LUUpdate(matrix*, int*, vector*, vector*);
+int CholeskyUpdate(matrix*, vector*);
+int CholeskyDowndate(matrix*, vector*);
+int QRReplaceColumn(matrix*, matrix*, int, vector*);
+matrix* LUSolveWoodbury(matrix*, int*, matrix*, matrix*, matrix*);
+matrix* CholeskySolveWoodbury(matrix*, matrix*, matrix*, matrix*);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif
@@ -0,0 +1,795 @@
+/**
+ * @file mtxview.c
+ * Make views into matricies and operate on them without copying.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "mtxview.h"
+#include "../repro/repro.h"
+#include "../instrument/instrument.h"
+
+///Size of the square tiles used when copying a view that isn't row-major
+#define TILESIZE 32
+///Number of floating point operations above which products are multithreaded
+#define PARALLELFLOPS 1e6
+///Number of rows of y each thread updates at a time in a column-major GEMV
+#define GEMVBLOCK 2048
+
+/**
+ * @brief View an entire matrix
+ * @param A The matrix to look at
+ * @returns A view of all of A
+ */
+mtxview ViewMatrix(matrix *A)
+{
+    mtxview v;
+    v.data = A->data;
+    v.rows = nRows(A);
+    v.cols = nCols(A);
+    if(A->layout == MTX_COLMAJOR) {
+        v.rs = 1;
+        v.cs = nRows(A);
+    } else {
+        v.rs = nCols(A);
+        v.cs = 1;
+    }
+    return v;
+}
+
+/**
+ * @brief View a rectangular block of a matrix
+ * @param A The matrix to look at
+ * @param row First row of the block
+ * @param col First column of the block
+ * @param rows Number of rows in the block
+ * @param cols Number of columns in the block
+ * @returns A view of the block. If it doesn't fit inside A, the returned view
+ * has no rows or columns.
+ */
+mtxview ViewBlock(matrix *A, int row, int col, int rows, int cols)
+{
+    return SubView(ViewMatrix(A), row, col, rows, cols);
+}
+
+/**
+ * @brief View a single row of a matrix
+ * @param A The matrix
+ * @param row The row to look at (numbering starts with 0)
+ * @returns A 1xn view
+ */
+mtxview ViewRow(matrix *A, int row)
+{
+    return ViewBlock(A, row, 0, 1, nCols(A));
+}
+
+/**
+ * @brief View a single column of a matrix
+ * @param A The matrix
+ * @param col The column to look at (numbering starts with 0)
+ * @returns An nx1 view
+ */
+mtxview ViewColumn(matrix *A, int col)
+{
+    return ViewBlock(A, 0, col, nRows(A), 1);
+}
+
+/**
+ * @brief View a block of another view
+ * @param v The view to look at
+ * @param row First row of the block
+ * @param col First column of the block
+ * @param rows Number of rows in the block
+ * @param cols Number of columns in the block
+ * @returns A view of the block, or an empty view if it doesn't fit inside v.
+ */
+mtxview SubView(mtxview v, int row, int col, int rows, int cols)
+{
+    mtxview s = v;
+
+    if(row < 0 || col < 0 || rows < 0 || cols < 0 ||
+       row+rows > v.rows || col+cols > v.cols) {
+        fprintf(stderr, "Error: View out of bounds.\n");
+        s.rows = s.cols = 0;
+        return s;
+    }
+
+    s.data = v.data + (long) row*v.rs + (long) col*v.cs;
+    s.rows = rows;
+    s.cols = cols;
+    return s;
+}
+
+/**
+ * @brief Transpose a view by swapping its dimensions and strides
+ * @param v The view
+ * @returns The transpose of v, looking at the same memory
+ */
+mtxview ViewTranspose(mtxview v)
+{
+    mtxview t;
+    t.data = v.data;
+    t.rows = v.cols;
+    t.cols = v.rows;
+    t.rs = v.cs;
+    t.cs = v.rs;
+    return t;
+}
+
+/* True if v can be broadcast to a rows x cols view */
+static int Broadcastable(mtxview v, int rows, int cols)
+{
+    return (v.rows == rows || v.rows == 1) && (v.cols == cols || v.cols == 1);
+}
+
+/**
+ * @brief Stretch a view to a larger size by repeating it
+ *
+ * A view with one row can be repeated down any number of rows, and one with
+ * one column can be repeated across any number of columns. Nothing is copied;
+ * the stride along each repeated dimension is set to zero. Since every copy
+ * of an element is the same memory, broadcast views should only be read.
+ *
+ * @param v The view to broadcast
+ * @param rows Number of rows in the result. Must be v.rows, or v must have
+ *      one row.
+ * @param cols Number of columns in the result. Must be v.cols, or v must have
+ *      one column.
+ * @returns A rows x cols view, or an empty view if v can't be stretched to
+ *      that size.
+ */
+mtxview BroadcastView(mtxview v, int rows, int cols)
+{
+    mtxview b = v;
+
+    if(!Broadcastable(v, rows, cols)) {
+        fprintf(stderr, "Error: Incompatible matrix dimensions.\n");
+        b.rows = b.cols = 0;
+        return b;
+    }
+
+    if(v.rows != rows)
+        b.rs = 0;
+    if(v.cols != cols)
+        b.cs = 0;
+    b.rows = rows;
+    b.cols = cols;
+    return b;
+}
+
+/**
+ * @brief View the x coordinates of a grid without building it
+ *
+ * Element (i, j) is x_j, the same as in the matrix returned by meshgridX.
+ *
+ * @param x Coordinates along the columns of the grid
+ * @param y Coordinates along the rows. Only the length is used.
+ * @returns A len(y) x len(x) broadcast view of x
+ */
+mtxview ViewMeshgridX(vector *x, vector *y)
+{
+    mtxview v;
+    v.data = x->v;
+    v.rows = len(y);
+    v.cols = len(x);
+    v.rs = 0;
+    v.cs = 1;
+    return v;
+}
+
+/**
+ * @brief View the y coordinates of a grid without building it
+ *
+ * Element (i, j) is y_i, the same as in the matrix returned by meshgridY.
+ *
+ * @param x Coordinates along the columns. Only the length is used.
+ * @param y Coordinates along the rows of the grid
+ * @returns A len(y) x len(x) broadcast view of y
+ */
+mtxview ViewMeshgridY(vector *x, vector *y)
+{
+    mtxview v;
+    v.data = y->v;
+    v.rows = len(y);
+    v.cols = len(x);
+    v.rs = 1;
+    v.cs = 0;
+    return v;
+}
+
+/**
+ * @brief Copy the elements of a view into a new matrix
+ * @param v The view to copy
+ * @returns A new matrix with the same size as v
+ */
+matrix* CopyView(mtxview v)
+{
+    matrix *A;
+    A = CreateMatrix(v.rows, v.cols);
+    if(!A)
+        return NULL;
+    return CopyViewInto(v, A);
+}
+
+/**
+ * @brief Copy the elements of a view into an existing matrix
+ *
+ * When the view and the matrix store their rows (or columns) contiguously,
+ * they are copied a row (or column) at a time. Anything else, like a
+ * transposed view, is copied in square tiles to keep both the reads and the
+ * writes in cache.
+ *
+ * @param v The view to copy. Must not overlap A.
+ * @param A Matrix with the same dimensions as the view
+ * @returns A, or NULL if the dimensions don't agree
+ */
+matrix* CopyViewInto(mtxview v, matrix *A)
+{
+    int i, j, ib, jb, iend, jend;
+    mtxview d;
+
+    if(nRows(A) != v.rows || nCols(A) != v.cols) {
+        fprintf(stderr, "Error: Incompatible matrix dimensions.\n");
+        return NULL;
+    }
+
+    UnshareMatrix(A);
+    d = ViewMatrix(A);
+
+    if(v.cs == 1 && d.cs == 1) {
+        for(i=0; i<v.rows; i++)
+            memcpy(d.data + (long) i*d.rs, v.data + (long) i*v.rs, v.cols*sizeof(double));
+        return A;
+    }
+    if(v.rs == 1 && d.rs == 1) {
+        for(j=0; j<v.cols; j++)
+            memcpy(d.data + (long) j*d.cs, v.data + (long) j*v.cs, v.rows*sizeof(double));
+        return A;
+    }
+
+    for(ib=0; ib<v.rows; ib+=TILESIZE) {
+        iend = (ib+TILESIZE < v.rows) ? ib+TILESIZE : v.rows;
+        for(jb=0; jb<v.cols; jb+=TILESIZE) {
+            jend = (jb+TILESIZE < v.cols) ? jb+TILESIZE : v.cols;
+            for(i=ib; i<iend; i++)
+                for(j=jb; j<jend; j++)
+                    valView(d, i, j) = valView(v, i, j);
+        }
+    }
+
+    return A;
+}
+
+/**
+ * @brief View an entire vector
+ * @param x The vector
+ * @returns A view of all of x
+ */
+vecview ViewVector(vector *x)
+{
+    vecview v;
+    v.v = x->v;
+    v.length = len(x);
+    v.stride = 1;
+    return v;
+}
+
+/**
+ * @brief View a row of a matrix as a vector
+ * @param A The matrix
+ * @param row The row to look at (numbering starts with 0)
+ * @returns A view with one component per column of A
+ */
+vecview ViewRowAsVector(matrix *A, int row)
+{
+    mtxview r;
+    vecview v;
+    r = ViewRow(A, row);
+    v.v = r.data;
+    v.length = r.cols;
+    v.stride = r.cs;
+    return v;
+}
+
+/**
+ * @brief View a column of a matrix as a vector
+ * @param A The matrix
+ * @param col The column to look at (numbering starts with 0)
+ * @returns A view with one component per row of A
+ */
+vecview ViewColumnAsVector(matrix *A, int col)
+{
+    mtxview c;
+    vecview v;
+    c = ViewColumn(A, col);
+    v.v = c.data;
+    v.length = c.rows;
+    v.stride = c.rs;
+    return v;
+}
+
+/**
+ * @brief Copy the components of a vector view into a new vector
+ * @param x The view to copy
+ * @returns A new vector of the same length
+ */
+vector* CopyVecView(vecview x)
+{
+    int i;
+    vector *v;
+
+    v = CreateVector(x.length);
+    for(i=0; i<x.length; i++)
+        valV(v, i) = valVecView(x, i);
+
+    return v;
+}
+
+/**
+ * @brief Calculate the dot product of two vector views
+ * @param a A vector view
+ * @param b Another view of the same length
+ * @returns a dot b
+ */
+double dotView(vecview a, vecview b)
+{
+    int i;
+    double result = 0;
+
+    if(a.length != b.length) {
+        fprintf(stderr, "Error: Incompatible vector lengths.\n");
+        return 0;
+    }
+
+    PROF_BEGIN(MTXOP_DOTV);
+    if(mtxreproducible()) {
+        result = ReproDot(a.v, a.stride, b.v, b.stride, a.length);
+    } else if(a.stride == 1 && b.stride == 1) {
+        #pragma omp simd reduction(+:result)
+        for(i=0; i<a.length; i++)
+            result += a.v[i] * b.v[i];
+    } else {
+        for(i=0; i<a.length; i++)
+            result += valVecView(a, i) * valVecView(b, i);
+    }
+    PROF_END(MTXOP_DOTV, 2.0*a.length);
+
+    return result;
+}
+
+/**
+ * @brief Put two views next to each other, forming [A | B]
+ * @param A The left view
+ * @param B The right view. Must have the same number of rows as A.
+ * @returns The combined view. If the row counts don't match, it has no rows
+ * or columns.
+ */
+mtxcatview ConcatView(mtxview A, mtxview B)
+{
+    mtxcatview c;
+
+    memset(&c, 0, sizeof(mtxcatview));
+    if(A.rows != B.rows) {
+        fprintf(stderr, "Error: Incompatible matrix dimensions.\n");
+        return c;
+    }
+
+    c.block[0][0] = A;
+    c.block[0][1] = B;
+    c.splitrow = A.rows;
+    c.splitcol = A.cols;
+    c.rows = A.rows;
+    c.cols = A.cols + B.cols;
+    return c;
+}
+
+/**
+ * @brief View a square matrix with one row and one column removed
+ * @param A The matrix
+ * @param row The row to leave out
+ * @param col The column to leave out
+ * @returns A view of the (n-1)x(n-1) minor. If the row or column is out of
+ * range, it has no rows or columns.
+ */
+mtxcatview ViewMinor(matrix *A, int row, int col)
+{
+    mtxcatview c;
+    mtxview a = ViewMatrix(A);
+    int i, j,
+        n = nRows(A),
+        m = nCols(A),
+        rows[2], cols[2];
+
+    if(row < 0 || col < 0 || row >= n || col >= m) {
+        fprintf(stderr, "Error: View out of bounds.\n");
+        memset(&c, 0, sizeof(mtxcatview));
+        return c;
+    }
+
+    /* Sizes of the blocks above/below and left/right of the deleted element */
+    rows[0] = row;
+    rows[1] = n-row-1;
+    cols[0] = col;
+    cols[1] = m-col-1;
+
+    for(i=0; i<2; i++) {
+        for(j=0; j<2; j++) {
+            c.block[i][j].data = a.data + (long) i*(row+1)*a.rs
+                                        + (long) j*(col+1)*a.cs;
+            c.block[i][j].rows = rows[i];
+            c.block[i][j].cols = cols[j];
+            c.block[i][j].rs = a.rs;
+            c.block[i][j].cs = a.cs;
+        }
+    }
+
+    c.splitrow = row;
+    c.splitcol = col;
+    c.rows = n-1;
+    c.cols = m-1;
+    return c;
+}
+
+/**
+ * @brief Find an element of a concatenated view
+ * @param v The view
+ * @param row Row of the element
+ * @param col Column of the element
+ * @returns A pointer to the element in the original matrix
+ */
+double* CatViewElement(mtxcatview *v, int row, int col)
+{
+    int bi = (row >= v->splitrow),
+        bj = (col >= v->splitcol);
+    mtxview *b = &v->block[bi][bj];
+
+    return &valView(*b, row - bi*v->splitrow, col - bj*v->splitcol);
+}
+
+/**
+ * @brief Copy the elements of a concatenated view into a new matrix
+ * @param v The view to copy
+ * @returns A new matrix with the same size as v
+ */
+matrix* CopyCatView(mtxcatview *v)
+{
+    int i, j, r, c;
+    matrix *A;
+    mtxview *b, d;
+    double *src, *dest;
+
+    A = CreateMatrix(v->rows, v->cols);
+    if(!A)
+        return NULL;
+    d = ViewMatrix(A);
+
+    for(i=0; i<2; i++) {
+        for(j=0; j<2; j++) {
+            b = &v->block[i][j];
+            for(r=0; r<b->rows; r++) {
+                src = b->data + (long) r*b->rs;
+                dest = &valView(d, i*v->splitrow + r, j*v->splitcol);
+                for(c=0; c<b->cols; c++)
+                    dest[c] = src[(long) c*b->cs];
+            }
+        }
+    }
+
+    return A;
+}
+
+/* C = A*B, where the rows of C are contiguous. When B is row-major, each row
+ * of C is accumulated from rows of B so that the innermost loop runs along
+ * contiguous memory. When B is column-major, as it is for a transposed view,
+ * each element of C is a contiguous dot product instead. Large products are
+ * split between threads by row. */
+static void MulView(mtxview A, mtxview B, mtxview C)
+{
+    int i, j, k, repro = mtxreproducible();
+    double aik, s, *b, *c;
+
+    if(B.cs == 1) {
+        /* Cij = AikBkj */
+        #pragma omp parallel for private(j, k, aik, b, c) if((double) A.rows*A.cols*B.cols > PARALLELFLOPS) schedule(static)
+        for(i=0; i<A.rows; i++) {
+            c = C.data + (long) i*C.rs;
+            for(j=0; j<B.cols; j++)
+                c[j] = 0;
+            for(k=0; k<A.cols; k++) {
+                aik = valView(A, i, k);
+                b = B.data + (long) k*B.rs;
+                #pragma omp simd
+                for(j=0; j<B.cols; j++)
+                    c[j] += aik*b[j];
+            }
+        }
+    } else {
+        #pragma omp parallel for private(j, k, s, b, c) if((double) A.rows*A.cols*B.cols > PARALLELFLOPS) schedule(static)
+        for(i=0; i<A.rows; i++) {
+            c = C.data + (long) i*C.rs;
+            for(j=0; j<B.cols; j++) {
+                b = B.data + (long) j*B.cs;
+                s = 0;
+                if(repro) {
+                    s = ReproDot(A.data + (long) i*A.rs, A.cs, b, B.rs, A.cols);
+                } else if(A.cs == 1 && B.rs == 1) {
+                    double *a = A.data + (long) i*A.rs;
+                    #pragma omp simd reduction(+:s)
+                    for(k=0; k<A.cols; k++)
+                        s += a[k]*b[k];
+                } else {
+                    for(k=0; k<A.cols; k++)
+                        s += valView(A, i, k)*b[(long) k*B.rs];
+                }
+                c[j] = s;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Multiply two views, storing the result in an existing matrix
+ *
+ * Works with any combination of layouts. A column-major C is computed as
+ * C^T = B^T*A^T so that the result is still written a row at a time.
+ *
+ * @param A The first view
+ * @param B The second view
+ * @param C Matrix to store A*B in. Must not overlap A or B.
+ * @returns C, or NULL if the dimensions don't agree
+ */
+matrix* mtxmulview(mtxview A, mtxview B, matrix *C)
+{
+    mtxview c;
+
+    if(A.cols != B.rows || nRows(C) != A.rows || nCols(C) != B.cols) {
+        fprintf(stderr, "Error: Incompatible matrix dimensions.\n");
+        return NULL;
+    }
+
+    UnshareMatrix(C);
+    PROF_BEGIN(MTXOP_MTXMUL);
+
+    c = ViewMatrix(C);
+    if(c.cs == 1)
+        MulView(A, B, c);
+    else
+        MulView(ViewTranspose(B), ViewTranspose(A), ViewTranspose(c));
+
+    PROF_END(MTXOP_MTXMUL, 2.0*A.rows*A.cols*B.cols);
+    return C;
+}
+
+/* y = alpha*A*x + beta*y. When the rows of A are contiguous, each component
+ * of y is a contiguous dot product. When the columns are, y is built up from
+ * columns of A four at a time, with each thread working on its own block of
+ * rows so that the block of y stays in cache. Either way A is read once. y
+ * isn't read when beta is zero. */
+static void GemvView(double alpha, mtxview A, const double *x, double beta,
+                     double *y)
+{
+    int i, j, ib, iend, repro = mtxreproducible();
+    double s;
+
+    if(A.cs == 1 || A.rs != 1) {
+        #pragma omp parallel for private(j, s) if(2.0*A.rows*A.cols > PARALLELFLOPS) schedule(static)
+        for(i=0; i<A.rows; i++) {
+            const double *a = A.data + (long) i*A.rs;
+            s = 0;
+            if(repro) {
+                s = ReproDot(a, A.cs, x, 1, A.cols);
+            } else if(A.cs == 1) {
+                #pragma omp simd reduction(+:s)
+                for(j=0; j<A.cols; j++)
+                    s += a[j]*x[j];
+            } else {
+                for(j=0; j<A.cols; j++)
+                    s += a[(long) j*A.cs]*x[j];
+            }
+            y[i] = (beta == 0) ? alpha*s : alpha*s + beta*y[i];
+        }
+        return;
+    }
+
+    #pragma omp parallel for private(i, j, iend) if(2.0*A.rows*A.cols > PARALLELFLOPS) schedule(static)
+    for(ib=0; ib<A.rows; ib+=GEMVBLOCK) {
+        double *yb = y + ib;
+        iend = (A.rows-ib < GEMVBLOCK) ? A.rows-ib : GEMVBLOCK;
+
+        if(beta == 0) {
+            for(i=0; i<iend; i++)
+                yb[i] = 0;
+        } else if(beta != 1) {
+            #pragma omp simd
+            for(i=0; i<iend; i++)
+                yb[i] *= beta;
+        }
+
+        for(j=0; j+3<A.cols; j+=4) {
+            const double *a0 = A.data + (long) j*A.cs + ib,
+                         *a1 = a0 + A.cs, *a2 = a1 + A.cs, *a3 = a2 + A.cs;
+            double t0 = alpha*x[j], t1 = alpha*x[j+1],
+                   t2 = alpha*x[j+2], t3 = alpha*x[j+3];
+            #pragma omp simd
+            for(i=0; i<iend; i++)
+                yb[i] += a0[i]*t0 + a1[i]*t1 + a2[i]*t2 + a3[i]*t3;
+        }
+        for(; j<A.cols; j++) {
+            const double *a0 = A.data + (long) j*A.cs + ib;
+            double t0 = alpha*x[j];
+            #pragma omp simd
+            for(i=0; i<iend; i++)
+                yb[i] += a0[i]*t0;
+        }
+    }
+}
+
+/* Check the sizes for GemvView and run it */
+static vector* Gemv(double alpha, mtxview A, vector *x, double beta, vector *y)
+{
+    if(len(x) != A.cols || len(y) != A.rows || x->v == y->v) {
+        fprintf(stderr, "Error: Incompatible matrix dimensions.\n");
+        return NULL;
+    }
+
+    PROF_BEGIN(MTXOP_GEMV);
+    GemvView(alpha, A, x->v, beta, y->v);
+    PROF_END(MTXOP_GEMV, 2.0*A.rows*A.cols);
+
+    return y;
+}
+
+/**
+ * @brief Calculate y = alpha*A*x + beta*y
+ *
+ * Works on either layout without copying A. Tall matricies are split between
+ * threads.
+ *
+ * @param alpha Multiplier for A*x
+ * @param A The matrix
+ * @param x Vector with one component per column of A
+ * @param beta Multiplier for the original y. If it's zero, y is only written
+ *      to, so it doesn't need to be initialized.
+ * @param y Vector with one component per row of A. Must not be x.
+ * @returns y, or NULL if the dimensions don't agree
+ */
+vector* mtxgemv(double alpha, matrix *A, vector *x, double beta, vector *y)
+{
+    return Gemv(alpha, ViewMatrix(A), x, beta, y);
+}
+
+/**
+ * @brief Calculate y = alpha*A^T*x + beta*y without transposing A
+ * @param alpha Multiplier for A^T*x
+ * @param A The matrix
+ * @param x Vector with one component per row of A
+ * @param beta Multiplier for the original y. If it's zero, y is only written
+ *      to.
+ * @param y Vector with one component per column of A. Must not be x.
+ * @returns y, or NULL if the dimensions don't agree
+ */
+vector* mtxgemvT(double alpha, matrix *A, vector *x, double beta, vector *y)
+{
+    return Gemv(alpha, ViewTranspose(ViewMatrix(A)), x, beta, y);
+}
+
+/**
+ * @brief Multiply a matrix by a vector
+ * @param A The matrix
+ * @param x Vector with one component per column of A
+ * @returns A new vector holding A*x, or NULL if the dimensions don't agree
+ */
+vector* mtxmulV(matrix *A, vector *x)
+{
+    vector *y;
+
+    if(len(x) != nCols(A)) {
+        fprintf(stderr, "Error: Incompatible matrix dimensions.\n");
+        return NULL;
+    }
+
+    y = CreateVector(nRows(A));
+    return mtxgemv(1, A, x, 0, y);
+}
+
+
+/* c = a + sign*b for one row. Rows that are broadcast along their length have
+ * a stride of zero, and are loaded once so the loop can still be vectorized. */
+static void AddRow(double *c, const double *a, int as, const double *b, int bs,
+                   double sign, int n)
+{
+    int j;
+    double t;
+
+    if(as == 1 && bs == 1) {
+        #pragma omp simd
+        for(j=0; j<n; j++)
+            c[j] = a[j] + sign*b[j];
+    } else if(as == 0 && bs == 1) {
+        t = a[0];
+        #pragma omp simd
+        for(j=0; j<n; j++)
+            c[j] = t + sign*b[j];
+    } else if(as == 1 && bs == 0) {
+        t = sign*b[0];
+        #pragma omp simd
+        for(j=0; j<n; j++)
+            c[j] = a[j] + t;
+    } else {
+        for(j=0; j<n; j++)
+            c[j] = a[(long) j*as] + sign*b[(long) j*bs];
+    }
+}
+
+/* C = A + sign*B, broadcasting A and B to the size of C */
+static matrix* AddView(mtxview A, mtxview B, double sign, matrix *C)
+{
+    mtxview c;
+    int i, rows = nRows(C), cols = nCols(C);
+
+    if(!Broadcastable(A, rows, cols) || !Broadcastable(B, rows, cols)) {
+        fprintf(stderr, "Error: Incompatible matrix dimensions.\n");
+        return NULL;
+    }
+
+    UnshareMatrix(C);
+    A = BroadcastView(A, rows, cols);
+    B = BroadcastView(B, rows, cols);
+    c = ViewMatrix(C);
+
+    /* Work along whichever direction C is contiguous in */
+    if(c.cs != 1) {
+        A = ViewTranspose(A);
+        B = ViewTranspose(B);
+        c = ViewTranspose(c);
+    }
+
+    #pragma omp parallel for if((double) rows*cols > PARALLELFLOPS) schedule(static)
+    for(i=0; i<c.rows; i++)
+        AddRow(c.data + (long) i*c.rs, A.data + (long) i*A.rs, A.cs,
+               B.data + (long) i*B.rs, B.cs, sign, c.cols);
+
+    return C;
+}
+
+/**
+ * @brief Add two views, storing the result in an existing matrix
+ *
+ * A and B are broadcast to the size of C, so a row or column can be added to
+ * every row or column of a matrix, and a row added to a column gives the
+ * whole table of sums without building either grid.
+ *
+ * @param A The first view
+ * @param B The second view
+ * @param C Matrix to store A+B in. May be the matrix A or B looks at, but
+ *      must not overlap them in any other way.
+ * @returns C, or NULL if A or B can't be broadcast to the size of C
+ */
+matrix* mtxaddview(mtxview A, mtxview B, matrix *C)
+{
+    matrix *r;
+    PROF_BEGIN(MTXOP_MTXADD);
+    r = AddView(A, B, 1, C);
+    PROF_END(MTXOP_MTXADD, (double) nRows(C)*nCols(C));
+    return r;
+}
+
+/**
+ * @brief Subtract two views, storing the result in an existing matrix
+ *
+ * A and B are broadcast to the size of C in the same way as for mtxaddview.
+ *
+ * @param A The first view
+ * @param B The view to subtract from it
+ * @param C Matrix to store A-B in
+ * @returns C, or NULL if A or B can't be broadcast to the size of C
+ */
+matrix* mtxsubview(mtxview A, mtxview B, matrix *C)
+{
+    matrix *r;
+    PROF_BEGIN(MTXOP_MTXSUB);
+    r = AddView(A, B, -1, C);
+    PROF_END(MTXOP_MTXSUB, (double) nRows(C)*nCols(C));
+    return r;
+}
@@ -0,0 +1,149 @@
+/**
+ * @file mtxview.h
+ * Views that look at part of an existing matrix without copying it.
+ *
+ * A view only holds a pointer into the storage of a matrix along with its
+ * shape and the distance in memory between consecutive rows and columns, so
+ * making one is free. Views are passed around by value and don't need to be
+ * destroyed, but they are only valid for as long as the matrix they look at.
+ * Writing through a view changes the original matrix.
+ *
+ * A stride can also be zero, which repeats a row or column without storing
+ * the copies. BroadcastView and the ViewMeshgrid functions make views like
+ * this, and mtxaddview and mtxsubview broadcast their operands automatically.
+ */
+
+#ifndef MTXVIEW_H
+#define MTXVIEW_H
+
+#include "2dmatrix.h"
+#include "../vector/vector.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @struct mtxview
+ * @brief A strided window into a matrix
+ * @var mtxview::data
+ * Pointer to element (0, 0) of the view
+ * @var mtxview::rows
+ * Number of rows in the view
+ * @var mtxview::cols
+ * Number of columns
+ * @var mtxview::rs
+ * Distance in memory between the starts of consecutive rows
+ * @var mtxview::cs
+ * Distance in memory between consecutive elements in a row
+ */
+typedef struct {
+    double *data;
+    int rows;
+    int cols;
+    int rs;
+    int cs;
+} mtxview;
+
+/**
+ * @struct vecview
+ * @brief A strided window into a matrix or vector that acts like a vector
+ * @var vecview::v
+ * Pointer to the first component
+ * @var vecview::length
+ * Number of components
+ * @var vecview::stride
+ * Distance in memory between consecutive components
+ */
+typedef struct {
+    double *v;
+    int length;
+    int stride;
+} vecview;
+
+/**
+ * @struct mtxcatview
+ * @brief Up to four views arranged in a 2x2 grid and treated as one matrix
+ *
+ * Used to look at [A | B] or a matrix with one row and column removed without
+ * building a new matrix. Blocks that aren't used have zero rows or columns.
+ *
+ * @var mtxcatview::block
+ * The blocks. block[0][0] is the top left one.
+ * @var mtxcatview::splitrow
+ * Number of rows in the top blocks
+ * @var mtxcatview::splitcol
+ * Number of columns in the left blocks
+ * @var mtxcatview::rows
+ * Total number of rows
+ * @var mtxcatview::cols
+ * Total number of columns
+ */
+typedef struct {
+    mtxview block[2][2];
+    int splitrow;
+    int splitcol;
+    int rows;
+    int cols;
+} mtxcatview;
+
+/**
+ * @brief Access an element of a view. Can also be assigned to.
+ * @param V The view
+ * @param I Row
+ * @param J Column
+ */
+#define valView(V, I, J) (V).data[(long) (I)*(V).rs + (long) (J)*(V).cs]
+
+/**
+ * @brief Access a component of a vector view. Can also be assigned to.
+ * @param V The view
+ * @param I Index of the component
+ */
+#define valVecView(V, I) (V).v[(long) (I)*(V).stride]
+
+/**
+ * @brief Access an element of a concatenated view. Can also be assigned to.
+ * @param V Pointer to the view
+ * @param I Row
+ * @param J Column
+ */
+#define valCatView(V, I, J) (*CatViewElement((V), (I), (J)))
+
+mtxview ViewMatrix(matrix*);
+mtxview ViewBlock(matrix*, int, int, int, int);
+mtxview ViewRow(matrix*, int);
+mtxview ViewColumn(matrix*, int);
+mtxview SubView(mtxview, int, int, int, int);
+mtxview ViewTranspose(mtxview);
+mtxview BroadcastView(mtxview, int, int);
+mtxview ViewMeshgridX(vector*, vector*);
+mtxview ViewMeshgridY(vector*, vector*);
+matrix* CopyView(mtxview);
+matrix* CopyViewInto(mtxview, matrix*);
+
+vecview ViewVector(vector*);
+vecview ViewRowAsVector(matrix*, int);
+vecview ViewColumnAsVector(matrix*, int);
+vector* CopyVecView(vecview);
+double dotView(vecview, vecview);
+
+mtxcatview ConcatView(mtxview, mtxview);
+mtxcatview ViewMinor(matrix*, int, int);
+double* CatViewElement(mtxcatview*, int, int);
+matrix* CopyCatView(mtxcatview*);
+
+matrix* mtxmulview(mtxview, mtxview, matrix*);
+matrix* mtxaddview(mtxview, mtxview, matrix*);
+matrix* mtxsubview(mtxview, mtxview, matrix*);
+
+vector* mtxgemv(double, matrix*, vector*, double, vector*);
+vector* mtxgemvT(double, matrix*, vector*, double, vector*);
+vector* mtxmulV(matrix*, vector*);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
@@ -0,0 +1,517 @@
+/**
+ * @file qr.c
+ * Householder QR factorization and linear least squares.
+ *
+ * QRFactor stores the factorization in place, LAPACK style: R occupies the
+ * upper triangle, and the Householder vectors (with an implicit 1 on the
+ * diagonal) occupy the part below it. Blocks of QRBLOCK reflectors are applied
+ * together using the compact WY representation H1*H2*...*Hk = I - V*T*V^T,
+ * which turns the trailing updates into two passes over the rows of the
+ * matrix per block instead of two per column.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "2dmatrix.h"
+#include "mtxview.h"
+#include "mtxsolver.h"
+#include "triangular.h"
+#include "../instrument/instrument.h"
+
+///Number of Householder reflectors applied together as one block reflector
+#define QRBLOCK 32
+///Number of rows folded into R at a time by SolveLeastSquares
+#define LSQCHUNK 256
+
+/* Element i of the Householder vector stored in column col of a */
+#define HHV(a, i, col) (((i) < (col)) ? 0 : (((i) == (col)) ? 1 : (a)[(i)][(col)]))
+
+/**
+ * @brief Compute a Householder reflector that zeros everything but the first
+ * element of a vector.
+ * @param alpha First element of the vector. Replaced with the value it is
+ *      reflected to.
+ * @param sigma Sum of the squares of the remaining elements
+ * @param scale Set to the factor the remaining elements must be multiplied by
+ *      to turn them into the Householder vector
+ * @returns tau, where the reflector is H = I - tau*v*v^T
+ */
+static double Householder(double *alpha, double sigma, double *scale)
+{
+    double beta, tau;
+
+    if(sigma == 0) {
+        *scale = 0;
+        return 0;
+    }
+
+    beta = -copysign(sqrt(*alpha * *alpha + sigma), *alpha);
+    tau = (beta - *alpha)/beta;
+    *scale = 1/(*alpha - beta);
+    *alpha = beta;
+
+    return tau;
+}
+
+/**
+ * @brief Unblocked QR factorization of the columns c0 to c0+nb-1 of a, with
+ * the reflectors applied only within those columns.
+ */
+static void PanelQR(double **a, int m, int c0, int nb, double *tau, double *w)
+{
+    int i, j, c, cend = c0+nb;
+    double sigma, scale, t;
+
+    for(j=c0; j<cend; j++) {
+        sigma = 0;
+        for(i=j+1; i<m; i++)
+            sigma += a[i][j]*a[i][j];
+        tau[j] = Householder(&a[j][j], sigma, &scale);
+        if(tau[j] == 0)
+            continue;
+        for(i=j+1; i<m; i++)
+            a[i][j] *= scale;
+
+        /* w = v^T * A(:, j+1:cend) */
+        for(c=j+1; c<cend; c++)
+            w[c-c0] = a[j][c];
+        for(i=j+1; i<m; i++) {
+            t = a[i][j];
+            for(c=j+1; c<cend; c++)
+                w[c-c0] += t*a[i][c];
+        }
+
+        /* A = A - tau*v*w^T */
+        for(c=j+1; c<cend; c++)
+            a[j][c] -= tau[j]*w[c-c0];
+        for(i=j+1; i<m; i++) {
+            t = tau[j]*a[i][j];
+            for(c=j+1; c<cend; c++)
+                a[i][c] -= t*w[c-c0];
+        }
+    }
+}
+
+/**
+ * @brief Form the upper triangular factor T of the block reflector for the
+ * Householder vectors stored in columns c0 to c0+nb-1 of a.
+ *
+ * The Gram matrix V^T*V is accumulated in a single pass over the rows, and T
+ * is then built from it column by column.
+ *
+ * @param T nb x nb array (row-major) to store T in
+ * @param G nb x nb scratch array
+ */
+static void FormT(double **a, int m, int c0, int nb, double *tau, double *T,
+                  double *G)
+{
+    int i, j, l, k;
+    double s;
+
+    memset(G, 0, nb*nb*sizeof(double));
+    for(i=c0; i<m; i++)
+        for(j=0; j<nb; j++)
+            for(l=0; l<j; l++)
+                G[l*nb+j] += HHV(a, i, c0+l)*HHV(a, i, c0+j);
+
+    memset(T, 0, nb*nb*sizeof(double));
+    for(j=0; j<nb; j++) {
+        T[j*nb+j] = tau[c0+j];
+        /* T(0:j, j) = -tau_j * T(0:j, 0:j) * G(0:j, j) */
+        for(l=0; l<j; l++) {
+            s = 0;
+            for(k=l; k<j; k++)
+                s += T[l*nb+k]*G[k*nb+j];
+            T[l*nb+j] = -tau[c0+j]*s;
+        }
+    }
+}
+
+/**
+ * @brief Apply the block reflector I - V*op(T)*V^T to rows c0 and below of
+ * columns cstart to cend-1 of c.
+ * @param trans Nonzero to use T^T (for applying Q^T), zero to use T
+ * @param W Scratch space of at least nb*(cend-cstart) doubles
+ */
+static void ApplyBlock(double **a, int m, int c0, int nb, double *T, int trans,
+                       double **c, int cstart, int cend, double *W)
+{
+    int i, j, l, k, nc = cend-cstart;
+    double v, s;
+
+    if(nc <= 0)
+        return;
+
+    /* W = V^T * C */
+    memset(W, 0, nb*nc*sizeof(double));
+    for(i=c0; i<m; i++) {
+        for(l=0; l<nb; l++) {
+            v = HHV(a, i, c0+l);
+            if(v == 0)
+                continue;
+            for(j=0; j<nc; j++)
+                W[l*nc+j] += v*c[i][cstart+j];
+        }
+    }
+
+    /* W = op(T) * W, done in place by working from the end that is not
+     * needed by the remaining rows */
+    for(j=0; j<nc; j++) {
+        if(trans) {
+            for(l=nb-1; l>=0; l--) {
+                s = 0;
+                for(k=0; k<=l; k++)
+                    s += T[k*nb+l]*W[k*nc+j];
+                W[l*nc+j] = s;
+            }
+        } else {
+            for(l=0; l<nb; l++) {
+                s = 0;
+                for(k=l; k<nb; k++)
+                    s += T[l*nb+k]*W[k*nc+j];
+                W[l*nc+j] = s;
+            }
+        }
+    }
+
+    /* C = C - V * W */
+    for(i=c0; i<m; i++) {
+        for(l=0; l<nb; l++) {
+            v = HHV(a, i, c0+l);
+            if(v == 0)
+                continue;
+            for(j=0; j<nc; j++)
+                c[i][cstart+j] -= v*W[l*nc+j];
+        }
+    }
+}
+
+/**
+ * @brief Calculate the QR factorization of a matrix in place.
+ *
+ * On return, the upper triangle of A contains R, and the Householder vectors
+ * that make up Q are stored below the diagonal. Q is never formed explicitly.
+ * Use QRApplyQ and QRApplyQt to multiply by it.
+ *
+ * @param A An mxn matrix to factor
+ * @returns A row matrix holding the scalar factors (tau) of the Householder
+ *      reflectors, which must be passed to the other QR functions.
+ */
+matrix* QRFactor(matrix *A)
+{
+    int m = nRows(A), n = nCols(A);
+    int k = (m < n) ? m : n;
+    int kb, nb, layout = A->layout;
+    matrix *tau;
+    double *T, *G, *W;
+    PROF_BEGIN(MTXOP_QR);
+
+    /* The blocked kernels work on rows */
+    mtxsetlayout(A, MTX_ROWMAJOR);
+    UnshareMatrix(A);
+    tau = CreateMatrix(1, k);
+    T = (double*) malloc(QRBLOCK*QRBLOCK*sizeof(double));
+    G = (double*) malloc(QRBLOCK*QRBLOCK*sizeof(double));
+    W = (double*) malloc(QRBLOCK*n*sizeof(double));
+
+    for(kb=0; kb<k; kb+=QRBLOCK) {
+        nb = (k-kb < QRBLOCK) ? k-kb : QRBLOCK;
+        PanelQR(A->array, m, kb, nb, tau->array[0], W);
+        if(kb+nb < n) {
+            FormT(A->array, m, kb, nb, tau->array[0], T, G);
+            ApplyBlock(A->array, m, kb, nb, T, 1, A->array, kb+nb, n, W);
+        }
+    }
+
+    free(T);
+    free(G);
+    free(W);
+    mtxsetlayout(A, layout);
+
+    PROF_END(MTXOP_QR, 2.0*n*n*(m-n/3.0));
+    return tau;
+}
+
+/**
+ * @brief Multiply by Q or Q^T using the output of QRFactor
+ * @param trans Nonzero for Q^T
+ */
+static void ApplyQ(matrix *QR, matrix *tau, matrix *B, int trans)
+{
+    int m = nRows(QR), k = nCols(tau);
+    int kb, nb, i, layout = B->layout;
+    matrix *QRr = NULL;
+    double *T, *G, *W;
+
+    if(nRows(B) != m) {
+        fprintf(stderr, "Error: Incompatible matrix dimensions.\n");
+        return;
+    }
+    if(QR->layout != MTX_ROWMAJOR)
+        QR = QRr = ConvertLayout(QR, MTX_ROWMAJOR);
+    mtxsetlayout(B, MTX_ROWMAJOR);
+    UnshareMatrix(B);
+
+    T = (double*) malloc(QRBLOCK*QRBLOCK*sizeof(double));
+    G = (double*) malloc(QRBLOCK*QRBLOCK*sizeof(double));
+    W = (double*) malloc(QRBLOCK*nCols(B)*sizeof(double));
+
+    /* Q = H1*H2*...*Hk, so Q^T applies the blocks first to last and Q
+     * applies them last to first. */
+    for(i=0; i<k; i+=QRBLOCK) {
+        kb = trans ? i : ((k-1)/QRBLOCK - i/QRBLOCK)*QRBLOCK;
+        nb = (k-kb < QRBLOCK) ? k-kb : QRBLOCK;
+        FormT(QR->array, m, kb, nb, tau->array[0], T, G);
+        ApplyBlock(QR->array, m, kb, nb, T, trans, B->array, 0, nCols(B), W);
+    }
+
+    free(T);
+    free(G);
+    free(W);
+    if(QRr)
+        DestroyMatrix(QRr);
+    mtxsetlayout(B, layout);
+}
+
+/**
+ * @brief Calculate Q*B in place without forming Q.
+ * @param QR Factored matrix from QRFactor
+ * @param tau Householder factors returned by QRFactor
+ * @param B Matrix with as many rows as QR. Overwritten with Q*B.
+ */
+void QRApplyQ(matrix *QR, matrix *tau, matrix *B)
+{
+    ApplyQ(QR, tau, B, 0);
+}
+
+/**
+ * @brief Calculate Q^T*B in place without forming Q.
+ * @param QR Factored matrix from QRFactor
+ * @param tau Householder factors returned by QRFactor
+ * @param B Matrix with as many rows as QR. Overwritten with Q^T*B.
+ */
+void QRApplyQt(matrix *QR, matrix *tau, matrix *B)
+{
+    ApplyQ(QR, tau, B, 1);
+}
+
+/**
+ * @brief Solve R*X = B in place, where R is the upper triangle of r.
+ * @returns 0 on success, or k if the k-th diagonal element of R is zero
+ */
+static int BackSubstitute(mtxview r, matrix *X)
+{
+    int i;
+
+    for(i=0; i<r.rows; i++)
+        if(valView(r, i, i) == 0)
+            return i+1;
+    trsm(TRI_LEFT, 1, ViewTriangle(r, TRI_UPPER, TRI_NONUNIT), X);
+
+    return 0;
+}
+
+/**
+ * @brief Find the least squares solution to A*X = B from a QR factorization.
+ * @param QR Factored mxn matrix from QRFactor, with m >= n
+ * @param tau Householder factors returned by QRFactor
+ * @param B An mxk matrix of right-hand sides
+ * @returns The nxk matrix X minimizing the 2-norm of each column of A*X - B,
+ *      or NULL if A does not have full column rank.
+ */
+matrix* QRSolve(matrix *QR, matrix *tau, matrix *B)
+{
+    int m = nRows(QR), n = nCols(QR), k = nCols(B);
+    matrix *R = NULL, *C, *X;
+
+    if(m < n || nRows(B) != m) {
+        fprintf(stderr, "QRSolve(): Incompatible matrix dimensions.\n");
+        return NULL;
+    }
+
+    if(QR->layout != MTX_ROWMAJOR)
+        QR = R = ConvertLayout(QR, MTX_ROWMAJOR);
+    C = ConvertLayout(B, MTX_ROWMAJOR);
+    QRApplyQt(QR, tau, C);
+    X = CreateMatrixLayout(n, k, B->layout);
+    CopyViewInto(ViewBlock(C, 0, 0, n, k), X);
+    if(BackSubstitute(ViewBlock(QR, 0, 0, n, n), X)) {
+        fprintf(stderr, "QRSolve(): Matrix is rank deficient.\n");
+        DestroyMatrix(X);
+        X = NULL;
+    }
+    DestroyMatrix(C);
+    if(R)
+        DestroyMatrix(R);
+
+    return X;
+}
+
+/**
+ * @brief Form the full orthogonal factor Q from the output of QRFactor.
+ *
+ * Only needed to update the factorization with QRReplaceColumn. Otherwise,
+ * QRApplyQ and QRApplyQt are cheaper.
+ *
+ * @param QR Factored mxn matrix from QRFactor
+ * @param tau Householder factors returned by QRFactor
+ * @returns The mxm matrix Q
+ */
+matrix* QRFormQ(matrix *QR, matrix *tau)
+{
+    int m = nRows(QR), i;
+    matrix *Q = CreateMatrix(m, m);
+
+    for(i=0; i<m; i++)
+        Q->array[i][i] = 1;
+    QRApplyQ(QR, tau, Q);
+
+    return Q;
+}
+
+/**
+ * @brief Copy the triangular factor R out of the output of QRFactor.
+ * @param QR Factored mxn matrix from QRFactor
+ * @returns The mxn matrix R, with zeros below the diagonal
+ */
+matrix* QRFormR(matrix *QR)
+{
+    int m = nRows(QR), n = nCols(QR), i, j;
+    matrix *R = CreateMatrix(m, n);
+    mtxview qr = ViewMatrix(QR);
+
+    for(i=0; i<m; i++)
+        for(j=i; j<n; j++)
+            R->array[i][j] = valView(qr, i, j);
+
+    return R;
+}
+
+/**
+ * @brief Find the least squares solution to A*X = B from explicit factors.
+ *
+ * For use with factors that have been kept up to date with QRReplaceColumn.
+ *
+ * @param Q The mxm orthogonal factor
+ * @param R The mxn upper triangular factor, with m >= n
+ * @param B An mxk matrix of right-hand sides
+ * @returns The nxk matrix X minimizing the 2-norm of each column of A*X - B,
+ *      or NULL if A does not have full column rank.
+ */
+matrix* QRSolveFormed(matrix *Q, matrix *R, matrix *B)
+{
+    int m = nRows(Q), n = nCols(R), k = nCols(B);
+    matrix *X;
+
+    if(m < n || nCols(Q) != m || nRows(R) != m || nRows(B) != m) {
+        fprintf(stderr, "QRSolveFormed(): Incompatible matrix dimensions.\n");
+        return NULL;
+    }
+
+    /* Only the first n columns of Q reach the first n rows of Q^T*B */
+    X = mtxmulview(ViewTranspose(ViewBlock(Q, 0, 0, m, n)), ViewMatrix(B),
+                   CreateMatrixLayout(n, k, B->layout));
+    if(BackSubstitute(ViewBlock(R, 0, 0, n, n), X)) {
+        fprintf(stderr, "QRSolveFormed(): Matrix is rank deficient.\n");
+        DestroyMatrix(X);
+        X = NULL;
+    }
+
+    return X;
+}
+
+/**
+ * @brief Solve an overdetermined system in the least squares sense.
+ *
+ * The rows of [A | B] are read exactly once. They are folded into a running
+ * triangular factor LSQCHUNK rows at a time by taking the QR factorization of
+ * [R z; A_chunk B_chunk], which stays in cache while it is worked on. Memory
+ * use is independent of the number of rows in A, and A is not modified.
+ *
+ * @param A An mxn matrix with m >= n and full column rank
+ * @param B An mxk matrix of right-hand sides
+ * @returns The nxk matrix X minimizing the 2-norm of each column of A*X - B,
+ *      or NULL if A does not have full column rank.
+ */
+matrix* SolveLeastSquares(matrix *A, matrix *B)
+{
+    int m = nRows(A), n = nCols(A), k = nCols(B), nc = n+k;
+    int r0, ch, i, j, c;
+    double **w;
+    double *h;
+    double sigma, scale, tau, t;
+    mtxview a, b;
+    matrix *W, *X;
+
+    if(m < n || nRows(B) != m) {
+        fprintf(stderr, "SolveLeastSquares(): Incompatible matrix dimensions.\n");
+        return NULL;
+    }
+
+    PROF_BEGIN(MTXOP_LEASTSQUARES);
+
+    /* Rows 0 to n-1 hold [R z], and the rows below hold the current chunk */
+    W = CreateMatrix(n+LSQCHUNK, nc);
+    w = W->array;
+    h = (double*) malloc(nc*sizeof(double));
+    a = ViewMatrix(A);
+    b = ViewMatrix(B);
+
+    for(r0=0; r0<m; r0+=LSQCHUNK) {
+        ch = (m-r0 < LSQCHUNK) ? m-r0 : LSQCHUNK;
+        for(i=0; i<ch; i++) {
+            for(c=0; c<n; c++)
+                w[n+i][c] = valView(a, r0+i, c);
+            for(c=0; c<k; c++)
+                w[n+i][n+c] = valView(b, r0+i, c);
+        }
+
+        /* Column j only has nonzeros in row j of R and in the chunk */
+        for(j=0; j<n; j++) {
+            sigma = 0;
+            for(i=n; i<n+ch; i++)
+                sigma += w[i][j]*w[i][j];
+            tau = Householder(&w[j][j], sigma, &scale);
+            if(tau == 0)
+                continue;
+            for(i=n; i<n+ch; i++)
+                w[i][j] *= scale;
+
+            for(c=j+1; c<nc; c++)
+                h[c] = w[j][c];
+            for(i=n; i<n+ch; i++) {
+                t = w[i][j];
+                for(c=j+1; c<nc; c++)
+                    h[c] += t*w[i][c];
+            }
+            for(c=j+1; c<nc; c++)
+                w[j][c] -= tau*h[c];
+            for(i=n; i<n+ch; i++) {
+                t = tau*w[i][j];
+                for(c=j+1; c<nc; c++)
+                    w[i][c] -= t*h[c];
+            }
+        }
+    }
+    free(h);
+
+    /* Copy z out and solve R*X = z with R left where it is in W */
+    X = CreateMatrix(n, k);
+    for(i=0; i<n; i++)
+        memcpy(X->array[i], w[i]+n, k*sizeof(double));
+    if(BackSubstitute(ViewBlock(W, 0, 0, n, n), X)) {
+        fprintf(stderr, "SolveLeastSquares(): Matrix is rank deficient.\n");
+        DestroyMatrix(X);
+        X = NULL;
+    } else {
+        mtxsetlayout(X, B->layout);
+    }
+    DestroyMatrix(W);
+
+    PROF_END(MTXOP_LEASTSQUARES, 2.0*m*n*(n+k));
+    return X;
+}
+
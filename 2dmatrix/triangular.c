@@ -0,0 +1,301 @@
+/**
+ * @file triangular.c
+ * Triangular solves (TRSM) and products (TRMM) with many right-hand sides.
+ *
+ * Everything is reduced to one case: a lower triangular matrix on the left of
+ * a row-major B, so that the innermost loops run along rows of B. An upper
+ * triangle becomes a lower one by reading both the triangle and the rows of B
+ * backwards, which is just a view with negative strides. Multiplying or
+ * solving on the right is the same as doing it on the left of B^T with T^T,
+ * and mtxtrnflip gets B^T without moving anything.
+ *
+ * The triangle is worked through in blocks of TRIBLOCK rows. Most of the work
+ * is updating the rows outside the current block, which is a small matrix
+ * product. With many right-hand sides, the columns of B are split into
+ * chunks that are handled by different threads. With only a few, the update
+ * is split between threads by row instead.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "triangular.h"
+#include "../instrument/instrument.h"
+
+///Number of rows of the triangle handled at a time
+#define TRIBLOCK 64
+///Number of columns of B in each chunk handed to a thread
+#define TRICOLS 256
+///Number of floating point operations above which the updates are
+///multithreaded
+#define PARALLELFLOPS 1e6
+
+/* Pointer to the start of row I of view V */
+#define ROW(V, I) ((V).data + (long) (I)*(V).rs)
+
+/**
+ * @brief View one triangle of a square block of a matrix
+ * @param a The square view holding the triangle
+ * @param uplo TRI_LOWER or TRI_UPPER
+ * @param diag TRI_NONUNIT, or TRI_UNIT if the diagonal is all ones
+ * @returns The triangular matrix. If a isn't square, it has no rows.
+ */
+trimatrix ViewTriangle(mtxview a, int uplo, int diag)
+{
+    trimatrix t;
+
+    if(a.rows != a.cols) {
+        fprintf(stderr, "Error: Triangular matrix must be square.\n");
+        a.rows = a.cols = 0;
+    }
+    t.a = a;
+    t.uplo = (uplo == TRI_UPPER) ? TRI_UPPER : TRI_LOWER;
+    t.diag = (diag == TRI_UNIT) ? TRI_UNIT : TRI_NONUNIT;
+    return t;
+}
+
+/**
+ * @brief Transpose a triangular matrix without copying it
+ *
+ * The transpose of a lower triangle is an upper triangle in the same storage.
+ *
+ * @param t The triangular matrix
+ * @returns Its transpose
+ */
+trimatrix TransposeTriangle(trimatrix t)
+{
+    t.a = ViewTranspose(t.a);
+    t.uplo = (t.uplo == TRI_LOWER) ? TRI_UPPER : TRI_LOWER;
+    return t;
+}
+
+/**
+ * @brief Copy a triangular matrix into a new, full matrix
+ * @param t The triangular matrix
+ * @returns A new row-major matrix with the other triangle set to zero and,
+ *      for a unit triangle, the diagonal set to one
+ */
+matrix* CopyTriangle(trimatrix t)
+{
+    matrix *A;
+    int i, j, n = t.a.rows;
+
+    A = CreateMatrix(n, n);
+    if(!A)
+        return NULL;
+    for(i=0; i<n; i++) {
+        for(j=0; j<n; j++) {
+            if(i == j && t.diag == TRI_UNIT)
+                A->array[i][j] = 1;
+            else if((t.uplo == TRI_LOWER) ? j <= i : j >= i)
+                A->array[i][j] = valView(t.a, i, j);
+        }
+    }
+    return A;
+}
+
+/* Read a view backwards in both directions */
+static mtxview Reverse(mtxview v)
+{
+    v.data = &valView(v, v.rows-1, v.cols-1);
+    v.rs = -v.rs;
+    v.cs = -v.cs;
+    return v;
+}
+
+/* b -= t*x for columns j0 to j1-1 */
+static void Axpy(double *b, double t, const double *x, int j0, int j1)
+{
+    int j;
+
+    #pragma omp simd
+    for(j=j0; j<j1; j++)
+        b[j] -= t*x[j];
+}
+
+/* Subtract rows k0 to k1-1 of X, weighted by row i of T, from row i of B, for
+ * columns j0 to j1-1. Rows of X are taken four at a time. */
+static void UpdateRow(mtxview T, mtxview B, int i, int k0, int k1,
+                      int j0, int j1)
+{
+    int j, k;
+    double *b = ROW(B, i);
+    const double *ti = ROW(T, i);
+
+    for(k=k0; k+3<k1; k+=4) {
+        const double *x0 = ROW(B, k), *x1 = ROW(B, k+1),
+                     *x2 = ROW(B, k+2), *x3 = ROW(B, k+3);
+        double t0 = ti[(long) k*T.cs], t1 = ti[(long) (k+1)*T.cs],
+               t2 = ti[(long) (k+2)*T.cs], t3 = ti[(long) (k+3)*T.cs];
+        #pragma omp simd
+        for(j=j0; j<j1; j++)
+            b[j] -= t0*x0[j] + t1*x1[j] + t2*x2[j] + t3*x3[j];
+    }
+    for(; k<k1; k++)
+        Axpy(b, ti[(long) k*T.cs], ROW(B, k), j0, j1);
+}
+
+/* Solve T*X = B for columns j0 to j1-1, where T is lower triangular. par
+ * allows the update below each block to be split between threads. */
+static void SolveLower(mtxview T, int unit, mtxview B, int j0, int j1, int par)
+{
+    int n = T.rows, ib, iend, i, k, j;
+    double d, *b;
+
+    for(ib=0; ib<n; ib+=TRIBLOCK) {
+        iend = (n-ib < TRIBLOCK) ? n : ib+TRIBLOCK;
+
+        for(i=ib; i<iend; i++) {
+            b = ROW(B, i);
+            for(k=ib; k<i; k++)
+                Axpy(b, valView(T, i, k), ROW(B, k), j0, j1);
+            if(!unit) {
+                d = valView(T, i, i);
+                for(j=j0; j<j1; j++)
+                    b[j] /= d;
+            }
+        }
+
+        #pragma omp parallel for if(par && 2.0*(n-iend)*(iend-ib)*(j1-j0) > PARALLELFLOPS) schedule(static)
+        for(i=iend; i<n; i++)
+            UpdateRow(T, B, i, ib, iend, j0, j1);
+    }
+}
+
+/* Calculate B = T*B for columns j0 to j1-1, where T is lower triangular.
+ * Working from the bottom up means the rows that are still needed haven't
+ * been overwritten yet. */
+static void MulLower(mtxview T, int unit, mtxview B, int j0, int j1, int par)
+{
+    int n = T.rows, ib, iend, i, k, j;
+    double d, *b;
+
+    for(ib=((n-1)/TRIBLOCK)*TRIBLOCK; ib>=0; ib-=TRIBLOCK) {
+        iend = (n-ib < TRIBLOCK) ? n : ib+TRIBLOCK;
+
+        for(i=iend-1; i>=ib; i--) {
+            b = ROW(B, i);
+            if(!unit) {
+                d = valView(T, i, i);
+                for(j=j0; j<j1; j++)
+                    b[j] *= d;
+            }
+            for(k=ib; k<i; k++)
+                Axpy(b, -valView(T, i, k), ROW(B, k), j0, j1);
+        }
+
+        /* Add in the rows above the block, which are still untouched. The
+         * signs are flipped since UpdateRow subtracts. */
+        #pragma omp parallel for if(par && 2.0*ib*(iend-ib)*(j1-j0) > PARALLELFLOPS) schedule(static)
+        for(i=ib; i<iend; i++) {
+            b = ROW(B, i);
+            for(j=j0; j<j1; j++)
+                b[j] = -b[j];
+            UpdateRow(T, B, i, 0, ib, j0, j1);
+            for(j=j0; j<j1; j++)
+                b[j] = -b[j];
+        }
+    }
+}
+
+/* Shared driver for trsm and trmm */
+static matrix* Triangular(int side, double alpha, trimatrix T, matrix *B,
+                          int solve)
+{
+    mtxview t = T.a, b;
+    int lower = (T.uplo == TRI_LOWER), unit = (T.diag == TRI_UNIT);
+    int n = t.rows, m, c, nchunks, layout;
+    long i;
+
+    if(n == 0 || (side == TRI_RIGHT ? nCols(B) : nRows(B)) != n) {
+        fprintf(stderr, "Error: Incompatible matrix dimensions.\n");
+        return NULL;
+    }
+
+    /* X*T = B is the same as T^T*X^T = B^T */
+    if(side == TRI_RIGHT) {
+        mtxtrnflip(B);
+        t = ViewTranspose(t);
+        lower = !lower;
+    }
+    layout = B->layout;
+    mtxsetlayout(B, MTX_ROWMAJOR);
+    UnshareMatrix(B);
+
+    b = ViewMatrix(B);
+    m = b.cols;
+    if(!lower) {
+        t = Reverse(t);
+        b.data = ROW(b, n-1);
+        b.rs = -b.rs;
+    }
+
+    if(alpha != 1)
+        for(i=0; i<(long) n*m; i++)
+            B->data[i] *= alpha;
+
+    nchunks = (m+TRICOLS-1)/TRICOLS;
+    if(nchunks > 1) {
+        #pragma omp parallel for if(1.0*n*n*m > PARALLELFLOPS) schedule(dynamic, 1)
+        for(c=0; c<nchunks; c++) {
+            if(solve)
+                SolveLower(t, unit, b, c*TRICOLS, (c == nchunks-1) ? m : (c+1)*TRICOLS, 0);
+            else
+                MulLower(t, unit, b, c*TRICOLS, (c == nchunks-1) ? m : (c+1)*TRICOLS, 0);
+        }
+    } else if(solve) {
+        SolveLower(t, unit, b, 0, m, 1);
+    } else {
+        MulLower(t, unit, b, 0, m, 1);
+    }
+
+    mtxsetlayout(B, layout);
+    if(side == TRI_RIGHT)
+        mtxtrnflip(B);
+    return B;
+}
+
+/**
+ * @brief Solve a triangular system with many right-hand sides in place
+ *
+ * Calculates X = alpha*T^-1*B, or X = alpha*B*T^-1 on the right. B can have
+ * either layout. Use TransposeTriangle to solve with T^T.
+ *
+ * @param side TRI_LEFT to solve T*X = alpha*B, or TRI_RIGHT for
+ *      X*T = alpha*B
+ * @param alpha Multiplier for B
+ * @param T The triangular matrix. Must not share storage with B, and must
+ *      not have zeros on its diagonal.
+ * @param B The right-hand sides. Overwritten with X.
+ * @returns B, or NULL if the dimensions don't agree
+ */
+matrix* trsm(int side, double alpha, trimatrix T, matrix *B)
+{
+    matrix *X;
+    PROF_BEGIN(MTXOP_TRSM);
+    X = Triangular(side, alpha, T, B, 1);
+    PROF_END(MTXOP_TRSM, (double) T.a.rows*nRows(B)*nCols(B));
+    return X;
+}
+
+/**
+ * @brief Multiply by a triangular matrix in place
+ *
+ * Calculates B = alpha*T*B, or B = alpha*B*T on the right, using half the
+ * work of a full product. B can have either layout.
+ *
+ * @param side TRI_LEFT or TRI_RIGHT
+ * @param alpha Multiplier for the product
+ * @param T The triangular matrix. Must not share storage with B.
+ * @param B The matrix to multiply. Overwritten with the product.
+ * @returns B, or NULL if the dimensions don't agree
+ */
+matrix* trmm(int side, double alpha, trimatrix T, matrix *B)
+{
+    matrix *X;
+    PROF_BEGIN(MTXOP_TRMM);
+    X = Triangular(side, alpha, T, B, 0);
+    PROF_END(MTXOP_TRMM, (double) T.a.rows*nRows(B)*nCols(B));
+    return X;
+}
+
@@ -0,0 +1,66 @@
+/**
+ * @file triangular.h
+ * Triangular matricies, and blocked triangular solves and products with many
+ * right-hand sides.
+ *
+ * A trimatrix is a view of the lower or upper triangle of a square block of a
+ * matrix, such as the factor left behind by CholeskyFactor or QRFactor. The
+ * other triangle is never read, so the factors can be used where they are
+ * without copying them out. With a unit diagonal, the diagonal isn't read
+ * either and is taken to be all ones.
+ */
+
+#ifndef TRIANGULAR_H
+#define TRIANGULAR_H
+
+#include "2dmatrix.h"
+#include "mtxview.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+///The triangle on and below the diagonal
+#define TRI_LOWER 0
+///The triangle on and above the diagonal
+#define TRI_UPPER 1
+
+///The diagonal is stored with the triangle
+#define TRI_NONUNIT 0
+///The diagonal is all ones and isn't stored
+#define TRI_UNIT 1
+
+///Multiply or solve with the triangular matrix on the left: T*X = B
+#define TRI_LEFT 0
+///Multiply or solve with the triangular matrix on the right: X*T = B
+#define TRI_RIGHT 1
+
+/**
+ * @struct trimatrix
+ * @brief A triangular matrix stored in one triangle of a square view
+ * @var trimatrix::a
+ * The square block of storage holding the triangle
+ * @var trimatrix::uplo
+ * TRI_LOWER or TRI_UPPER
+ * @var trimatrix::diag
+ * TRI_NONUNIT or TRI_UNIT
+ */
+typedef struct {
+    mtxview a;
+    int uplo;
+    int diag;
+} trimatrix;
+
+trimatrix ViewTriangle(mtxview, int, int);
+trimatrix TransposeTriangle(trimatrix);
+matrix* CopyTriangle(trimatrix);
+
+matrix* trsm(int, double, trimatrix, matrix*);
+matrix* trmm(int, double, trimatrix, matrix*);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
@@ -0,0 +1,396 @@
+/**
+ * @file update.c
+ * Updating stored factorizations when the matrix changes by a low-rank term.
+ *
+ * Refactoring a matrix after a small change costs O(n^3). The functions here
+ * bring an existing factorization up to date in O(n^2) instead, or solve with
+ * the changed matrix through the Sherman-Morrison-Woodbury formula without
+ * touching the factors at all:
+ *
+ *     (A + U*V^T)^-1 = A^-1 - A^-1*U*(I + V^T*A^-1*U)^-1*V^T*A^-1
+ *
+ * Replacing row i of A with r is the rank-one update A + e_i*(r - a_i)^T, and
+ * replacing column j with c is A + (c - a_j)*e_j^T, so both can be done with
+ * LUUpdate.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+
+#include "2dmatrix.h"
+#include "mtxsolver.h"
+#include "mtxview.h"
+#include "../vector/vector.h"
+#include "../instrument/instrument.h"
+
+/**
+ * @brief Update an LU factorization for a rank-one change to the matrix
+ *
+ * Turns the factors of A into those of A + x*y^T, using Bennett's algorithm.
+ * The rows are kept in the order chosen when A was factored, so if the change
+ * makes one of the pivots small, accuracy suffers. For a downdate, negate x.
+ *
+ * @param LU Output of LUFactor. Updated in place.
+ * @param perm Row swaps from LUFactor
+ * @param x Column vector of the change
+ * @param y Row vector of the change
+ * @returns 0 on success, or k if the k-th pivot becomes zero, in which case
+ *      LU is left partly updated and the matrix has to be factored again
+ */
+int LUUpdate(matrix *LU, int *perm, vector *x, vector *y)
+{
+    int n = nRows(LU), i, j, k, layout, info = 0;
+    double *X, *Y, *a, xi, t;
+
+    if(nCols(LU) != n || len(x) != n || len(y) != n) {
+        fprintf(stderr, "Error: Incompatible matrix dimensions.\n");
+        return -1;
+    }
+    X = (double*) malloc(2*n*sizeof(double));
+    if(!X) {
+        fprintf(stderr, "Memory allocation error: %s\n", strerror(errno));
+        return -1;
+    }
+    Y = X + n;
+
+    /* P*(A + x*y^T) = L*U + (P*x)*y^T */
+    memcpy(X, x->v, n*sizeof(double));
+    memcpy(Y, y->v, n*sizeof(double));
+    for(i=0; i<n; i++) {
+        if(perm[i] != i) {
+            t = X[i];
+            X[i] = X[perm[i]];
+            X[perm[i]] = t;
+        }
+    }
+
+    PROF_BEGIN(MTXOP_LUUPDATE);
+    layout = LU->layout;
+    mtxsetlayout(LU, MTX_ROWMAJOR);
+    UnshareMatrix(LU);
+
+    /* Step i of the algorithm changes column i of L and row i of U. Both are
+     * done here a row at a time: row i takes the changes to its part of L
+     * from the steps before it, and then makes its own step on its part of
+     * U. X and Y keep the values each step left behind. */
+    for(i=0; i<n; i++) {
+        a = LU->array[i];
+        xi = X[i];
+        for(j=0; j<i; j++) {
+            xi -= X[j]*a[j];
+            a[j] += Y[j]*xi;
+        }
+
+        a[i] += xi*Y[i];
+        if(a[i] == 0 || !isfinite(a[i])) {
+            info = i+1;
+            break;
+        }
+        X[i] = xi;
+        Y[i] /= a[i];
+        for(k=i+1; k<n; k++) {
+            a[k] += xi*Y[k];
+            Y[k] -= Y[i]*a[k];
+        }
+    }
+
+    mtxsetlayout(LU, layout);
+    PROF_END(MTXOP_LUUPDATE, 4.0*n*n);
+    free(X);
+
+    return info;
+}
+
+/* L*L^T + sign*x*x^T, a row at a time. Column k is rotated with x by the
+ * cosine c[k] and sine s[k], which are found on the diagonal of row k and then
+ * used by every row after it. */
+static int CholeskyRankOne(matrix *L, vector *x, int sign)
+{
+    int n = nRows(L), i, k, layout, info = 0;
+    double *c, *s, *l, xi, r2, r;
+
+    if(nCols(L) != n || len(x) != n) {
+        fprintf(stderr, "Error: Incompatible matrix dimensions.\n");
+        return -1;
+    }
+    c = (double*) malloc(2*n*sizeof(double));
+    if(!c) {
+        fprintf(stderr, "Memory allocation error: %s\n", strerror(errno));
+        return -1;
+    }
+    s = c + n;
+
+    PROF_BEGIN(MTXOP_CHOLUPDATE);
+    layout = L->layout;
+    mtxsetlayout(L, MTX_ROWMAJOR);
+    UnshareMatrix(L);
+
+    for(i=0; i<n; i++) {
+        l = L->array[i];
+        xi = valV(x, i);
+        for(k=0; k<i; k++) {
+            l[k] = (l[k] + sign*s[k]*xi)/c[k];
+            xi = c[k]*xi - s[k]*l[k];
+        }
+
+        r2 = l[i]*l[i] + sign*xi*xi;
+        if(!(r2 > 0) || !isfinite(r2)) {
+            info = i+1;
+            break;
+        }
+        r = sqrt(r2);
+        c[i] = r/l[i];
+        s[i] = xi/l[i];
+        l[i] = r;
+    }
+
+    mtxsetlayout(L, layout);
+    PROF_END(MTXOP_CHOLUPDATE, 4.0*n*n);
+    free(c);
+
+    return info;
+}
+
+/**
+ * @brief Update a Cholesky factorization for a rank-one change to the matrix
+ *
+ * Turns L, the factor of A, into the factor of A + x*x^T. Only the lower
+ * triangle of L is used or changed.
+ *
+ * @param L Output of CholeskyFactor. Updated in place.
+ * @param x The change
+ * @returns 0 on success, or -1 if the dimensions don't agree
+ */
+int CholeskyUpdate(matrix *L, vector *x)
+{
+    return CholeskyRankOne(L, x, 1) ? -1 : 0;
+}
+
+/**
+ * @brief Downdate a Cholesky factorization for a rank-one change to the
+ * matrix
+ *
+ * Turns L, the factor of A, into the factor of A - x*x^T.
+ *
+ * @param L Output of CholeskyFactor. Updated in place.
+ * @param x The change
+ * @returns 0 on success, or k if the leading minor of order k of A - x*x^T is
+ *      not positive definite. In that case L is left partly updated and has
+ *      to be factored again.
+ */
+int CholeskyDowndate(matrix *L, vector *x)
+{
+    return CholeskyRankOne(L, x, -1);
+}
+
+/* Find the rotation that takes (a, b) to (r, 0), and return r */
+static double Givens(double a, double b, double *c, double *s)
+{
+    double r = hypot(a, b);
+
+    if(r == 0) {
+        *c = 1;
+        *s = 0;
+    } else {
+        *c = a/r;
+        *s = b/r;
+    }
+    return r;
+}
+
+/* Rotate columns c0 to n-1 of rows p and q of a row-major matrix */
+static void RotateRows(matrix *A, int p, int q, int c0, double c, double s)
+{
+    double *a = A->array[p], *b = A->array[q], t;
+    int k;
+
+    for(k=c0; k<A->cols; k++) {
+        t = c*a[k] + s*b[k];
+        b[k] = c*b[k] - s*a[k];
+        a[k] = t;
+    }
+}
+
+/* Rotate columns p and q of a row-major matrix, for Q*G^T */
+static void RotateCols(matrix *A, int p, int q, double c, double s)
+{
+    double *a, t;
+    int i;
+
+    for(i=0; i<A->rows; i++) {
+        a = A->array[i];
+        t = c*a[p] + s*a[q];
+        a[q] = c*a[q] - s*a[p];
+        a[p] = t;
+    }
+}
+
+/**
+ * @brief Replace a column of a matrix in its QR factorization
+ *
+ * Turns Q and R, with A = Q*R, into the factors of A with column j replaced
+ * by a. Q^T*a goes into column j of R, and Givens rotations restore R to
+ * upper triangular form, first by zeroing column j below the diagonal from
+ * the bottom up and then by zeroing the subdiagonal this leaves to its right.
+ * Each rotation is applied to Q as well. This takes O(m^2 + m*n) time,
+ * compared to O(m*n^2) for a new factorization.
+ *
+ * @param Q The mxm orthogonal factor, as from QRFormQ. Updated in place.
+ * @param R The mxn upper triangular factor, as from QRFormR. Updated in
+ *      place.
+ * @param j The column to replace
+ * @param a The new column, of length m
+ * @returns 0 on success, or -1 if the dimensions don't agree
+ */
+int QRReplaceColumn(matrix *Q, matrix *R, int j, vector *a)
+{
+    int m = nRows(Q), n = nCols(R), i, k, lq, lr;
+    double *w, *q, c, s;
+
+    if(nCols(Q) != m || nRows(R) != m || len(a) != m || j < 0 || j >= n) {
+        fprintf(stderr, "Error: Incompatible matrix dimensions.\n");
+        return -1;
+    }
+    w = (double*) calloc(m, sizeof(double));
+    if(!w) {
+        fprintf(stderr, "Memory allocation error: %s\n", strerror(errno));
+        return -1;
+    }
+
+    PROF_BEGIN(MTXOP_QRREPLACE);
+    lq = Q->layout;
+    lr = R->layout;
+    mtxsetlayout(Q, MTX_ROWMAJOR);
+    mtxsetlayout(R, MTX_ROWMAJOR);
+    UnshareMatrix(Q);
+    UnshareMatrix(R);
+
+    /* w = Q^T*a, a row of Q at a time */
+    for(i=0; i<m; i++) {
+        q = Q->array[i];
+        for(k=0; k<m; k++)
+            w[k] += valV(a, i)*q[k];
+    }
+    for(i=0; i<m; i++)
+        R->array[i][j] = w[i];
+
+    /* Zero column j from the bottom up. Rows k-1 and k are only nonzero from
+     * column k-1 on, apart from column j, and each rotation leaves an element
+     * behind at (k, k-1). */
+    for(k=m-1; k>j; k--) {
+        R->array[k-1][j] = Givens(R->array[k-1][j], R->array[k][j], &c, &s);
+        R->array[k][j] = 0;
+        RotateRows(R, k-1, k, (k-1 > j+1) ? k-1 : j+1, c, s);
+        RotateCols(Q, k-1, k, c, s);
+    }
+
+    /* R is now upper Hessenberg to the right of column j */
+    for(k=j+1; k<n && k+1<m; k++) {
+        R->array[k][k] = Givens(R->array[k][k], R->array[k+1][k], &c, &s);
+        R->array[k+1][k] = 0;
+        RotateRows(R, k, k+1, k+1, c, s);
+        RotateCols(Q, k, k+1, c, s);
+    }
+
+    mtxsetlayout(Q, lq);
+    mtxsetlayout(R, lr);
+    PROF_END(MTXOP_QRREPLACE, 2.0*m*m + 6.0*(m-j)*(m+n));
+    free(w);
+
+    return 0;
+}
+
+/* Solve (A + U*V^T)*X = B, where F holds the LU factorization of A if perm
+ * isn't NULL, or its Cholesky factor if it is. Needs k+m solves with A and
+ * the factorization of a kxk matrix. */
+static matrix* Woodbury(matrix *F, int *perm, matrix *U, matrix *V, matrix *B)
+{
+    int n = nRows(F), k = nCols(U), i, *p;
+    matrix *Z, *X, *S, *W, *ZW;
+    mtxview vt, s;
+
+    if(nRows(U) != n || nRows(V) != n || nCols(V) != k || nRows(B) != n) {
+        fprintf(stderr, "Error: Incompatible matrix dimensions.\n");
+        return NULL;
+    }
+    p = (int*) malloc(k*sizeof(int));
+    if(!p) {
+        fprintf(stderr, "Memory allocation error: %s\n", strerror(errno));
+        return NULL;
+    }
+
+    /* Z = A^-1*U and X = A^-1*B */
+    Z = CopyMatrix(U);
+    X = CopyMatrix(B);
+    if(perm) {
+        LUSolve(F, perm, Z);
+        LUSolve(F, perm, X);
+    } else {
+        CholeskySolve(F, Z);
+        CholeskySolve(F, X);
+    }
+
+    /* S = I + V^T*Z is the capacitance matrix, and W = S^-1*V^T*X */
+    vt = ViewTranspose(ViewMatrix(V));
+    S = mtxmulview(vt, ViewMatrix(Z), CreateMatrix(k, k));
+    W = mtxmulview(vt, ViewMatrix(X), CreateMatrix(k, nCols(B)));
+    s = ViewMatrix(S);
+    for(i=0; i<k; i++)
+        valView(s, i, i) += 1;
+
+    if(LUFactor(S, p)) {
+        fprintf(stderr, "Error: Updated matrix is singular.\n");
+        DestroyMatrix(X);
+        X = NULL;
+    } else {
+        LUSolve(S, p, W);
+        ZW = mtxmul(Z, W);
+        mtxsubinto(X, ZW, X);
+        DestroyMatrix(ZW);
+    }
+
+    DestroyMatrix(Z);
+    DestroyMatrix(S);
+    DestroyMatrix(W);
+    free(p);
+
+    return X;
+}
+
+/**
+ * @brief Solve (A + U*V^T)*X = B using the LU factorization of A
+ *
+ * The factors aren't changed, so this suits updates that are only needed
+ * for a few solves, or that are too large to apply one rank at a time.
+ *
+ * @param LU Output of LUFactor for A
+ * @param perm Row swaps from LUFactor
+ * @param U An nxk matrix
+ * @param V Another nxk matrix
+ * @param B Right-hand sides, one per column
+ * @returns The solution, or NULL if A + U*V^T is singular
+ */
+matrix* LUSolveWoodbury(matrix *LU, int *perm, matrix *U, matrix *V, matrix *B)
+{
+    return Woodbury(LU, perm, U, V, B);
+}
+
+/**
+ * @brief Solve (A + U*V^T)*X = B using the Cholesky factor of A
+ *
+ * A + U*V^T doesn't need to be symmetric.
+ *
+ * @param L Output of CholeskyFactor for A
+ * @param U An nxk matrix
+ * @param V Another nxk matrix
+ * @param B Right-hand sides, one per column
+ * @returns The solution, or NULL if A + U*V^T is singular
+ */
+matrix* CholeskySolveWoodbury(matrix *L, matrix *U, matrix *V, matrix *B)
+{
+    return Woodbury(L, NULL, U, V, B);
+}
+
@@ -6,38 +6,52 @@
 
 #include <string.h>
 
+#include "xstrtok.h"
+
 /**
  * Revised version of the strtok function.
  * This version returns "" if there are two deliminaters right next to each
  * other.
  * Code from: http://www.tek-tips.com/viewthread.cfm?qid=294161
  */
-char *xstrtok(line, delims)
-char *line, *delims;
+char *xstrtok(char *line, const char *delims)
 {
     static char *saveline = NULL;
+    return xstrtok_r(line, delims, &saveline);
+}
+
+/**
+ * Reentrant version of xstrtok. The position in the line is kept in *save
+ * instead of in a static variable, so different threads can split different
+ * lines at the same time.
+ * @param line The line to split, or NULL to continue with the last one
+ * @param delims Characters that separate tokens
+ * @param save Where to keep the position between calls
+ * @returns The next token, or NULL at the end of the line
+ */
+char *xstrtok_r(char *line, const char *delims, char **save)
+{
     char *p;
     int n;
 
     if(line != NULL)
-        saveline = line;
+        *save = line;
 
     /*
      *see if we have reached the end of the line
      */
-    if(saveline == NULL || *saveline == '\0')
+    if(*save == NULL || **save == '\0')
     return(NULL);
     /*
      *return the number of characters that aren't delims
      */
-    n = strcspn(saveline, delims);
-    p = saveline; /*save start of this token*/
+    n = strcspn(*save, delims);
+    p = *save; /*save start of this token*/
 
-    saveline += n; /*bump past the delim*/
+    *save += n; /*bump past the delim*/
 
-    if(*saveline != '\0') /*trash the delim if necessary*/
-        *saveline++ = '\0';
+    if(**save != '\0') /*trash the delim if necessary*/
+        *(*save)++ = '\0';
 
     return(p);
 }
-
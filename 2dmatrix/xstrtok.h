@@ -2,6 +2,7 @@
 #define XSTRTOK_H
 
 char* xstrtok(char*, const char*);
+char* xstrtok_r(char*, const char*, char**);
 
 #endif
 
@@ -1,8 +1,16 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <math.h>
 #include "bandmatrix.h"
 #include "matrix.h"
+#include "../repro/repro.h"
+#include "../instrument/instrument.h"
+
+///Number of matrix elements above which products are multithreaded
+#define PARALLELSIZE 1e5
+///Number of components of y each thread works on at a time in gemvTB
+#define GEMVBLOCK 2048
 
 bndmatrix* CreateBandMatrix(int rows, int bandwidth)
 {
@@ -26,10 +34,23 @@ void DestroyBandMatrix(bndmatrix *bm)
     if(bm) {
         for(i=0; i<bm->r; i++)
             free(bm->data[i]);
+        free(bm->data);
         free(bm);
     }
 }
 
+bndmatrix* CopyBandMatrix(bndmatrix *bm)
+{
+    int i;
+    bndmatrix *copy;
+
+    copy = CreateBandMatrix(bm->r, bm->w);
+    for(i=0; i<bm->r; i++)
+        memcpy(copy->data[i], bm->data[i], bm->w*sizeof(double));
+
+    return copy;
+}
+
 double valB(bndmatrix *bm, int row, int col)
 {
     int datacol;
@@ -117,3 +138,106 @@ void bandprnt(bndmatrix *bm)
         printf("]\n");
     }
 }
+
+/* Check the sizes of the operands of a band matrix-vector product */
+static int GemvSizeB(bndmatrix *A, vector *x, vector *y)
+{
+    if(len(x) != A->r || len(y) != A->r || x->v == y->v) {
+        fprintf(stderr, "Error: Incompatible matrix dimensions.\n");
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief Calculate y = alpha*A*x + beta*y for a band matrix
+ *
+ * Each component of y is a contiguous dot product of a row of the band with
+ * part of x, and long matricies are split between threads by row.
+ *
+ * @param alpha Multiplier for A*x
+ * @param A The band matrix
+ * @param x Vector with one component per row of A
+ * @param beta Multiplier for the original y. If it's zero, y is only written
+ *      to.
+ * @param y Vector to add the product to. Must not be x.
+ * @returns y, or NULL if the dimensions don't agree
+ */
+vector* gemvB(double alpha, bndmatrix *A, vector *x, double beta, vector *y)
+{
+    int n = A->r, w = A->w, p = A->w/2, i, k, k0, k1, repro = mtxreproducible();
+    double s;
+
+    if(!GemvSizeB(A, x, y))
+        return NULL;
+
+    PROF_BEGIN(MTXOP_GEMVB);
+    #pragma omp parallel for private(k, k0, k1, s) if((double) n*w > PARALLELSIZE) schedule(static)
+    for(i=0; i<n; i++) {
+        const double *a = A->data[i], *xi = x->v + i - p;
+        k0 = (i < p) ? p-i : 0;
+        k1 = (n-i+p < w) ? n-i+p : w;
+        s = 0;
+        if(repro) {
+            s = ReproDot(a + k0, 1, xi + k0, 1, k1-k0);
+        } else {
+            #pragma omp simd reduction(+:s)
+            for(k=k0; k<k1; k++)
+                s += a[k]*xi[k];
+        }
+        y->v[i] = (beta == 0) ? alpha*s : alpha*s + beta*y->v[i];
+    }
+    PROF_END(MTXOP_GEMVB, 2.0*n*w);
+
+    return y;
+}
+
+/**
+ * @brief Calculate y = alpha*A^T*x + beta*y for a band matrix
+ *
+ * Row i of the band adds x_i times itself to a stretch of y. Each thread takes
+ * a block of y and goes through the rows that touch it, so the updates stay
+ * contiguous without threads writing to the same place.
+ *
+ * @param alpha Multiplier for A^T*x
+ * @param A The band matrix
+ * @param x Vector with one component per row of A
+ * @param beta Multiplier for the original y. If it's zero, y is only written
+ *      to.
+ * @param y Vector to add the product to. Must not be x.
+ * @returns y, or NULL if the dimensions don't agree
+ */
+vector* gemvTB(double alpha, bndmatrix *A, vector *x, double beta, vector *y)
+{
+    int n = A->r, w = A->w, p = A->w/2, jb, jend, i, i0, i1, k, k0, k1;
+    double t;
+
+    if(!GemvSizeB(A, x, y))
+        return NULL;
+
+    PROF_BEGIN(MTXOP_GEMVB);
+    #pragma omp parallel for private(jend, i, i0, i1, k, k0, k1, t) if((double) n*w > PARALLELSIZE) schedule(static)
+    for(jb=0; jb<n; jb+=GEMVBLOCK) {
+        jend = (n-jb < GEMVBLOCK) ? n : jb+GEMVBLOCK;
+
+        for(i=jb; i<jend; i++)
+            y->v[i] = (beta == 0) ? 0 : beta*y->v[i];
+
+        /* Row i covers columns i-p to i-p+w-1 */
+        i0 = (jb-w+1+p > 0) ? jb-w+1+p : 0;
+        i1 = (jend+p < n) ? jend+p : n;
+        for(i=i0; i<i1; i++) {
+            const double *a = A->data[i];
+            double *yi = y->v + i - p;
+            k0 = (jb-i+p > 0) ? jb-i+p : 0;
+            k1 = (jend-i+p < w) ? jend-i+p : w;
+            t = alpha*x->v[i];
+            #pragma omp simd
+            for(k=k0; k<k1; k++)
+                yi[k] += a[k]*t;
+        }
+    }
+    PROF_END(MTXOP_GEMVB, 2.0*n*w);
+
+    return y;
+}
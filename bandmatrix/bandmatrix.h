@@ -3,6 +3,10 @@
 
 #include "matrix.h"
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 typedef struct {
     double **data; /* Raw data */
     int r; /* Rows */
@@ -11,9 +15,24 @@ typedef struct {
 
 bndmatrix* CreateBandMatrix(int, int);
 void DestroyBandMatrix(bndmatrix*);
+bndmatrix* CopyBandMatrix(bndmatrix*);
 double valB(bndmatrix*, int, int);
 double setvalB(bndmatrix*, double, int, int);
 bndmatrix* ConvertFromDenseMatrix(matrix*, int);
 void bandprnt(bndmatrix*);
 
+vector* gemvB(double, bndmatrix*, vector*, double, vector*);
+vector* gemvTB(double, bndmatrix*, vector*, double, vector*);
+
+int CholeskyFactorB(bndmatrix*);
+int LDLFactorB(bndmatrix*);
+void CholeskySolveB(bndmatrix*, matrix*);
+void LDLSolveB(bndmatrix*, matrix*);
+double CholeskyDeterminantB(bndmatrix*);
+double LDLDeterminantB(bndmatrix*);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif
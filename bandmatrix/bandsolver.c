@@ -0,0 +1,186 @@
+/**
+ * @file bandsolver.c
+ * Cholesky (LL^T) and LDL^T factorizations of symmetric positive definite band
+ * matricies.
+ *
+ * The factors have the same bandwidth as the original matrix, so they are
+ * stored in place of its lower half. Each row of the band is contiguous in
+ * memory, so every inner loop below is a contiguous dot product or update.
+ */
+
+#include <stdio.h>
+#include <math.h>
+
+#include "bandmatrix.h"
+
+/* Access the (I,J) element of band matrix M with half-bandwidth P, without
+ * bounds checking. J must lie within the band of row I. */
+#define BAND(M, P, I, J) (M)->data[(I)][(J) + (P) - (I)]
+
+/**
+ * @brief Row-oriented band factorization shared by LL^T and LDL^T
+ * @param A Band matrix to factor in place
+ * @param ldl Nonzero for LDL^T, zero for LL^T
+ * @returns 0 on success, or k if the leading minor of order k is not positive
+ *      definite (LL^T) or is singular (LDL^T)
+ */
+static int FactorBand(bndmatrix *A, int ldl)
+{
+    int n = A->r, p = A->w/2;
+    int i, j, k, k0;
+    double s;
+
+    for(i=0; i<n; i++) {
+        k0 = (i-p > 0) ? i-p : 0;
+        for(j=k0; j<=i; j++) {
+            s = BAND(A, p, i, j);
+            for(k=k0; k<j; k++)
+                s -= BAND(A, p, i, k)*BAND(A, p, j, k) * (ldl ? BAND(A, p, k, k) : 1);
+
+            if(j < i) {
+                BAND(A, p, i, j) = s/BAND(A, p, j, j);
+            } else if(ldl) {
+                if(s == 0 || !isfinite(s))
+                    return i+1;
+                BAND(A, p, i, i) = s;
+            } else {
+                if(s <= 0 || !isfinite(s))
+                    return i+1;
+                BAND(A, p, i, i) = sqrt(s);
+            }
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Factor a symmetric positive definite band matrix as L*L^T in place.
+ * @param A Band matrix. Only the lower half of the band is used, and it is
+ *      replaced with L.
+ * @returns 0 on success, or k if the leading minor of order k is not positive
+ *      definite.
+ */
+int CholeskyFactorB(bndmatrix *A)
+{
+    return FactorBand(A, 0);
+}
+
+/**
+ * @brief Factor a symmetric band matrix as L*D*L^T in place, without pivoting.
+ * @param A Band matrix. Only the lower half of the band is used. On return, it
+ *      holds the unit lower triangular L below the diagonal and D on it.
+ * @returns 0 on success, or k if the k-th pivot is zero.
+ */
+int LDLFactorB(bndmatrix *A)
+{
+    return FactorBand(A, 1);
+}
+
+/**
+ * @brief Forward and back substitution with a factored band matrix
+ * @param L Factored band matrix
+ * @param B Right-hand sides, one per column. Overwritten with the solution.
+ * @param ldl Nonzero if L came from LDLFactorB
+ */
+static void SolveBand(bndmatrix *L, matrix *B, int ldl)
+{
+    int n = L->r, p = L->w/2, m = nCols(B);
+    int i, j, k, k0, layout = B->layout;
+    double **b;
+    double t;
+
+    if(nRows(B) != n) {
+        fprintf(stderr, "Incompatible matrix dimensions.\n");
+        return;
+    }
+    mtxsetlayout(B, MTX_ROWMAJOR);
+    UnshareMatrix(B);
+    b = B->array;
+
+    for(i=0; i<n; i++) {
+        k0 = (i-p > 0) ? i-p : 0;
+        for(k=k0; k<i; k++) {
+            t = BAND(L, p, i, k);
+            for(j=0; j<m; j++)
+                b[i][j] -= t*b[k][j];
+        }
+        if(!ldl) {
+            t = BAND(L, p, i, i);
+            for(j=0; j<m; j++)
+                b[i][j] /= t;
+        }
+    }
+
+    if(ldl) {
+        for(i=0; i<n; i++) {
+            t = BAND(L, p, i, i);
+            for(j=0; j<m; j++)
+                b[i][j] /= t;
+        }
+    }
+
+    for(i=n-1; i>=0; i--) {
+        if(!ldl) {
+            t = BAND(L, p, i, i);
+            for(j=0; j<m; j++)
+                b[i][j] /= t;
+        }
+        k0 = (i-p > 0) ? i-p : 0;
+        for(k=k0; k<i; k++) {
+            t = BAND(L, p, i, k);
+            for(j=0; j<m; j++)
+                b[k][j] -= t*b[i][j];
+        }
+    }
+    mtxsetlayout(B, layout);
+}
+
+/**
+ * @brief Solve A*X = B in place using the output of CholeskyFactorB.
+ * @param L Cholesky factor of A
+ * @param B Matrix of right-hand sides. Overwritten with X.
+ */
+void CholeskySolveB(bndmatrix *L, matrix *B)
+{
+    SolveBand(L, B, 0);
+}
+
+/**
+ * @brief Solve A*X = B in place using the output of LDLFactorB.
+ * @param LD LDL^T factorization of A
+ * @param B Matrix of right-hand sides. Overwritten with X.
+ */
+void LDLSolveB(bndmatrix *LD, matrix *B)
+{
+    SolveBand(LD, B, 1);
+}
+
+/**
+ * @brief Calculate the determinant of A from its band Cholesky factor.
+ * @param L Output of CholeskyFactorB
+ * @returns det(A)
+ */
+double CholeskyDeterminantB(bndmatrix *L)
+{
+    int i;
+    double det = 1;
+    for(i=0; i<L->r; i++)
+        det *= BAND(L, L->w/2, i, i);
+    return det*det;
+}
+
+/**
+ * @brief Calculate the determinant of A from its band LDL^T factorization.
+ * @param LD Output of LDLFactorB
+ * @returns det(A)
+ */
+double LDLDeterminantB(bndmatrix *LD)
+{
+    int i;
+    double det = 1;
+    for(i=0; i<LD->r; i++)
+        det *= BAND(LD, LD->w/2, i, i);
+    return det;
+}
+
@@ -0,0 +1,434 @@
+/**
+ * @file batch.c
+ * Solve, invert, and multiply large batches of small matricies.
+ *
+ * The matricies in a batch are interleaved in groups of BATCHLANES, so every
+ * operation here works on a whole group at once with the innermost loop
+ * running across the group. That loop is contiguous and free of dependencies,
+ * so it vectorizes, and the groups themselves are split between threads. No
+ * memory is allocated per matrix.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "batch.h"
+
+/* Index of element (I, J) of the group starting at G for an R x C batch */
+#define BIDX(G, C, I, J) ((G) + ((I)*(C) + (J))*BATCHLANES)
+
+/**
+ * @brief Create a batch of matricies
+ *
+ * Every matrix in the batch is initialized to zero. The unused slots at the
+ * end of the last group are set to the identity (when square), so that they
+ * never produce spurious failures.
+ *
+ * @param count Number of matricies
+ * @param rows Number of rows in each matrix
+ * @param cols Number of columns in each matrix
+ * @returns The new batch, or NULL on error
+ */
+mtxbatch* CreateMatrixBatch(int count, int rows, int cols)
+{
+    mtxbatch *b;
+    int ngroups, k, i;
+
+    if(count < 1 || rows < 1 || cols < 1 ||
+       rows > BATCHMAXDIM || cols > BATCHMAXDIM) {
+        fprintf(stderr, "CreateMatrixBatch(): Invalid dimensions %d x %dx%d.\n",
+                count, rows, cols);
+        return NULL;
+    }
+
+    ngroups = (count + BATCHLANES-1)/BATCHLANES;
+
+    b = (mtxbatch*) calloc(1, sizeof(mtxbatch));
+    b->data = (double*) calloc((size_t) ngroups*rows*cols*BATCHLANES,
+                               sizeof(double));
+    if(!b->data) {
+        fprintf(stderr, "Failed to allocate a batch of %d %dx%d matricies.\n",
+                count, rows, cols);
+        free(b);
+        return NULL;
+    }
+    b->count = count;
+    b->rows = rows;
+    b->cols = cols;
+
+    if(rows == cols)
+        for(k=count; k<ngroups*BATCHLANES; k++)
+            for(i=0; i<rows; i++)
+                setvalBatch(b, k, 1, i, i);
+
+    return b;
+}
+
+/**
+ * @brief Free a batch of matricies
+ * @param b The batch to destroy
+ */
+void DestroyMatrixBatch(mtxbatch *b)
+{
+    if(b) {
+        free(b->data);
+        free(b);
+    }
+}
+
+/**
+ * @brief Get the value of an element of one matrix in a batch
+ * @param b The batch
+ * @param k Index of the matrix in the batch
+ * @param row Row of the element
+ * @param col Column of the element
+ * @returns The value of the element, or NaN if the indicies are out of bounds
+ */
+double valBatch(mtxbatch *b, int k, int row, int col)
+{
+    int g;
+    if(row < 0 || col < 0 || row >= b->rows || col >= b->cols ||
+       k < 0 || k >= b->count) {
+        fprintf(stderr, "Error: index out of bounds. (%d, %d, %d)\n", k, row, col);
+        return NAN;
+    }
+    g = (k/BATCHLANES)*b->rows*b->cols*BATCHLANES;
+    return b->data[BIDX(g, b->cols, row, col) + k%BATCHLANES];
+}
+
+/**
+ * @brief Set the value of an element of one matrix in a batch
+ * @param b The batch
+ * @param k Index of the matrix in the batch. Padding slots past the end of the
+ *      batch may also be set.
+ * @param value The value to set
+ * @param row Row of the element
+ * @param col Column of the element
+ */
+void setvalBatch(mtxbatch *b, int k, double value, int row, int col)
+{
+    int g;
+    if(row < 0 || col < 0 || row >= b->rows || col >= b->cols || k < 0 ||
+       k >= ((b->count + BATCHLANES-1)/BATCHLANES)*BATCHLANES)
+        return;
+    g = (k/BATCHLANES)*b->rows*b->cols*BATCHLANES;
+    b->data[BIDX(g, b->cols, row, col) + k%BATCHLANES] = value;
+}
+
+/**
+ * @brief Copy a matrix into a batch
+ * @param b The batch
+ * @param k Index of the matrix in the batch to overwrite
+ * @param A Matrix of the same size as those in the batch
+ */
+void BatchSetMatrix(mtxbatch *b, int k, matrix *A)
+{
+    int i, j;
+    if(nRows(A) != b->rows || nCols(A) != b->cols) {
+        fprintf(stderr, "Error: Incompatible matrix dimensions.\n");
+        return;
+    }
+    for(i=0; i<b->rows; i++)
+        for(j=0; j<b->cols; j++)
+            setvalBatch(b, k, val(A, i, j), i, j);
+}
+
+/**
+ * @brief Copy one matrix out of a batch
+ * @param b The batch
+ * @param k Index of the matrix to copy
+ * @returns A new matrix
+ */
+matrix* BatchGetMatrix(mtxbatch *b, int k)
+{
+    int i, j;
+    matrix *A;
+    A = CreateMatrix(b->rows, b->cols);
+    for(i=0; i<b->rows; i++)
+        for(j=0; j<b->cols; j++)
+            A->array[i][j] = valBatch(b, k, i, j);
+    return A;
+}
+
+/**
+ * @brief Gaussian elimination with partial pivoting on one group of matricies
+ *
+ * Each lane picks its own pivot, so row swaps are done lane by lane. The
+ * elimination itself runs across all lanes at once.
+ *
+ * @param a n x n group of matricies. Overwritten with U, and the multipliers
+ *      of L below the diagonal.
+ * @param b n x m group of right-hand sides, or NULL. The same row operations
+ *      are applied to it.
+ * @param n Size of the matricies
+ * @param m Number of columns in b
+ * @param sign If not NULL, set to the sign of the row permutation of each lane
+ * @returns Bit mask of the lanes that turned out to be singular
+ */
+static int EliminateGroup(double *a, double *b, int n, int m, double *sign)
+{
+    int i, j, k, l, p;
+    int singular = 0;
+    double f[BATCHLANES], piv[BATCHLANES], t;
+
+    if(sign)
+        for(l=0; l<BATCHLANES; l++)
+            sign[l] = 1;
+
+    for(k=0; k<n; k++) {
+        /* Pivot each lane independently */
+        for(l=0; l<BATCHLANES; l++) {
+            p = k;
+            for(i=k+1; i<n; i++)
+                if(fabs(a[BIDX(0, n, i, k)+l]) > fabs(a[BIDX(0, n, p, k)+l]))
+                    p = i;
+            if(p != k) {
+                for(j=0; j<n; j++) {
+                    t = a[BIDX(0, n, k, j)+l];
+                    a[BIDX(0, n, k, j)+l] = a[BIDX(0, n, p, j)+l];
+                    a[BIDX(0, n, p, j)+l] = t;
+                }
+                if(b) {
+                    for(j=0; j<m; j++) {
+                        t = b[BIDX(0, m, k, j)+l];
+                        b[BIDX(0, m, k, j)+l] = b[BIDX(0, m, p, j)+l];
+                        b[BIDX(0, m, p, j)+l] = t;
+                    }
+                }
+                if(sign)
+                    sign[l] = -sign[l];
+            }
+            piv[l] = a[BIDX(0, n, k, k)+l];
+            if(piv[l] == 0)
+                singular |= 1 << l;
+        }
+
+        for(i=k+1; i<n; i++) {
+            /* Lanes with a zero pivot are left alone, so that a singular
+             * matrix doesn't fill its lane with infinities and NaNs */
+            #pragma omp simd
+            for(l=0; l<BATCHLANES; l++) {
+                f[l] = (piv[l] != 0) ? a[BIDX(0, n, i, k)+l]/piv[l] : 0;
+                a[BIDX(0, n, i, k)+l] = f[l];
+            }
+            for(j=k+1; j<n; j++) {
+                #pragma omp simd
+                for(l=0; l<BATCHLANES; l++)
+                    a[BIDX(0, n, i, j)+l] -= f[l]*a[BIDX(0, n, k, j)+l];
+            }
+            if(b) {
+                for(j=0; j<m; j++) {
+                    #pragma omp simd
+                    for(l=0; l<BATCHLANES; l++)
+                        b[BIDX(0, m, i, j)+l] -= f[l]*b[BIDX(0, m, k, j)+l];
+                }
+            }
+        }
+    }
+
+    return singular;
+}
+
+/**
+ * @brief Back substitution on one group, after EliminateGroup
+ */
+static void BackSubstituteGroup(double *a, double *b, int n, int m)
+{
+    int i, j, k, l;
+    double d[BATCHLANES];
+
+    for(i=n-1; i>=0; i--) {
+        for(k=i+1; k<n; k++) {
+            for(j=0; j<m; j++) {
+                #pragma omp simd
+                for(l=0; l<BATCHLANES; l++)
+                    b[BIDX(0, m, i, j)+l] -= a[BIDX(0, n, i, k)+l]*b[BIDX(0, m, k, j)+l];
+            }
+        }
+        #pragma omp simd
+        for(l=0; l<BATCHLANES; l++)
+            d[l] = 1/a[BIDX(0, n, i, i)+l];
+        for(j=0; j<m; j++) {
+            #pragma omp simd
+            for(l=0; l<BATCHLANES; l++)
+                b[BIDX(0, m, i, j)+l] *= d[l];
+        }
+    }
+}
+
+/**
+ * @brief Bit mask of the lanes of group g that hold matricies in the batch,
+ * rather than padding
+ */
+static int LaneMask(mtxbatch *b, int g)
+{
+    int nvalid = b->count - g*BATCHLANES;
+    return (nvalid >= BATCHLANES) ? (1 << BATCHLANES) - 1 : (1 << nvalid) - 1;
+}
+
+static int popcount(int x)
+{
+    int n = 0;
+    for(; x; x >>= 1)
+        n += x & 1;
+    return n;
+}
+
+/**
+ * @brief Solve A_k*X_k = B_k for every matrix in a batch.
+ *
+ * This is the batched equivalent of SolveMatrixEquation, using Gaussian
+ * elimination with partial pivoting.
+ *
+ * @param A Batch of square matricies. Overwritten with their LU factors.
+ * @param B Batch of right-hand sides, each with as many rows as the matricies
+ *      in A and any number of columns. Overwritten with the solutions.
+ * @returns The number of singular matricies in the batch, or -1 if the
+ *      dimensions do not agree. Solutions for singular matricies are not
+ *      meaningful.
+ */
+int BatchLUSolve(mtxbatch *A, mtxbatch *B)
+{
+    int n = A->rows, m = B->cols;
+    int ngroups, g, nsingular = 0;
+
+    if(A->rows != A->cols || B->rows != n || B->count != A->count) {
+        fprintf(stderr, "BatchLUSolve(): Incompatible batch dimensions.\n");
+        return -1;
+    }
+
+    ngroups = (A->count + BATCHLANES-1)/BATCHLANES;
+
+    #pragma omp parallel for reduction(+:nsingular) schedule(static)
+    for(g=0; g<ngroups; g++) {
+        double *a = A->data + (size_t) g*n*n*BATCHLANES;
+        double *b = B->data + (size_t) g*n*m*BATCHLANES;
+        nsingular += popcount(EliminateGroup(a, b, n, m, NULL) & LaneMask(A, g));
+        BackSubstituteGroup(a, b, n, m);
+    }
+
+    return nsingular;
+}
+
+/**
+ * @brief Invert every matrix in a batch.
+ * @param A Batch of square matricies. Left unchanged.
+ * @param Ainv Batch of the same size to store the inverses in
+ * @returns The number of singular matricies in the batch, or -1 if the
+ *      dimensions do not agree.
+ */
+int BatchInverse(mtxbatch *A, mtxbatch *Ainv)
+{
+    int n = A->rows;
+    int ngroups, g, nsingular = 0;
+
+    if(A->rows != A->cols || Ainv->rows != n || Ainv->cols != n ||
+       Ainv->count != A->count) {
+        fprintf(stderr, "BatchInverse(): Incompatible batch dimensions.\n");
+        return -1;
+    }
+
+    ngroups = (A->count + BATCHLANES-1)/BATCHLANES;
+
+    #pragma omp parallel for reduction(+:nsingular) schedule(static)
+    for(g=0; g<ngroups; g++) {
+        double a[BATCHMAXDIM*BATCHMAXDIM*BATCHLANES];
+        double *b = Ainv->data + (size_t) g*n*n*BATCHLANES;
+        int i, l;
+
+        memcpy(a, A->data + (size_t) g*n*n*BATCHLANES,
+               n*n*BATCHLANES*sizeof(double));
+        memset(b, 0, n*n*BATCHLANES*sizeof(double));
+        for(i=0; i<n; i++)
+            for(l=0; l<BATCHLANES; l++)
+                b[BIDX(0, n, i, i)+l] = 1;
+
+        nsingular += popcount(EliminateGroup(a, b, n, n, NULL) & LaneMask(A, g));
+        BackSubstituteGroup(a, b, n, n);
+    }
+
+    return nsingular;
+}
+
+/**
+ * @brief Calculate the determinant of every matrix in a batch.
+ * @param A Batch of square matricies. Left unchanged.
+ * @param det Array of at least A->count doubles to store the determinants in
+ */
+void BatchDeterminant(mtxbatch *A, double *det)
+{
+    int n = A->rows;
+    int ngroups, g;
+
+    if(A->rows != A->cols) {
+        fprintf(stderr, "BatchDeterminant(): Matricies must be square.\n");
+        return;
+    }
+
+    ngroups = (A->count + BATCHLANES-1)/BATCHLANES;
+
+    #pragma omp parallel for schedule(static)
+    for(g=0; g<ngroups; g++) {
+        double a[BATCHMAXDIM*BATCHMAXDIM*BATCHLANES];
+        double d[BATCHLANES];
+        int i, l;
+
+        memcpy(a, A->data + (size_t) g*n*n*BATCHLANES,
+               n*n*BATCHLANES*sizeof(double));
+        EliminateGroup(a, NULL, n, 0, d);
+        for(i=0; i<n; i++) {
+            #pragma omp simd
+            for(l=0; l<BATCHLANES; l++)
+                d[l] *= a[BIDX(0, n, i, i)+l];
+        }
+        for(l=0; l<BATCHLANES && g*BATCHLANES+l < A->count; l++)
+            det[g*BATCHLANES+l] = d[l];
+    }
+}
+
+/**
+ * @brief Calculate C_k = A_k*B_k for every matrix in a batch.
+ * @param A Batch of matricies
+ * @param B Batch with as many matricies as A, whose row count equals the
+ *      column count of those in A
+ * @param C Batch to store the products in
+ */
+void BatchMultiply(mtxbatch *A, mtxbatch *B, mtxbatch *C)
+{
+    int r = A->rows, p = A->cols, c = B->cols;
+    int ngroups, g;
+
+    if(B->rows != p || C->rows != r || C->cols != c ||
+       B->count != A->count || C->count != A->count) {
+        fprintf(stderr, "BatchMultiply(): Incompatible batch dimensions.\n");
+        return;
+    }
+
+    ngroups = (A->count + BATCHLANES-1)/BATCHLANES;
+
+    #pragma omp parallel for schedule(static)
+    for(g=0; g<ngroups; g++) {
+        double *a = A->data + (size_t) g*r*p*BATCHLANES;
+        double *b = B->data + (size_t) g*p*c*BATCHLANES;
+        double *x = C->data + (size_t) g*r*c*BATCHLANES;
+        double s[BATCHLANES];
+        int i, j, k, l;
+
+        for(i=0; i<r; i++) {
+            for(j=0; j<c; j++) {
+                for(l=0; l<BATCHLANES; l++)
+                    s[l] = 0;
+                for(k=0; k<p; k++) {
+                    #pragma omp simd
+                    for(l=0; l<BATCHLANES; l++)
+                        s[l] += a[BIDX(0, p, i, k)+l]*b[BIDX(0, c, k, j)+l];
+                }
+                for(l=0; l<BATCHLANES; l++)
+                    x[BIDX(0, c, i, j)+l] = s[l];
+            }
+        }
+    }
+}
+
@@ -0,0 +1,59 @@
+/**
+ * @file batch.h
+ * Batches of small matricies of the same size, stored interleaved so that the
+ * same element of consecutive matricies is contiguous in memory.
+ */
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "2dmatrix/2dmatrix.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+///Number of matricies interleaved together. Should be a multiple of the SIMD
+///width in doubles.
+#define BATCHLANES 8
+///Largest number of rows or columns allowed for the matricies in a batch
+#define BATCHMAXDIM 16
+
+/**
+ * @struct mtxbatch
+ * @brief A batch of equally sized matricies
+ * @var mtxbatch::data
+ * Raw data. Element (i, j) of matrix k is stored at
+ * data[((k/BATCHLANES)*rows*cols + i*cols + j)*BATCHLANES + k%BATCHLANES]
+ * @var mtxbatch::count
+ * Number of matricies in the batch
+ * @var mtxbatch::rows
+ * Number of rows in each matrix
+ * @var mtxbatch::cols
+ * Number of columns in each matrix
+ */
+typedef struct {
+    double *data;
+    int count;
+    int rows;
+    int cols;
+} mtxbatch;
+
+mtxbatch* CreateMatrixBatch(int, int, int);
+void DestroyMatrixBatch(mtxbatch*);
+double valBatch(mtxbatch*, int, int, int);
+void setvalBatch(mtxbatch*, int, double, int, int);
+void BatchSetMatrix(mtxbatch*, int, matrix*);
+matrix* BatchGetMatrix(mtxbatch*, int);
+
+int BatchLUSolve(mtxbatch*, mtxbatch*);
+int BatchInverse(mtxbatch*, mtxbatch*);
+void BatchDeterminant(mtxbatch*, double*);
+void BatchMultiply(mtxbatch*, mtxbatch*, mtxbatch*);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
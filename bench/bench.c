@@ -0,0 +1,624 @@
+/**
+ * @file bench.c
+ * Benchmark harness for the hot paths of the matrix library.
+ *
+ * Each benchmark is run over a sweep of problem sizes and reports the time per
+ * call, the achieved floating point and memory throughput, the number of heap
+ * allocations made per call, and the peak resident set size of the process.
+ * Results can be written out as CSV or JSON, and a previously saved CSV file
+ * can be used as a baseline to check for regressions.
+ *
+ * Allocations are counted by wrapping malloc, calloc and realloc at link time
+ * (see the "bench" target in the Makefile), so the library itself does not
+ * need to be rebuilt to be measured.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include "matrix.h"
+
+///Maximum number of results held in memory (and read from a baseline file)
+#define MAXRESULTS 512
+///Number of timed repetitions per benchmark. The median is reported.
+#define NREPS 5
+
+/* Allocation counters fed by the wrapped allocator functions below. */
+static unsigned long nallocs = 0;
+static unsigned long nbytes = 0;
+
+void* __real_malloc(size_t);
+void* __real_calloc(size_t, size_t);
+void* __real_realloc(void*, size_t);
+
+void* __wrap_malloc(size_t size)
+{
+    nallocs++;
+    nbytes += size;
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t n, size_t size)
+{
+    nallocs++;
+    nbytes += n*size;
+    return __real_calloc(n, size);
+}
+
+void* __wrap_realloc(void *ptr, size_t size)
+{
+    nallocs++;
+    nbytes += size;
+    return __real_realloc(ptr, size);
+}
+
+/**
+ * @struct benchctx
+ * @brief Data shared between the setup, run and teardown steps of a benchmark
+ */
+typedef struct {
+    int n; /* Problem size */
+    matrix *A, *B;
+    vector *x, *y;
+    mtxbatch *P, *Q, *R;
+    double *work;
+    char file[256]; /* Scratch file for the I/O benchmarks */
+} benchctx;
+
+/**
+ * @struct benchmark
+ * @brief Description of one benchmarked operation
+ */
+typedef struct {
+    const char *name;
+    const int *sizes; /* Zero-terminated list of problem sizes */
+    const int *quicksizes; /* Reduced sweep used with -q */
+    void (*setup)(benchctx*);
+    void (*run)(benchctx*);
+    void (*teardown)(benchctx*);
+    double (*flops)(int); /* Floating point operations per call */
+    double (*bytes)(int); /* Bytes of memory traffic per call */
+} benchmark;
+
+/**
+ * @struct benchresult
+ * @brief Measurements for a single benchmark at a single problem size
+ */
+typedef struct {
+    char name[64];
+    int n;
+    long iters;
+    double nsop;
+    double gflops;
+    double gbs;
+    double allocs;
+    double allocbytes;
+    long peakrss; /* kB */
+} benchresult;
+
+/**
+ * @brief Fill a matrix with pseudo-random values between -1 and 1
+ * @param A The matrix to fill
+ * @param diag Value added to each diagonal element. A large value makes the
+ *      matrix diagonally dominant, and therefore safe to solve.
+ */
+static void randfill(matrix *A, double diag)
+{
+    int i, j;
+    for(i=0; i<nRows(A); i++)
+        for(j=0; j<nCols(A); j++)
+            setval(A, 2.0*rand()/RAND_MAX - 1 + ((i==j) ? diag : 0), i, j);
+}
+
+static vector* randvector(int n)
+{
+    vector *v;
+    int i;
+    v = CreateVector(n);
+    for(i=0; i<n; i++)
+        setvalV(v, i, 2.0*rand()/RAND_MAX - 1);
+    return v;
+}
+
+static void scratchfile(benchctx *c)
+{
+    const char *dir = getenv("TMPDIR");
+    snprintf(c->file, sizeof(c->file), "%s/matrixbench-%d.csv",
+             dir ? dir : "/tmp", (int) getpid());
+}
+
+/* Setup and teardown functions */
+
+static void setup_square(benchctx *c)
+{
+    c->A = CreateMatrix(c->n, c->n);
+    c->B = CreateMatrix(c->n, c->n);
+    randfill(c->A, 0);
+    randfill(c->B, 0);
+}
+
+/* B is column-major, so each element of A*B is a contiguous dot product */
+static void setup_dotform(benchctx *c)
+{
+    c->A = CreateMatrix(c->n, c->n);
+    c->B = CreateMatrixLayout(c->n, c->n, MTX_COLMAJOR);
+    randfill(c->A, 0);
+    randfill(c->B, 0);
+}
+
+static void setup_gemv(benchctx *c)
+{
+    c->A = CreateMatrix(c->n, c->n);
+    randfill(c->A, 0);
+    c->x = randvector(c->n);
+    c->y = randvector(c->n);
+}
+
+static void setup_system(benchctx *c)
+{
+    c->A = CreateMatrix(c->n, c->n);
+    c->B = CreateMatrix(c->n, 1);
+    randfill(c->A, c->n);
+    randfill(c->B, 0);
+}
+
+static void setup_tall(benchctx *c)
+{
+    c->A = CreateMatrix(c->n, 20);
+    c->B = CreateMatrix(c->n, 1);
+    randfill(c->A, 0);
+    randfill(c->B, 0);
+}
+
+static void setup_batch(benchctx *c)
+{
+    int k, i, j;
+    /* A batch of n diagonally dominant 4x4 matricies */
+    c->P = CreateMatrixBatch(c->n, 4, 4);
+    c->Q = CreateMatrixBatch(c->n, 4, 4);
+    c->R = CreateMatrixBatch(c->n, 4, 4);
+    c->work = (double*) malloc(c->n*sizeof(double));
+    for(k=0; k<c->n; k++)
+        for(i=0; i<4; i++)
+            for(j=0; j<4; j++)
+                setvalBatch(c->P, k, 2.0*rand()/RAND_MAX - 1 + ((i==j) ? 4 : 0), i, j);
+}
+
+static void setup_vectors(benchctx *c)
+{
+    c->x = randvector(c->n);
+    c->y = randvector(c->n);
+}
+
+static void setup_write(benchctx *c)
+{
+    /* Six columns keeps each line of the file under LINELENGTH characters */
+    c->A = CreateMatrix(c->n, 6);
+    randfill(c->A, 0);
+    scratchfile(c);
+}
+
+static void setup_read(benchctx *c)
+{
+    setup_write(c);
+    mtxprntfile(c->A, c->file);
+}
+
+static void teardown(benchctx *c)
+{
+    if(c->A)
+        DestroyMatrix(c->A);
+    if(c->B)
+        DestroyMatrix(c->B);
+    if(c->x)
+        DestroyVector(c->x);
+    if(c->y)
+        DestroyVector(c->y);
+    if(c->P)
+        DestroyMatrixBatch(c->P);
+    if(c->Q)
+        DestroyMatrixBatch(c->Q);
+    if(c->R)
+        DestroyMatrixBatch(c->R);
+    free(c->work);
+    if(c->file[0])
+        remove(c->file);
+    memset(c, 0, sizeof(benchctx));
+}
+
+/* Benchmarked operations */
+
+static void run_mtxmul(benchctx *c) { DestroyMatrix(mtxmul(c->A, c->B)); }
+static void run_gemv(benchctx *c) { mtxgemv(1, c->A, c->x, 0, c->y); }
+static void run_mtxtrn(benchctx *c) { DestroyMatrix(mtxtrn(c->A)); }
+static void run_mtxadd(benchctx *c) { DestroyMatrix(mtxadd(c->A, c->B)); }
+static void run_copy(benchctx *c) { DestroyMatrix(CopyMatrix(c->A)); }
+static void run_solve(benchctx *c) { DestroyMatrix(SolveMatrixEquation(c->A, c->B)); }
+static void run_spd(benchctx *c) { DestroyMatrix(SolveSPDEquation(c->A, c->B)); }
+static void run_lsq(benchctx *c) { DestroyMatrix(SolveLeastSquares(c->A, c->B)); }
+static void run_inv(benchctx *c) { DestroyMatrix(CalcInv(c->A)); }
+static void run_det(benchctx *c) { CalcDeterminant(c->A); }
+static void run_loadcsv(benchctx *c) { DestroyMatrix(mtxloadcsv(c->file, 0)); }
+static void run_prntfile(benchctx *c) { mtxprntfile(c->A, c->file); }
+static void run_addV(benchctx *c) { DestroyVector(addV(c->x, c->y)); }
+
+static void run_batchinv(benchctx *c) { BatchInverse(c->P, c->Q); }
+static void run_batchdet(benchctx *c) { BatchDeterminant(c->P, c->work); }
+static void run_batchmul(benchctx *c) { BatchMultiply(c->P, c->P, c->R); }
+
+static volatile double sink;
+static void run_dotV(benchctx *c) { sink = dotV(c->x, c->y); }
+
+/* The same operations in reproducible mode, to measure what it costs */
+static void run_mtxmul_repro(benchctx *c)
+{
+    mtxsetreproducible(1);
+    DestroyMatrix(mtxmul(c->A, c->B));
+    mtxsetreproducible(0);
+}
+
+static void run_gemv_repro(benchctx *c)
+{
+    mtxsetreproducible(1);
+    mtxgemv(1, c->A, c->x, 0, c->y);
+    mtxsetreproducible(0);
+}
+
+static void run_dotV_repro(benchctx *c)
+{
+    mtxsetreproducible(1);
+    sink = dotV(c->x, c->y);
+    mtxsetreproducible(0);
+}
+
+/* Cost models. Byte counts cover the compulsory traffic for the operands and
+ * the result, so GB/s is the effective rather than the hardware bandwidth. */
+
+static double fact(int n) { return (n <= 1) ? 1 : n*fact(n-1); }
+static double sq(int n) { return (double) n*n; }
+
+static double flops_mtxmul(int n) { return 2.0*n*n*n; }
+static double bytes_mtxmul(int n) { return 3*sq(n)*sizeof(double); }
+static double flops_gemv(int n) { return 2*sq(n); }
+static double bytes_gemv(int n) { return (sq(n)+2*n)*sizeof(double); }
+static double bytes_unary(int n) { return 2*sq(n)*sizeof(double); }
+static double flops_binary(int n) { return sq(n); }
+static double bytes_binary(int n) { return 3*sq(n)*sizeof(double); }
+static double flops_solve(int n) { return 2.0/3.0*n*n*n + 2*sq(n); }
+static double bytes_solve(int n) { return (sq(n)+2*n)*sizeof(double); }
+static double flops_spd(int n) { return 1.0/3.0*n*n*n + 2*sq(n); }
+static double flops_lsq(int n) { return 2.0*n*20*21; }
+static double bytes_lsq(int n) { return 21.0*n*sizeof(double); }
+static double flops_det(int n) { return 2*fact(n); }
+static double flops_inv(int n) { return sq(n)*flops_det(n-1) + flops_det(n); }
+static double bytes_inv(int n) { return 2*sq(n)*sizeof(double); }
+static double bytes_csv(int n) { return 6.0*n*(sizeof(double) + 13); }
+static double flops_dotV(int n) { return 2.0*n; }
+static double bytes_dotV(int n) { return 2.0*n*sizeof(double); }
+static double flops_addV(int n) { return n; }
+static double bytes_addV(int n) { return 3.0*n*sizeof(double); }
+static double flops_batchinv(int n) { return n*(4.0/3.0*64 + 2*64); }
+static double flops_batchdet(int n) { return n*(2.0/3.0*64); }
+static double flops_batchmul(int n) { return n*2.0*64; }
+static double bytes_batch2(int n) { return 2.0*n*16*sizeof(double); }
+static double bytes_batch3(int n) { return 3.0*n*16*sizeof(double); }
+static double none(int n) { return 0; }
+
+static const int sz_dense[] = {16, 32, 64, 128, 256, 512, 0};
+static const int qsz_dense[] = {16, 64, 0};
+static const int sz_cubic[] = {16, 32, 64, 128, 256, 0};
+static const int qsz_cubic[] = {16, 64, 0};
+static const int sz_tall[] = {1000, 10000, 100000, 1000000, 0};
+static const int qsz_tall[] = {1000, 100000, 0};
+static const int sz_fact[] = {2, 3, 4, 5, 6, 7, 0};
+static const int qsz_fact[] = {3, 5, 0};
+static const int sz_batch[] = {64, 1024, 16384, 262144, 0};
+static const int qsz_batch[] = {64, 16384, 0};
+static const int sz_io[] = {100, 1000, 10000, 100000, 0};
+static const int qsz_io[] = {100, 1000, 0};
+static const int sz_vec[] = {1000, 10000, 100000, 1000000, 10000000, 0};
+static const int qsz_vec[] = {1000, 100000, 0};
+
+static const benchmark benchmarks[] = {
+    {"mtxmul", sz_cubic, qsz_cubic, setup_square, run_mtxmul, teardown, flops_mtxmul, bytes_mtxmul},
+    {"mtxmul-colmajorB", sz_cubic, qsz_cubic, setup_dotform, run_mtxmul, teardown, flops_mtxmul, bytes_mtxmul},
+    {"mtxmul-colmajorB-repro", sz_cubic, qsz_cubic, setup_dotform, run_mtxmul_repro, teardown, flops_mtxmul, bytes_mtxmul},
+    {"mtxgemv", sz_dense, qsz_dense, setup_gemv, run_gemv, teardown, flops_gemv, bytes_gemv},
+    {"mtxgemv-repro", sz_dense, qsz_dense, setup_gemv, run_gemv_repro, teardown, flops_gemv, bytes_gemv},
+    {"mtxtrn", sz_dense, qsz_dense, setup_square, run_mtxtrn, teardown, none, bytes_unary},
+    {"mtxadd", sz_dense, qsz_dense, setup_square, run_mtxadd, teardown, flops_binary, bytes_binary},
+    {"CopyMatrix", sz_dense, qsz_dense, setup_square, run_copy, teardown, none, bytes_unary},
+    {"SolveMatrixEquation", sz_cubic, qsz_cubic, setup_system, run_solve, teardown, flops_solve, bytes_solve},
+    {"SolveSPDEquation", sz_cubic, qsz_cubic, setup_system, run_spd, teardown, flops_spd, bytes_solve},
+    {"SolveLeastSquares", sz_tall, qsz_tall, setup_tall, run_lsq, teardown, flops_lsq, bytes_lsq},
+    {"CalcDeterminant", sz_fact, qsz_fact, setup_square, run_det, teardown, flops_det, bytes_unary},
+    {"CalcInv", sz_fact, qsz_fact, setup_square, run_inv, teardown, flops_inv, bytes_inv},
+    {"BatchInverse4x4", sz_batch, qsz_batch, setup_batch, run_batchinv, teardown, flops_batchinv, bytes_batch2},
+    {"BatchDeterminant4x4", sz_batch, qsz_batch, setup_batch, run_batchdet, teardown, flops_batchdet, bytes_batch2},
+    {"BatchMultiply4x4", sz_batch, qsz_batch, setup_batch, run_batchmul, teardown, flops_batchmul, bytes_batch3},
+    {"mtxloadcsv", sz_io, qsz_io, setup_read, run_loadcsv, teardown, none, bytes_csv},
+    {"mtxprntfile", sz_io, qsz_io, setup_write, run_prntfile, teardown, none, bytes_csv},
+    {"dotV", sz_vec, qsz_vec, setup_vectors, run_dotV, teardown, flops_dotV, bytes_dotV},
+    {"dotV-repro", sz_vec, qsz_vec, setup_vectors, run_dotV_repro, teardown, flops_dotV, bytes_dotV},
+    {"addV", sz_vec, qsz_vec, setup_vectors, run_addV, teardown, flops_addV, bytes_addV},
+};
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1e-9*ts.tv_nsec;
+}
+
+static long peakrss(void)
+{
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_maxrss;
+}
+
+static int cmpdouble(const void *a, const void *b)
+{
+    double x = *(const double*) a, y = *(const double*) b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Time one benchmark at one problem size.
+ *
+ * The number of iterations is doubled until a single repetition takes at least
+ * mintime seconds. The median of NREPS repetitions is then reported.
+ *
+ * @param b The benchmark to run
+ * @param n Problem size
+ * @param mintime Minimum duration of each timed repetition (seconds)
+ * @param r Structure to store the results in
+ */
+static void runbenchmark(const benchmark *b, int n, double mintime,
+                         benchresult *r)
+{
+    benchctx c;
+    long iters = 1, i;
+    int rep;
+    double t, times[NREPS];
+    unsigned long a0, b0;
+
+    memset(&c, 0, sizeof(benchctx));
+    c.n = n;
+    b->setup(&c);
+
+    /* Warm up and count allocations for a single call */
+    a0 = nallocs;
+    b0 = nbytes;
+    b->run(&c);
+    r->allocs = nallocs - a0;
+    r->allocbytes = nbytes - b0;
+
+    /* Calibrate */
+    for(;;) {
+        t = now();
+        for(i=0; i<iters; i++)
+            b->run(&c);
+        t = now() - t;
+        if(t >= mintime || iters >= (1L<<30))
+            break;
+        iters *= 2;
+    }
+
+    for(rep=0; rep<NREPS; rep++) {
+        t = now();
+        for(i=0; i<iters; i++)
+            b->run(&c);
+        times[rep] = (now() - t)/iters;
+    }
+    qsort(times, NREPS, sizeof(double), cmpdouble);
+    t = times[NREPS/2];
+
+    b->teardown(&c);
+
+    snprintf(r->name, sizeof(r->name), "%s", b->name);
+    r->n = n;
+    r->iters = iters;
+    r->nsop = t*1e9;
+    r->gflops = b->flops(n)/t*1e-9;
+    r->gbs = b->bytes(n)/t*1e-9;
+    r->peakrss = peakrss();
+}
+
+static void printheader(FILE *fp)
+{
+    fprintf(fp, "%-20s %9s %10s %14s %10s %10s %10s %12s\n", "benchmark", "n",
+            "iters", "ns/op", "GFLOP/s", "GB/s", "allocs", "peakRSS(kB)");
+}
+
+static void printresult(FILE *fp, benchresult *r)
+{
+    fprintf(fp, "%-20s %9d %10ld %14.1f %10.3f %10.3f %10.1f %12ld\n", r->name,
+            r->n, r->iters, r->nsop, r->gflops, r->gbs, r->allocs, r->peakrss);
+}
+
+static void writecsv(FILE *fp, benchresult *r, int nr)
+{
+    int i;
+    fprintf(fp, "name,n,iters,ns_per_op,gflops,gbs,allocs_per_call,alloc_bytes_per_call,peak_rss_kb\n");
+    for(i=0; i<nr; i++)
+        fprintf(fp, "%s,%d,%ld,%.6e,%.6e,%.6e,%.6e,%.6e,%ld\n", r[i].name,
+                r[i].n, r[i].iters, r[i].nsop, r[i].gflops, r[i].gbs,
+                r[i].allocs, r[i].allocbytes, r[i].peakrss);
+}
+
+static void writejson(FILE *fp, benchresult *r, int nr)
+{
+    int i;
+    fprintf(fp, "{\n  \"results\": [\n");
+    for(i=0; i<nr; i++) {
+        fprintf(fp, "    {\"name\": \"%s\", \"n\": %d, \"iters\": %ld, "
+                "\"ns_per_op\": %.6e, \"gflops\": %.6e, \"gbs\": %.6e, "
+                "\"allocs_per_call\": %.6e, \"alloc_bytes_per_call\": %.6e, "
+                "\"peak_rss_kb\": %ld}%s\n", r[i].name, r[i].n, r[i].iters,
+                r[i].nsop, r[i].gflops, r[i].gbs, r[i].allocs, r[i].allocbytes,
+                r[i].peakrss, (i < nr-1) ? "," : "");
+    }
+    fprintf(fp, "  ]\n}\n");
+}
+
+/**
+ * @brief Load results previously saved with "-f csv"
+ * @param filename CSV file to read
+ * @param r Array to store the results in (at least MAXRESULTS long)
+ * @return Number of results read, or -1 if the file could not be opened
+ */
+static int readcsv(char *filename, benchresult *r)
+{
+    FILE *fp;
+    char line[512];
+    int nr = 0;
+
+    fp = fopen(filename, "r");
+    if(!fp)
+        return -1;
+
+    /* Skip the header */
+    if(!fgets(line, sizeof(line), fp)) {
+        fclose(fp);
+        return 0;
+    }
+    while(nr < MAXRESULTS && fgets(line, sizeof(line), fp)) {
+        if(sscanf(line, "%63[^,],%d,%ld,%lf,%lf,%lf,%lf,%lf,%ld", r[nr].name,
+                  &r[nr].n, &r[nr].iters, &r[nr].nsop, &r[nr].gflops,
+                  &r[nr].gbs, &r[nr].allocs, &r[nr].allocbytes,
+                  &r[nr].peakrss) == 9)
+            nr++;
+    }
+    fclose(fp);
+    return nr;
+}
+
+/**
+ * @brief Compare a set of results against a baseline
+ * @param r Current results
+ * @param nr Number of current results
+ * @param base Baseline results
+ * @param nb Number of baseline results
+ * @param threshold Allowed slowdown, as a fraction (0.1 is 10%)
+ * @return Number of regressions found
+ */
+static int compare(benchresult *r, int nr, benchresult *base, int nb,
+                   double threshold)
+{
+    int i, j, nreg = 0;
+    double ratio;
+
+    printf("\n%-20s %9s %14s %14s %8s\n", "benchmark", "n", "base ns/op",
+           "ns/op", "ratio");
+    for(i=0; i<nr; i++) {
+        for(j=0; j<nb; j++)
+            if(r[i].n == base[j].n && !strcmp(r[i].name, base[j].name))
+                break;
+        if(j == nb)
+            continue;
+        ratio = r[i].nsop/base[j].nsop;
+        printf("%-20s %9d %14.1f %14.1f %8.3f", r[i].name, r[i].n,
+               base[j].nsop, r[i].nsop, ratio);
+        if(ratio > 1+threshold) {
+            printf("  REGRESSION");
+            nreg++;
+        } else if(r[i].allocs > base[j].allocs) {
+            printf("  MORE ALLOCS");
+            nreg++;
+        }
+        printf("\n");
+    }
+    return nreg;
+}
+
+static void usage(char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [-q] [-s filter] [-m seconds] [-f csv|json] [-o file]\n"
+            "          [-b baseline.csv] [-t percent]\n"
+            "  -q            Quick run with a reduced size sweep\n"
+            "  -s filter     Only run benchmarks whose name contains filter\n"
+            "  -m seconds    Minimum time per repetition (default 0.1)\n"
+            "  -f format     Format of the output file (default csv)\n"
+            "  -o file       Write results to file\n"
+            "  -b file       Compare against a baseline saved in CSV format\n"
+            "  -t percent    Allowed slowdown before a result counts as a\n"
+            "                regression (default 10)\n", prog);
+}
+
+int main(int argc, char *argv[])
+{
+    static benchresult results[MAXRESULTS], base[MAXRESULTS];
+    int nr = 0, nb = 0, quick = 0, opt, i, k;
+    unsigned int ib;
+    double mintime = 0.1, threshold = 10;
+    char *filter = NULL, *format = "csv", *outfile = NULL, *basefile = NULL;
+    const int *sizes;
+    FILE *fp;
+
+    while((opt = getopt(argc, argv, "qs:m:f:o:b:t:h")) != -1) {
+        switch(opt) {
+            case 'q': quick = 1; break;
+            case 's': filter = optarg; break;
+            case 'm': mintime = atof(optarg); break;
+            case 'f': format = optarg; break;
+            case 'o': outfile = optarg; break;
+            case 'b': basefile = optarg; break;
+            case 't': threshold = atof(optarg); break;
+            default: usage(argv[0]); return 2;
+        }
+    }
+    if(strcmp(format, "csv") && strcmp(format, "json")) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    srand(1);
+    printheader(stdout);
+    for(ib=0; ib<sizeof(benchmarks)/sizeof(benchmark); ib++) {
+        if(filter && !strstr(benchmarks[ib].name, filter))
+            continue;
+        sizes = quick ? benchmarks[ib].quicksizes : benchmarks[ib].sizes;
+        for(k=0; sizes[k] && nr<MAXRESULTS; k++) {
+            runbenchmark(&benchmarks[ib], sizes[k], mintime, &results[nr]);
+            printresult(stdout, &results[nr]);
+            fflush(stdout);
+            nr++;
+        }
+    }
+
+    if(outfile) {
+        fp = fopen(outfile, "w");
+        if(!fp) {
+            fprintf(stderr, "Unable to open %s for writing.\n", outfile);
+            return 2;
+        }
+        if(!strcmp(format, "json"))
+            writejson(fp, results, nr);
+        else
+            writecsv(fp, results, nr);
+        fclose(fp);
+    }
+
+    if(basefile) {
+        nb = readcsv(basefile, base);
+        if(nb < 0) {
+            fprintf(stderr, "Unable to read baseline %s.\n", basefile);
+            return 2;
+        }
+        i = compare(results, nr, base, nb, threshold/100);
+        if(i) {
+            printf("%d regression(s) beyond %g%%.\n", i, threshold);
+            return 1;
+        }
+    }
+
+    return 0;
+}
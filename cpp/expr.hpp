@@ -0,0 +1,686 @@
+/**
+ * @file expr.hpp
+ * Lazily evaluated matrix and vector expressions (C++11 or later).
+ *
+ * Wrapping a matrix or vector with lazy() turns it into an expression. The
+ * operators below don't compute anything; they build a small tree of nodes
+ * that describes the calculation. Passing the tree to assign() or eval()
+ * evaluates every element-wise part of it in a single loop over the
+ * destination, without any temporaries:
+ *
+ *     using mtx::expr::lazy;
+ *     assign(D, k*lazy(A) + lazy(B) - exp(lazy(C)));
+ *
+ * reads A, B and C once and writes D once, the same as a hand-written loop.
+ * Products of a matrix with a matrix or a vector are handed to the product
+ * kernels instead, and their results are then used like any other operand.
+ * Expressions only hold pointers to their operands, so the matricies and
+ * vectors used must outlive them.
+ *
+ * Vectors are treated as matricies with one row, so the same node types are
+ * used for both. Mixing them in an element-wise operation is a compile error.
+ * grid() evaluates a function of two variables over the points of a grid
+ * given only its axes, and can be used in an expression like any operand.
+ *
+ * This file is header-only and does not need to be compiled into the library.
+ */
+
+#ifndef EXPR_HPP
+#define EXPR_HPP
+
+#include <cmath>
+#include <cstdio>
+
+#include "cpp/matrix.hpp"
+
+namespace mtx {
+namespace expr {
+
+///Number of elements above which evaluation is split between threads
+const double PARALLELSIZE = 1e5;
+
+/**
+ * @brief Base class for every expression node
+ *
+ * Each node E provides rows(), cols(), prepare() and row(i). row(i) returns a
+ * small object whose operator[](j) gives element (i, j) of the expression.
+ * Evaluation fetches one of these per row so that the pointers it holds stay
+ * in registers and the inner loop can be vectorized. prepare() is called once
+ * before evaluation to check dimensions and compute any products, and returns
+ * false on error.
+ */
+template<class E>
+struct Expr {
+    const E& self() const { return static_cast<const E&>(*this); }
+};
+
+namespace ops {
+struct Add { static double apply(double a, double b) { return a + b; } };
+struct Sub { static double apply(double a, double b) { return a - b; } };
+struct Mul { static double apply(double a, double b) { return a * b; } };
+struct Div { static double apply(double a, double b) { return a / b; } };
+
+struct Neg { double operator()(double x) const { return -x; } };
+struct Abs { double operator()(double x) const { return std::fabs(x); } };
+struct Sqrt { double operator()(double x) const { return std::sqrt(x); } };
+struct Exp { double operator()(double x) const { return std::exp(x); } };
+struct Log { double operator()(double x) const { return std::log(x); } };
+struct Sin { double operator()(double x) const { return std::sin(x); } };
+struct Cos { double operator()(double x) const { return std::cos(x); } };
+
+struct GridX { double operator()(double x, double) const { return x; } };
+struct GridY { double operator()(double, double y) const { return y; } };
+} // namespace ops
+
+///Row of a matrix or vector that is already stored in memory
+struct StoredRow {
+    const double *p;
+    double operator[](int j) const { return p[j]; }
+};
+
+/**
+ * @brief An existing matrix used as an operand
+ */
+class MatrixLeaf : public Expr<MatrixLeaf> {
+public:
+    static const bool isvector = false;
+    typedef StoredRow Row;
+
+    explicit MatrixLeaf(matrix *A) : m(A), p(A) {}
+    ///Copies refer to the same matrix but not to its row-major copy
+    MatrixLeaf(const MatrixLeaf &e) : m(e.m), p(e.m) {}
+
+    int rows() const { return nRows(m); }
+    int cols() const { return nCols(m); }
+    ///Column-major matricies are copied so that their rows are contiguous
+    bool prepare() const
+    {
+        if(m->layout == MTX_ROWMAJOR) {
+            p = m;
+        } else {
+            copy = Matrix(ConvertLayout(m, MTX_ROWMAJOR));
+            p = copy.get();
+        }
+        return p != nullptr;
+    }
+    Row row(int i) const { Row r = {p->array[i]}; return r; }
+    matrix* get() const { return m; }
+
+private:
+    matrix *m;
+    mutable matrix *p;
+    mutable Matrix copy;
+};
+
+/**
+ * @brief An existing vector used as an operand
+ */
+class VectorLeaf : public Expr<VectorLeaf> {
+public:
+    static const bool isvector = true;
+    typedef StoredRow Row;
+
+    explicit VectorLeaf(vector *x) : v(x) {}
+
+    int rows() const { return 1; }
+    int cols() const { return len(v); }
+    bool prepare() const { return true; }
+    Row row(int) const { Row r = {v->v}; return r; }
+    vector* get() const { return v; }
+
+private:
+    vector *v;
+};
+
+/**
+ * @brief Element-wise operation between two expressions of the same size
+ */
+template<class Op, class L, class R>
+class Binary : public Expr<Binary<Op, L, R> > {
+public:
+    static_assert(L::isvector == R::isvector,
+                  "Element-wise operations can't mix matricies and vectors");
+    static const bool isvector = L::isvector;
+
+    struct Row {
+        typename L::Row a;
+        typename R::Row b;
+        double operator[](int j) const { return Op::apply(a[j], b[j]); }
+    };
+
+    Binary(const L &l, const R &r) : l(l), r(r) {}
+
+    int rows() const { return l.rows(); }
+    int cols() const { return l.cols(); }
+
+    bool prepare() const
+    {
+        if(!l.prepare() || !r.prepare())
+            return false;
+        if(l.rows() != r.rows() || l.cols() != r.cols()) {
+            fprintf(stderr, "Error: Incompatible matrix dimensions.\n");
+            return false;
+        }
+        return true;
+    }
+
+    Row row(int i) const { Row x = {l.row(i), r.row(i)}; return x; }
+
+private:
+    L l;
+    R r;
+};
+
+/**
+ * @brief Operation between an expression and a scalar
+ * @tparam Left True if the scalar is the left operand
+ */
+template<class Op, class E, bool Left>
+class Scalar : public Expr<Scalar<Op, E, Left> > {
+public:
+    static const bool isvector = E::isvector;
+
+    struct Row {
+        typename E::Row a;
+        double k;
+        double operator[](int j) const
+        {
+            return Left ? Op::apply(k, a[j]) : Op::apply(a[j], k);
+        }
+    };
+
+    Scalar(const E &e, double k) : e(e), k(k) {}
+
+    int rows() const { return e.rows(); }
+    int cols() const { return e.cols(); }
+    bool prepare() const { return e.prepare(); }
+    Row row(int i) const { Row x = {e.row(i), k}; return x; }
+
+private:
+    E e;
+    double k;
+};
+
+/**
+ * @brief A function applied to each element of an expression
+ */
+template<class F, class E>
+class Map : public Expr<Map<F, E> > {
+public:
+    static const bool isvector = E::isvector;
+
+    struct Row {
+        typename E::Row a;
+        F f;
+        double operator[](int j) const { return f(a[j]); }
+    };
+
+    Map(const E &e, const F &f) : e(e), f(f) {}
+
+    int rows() const { return e.rows(); }
+    int cols() const { return e.cols(); }
+    bool prepare() const { return e.prepare(); }
+    Row row(int i) const { Row x = {e.row(i), f}; return x; }
+
+private:
+    E e;
+    F f;
+};
+
+/**
+ * @brief A function of two variables evaluated over a grid of points
+ *
+ * Element (i, j) is f(x_j, y_i), the same layout as meshgridX and meshgridY.
+ * Only the two axes are stored, and each element is computed as it is needed.
+ */
+template<class F>
+class Grid : public Expr<Grid<F> > {
+public:
+    static const bool isvector = false;
+
+    struct Row {
+        const double *x;
+        double y;
+        F f;
+        double operator[](int j) const { return f(x[j], y); }
+    };
+
+    Grid(vector *x, vector *y, const F &f) : x(x), y(y), f(f) {}
+
+    int rows() const { return len(y); }
+    int cols() const { return len(x); }
+    bool prepare() const { return true; }
+    Row row(int i) const { Row r = {x->v, valV(y, i), f}; return r; }
+
+private:
+    vector *x;
+    vector *y;
+    F f;
+};
+
+namespace detail {
+
+/* Copy one row of an expression into memory. */
+template<class Row>
+inline void fillrow(double *d, const Row &r, int n)
+{
+    int j;
+    #pragma omp simd
+    for(j=0; j<n; j++)
+        d[j] = r[j];
+}
+
+/* Evaluate a prepared expression into a matrix of the same size. */
+template<class E>
+inline void fill(matrix *D, const E &e)
+{
+    int i, j, rows = e.rows(), cols = e.cols();
+    if(D->layout == MTX_ROWMAJOR) {
+        #pragma omp parallel for if((double) rows*cols > PARALLELSIZE) schedule(static)
+        for(i=0; i<rows; i++)
+            fillrow(D->array[i], e.row(i), cols);
+    } else {
+        #pragma omp parallel for private(j) if((double) rows*cols > PARALLELSIZE) schedule(static)
+        for(i=0; i<rows; i++) {
+            typename E::Row r = e.row(i);
+            for(j=0; j<cols; j++)
+                D->array[j][i] = r[j];
+        }
+    }
+}
+
+/* Evaluate a prepared expression into a vector of the same length. Long
+ * vectors are split into one chunk per thread. */
+template<class E>
+inline void fill(vector *d, const E &e)
+{
+    int j, n = e.cols();
+    typename E::Row r = e.row(0);
+    #pragma omp parallel for simd if(n > PARALLELSIZE) schedule(static)
+    for(j=0; j<n; j++)
+        d->v[j] = r[j];
+}
+
+/* Get a pointer to the value of an operand, evaluating it into store if it
+ * isn't already sitting in memory. */
+inline matrix* operand(const MatrixLeaf &e, Matrix&) { return e.get(); }
+inline vector* operand(const VectorLeaf &e, Vector&) { return e.get(); }
+
+template<class E>
+inline matrix* operand(const Expr<E> &e, Matrix &store)
+{
+    store = Matrix(e.self().rows(), e.self().cols());
+    fill(store.get(), e.self());
+    return store.get();
+}
+
+template<class E>
+inline vector* operand(const Expr<E> &e, Vector &store)
+{
+    store = Vector(e.self().cols());
+    fill(store.get(), e.self());
+    return store.get();
+}
+
+inline bool product(matrix *A, matrix *B, matrix *C) { return mtxmulinto(A, B, C) != nullptr; }
+inline bool product(matrix *A, vector *x, vector *y) { return mtxgemv(1, A, x, 0, y) != nullptr; }
+
+/* Make sure a result has the given size, reallocating it if it doesn't. */
+inline void resize(Matrix &D, int rows, int cols)
+{
+    if(D.rows() != rows || D.cols() != cols)
+        D = Matrix(rows, cols);
+}
+
+inline void resize(Vector &d, int, int cols)
+{
+    if(d.length() != cols)
+        d = Vector(cols);
+}
+
+/* Storage types for the right operand and the result of a product. */
+template<bool V> struct Storage { typedef Matrix type; };
+template<> struct Storage<true> { typedef Vector type; };
+
+} // namespace detail
+
+/**
+ * @brief Product of a matrix expression with a matrix or vector expression
+ *
+ * Operands that aren't already stored in memory are evaluated first, then the
+ * product kernel is run. When the product is the whole expression being
+ * assigned, it is written straight into the destination.
+ */
+template<class L, class R>
+class Product : public Expr<Product<L, R> > {
+public:
+    static_assert(!L::isvector, "The left operand of a product must be a matrix");
+    static const bool isvector = R::isvector;
+    typedef StoredRow Row;
+    typedef typename detail::Storage<isvector>::type Result;
+
+    Product(const L &l, const R &r) : l(l), r(r) {}
+    ///Copies share the operands but not the evaluated result
+    Product(const Product &p) : l(p.l), r(p.r) {}
+
+    int rows() const { return isvector ? 1 : l.rows(); }
+    int cols() const { return isvector ? l.rows() : r.cols(); }
+
+    bool prepare() const
+    {
+        detail::resize(tmp, rows(), cols());
+        return compute(tmp.get());
+    }
+
+    Row row(int i) const { return rowof(tmp.get(), i); }
+
+    /**
+     * @brief Calculate the product into dest, which must already have the
+     * right size and must not be one of the operands
+     */
+    template<class D>
+    bool compute(D *dest) const
+    {
+        if(!l.prepare() || !r.prepare())
+            return false;
+        if(l.cols() != (isvector ? r.cols() : r.rows())) {
+            fprintf(stderr, "Error: Incompatible matrix dimensions.\n");
+            return false;
+        }
+        return detail::product(detail::operand(l, lstore),
+                               detail::operand(r, rstore), dest);
+    }
+
+    ///True if D is used directly as one of the operands
+    bool uses(const void *D) const { return refers(l, D) || refers(r, D); }
+
+private:
+    static Row rowof(matrix *A, int i) { Row x = {A->array[i]}; return x; }
+    static Row rowof(vector *v, int) { Row x = {v->v}; return x; }
+
+    static bool refers(const MatrixLeaf &e, const void *D) { return e.get() == D; }
+    static bool refers(const VectorLeaf &e, const void *D) { return e.get() == D; }
+    template<class E>
+    static bool refers(const Expr<E>&, const void*) { return false; }
+
+    L l;
+    R r;
+    mutable Matrix lstore;
+    mutable Result rstore;
+    mutable Result tmp;
+};
+
+/* Operand wrappers */
+
+///Use a matrix as an operand in an expression
+inline MatrixLeaf lazy(MatrixRef A) { return MatrixLeaf(A.get()); }
+///Use a vector as an operand in an expression
+inline VectorLeaf lazy(VectorRef x) { return VectorLeaf(x.get()); }
+
+/* Element-wise operators */
+
+template<class L, class R>
+inline Binary<ops::Add, L, R> operator+(const Expr<L> &l, const Expr<R> &r)
+{
+    return Binary<ops::Add, L, R>(l.self(), r.self());
+}
+
+template<class L, class R>
+inline Binary<ops::Sub, L, R> operator-(const Expr<L> &l, const Expr<R> &r)
+{
+    return Binary<ops::Sub, L, R>(l.self(), r.self());
+}
+
+///Element-by-element product
+template<class L, class R>
+inline Binary<ops::Mul, L, R> mul(const Expr<L> &l, const Expr<R> &r)
+{
+    return Binary<ops::Mul, L, R>(l.self(), r.self());
+}
+
+///Element-by-element quotient
+template<class L, class R>
+inline Binary<ops::Div, L, R> div(const Expr<L> &l, const Expr<R> &r)
+{
+    return Binary<ops::Div, L, R>(l.self(), r.self());
+}
+
+template<class E>
+inline Scalar<ops::Mul, E, true> operator*(double k, const Expr<E> &e)
+{
+    return Scalar<ops::Mul, E, true>(e.self(), k);
+}
+
+template<class E>
+inline Scalar<ops::Mul, E, false> operator*(const Expr<E> &e, double k)
+{
+    return Scalar<ops::Mul, E, false>(e.self(), k);
+}
+
+template<class E>
+inline Scalar<ops::Div, E, false> operator/(const Expr<E> &e, double k)
+{
+    return Scalar<ops::Div, E, false>(e.self(), k);
+}
+
+template<class E>
+inline Scalar<ops::Add, E, true> operator+(double k, const Expr<E> &e)
+{
+    return Scalar<ops::Add, E, true>(e.self(), k);
+}
+
+template<class E>
+inline Scalar<ops::Add, E, false> operator+(const Expr<E> &e, double k)
+{
+    return Scalar<ops::Add, E, false>(e.self(), k);
+}
+
+template<class E>
+inline Scalar<ops::Sub, E, true> operator-(double k, const Expr<E> &e)
+{
+    return Scalar<ops::Sub, E, true>(e.self(), k);
+}
+
+template<class E>
+inline Scalar<ops::Sub, E, false> operator-(const Expr<E> &e, double k)
+{
+    return Scalar<ops::Sub, E, false>(e.self(), k);
+}
+
+template<class E>
+inline Map<ops::Neg, E> operator-(const Expr<E> &e)
+{
+    return Map<ops::Neg, E>(e.self(), ops::Neg());
+}
+
+/**
+ * @brief Apply a function to each element. Functors and lambdas can be
+ * inlined into the evaluation loop; plain function pointers can't.
+ */
+template<class F, class E>
+inline Map<F, E> map(const Expr<E> &e, F f)
+{
+    return Map<F, E>(e.self(), f);
+}
+
+template<class E> inline Map<ops::Abs, E> abs(const Expr<E> &e) { return map(e, ops::Abs()); }
+template<class E> inline Map<ops::Sqrt, E> sqrt(const Expr<E> &e) { return map(e, ops::Sqrt()); }
+template<class E> inline Map<ops::Exp, E> exp(const Expr<E> &e) { return map(e, ops::Exp()); }
+template<class E> inline Map<ops::Log, E> log(const Expr<E> &e) { return map(e, ops::Log()); }
+template<class E> inline Map<ops::Sin, E> sin(const Expr<E> &e) { return map(e, ops::Sin()); }
+template<class E> inline Map<ops::Cos, E> cos(const Expr<E> &e) { return map(e, ops::Cos()); }
+
+/* Grids */
+
+/**
+ * @brief Evaluate f(x_j, y_i) over a grid without building it. Assigning the
+ * result evaluates f in a vectorizable loop that writes straight into the
+ * destination.
+ * @param x Coordinates along the columns
+ * @param y Coordinates along the rows
+ * @param f Function or lambda taking (x, y)
+ */
+template<class F>
+inline Grid<F> grid(VectorRef x, VectorRef y, F f)
+{
+    return Grid<F>(x.get(), y.get(), f);
+}
+
+///x coordinates of a grid, the same as meshgridX
+inline Grid<ops::GridX> gridx(VectorRef x, VectorRef y) { return grid(x, y, ops::GridX()); }
+///y coordinates of a grid, the same as meshgridY
+inline Grid<ops::GridY> gridy(VectorRef x, VectorRef y) { return grid(x, y, ops::GridY()); }
+
+/* Products */
+
+///Matrix-matrix or matrix-vector product
+template<class L, class R>
+inline Product<L, R> operator*(const Expr<L> &l, const Expr<R> &r)
+{
+    return Product<L, R>(l.self(), r.self());
+}
+
+/* Evaluation */
+
+/**
+ * @brief Evaluate a matrix expression into an existing matrix
+ * @param D Destination. Must already have the right size. May also appear
+ * in the expression.
+ * @param e Expression to evaluate
+ * @return false if the dimensions don't agree
+ */
+template<class E>
+inline bool assign(matrix *D, const Expr<E> &e)
+{
+    static_assert(!E::isvector, "Can't assign a vector expression to a matrix");
+    const E &x = e.self();
+    if(!x.prepare())
+        return false;
+    if(nRows(D) != x.rows() || nCols(D) != x.cols()) {
+        fprintf(stderr, "Error: Incompatible matrix dimensions.\n");
+        return false;
+    }
+    UnshareMatrix(D);
+    detail::fill(D, x);
+    return true;
+}
+
+/**
+ * @brief Evaluate a vector expression into an existing vector
+ * @param d Destination. Must already have the right length. May also appear
+ * in the expression.
+ * @param e Expression to evaluate
+ * @return false if the dimensions don't agree
+ */
+template<class E>
+inline bool assign(vector *d, const Expr<E> &e)
+{
+    static_assert(E::isvector, "Can't assign a matrix expression to a vector");
+    const E &x = e.self();
+    if(!x.prepare())
+        return false;
+    if(len(d) != x.cols()) {
+        fprintf(stderr, "Error: Incompatible vector lengths.\n");
+        return false;
+    }
+    detail::fill(d, x);
+    return true;
+}
+
+namespace detail {
+
+template<class D, class E>
+inline bool store(D &dest, const E &x)
+{
+    resize(dest, x.rows(), x.cols());
+    return assign(dest.get(), x);
+}
+
+/* A product on its own is written straight into the destination, unless the
+ * destination is also one of its operands. */
+template<class D, class L, class R>
+inline bool store(D &dest, const Product<L, R> &p)
+{
+    resize(dest, p.rows(), p.cols());
+    if(p.uses(dest.get()))
+        return assign(dest.get(), p);
+    return p.compute(dest.get());
+}
+
+} // namespace detail
+
+/**
+ * @brief Evaluate a matrix expression into D, reusing its storage when it is
+ * already the right size
+ * @return false if the dimensions don't agree
+ */
+template<class E>
+inline bool assign(Matrix &D, const Expr<E> &e)
+{
+    static_assert(!E::isvector, "Can't assign a vector expression to a matrix");
+    return detail::store(D, e.self());
+}
+
+/**
+ * @brief Evaluate a vector expression into d, reusing its storage when it is
+ * already the right length
+ * @return false if the dimensions don't agree
+ */
+template<class E>
+inline bool assign(Vector &d, const Expr<E> &e)
+{
+    static_assert(E::isvector, "Can't assign a matrix expression to a vector");
+    return detail::store(d, e.self());
+}
+
+/**
+ * @brief Evaluate an expression into a new Matrix or Vector
+ * @return The result, or an empty object if the dimensions don't agree
+ */
+template<class E>
+inline typename detail::Storage<E::isvector>::type eval(const Expr<E> &e)
+{
+    typename detail::Storage<E::isvector>::type D;
+    if(!assign(D, e.self()))
+        D.reset();
+    return D;
+}
+
+/* Reductions */
+
+///Sum of all the elements of an expression, in one pass
+template<class E>
+inline double sum(const Expr<E> &e)
+{
+    const E &x = e.self();
+    int i, j, rows, cols;
+    double s = 0;
+
+    if(!x.prepare())
+        return NAN;
+    rows = x.rows();
+    cols = x.cols();
+
+    #pragma omp parallel for private(j) reduction(+:s) if((double) rows*cols > PARALLELSIZE) schedule(static)
+    for(i=0; i<rows; i++) {
+        typename E::Row r = x.row(i);
+        double t = 0;
+        #pragma omp simd reduction(+:t)
+        for(j=0; j<cols; j++)
+            t += r[j];
+        s += t;
+    }
+    return s;
+}
+
+///Dot product of two expressions, without evaluating either of them
+template<class L, class R>
+inline double dot(const Expr<L> &l, const Expr<R> &r)
+{
+    return sum(mul(l, r));
+}
+
+} // namespace expr
+} // namespace mtx
+
+#endif
@@ -0,0 +1,586 @@
+/**
+ * @file fixedmatrix.hpp
+ * Fixed-size matricies and vectors for C++ (C++14 or later).
+ *
+ * FixedMatrix and FixedVector hold their elements directly, so they live on
+ * the stack, are trivially copyable, and never allocate. All of their sizes
+ * are known at compile time, which lets the compiler fully unroll the loops
+ * below. Determinants and inverses use closed-form expressions up to 4x4, and
+ * solve uses Cramer's rule for up to 3 equations. Everything larger, including
+ * 4x4 solves, falls back to Gaussian elimination with partial pivoting.
+ * Everything except the conversions to and from the C types can be evaluated
+ * at compile time.
+ *
+ * This file is header-only and does not need to be compiled into the library.
+ */
+
+#ifndef FIXEDMATRIX_HPP
+#define FIXEDMATRIX_HPP
+
+#include <cstdio>
+#include <cstring>
+
+#include "matrix.h"
+
+namespace mtx {
+
+/**
+ * @brief A vector with N components
+ */
+template<int N>
+struct FixedVector {
+    static_assert(N > 0, "FixedVector must have at least one component");
+
+    ///The components
+    double v[N];
+
+    constexpr double& operator[](int i) { return v[i]; }
+    constexpr const double& operator[](int i) const { return v[i]; }
+    static constexpr int length() { return N; }
+
+    /**
+     * @brief Make a vector of zeros
+     */
+    static constexpr FixedVector zero()
+    {
+        FixedVector r{};
+        return r;
+    }
+
+    /**
+     * @brief Copy the components of a C vector
+     * @param x Vector of length N
+     */
+    static FixedVector fromVector(vector *x)
+    {
+        FixedVector r{};
+        if(len(x) != N)
+            fprintf(stderr, "FixedVector: Expected a vector of length %d, got %d.\n", N, len(x));
+        else
+            memcpy(r.v, x->v, sizeof(r.v));
+        return r;
+    }
+
+    /**
+     * @brief Copy the components into an existing C vector of length N
+     */
+    void copyTo(vector *x) const
+    {
+        if(len(x) != N)
+            fprintf(stderr, "FixedVector: Expected a vector of length %d, got %d.\n", N, len(x));
+        else
+            memcpy(x->v, v, sizeof(v));
+    }
+
+    /**
+     * @brief Copy the components into a new C vector
+     * @returns A vector that must be freed with DestroyVector
+     */
+    vector* toVector() const
+    {
+        vector *x = CreateVector(N);
+        memcpy(x->v, v, sizeof(v));
+        return x;
+    }
+};
+
+/**
+ * @brief An R by C matrix
+ */
+template<int R, int C>
+struct FixedMatrix {
+    static_assert(R > 0 && C > 0, "FixedMatrix must have at least one element");
+
+    ///The elements, stored by row
+    double a[R][C];
+
+    constexpr double& operator()(int i, int j) { return a[i][j]; }
+    constexpr const double& operator()(int i, int j) const { return a[i][j]; }
+    static constexpr int rows() { return R; }
+    static constexpr int cols() { return C; }
+
+    /**
+     * @brief Make a matrix of zeros
+     */
+    static constexpr FixedMatrix zero()
+    {
+        FixedMatrix r{};
+        return r;
+    }
+
+    /**
+     * @brief Make an identity matrix (ones on the main diagonal)
+     */
+    static constexpr FixedMatrix identity()
+    {
+        FixedMatrix r{};
+        for(int i=0; i<R && i<C; i++)
+            r.a[i][i] = 1;
+        return r;
+    }
+
+    /**
+     * @brief Copy the elements of a C matrix
+     * @param A An R by C matrix
+     */
+    static FixedMatrix fromMatrix(matrix *A)
+    {
+        FixedMatrix r{};
+        if(nRows(A) != R || nCols(A) != C) {
+            fprintf(stderr, "FixedMatrix: Expected a %dx%d matrix, got %dx%d.\n", R, C, nRows(A), nCols(A));
+            return r;
+        }
+        if(A->layout == MTX_COLMAJOR) {
+            for(int j=0; j<C; j++)
+                for(int i=0; i<R; i++)
+                    r.a[i][j] = A->array[j][i];
+        } else {
+            for(int i=0; i<R; i++)
+                memcpy(r.a[i], A->array[i], sizeof(r.a[i]));
+        }
+        return r;
+    }
+
+    /**
+     * @brief Copy the elements into an existing R by C matrix
+     */
+    void copyTo(matrix *A) const
+    {
+        if(nRows(A) != R || nCols(A) != C) {
+            fprintf(stderr, "FixedMatrix: Expected a %dx%d matrix, got %dx%d.\n", R, C, nRows(A), nCols(A));
+            return;
+        }
+        UnshareMatrix(A);
+        if(A->layout == MTX_COLMAJOR) {
+            for(int j=0; j<C; j++)
+                for(int i=0; i<R; i++)
+                    A->array[j][i] = a[i][j];
+        } else {
+            for(int i=0; i<R; i++)
+                memcpy(A->array[i], a[i], sizeof(a[i]));
+        }
+    }
+
+    /**
+     * @brief Copy the elements into a new C matrix
+     * @returns A matrix that must be freed with DestroyMatrix
+     */
+    matrix* toMatrix() const
+    {
+        matrix *A = CreateMatrix(R, C);
+        copyTo(A);
+        return A;
+    }
+};
+
+typedef FixedMatrix<2, 2> FixedMatrix2;
+typedef FixedMatrix<3, 3> FixedMatrix3;
+typedef FixedMatrix<4, 4> FixedMatrix4;
+typedef FixedVector<2> FixedVector2;
+typedef FixedVector<3> FixedVector3;
+typedef FixedVector<4> FixedVector4;
+
+/* Element-wise arithmetic */
+
+template<int R, int C>
+constexpr FixedMatrix<R, C> operator+(const FixedMatrix<R, C> &A, const FixedMatrix<R, C> &B)
+{
+    FixedMatrix<R, C> r{};
+    for(int i=0; i<R; i++)
+        for(int j=0; j<C; j++)
+            r.a[i][j] = A.a[i][j] + B.a[i][j];
+    return r;
+}
+
+template<int R, int C>
+constexpr FixedMatrix<R, C> operator-(const FixedMatrix<R, C> &A, const FixedMatrix<R, C> &B)
+{
+    FixedMatrix<R, C> r{};
+    for(int i=0; i<R; i++)
+        for(int j=0; j<C; j++)
+            r.a[i][j] = A.a[i][j] - B.a[i][j];
+    return r;
+}
+
+template<int R, int C>
+constexpr FixedMatrix<R, C> operator-(const FixedMatrix<R, C> &A)
+{
+    FixedMatrix<R, C> r{};
+    for(int i=0; i<R; i++)
+        for(int j=0; j<C; j++)
+            r.a[i][j] = -A.a[i][j];
+    return r;
+}
+
+template<int R, int C>
+constexpr FixedMatrix<R, C> operator*(double k, const FixedMatrix<R, C> &A)
+{
+    FixedMatrix<R, C> r{};
+    for(int i=0; i<R; i++)
+        for(int j=0; j<C; j++)
+            r.a[i][j] = k*A.a[i][j];
+    return r;
+}
+
+template<int R, int C>
+constexpr FixedMatrix<R, C> operator*(const FixedMatrix<R, C> &A, double k)
+{
+    return k*A;
+}
+
+template<int N>
+constexpr FixedVector<N> operator+(const FixedVector<N> &x, const FixedVector<N> &y)
+{
+    FixedVector<N> r{};
+    for(int i=0; i<N; i++)
+        r.v[i] = x.v[i] + y.v[i];
+    return r;
+}
+
+template<int N>
+constexpr FixedVector<N> operator-(const FixedVector<N> &x, const FixedVector<N> &y)
+{
+    FixedVector<N> r{};
+    for(int i=0; i<N; i++)
+        r.v[i] = x.v[i] - y.v[i];
+    return r;
+}
+
+template<int N>
+constexpr FixedVector<N> operator-(const FixedVector<N> &x)
+{
+    FixedVector<N> r{};
+    for(int i=0; i<N; i++)
+        r.v[i] = -x.v[i];
+    return r;
+}
+
+template<int N>
+constexpr FixedVector<N> operator*(double k, const FixedVector<N> &x)
+{
+    FixedVector<N> r{};
+    for(int i=0; i<N; i++)
+        r.v[i] = k*x.v[i];
+    return r;
+}
+
+template<int N>
+constexpr FixedVector<N> operator*(const FixedVector<N> &x, double k)
+{
+    return k*x;
+}
+
+/**
+ * @brief Dot product of two vectors
+ */
+template<int N>
+constexpr double dot(const FixedVector<N> &x, const FixedVector<N> &y)
+{
+    double s = 0;
+    for(int i=0; i<N; i++)
+        s += x.v[i]*y.v[i];
+    return s;
+}
+
+/* Products */
+
+/**
+ * @brief Matrix product A*B
+ */
+template<int R, int K, int C>
+constexpr FixedMatrix<R, C> operator*(const FixedMatrix<R, K> &A, const FixedMatrix<K, C> &B)
+{
+    FixedMatrix<R, C> r{};
+    for(int i=0; i<R; i++)
+        for(int k=0; k<K; k++)
+            for(int j=0; j<C; j++)
+                r.a[i][j] += A.a[i][k]*B.a[k][j];
+    return r;
+}
+
+/**
+ * @brief Matrix-vector product A*x
+ */
+template<int R, int C>
+constexpr FixedVector<R> operator*(const FixedMatrix<R, C> &A, const FixedVector<C> &x)
+{
+    FixedVector<R> r{};
+    for(int i=0; i<R; i++)
+        for(int j=0; j<C; j++)
+            r.v[i] += A.a[i][j]*x.v[j];
+    return r;
+}
+
+/**
+ * @brief Transpose of a matrix
+ */
+template<int R, int C>
+constexpr FixedMatrix<C, R> transpose(const FixedMatrix<R, C> &A)
+{
+    FixedMatrix<C, R> r{};
+    for(int i=0; i<R; i++)
+        for(int j=0; j<C; j++)
+            r.a[j][i] = A.a[i][j];
+    return r;
+}
+
+namespace detail {
+
+constexpr double abs(double x)
+{
+    return (x < 0) ? -x : x;
+}
+
+/**
+ * @brief Gaussian elimination with partial pivoting on A, applying the same
+ * row operations to B.
+ * @returns The determinant of A
+ */
+template<int N, int M>
+constexpr double eliminate(FixedMatrix<N, N> &A, FixedMatrix<N, M> &B)
+{
+    double det = 1;
+    for(int k=0; k<N; k++) {
+        int p = k;
+        for(int i=k+1; i<N; i++)
+            if(abs(A.a[i][k]) > abs(A.a[p][k]))
+                p = i;
+        if(p != k) {
+            for(int j=0; j<N; j++) {
+                double t = A.a[k][j];
+                A.a[k][j] = A.a[p][j];
+                A.a[p][j] = t;
+            }
+            for(int j=0; j<M; j++) {
+                double t = B.a[k][j];
+                B.a[k][j] = B.a[p][j];
+                B.a[p][j] = t;
+            }
+            det = -det;
+        }
+        det *= A.a[k][k];
+        if(A.a[k][k] == 0)
+            return 0;
+        for(int i=k+1; i<N; i++) {
+            double f = A.a[i][k]/A.a[k][k];
+            for(int j=k+1; j<N; j++)
+                A.a[i][j] -= f*A.a[k][j];
+            for(int j=0; j<M; j++)
+                B.a[i][j] -= f*B.a[k][j];
+        }
+    }
+    return det;
+}
+
+/**
+ * @brief Back substitution after eliminate()
+ */
+template<int N, int M>
+constexpr void backsubstitute(const FixedMatrix<N, N> &A, FixedMatrix<N, M> &B)
+{
+    for(int i=N-1; i>=0; i--) {
+        for(int k=i+1; k<N; k++)
+            for(int j=0; j<M; j++)
+                B.a[i][j] -= A.a[i][k]*B.a[k][j];
+        for(int j=0; j<M; j++)
+            B.a[i][j] /= A.a[i][i];
+    }
+}
+
+} // namespace detail
+
+/* Determinants */
+
+/**
+ * @brief Determinant of a square matrix
+ */
+template<int N>
+constexpr double det(const FixedMatrix<N, N> &A)
+{
+    FixedMatrix<N, N> lu = A;
+    FixedMatrix<N, 1> none{};
+    return detail::eliminate(lu, none);
+}
+
+constexpr double det(const FixedMatrix<1, 1> &A)
+{
+    return A.a[0][0];
+}
+
+constexpr double det(const FixedMatrix<2, 2> &A)
+{
+    return A.a[0][0]*A.a[1][1] - A.a[0][1]*A.a[1][0];
+}
+
+constexpr double det(const FixedMatrix<3, 3> &A)
+{
+    return A.a[0][0]*(A.a[1][1]*A.a[2][2] - A.a[1][2]*A.a[2][1])
+         - A.a[0][1]*(A.a[1][0]*A.a[2][2] - A.a[1][2]*A.a[2][0])
+         + A.a[0][2]*(A.a[1][0]*A.a[2][1] - A.a[1][1]*A.a[2][0]);
+}
+
+constexpr double det(const FixedMatrix<4, 4> &A)
+{
+    /* Laplace expansion along the first two rows */
+    double s0 = A.a[0][0]*A.a[1][1] - A.a[1][0]*A.a[0][1];
+    double s1 = A.a[0][0]*A.a[1][2] - A.a[1][0]*A.a[0][2];
+    double s2 = A.a[0][0]*A.a[1][3] - A.a[1][0]*A.a[0][3];
+    double s3 = A.a[0][1]*A.a[1][2] - A.a[1][1]*A.a[0][2];
+    double s4 = A.a[0][1]*A.a[1][3] - A.a[1][1]*A.a[0][3];
+    double s5 = A.a[0][2]*A.a[1][3] - A.a[1][2]*A.a[0][3];
+    double c5 = A.a[2][2]*A.a[3][3] - A.a[3][2]*A.a[2][3];
+    double c4 = A.a[2][1]*A.a[3][3] - A.a[3][1]*A.a[2][3];
+    double c3 = A.a[2][1]*A.a[3][2] - A.a[3][1]*A.a[2][2];
+    double c2 = A.a[2][0]*A.a[3][3] - A.a[3][0]*A.a[2][3];
+    double c1 = A.a[2][0]*A.a[3][2] - A.a[3][0]*A.a[2][2];
+    double c0 = A.a[2][0]*A.a[3][1] - A.a[3][0]*A.a[2][1];
+    return s0*c5 - s1*c4 + s2*c3 + s3*c2 - s4*c1 + s5*c0;
+}
+
+/* Inverses. The inverse of a singular matrix contains infinities or NaNs. */
+
+/**
+ * @brief Inverse of a square matrix
+ */
+template<int N>
+constexpr FixedMatrix<N, N> inverse(const FixedMatrix<N, N> &A)
+{
+    FixedMatrix<N, N> lu = A;
+    FixedMatrix<N, N> r = FixedMatrix<N, N>::identity();
+    detail::eliminate(lu, r);
+    detail::backsubstitute(lu, r);
+    return r;
+}
+
+constexpr FixedMatrix<1, 1> inverse(const FixedMatrix<1, 1> &A)
+{
+    return FixedMatrix<1, 1>{{{1/A.a[0][0]}}};
+}
+
+constexpr FixedMatrix<2, 2> inverse(const FixedMatrix<2, 2> &A)
+{
+    double d = 1/det(A);
+    return FixedMatrix<2, 2>{{{ d*A.a[1][1], -d*A.a[0][1]},
+                              {-d*A.a[1][0],  d*A.a[0][0]}}};
+}
+
+constexpr FixedMatrix<3, 3> inverse(const FixedMatrix<3, 3> &A)
+{
+    /* Transposed matrix of cofactors, divided by the determinant */
+    double c00 = A.a[1][1]*A.a[2][2] - A.a[1][2]*A.a[2][1];
+    double c01 = A.a[1][2]*A.a[2][0] - A.a[1][0]*A.a[2][2];
+    double c02 = A.a[1][0]*A.a[2][1] - A.a[1][1]*A.a[2][0];
+    double d = 1/(A.a[0][0]*c00 + A.a[0][1]*c01 + A.a[0][2]*c02);
+    return FixedMatrix<3, 3>{{
+        {d*c00, d*(A.a[0][2]*A.a[2][1] - A.a[0][1]*A.a[2][2]), d*(A.a[0][1]*A.a[1][2] - A.a[0][2]*A.a[1][1])},
+        {d*c01, d*(A.a[0][0]*A.a[2][2] - A.a[0][2]*A.a[2][0]), d*(A.a[0][2]*A.a[1][0] - A.a[0][0]*A.a[1][2])},
+        {d*c02, d*(A.a[0][1]*A.a[2][0] - A.a[0][0]*A.a[2][1]), d*(A.a[0][0]*A.a[1][1] - A.a[0][1]*A.a[1][0])}}};
+}
+
+constexpr FixedMatrix<4, 4> inverse(const FixedMatrix<4, 4> &A)
+{
+    /* The same 2x2 minors as det() are reused for all of the cofactors */
+    double s0 = A.a[0][0]*A.a[1][1] - A.a[1][0]*A.a[0][1];
+    double s1 = A.a[0][0]*A.a[1][2] - A.a[1][0]*A.a[0][2];
+    double s2 = A.a[0][0]*A.a[1][3] - A.a[1][0]*A.a[0][3];
+    double s3 = A.a[0][1]*A.a[1][2] - A.a[1][1]*A.a[0][2];
+    double s4 = A.a[0][1]*A.a[1][3] - A.a[1][1]*A.a[0][3];
+    double s5 = A.a[0][2]*A.a[1][3] - A.a[1][2]*A.a[0][3];
+    double c5 = A.a[2][2]*A.a[3][3] - A.a[3][2]*A.a[2][3];
+    double c4 = A.a[2][1]*A.a[3][3] - A.a[3][1]*A.a[2][3];
+    double c3 = A.a[2][1]*A.a[3][2] - A.a[3][1]*A.a[2][2];
+    double c2 = A.a[2][0]*A.a[3][3] - A.a[3][0]*A.a[2][3];
+    double c1 = A.a[2][0]*A.a[3][2] - A.a[3][0]*A.a[2][2];
+    double c0 = A.a[2][0]*A.a[3][1] - A.a[3][0]*A.a[2][1];
+    double d = 1/(s0*c5 - s1*c4 + s2*c3 + s3*c2 - s4*c1 + s5*c0);
+    return FixedMatrix<4, 4>{{
+        {d*( A.a[1][1]*c5 - A.a[1][2]*c4 + A.a[1][3]*c3),
+         d*(-A.a[0][1]*c5 + A.a[0][2]*c4 - A.a[0][3]*c3),
+         d*( A.a[3][1]*s5 - A.a[3][2]*s4 + A.a[3][3]*s3),
+         d*(-A.a[2][1]*s5 + A.a[2][2]*s4 - A.a[2][3]*s3)},
+        {d*(-A.a[1][0]*c5 + A.a[1][2]*c2 - A.a[1][3]*c1),
+         d*( A.a[0][0]*c5 - A.a[0][2]*c2 + A.a[0][3]*c1),
+         d*(-A.a[3][0]*s5 + A.a[3][2]*s2 - A.a[3][3]*s1),
+         d*( A.a[2][0]*s5 - A.a[2][2]*s2 + A.a[2][3]*s1)},
+        {d*( A.a[1][0]*c4 - A.a[1][1]*c2 + A.a[1][3]*c0),
+         d*(-A.a[0][0]*c4 + A.a[0][1]*c2 - A.a[0][3]*c0),
+         d*( A.a[3][0]*s4 - A.a[3][1]*s2 + A.a[3][3]*s0),
+         d*(-A.a[2][0]*s4 + A.a[2][1]*s2 - A.a[2][3]*s0)},
+        {d*(-A.a[1][0]*c3 + A.a[1][1]*c1 - A.a[1][2]*c0),
+         d*( A.a[0][0]*c3 - A.a[0][1]*c1 + A.a[0][2]*c0),
+         d*(-A.a[3][0]*s3 + A.a[3][1]*s1 - A.a[3][2]*s0),
+         d*( A.a[2][0]*s3 - A.a[2][1]*s1 + A.a[2][2]*s0)}}};
+}
+
+/* Linear solves */
+
+/**
+ * @brief Solve A*x = b
+ *
+ * Systems of up to 3 equations are solved with Cramer's rule. Larger ones use
+ * Gaussian elimination with partial pivoting.
+ */
+template<int N>
+constexpr FixedVector<N> solve(const FixedMatrix<N, N> &A, const FixedVector<N> &b)
+{
+    FixedMatrix<N, N> lu = A;
+    FixedMatrix<N, 1> x{};
+    for(int i=0; i<N; i++)
+        x.a[i][0] = b.v[i];
+    detail::eliminate(lu, x);
+    detail::backsubstitute(lu, x);
+
+    FixedVector<N> r{};
+    for(int i=0; i<N; i++)
+        r.v[i] = x.a[i][0];
+    return r;
+}
+
+constexpr FixedVector<1> solve(const FixedMatrix<1, 1> &A, const FixedVector<1> &b)
+{
+    return FixedVector<1>{{b.v[0]/A.a[0][0]}};
+}
+
+constexpr FixedVector<2> solve(const FixedMatrix<2, 2> &A, const FixedVector<2> &b)
+{
+    double d = 1/det(A);
+    return FixedVector<2>{{d*(b.v[0]*A.a[1][1] - A.a[0][1]*b.v[1]),
+                           d*(A.a[0][0]*b.v[1] - b.v[0]*A.a[1][0])}};
+}
+
+constexpr FixedVector<3> solve(const FixedMatrix<3, 3> &A, const FixedVector<3> &b)
+{
+    /* Replacing column i of A with b gives b dot the cross product of the
+     * other two columns, taken in cyclic order */
+    double x12[3] = {A.a[1][1]*A.a[2][2] - A.a[2][1]*A.a[1][2],
+                     A.a[2][1]*A.a[0][2] - A.a[0][1]*A.a[2][2],
+                     A.a[0][1]*A.a[1][2] - A.a[1][1]*A.a[0][2]};
+    double x20[3] = {A.a[1][2]*A.a[2][0] - A.a[2][2]*A.a[1][0],
+                     A.a[2][2]*A.a[0][0] - A.a[0][2]*A.a[2][0],
+                     A.a[0][2]*A.a[1][0] - A.a[1][2]*A.a[0][0]};
+    double x01[3] = {A.a[1][0]*A.a[2][1] - A.a[2][0]*A.a[1][1],
+                     A.a[2][0]*A.a[0][1] - A.a[0][0]*A.a[2][1],
+                     A.a[0][0]*A.a[1][1] - A.a[1][0]*A.a[0][1]};
+    double d = 1/(A.a[0][0]*x12[0] + A.a[1][0]*x12[1] + A.a[2][0]*x12[2]);
+    return FixedVector<3>{{d*(b.v[0]*x12[0] + b.v[1]*x12[1] + b.v[2]*x12[2]),
+                           d*(b.v[0]*x20[0] + b.v[1]*x20[1] + b.v[2]*x20[2]),
+                           d*(b.v[0]*x01[0] + b.v[1]*x01[1] + b.v[2]*x01[2])}};
+}
+
+/**
+ * @brief Solve A*X = B for several right-hand sides at once
+ */
+template<int N, int M>
+constexpr FixedMatrix<N, M> solve(const FixedMatrix<N, N> &A, const FixedMatrix<N, M> &B)
+{
+    FixedMatrix<N, N> lu = A;
+    FixedMatrix<N, M> X = B;
+    detail::eliminate(lu, X);
+    detail::backsubstitute(lu, X);
+    return X;
+}
+
+} // namespace mtx
+
+#endif
+
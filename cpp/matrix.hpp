@@ -0,0 +1,615 @@
+/**
+ * @file matrix.hpp
+ * Owning C++ wrappers for matrix, vector and bndmatrix (C++11 or later).
+ *
+ * Matrix, Vector and BandMatrix each own exactly one C object and free it when
+ * they go out of scope. They can be moved but not copied, so ownership is
+ * always explicit: use clone() to make a deep copy. MatrixRef and VectorRef
+ * are non-owning views that accept either a wrapper or a raw C pointer, so the
+ * operators below work on both.
+ *
+ * The arithmetic operators call the destination-passing kernels (mtxaddinto,
+ * addVinto, ...). When one of the operands is a temporary its storage is
+ * reused for the result, so an expression like A + B - C + D only allocates
+ * once. Errors are reported the same way as the C functions: a message is
+ * printed to stderr and the result is empty (it converts to false).
+ *
+ * This file is header-only and does not need to be compiled into the library.
+ */
+
+#ifndef MATRIX_HPP
+#define MATRIX_HPP
+
+#include <utility>
+
+#include "matrix.h"
+#include "bandmatrix/bandmatrix.h"
+
+namespace mtx {
+
+namespace detail {
+
+/* Reference to an element of a matrix in either layout */
+inline double& at(matrix *A, int i, int j)
+{
+    return (A->layout == MTX_COLMAJOR) ? A->array[j][i] : A->array[i][j];
+}
+
+} // namespace detail
+
+/**
+ * @brief A dense matrix that owns its storage
+ */
+class Matrix {
+public:
+    ///Make an empty matrix that doesn't hold anything
+    Matrix() noexcept : m(nullptr) {}
+
+    /**
+     * @brief Allocate a matrix of zeros
+     * @param rows Number of rows
+     * @param cols Number of columns
+     * @param layout MTX_ROWMAJOR (the default) or MTX_COLMAJOR
+     */
+    Matrix(int rows, int cols, int layout = MTX_ROWMAJOR)
+        : m(CreateMatrixLayout(rows, cols, layout)) {}
+
+    /**
+     * @brief Take ownership of a matrix from the C interface
+     * @param A Matrix to adopt. It will be destroyed with this object.
+     */
+    explicit Matrix(matrix *A) noexcept : m(A) {}
+
+    ~Matrix() { reset(); }
+
+    Matrix(const Matrix&) = delete;
+    Matrix& operator=(const Matrix&) = delete;
+
+    Matrix(Matrix &&other) noexcept : m(other.m) { other.m = nullptr; }
+
+    Matrix& operator=(Matrix &&other) noexcept
+    {
+        if(this != &other) {
+            reset();
+            m = other.m;
+            other.m = nullptr;
+        }
+        return *this;
+    }
+
+    ///Make a deep copy of this matrix
+    Matrix clone() const { return Matrix(m ? CopyMatrix(m) : nullptr); }
+
+    /**
+     * @brief Make a copy-on-write copy that shares storage with this matrix
+     * until either one is modified. Writes through operator() don't trigger
+     * the copy, so call unshare() before using it to modify a shared matrix.
+     * @see ShareMatrix
+     */
+    Matrix share() const { return Matrix(m ? ShareMatrix(m) : nullptr); }
+
+    ///Give this matrix its own copy of any storage it shares
+    void unshare() { if(m) UnshareMatrix(m); }
+
+    ///Memory layout of the matrix, MTX_ROWMAJOR or MTX_COLMAJOR
+    int layout() const noexcept { return m ? m->layout : MTX_ROWMAJOR; }
+
+    ///Rearrange the matrix in memory to use a different layout
+    void setLayout(int layout) { if(m) mtxsetlayout(m, layout); }
+
+    ///The underlying C matrix. Still owned by this object.
+    matrix* get() const noexcept { return m; }
+
+    ///Give up ownership of the underlying C matrix and return it
+    matrix* release() noexcept
+    {
+        matrix *A = m;
+        m = nullptr;
+        return A;
+    }
+
+    ///Destroy the matrix being held, leaving this one empty
+    void reset() noexcept
+    {
+        if(m)
+            DestroyMatrix(m);
+        m = nullptr;
+    }
+
+    int rows() const noexcept { return m ? nRows(m) : 0; }
+    int cols() const noexcept { return m ? nCols(m) : 0; }
+    explicit operator bool() const noexcept { return m != nullptr; }
+
+    double& operator()(int i, int j) { return detail::at(m, i, j); }
+    const double& operator()(int i, int j) const { return detail::at(m, i, j); }
+
+private:
+    matrix *m;
+};
+
+/**
+ * @brief A vector that owns its storage
+ */
+class Vector {
+public:
+    ///Make an empty vector that doesn't hold anything
+    Vector() noexcept : v(nullptr) {}
+
+    /**
+     * @brief Allocate a vector of zeros
+     * @param length Number of components
+     */
+    explicit Vector(int length) : v(CreateVector(length)) {}
+
+    /**
+     * @brief Take ownership of a vector from the C interface
+     * @param x Vector to adopt. It will be destroyed with this object.
+     */
+    explicit Vector(vector *x) noexcept : v(x) {}
+
+    ~Vector() { reset(); }
+
+    Vector(const Vector&) = delete;
+    Vector& operator=(const Vector&) = delete;
+
+    Vector(Vector &&other) noexcept : v(other.v) { other.v = nullptr; }
+
+    Vector& operator=(Vector &&other) noexcept
+    {
+        if(this != &other) {
+            reset();
+            v = other.v;
+            other.v = nullptr;
+        }
+        return *this;
+    }
+
+    ///Make a deep copy of this vector
+    Vector clone() const { return Vector(v ? CopyVector(v) : nullptr); }
+
+    ///The underlying C vector. Still owned by this object.
+    vector* get() const noexcept { return v; }
+
+    ///Give up ownership of the underlying C vector and return it
+    vector* release() noexcept
+    {
+        vector *x = v;
+        v = nullptr;
+        return x;
+    }
+
+    ///Destroy the vector being held, leaving this one empty
+    void reset() noexcept
+    {
+        if(v)
+            DestroyVector(v);
+        v = nullptr;
+    }
+
+    int length() const noexcept { return v ? len(v) : 0; }
+    explicit operator bool() const noexcept { return v != nullptr; }
+
+    double& operator[](int i) { return valV(v, i); }
+    const double& operator[](int i) const { return valV(v, i); }
+
+private:
+    vector *v;
+};
+
+/**
+ * @brief A banded matrix that owns its storage
+ */
+class BandMatrix {
+public:
+    ///Make an empty matrix that doesn't hold anything
+    BandMatrix() noexcept : b(nullptr) {}
+
+    /**
+     * @brief Allocate a banded matrix of zeros
+     * @param rows Number of rows (and columns)
+     * @param bandwidth Number of diagonals stored
+     */
+    BandMatrix(int rows, int bandwidth) : b(CreateBandMatrix(rows, bandwidth)) {}
+
+    /**
+     * @brief Take ownership of a banded matrix from the C interface
+     * @param A Matrix to adopt. It will be destroyed with this object.
+     */
+    explicit BandMatrix(bndmatrix *A) noexcept : b(A) {}
+
+    ~BandMatrix() { reset(); }
+
+    BandMatrix(const BandMatrix&) = delete;
+    BandMatrix& operator=(const BandMatrix&) = delete;
+
+    BandMatrix(BandMatrix &&other) noexcept : b(other.b) { other.b = nullptr; }
+
+    BandMatrix& operator=(BandMatrix &&other) noexcept
+    {
+        if(this != &other) {
+            reset();
+            b = other.b;
+            other.b = nullptr;
+        }
+        return *this;
+    }
+
+    ///Make a deep copy of this matrix
+    BandMatrix clone() const { return BandMatrix(b ? CopyBandMatrix(b) : nullptr); }
+
+    ///The underlying C matrix. Still owned by this object.
+    bndmatrix* get() const noexcept { return b; }
+
+    ///Give up ownership of the underlying C matrix and return it
+    bndmatrix* release() noexcept
+    {
+        bndmatrix *A = b;
+        b = nullptr;
+        return A;
+    }
+
+    ///Destroy the matrix being held, leaving this one empty
+    void reset() noexcept
+    {
+        if(b)
+            DestroyBandMatrix(b);
+        b = nullptr;
+    }
+
+    int rows() const noexcept { return b ? b->r : 0; }
+    int bandwidth() const noexcept { return b ? b->w : 0; }
+    explicit operator bool() const noexcept { return b != nullptr; }
+
+    double operator()(int i, int j) const { return valB(b, i, j); }
+    void set(int i, int j, double value) { setvalB(b, value, i, j); }
+
+private:
+    bndmatrix *b;
+};
+
+/**
+ * @brief Non-owning view of a matrix
+ *
+ * Converts implicitly from Matrix and from matrix*, so functions that only
+ * read their arguments can take either.
+ */
+class MatrixRef {
+public:
+    MatrixRef(const Matrix &A) noexcept : m(A.get()) {}
+    MatrixRef(matrix *A) noexcept : m(A) {}
+
+    matrix* get() const noexcept { return m; }
+    int rows() const noexcept { return m ? nRows(m) : 0; }
+    int cols() const noexcept { return m ? nCols(m) : 0; }
+    explicit operator bool() const noexcept { return m != nullptr; }
+
+    double& operator()(int i, int j) const { return detail::at(m, i, j); }
+
+    ///Make an owning copy of the matrix being viewed
+    Matrix clone() const { return Matrix(m ? CopyMatrix(m) : nullptr); }
+
+private:
+    matrix *m;
+};
+
+/**
+ * @brief Non-owning view of a vector
+ */
+class VectorRef {
+public:
+    VectorRef(const Vector &x) noexcept : v(x.get()) {}
+    VectorRef(vector *x) noexcept : v(x) {}
+
+    vector* get() const noexcept { return v; }
+    int length() const noexcept { return v ? len(v) : 0; }
+    explicit operator bool() const noexcept { return v != nullptr; }
+
+    double& operator[](int i) const { return valV(v, i); }
+
+    ///Make an owning copy of the vector being viewed
+    Vector clone() const { return Vector(v ? CopyVector(v) : nullptr); }
+
+private:
+    vector *v;
+};
+
+namespace detail {
+
+/* Keep the destination if the kernel succeeded, otherwise empty it. */
+inline Matrix keep(Matrix &&C, matrix *result)
+{
+    if(!result)
+        C.reset();
+    return std::move(C);
+}
+
+inline Vector keep(Vector &&c, vector *result)
+{
+    if(!result)
+        c.reset();
+    return std::move(c);
+}
+
+} // namespace detail
+
+/* Matrix arithmetic. The overloads taking Matrix&& write the result into the
+ * temporary and hand it back instead of allocating a new matrix. Addition and
+ * subtraction broadcast single rows and columns the same way mtxadd does. */
+
+inline Matrix operator+(MatrixRef A, MatrixRef B)
+{
+    if(!A || !B)
+        return Matrix();
+    return Matrix(mtxadd(A.get(), B.get()));
+}
+
+inline Matrix operator+(Matrix &&A, MatrixRef B)
+{
+    if(!A || !B)
+        return Matrix();
+    if(A.rows() < B.rows() || A.cols() < B.cols())
+        return MatrixRef(A) + B;
+    matrix *r = mtxaddinto(A.get(), B.get(), A.get());
+    return detail::keep(std::move(A), r);
+}
+
+inline Matrix operator+(MatrixRef A, Matrix &&B)
+{
+    if(!A || !B)
+        return Matrix();
+    if(B.rows() < A.rows() || B.cols() < A.cols())
+        return A + MatrixRef(B);
+    matrix *r = mtxaddinto(A.get(), B.get(), B.get());
+    return detail::keep(std::move(B), r);
+}
+
+inline Matrix operator+(Matrix &&A, Matrix &&B)
+{
+    if(!A || !B)
+        return Matrix();
+    return std::move(A) + MatrixRef(B);
+}
+
+inline Matrix operator-(MatrixRef A, MatrixRef B)
+{
+    if(!A || !B)
+        return Matrix();
+    return Matrix(mtxsub(A.get(), B.get()));
+}
+
+inline Matrix operator-(Matrix &&A, MatrixRef B)
+{
+    if(!A || !B)
+        return Matrix();
+    if(A.rows() < B.rows() || A.cols() < B.cols())
+        return MatrixRef(A) - B;
+    matrix *r = mtxsubinto(A.get(), B.get(), A.get());
+    return detail::keep(std::move(A), r);
+}
+
+inline Matrix operator-(MatrixRef A, Matrix &&B)
+{
+    if(!A || !B)
+        return Matrix();
+    if(B.rows() < A.rows() || B.cols() < A.cols())
+        return A - MatrixRef(B);
+    matrix *r = mtxsubinto(A.get(), B.get(), B.get());
+    return detail::keep(std::move(B), r);
+}
+
+inline Matrix operator-(Matrix &&A, Matrix &&B)
+{
+    if(!A || !B)
+        return Matrix();
+    return std::move(A) - MatrixRef(B);
+}
+
+inline Matrix operator*(double k, MatrixRef A)
+{
+    if(!A)
+        return Matrix();
+    Matrix C(A.rows(), A.cols());
+    return detail::keep(std::move(C), mtxmulconstinto(A.get(), k, C.get()));
+}
+
+inline Matrix operator*(double k, Matrix &&A)
+{
+    if(!A)
+        return Matrix();
+    matrix *r = mtxmulconstinto(A.get(), k, A.get());
+    return detail::keep(std::move(A), r);
+}
+
+inline Matrix operator*(MatrixRef A, double k) { return k*A; }
+inline Matrix operator*(Matrix &&A, double k) { return k*std::move(A); }
+inline Matrix operator-(MatrixRef A) { return -1.0*A; }
+inline Matrix operator-(Matrix &&A) { return -1.0*std::move(A); }
+
+/**
+ * @brief Matrix product. The result always gets new storage, since the
+ * product kernel can't write over its inputs.
+ */
+inline Matrix operator*(MatrixRef A, MatrixRef B)
+{
+    if(!A || !B)
+        return Matrix();
+    return Matrix(mtxmul(A.get(), B.get()));
+}
+
+/**
+ * @brief Calculate A*B, reusing the storage in C when it's already the right
+ * size
+ * @param A The first matrix
+ * @param B The second matrix
+ * @param C Matrix to store the product in. Must not be A or B.
+ * @return false if the dimensions don't agree
+ */
+inline bool multiply(MatrixRef A, MatrixRef B, Matrix &C)
+{
+    if(!A || !B)
+        return false;
+    if(C.rows() != A.rows() || C.cols() != B.cols())
+        C = Matrix(A.rows(), B.cols());
+    return mtxmulinto(A.get(), B.get(), C.get()) != nullptr;
+}
+
+///Transpose of a matrix
+inline Matrix transpose(MatrixRef A)
+{
+    if(!A)
+        return Matrix();
+    return Matrix(mtxtrn(A.get()));
+}
+
+inline Matrix& operator+=(Matrix &A, MatrixRef B)
+{
+    if(!A || !B) {
+        A.reset();
+        return A;
+    }
+    if(!mtxaddinto(A.get(), B.get(), A.get()))
+        A.reset();
+    return A;
+}
+
+inline Matrix& operator-=(Matrix &A, MatrixRef B)
+{
+    if(!A || !B) {
+        A.reset();
+        return A;
+    }
+    if(!mtxsubinto(A.get(), B.get(), A.get()))
+        A.reset();
+    return A;
+}
+
+inline Matrix& operator*=(Matrix &A, double k)
+{
+    if(A)
+        mtxmulconstinto(A.get(), k, A.get());
+    return A;
+}
+
+/* Vector arithmetic, following the same pattern as the matrix operators. */
+
+inline Vector operator+(VectorRef a, VectorRef b)
+{
+    if(!a || !b)
+        return Vector();
+    Vector c(a.length());
+    return detail::keep(std::move(c), addVinto(a.get(), b.get(), c.get()));
+}
+
+inline Vector operator+(Vector &&a, VectorRef b)
+{
+    if(!a || !b)
+        return Vector();
+    vector *r = addVinto(a.get(), b.get(), a.get());
+    return detail::keep(std::move(a), r);
+}
+
+inline Vector operator+(VectorRef a, Vector &&b)
+{
+    if(!a || !b)
+        return Vector();
+    vector *r = addVinto(a.get(), b.get(), b.get());
+    return detail::keep(std::move(b), r);
+}
+
+inline Vector operator+(Vector &&a, Vector &&b)
+{
+    if(!a || !b)
+        return Vector();
+    return std::move(a) + VectorRef(b);
+}
+
+inline Vector operator-(VectorRef a, VectorRef b)
+{
+    if(!a || !b)
+        return Vector();
+    Vector c(a.length());
+    return detail::keep(std::move(c), subtractVinto(a.get(), b.get(), c.get()));
+}
+
+inline Vector operator-(Vector &&a, VectorRef b)
+{
+    if(!a || !b)
+        return Vector();
+    vector *r = subtractVinto(a.get(), b.get(), a.get());
+    return detail::keep(std::move(a), r);
+}
+
+inline Vector operator-(VectorRef a, Vector &&b)
+{
+    if(!a || !b)
+        return Vector();
+    vector *r = subtractVinto(a.get(), b.get(), b.get());
+    return detail::keep(std::move(b), r);
+}
+
+inline Vector operator-(Vector &&a, Vector &&b)
+{
+    if(!a || !b)
+        return Vector();
+    return std::move(a) - VectorRef(b);
+}
+
+inline Vector operator*(double k, VectorRef a)
+{
+    if(!a)
+        return Vector();
+    Vector c(a.length());
+    return detail::keep(std::move(c), scalarmultVinto(k, a.get(), c.get()));
+}
+
+inline Vector operator*(double k, Vector &&a)
+{
+    if(!a)
+        return Vector();
+    vector *r = scalarmultVinto(k, a.get(), a.get());
+    return detail::keep(std::move(a), r);
+}
+
+inline Vector operator*(VectorRef a, double k) { return k*a; }
+inline Vector operator*(Vector &&a, double k) { return k*std::move(a); }
+inline Vector operator-(VectorRef a) { return -1.0*a; }
+inline Vector operator-(Vector &&a) { return -1.0*std::move(a); }
+
+///Dot product of two vectors
+inline double dot(VectorRef a, VectorRef b)
+{
+    return dotV(a.get(), b.get());
+}
+
+inline Vector& operator+=(Vector &a, VectorRef b)
+{
+    if(!a || !b) {
+        a.reset();
+        return a;
+    }
+    if(!addVinto(a.get(), b.get(), a.get()))
+        a.reset();
+    return a;
+}
+
+inline Vector& operator-=(Vector &a, VectorRef b)
+{
+    if(!a || !b) {
+        a.reset();
+        return a;
+    }
+    if(!subtractVinto(a.get(), b.get(), a.get()))
+        a.reset();
+    return a;
+}
+
+inline Vector& operator*=(Vector &a, double k)
+{
+    if(a)
+        scalarmultVinto(k, a.get(), a.get());
+    return a;
+}
+
+} // namespace mtx
+
+#endif
@@ -0,0 +1,311 @@
+/**
+ * @file instrument.c
+ * Counters, timers and the trace event exporter used by the instrumentation
+ * layer. All counters are updated atomically, so instrumented functions may be
+ * called from several threads at once.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "instrument.h"
+
+///Default number of trace events kept when tracing is enabled
+#define MAXTRACEEVENTS 1000000
+
+/**
+ * @struct traceevent
+ * @brief A single completed operation, in Chrome trace event terms
+ */
+typedef struct {
+    int op;
+    unsigned long tid;
+    long long start; /* ns */
+    long long dur; /* ns */
+    double flops;
+} traceevent;
+
+static const char *opnames[MTXOP_COUNT] = {
+    "mtxmul",
+    "mtxtrn",
+    "mtxmulconst",
+    "mtxadd",
+    "mtxsub",
+    "CopyMatrix",
+    "CalcInv",
+    "SolveMatrixEquation",
+    "CholeskyFactor",
+    "LDLFactor",
+    "QRFactor",
+    "SolveLeastSquares",
+    "mtxloadcsv",
+    "mtxprntfile",
+    "ParseMatrix",
+    "dotV",
+    "addV",
+    "subtractV",
+    "scalarmultV",
+    "EvalGrid",
+    "ApplyStencil",
+    "MultigridSolve",
+    "mtxgemv",
+    "gemvB",
+    "gemvF",
+    "gemmF",
+    "LUFactorF",
+    "SolveMatrixEquationMixed",
+    "symvS",
+    "symmS",
+    "syrkS",
+    "trsm",
+    "trmm",
+    "gemmOOC",
+    "mtxtrnOOC",
+    "StatsUpdate",
+    "Interp1V",
+    "Interp2V",
+    "LUFactor",
+    "LUUpdate",
+    "CholeskyUpdate",
+    "QRReplaceColumn"
+};
+
+static unsigned long long allocs[MTXOBJ_COUNT];
+static unsigned long long frees[MTXOBJ_COUNT];
+static long long livebytes, peakbytes;
+static unsigned long long calls[MTXOP_COUNT];
+static unsigned long long nanoseconds[MTXOP_COUNT];
+static unsigned long long flops[MTXOP_COUNT];
+
+static traceevent *events = NULL;
+static int maxevents = 0;
+static int nevents = 0;
+static long long epoch = 0;
+
+static long long clockns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long) ts.tv_sec*1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * @brief Determine if the library was compiled with instrumentation.
+ * @returns 1 if MTX_INSTRUMENT was defined, 0 otherwise
+ */
+int mtxprofenabled(void)
+{
+#ifdef MTX_INSTRUMENT
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+/**
+ * @brief Get the name of an instrumented operation
+ * @param op One of the values of enum mtxop
+ * @returns The name of the corresponding library function
+ */
+const char* mtxopname(int op)
+{
+    if(op < 0 || op >= MTXOP_COUNT)
+        return "unknown";
+    return opnames[op];
+}
+
+void mtxprofalloc(int kind, long long bytes)
+{
+    long long live, peak;
+
+    __atomic_add_fetch(&allocs[kind], 1, __ATOMIC_RELAXED);
+    live = __atomic_add_fetch(&livebytes, bytes, __ATOMIC_RELAXED);
+
+    /* Raise the high-water mark if this allocation pushed past it */
+    peak = __atomic_load_n(&peakbytes, __ATOMIC_RELAXED);
+    while(live > peak &&
+          !__atomic_compare_exchange_n(&peakbytes, &peak, live, 1,
+                                       __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+void mtxproffree(int kind, long long bytes)
+{
+    __atomic_add_fetch(&frees[kind], 1, __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&livebytes, bytes, __ATOMIC_RELAXED);
+}
+
+long long mtxprofbegin(void)
+{
+    return clockns();
+}
+
+void mtxprofend(int op, long long t0, double nflops)
+{
+    long long dur;
+    int i;
+
+    dur = clockns() - t0;
+    __atomic_add_fetch(&calls[op], 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&nanoseconds[op], dur, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&flops[op], (unsigned long long) nflops,
+                       __ATOMIC_RELAXED);
+
+    if(__atomic_load_n(&events, __ATOMIC_ACQUIRE)) {
+        i = __atomic_fetch_add(&nevents, 1, __ATOMIC_RELAXED);
+        if(i < maxevents) {
+            events[i].op = op;
+            events[i].tid = (unsigned long) pthread_self();
+            events[i].start = t0;
+            events[i].dur = dur;
+            events[i].flops = nflops;
+        }
+    }
+}
+
+/**
+ * @brief Copy the current value of all counters.
+ * @param p Structure to store the values in
+ */
+void mtxprofsnapshot(mtxprofile *p)
+{
+    int i;
+
+    for(i=0; i<MTXOBJ_COUNT; i++) {
+        p->allocs[i] = __atomic_load_n(&allocs[i], __ATOMIC_RELAXED);
+        p->frees[i] = __atomic_load_n(&frees[i], __ATOMIC_RELAXED);
+    }
+    p->livebytes = __atomic_load_n(&livebytes, __ATOMIC_RELAXED);
+    p->peakbytes = __atomic_load_n(&peakbytes, __ATOMIC_RELAXED);
+    for(i=0; i<MTXOP_COUNT; i++) {
+        p->ops[i].calls = __atomic_load_n(&calls[i], __ATOMIC_RELAXED);
+        p->ops[i].seconds = 1e-9*__atomic_load_n(&nanoseconds[i], __ATOMIC_RELAXED);
+        p->ops[i].flops = __atomic_load_n(&flops[i], __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * @brief Zero all counters and discard any recorded trace events.
+ *
+ * The number of live bytes is not reset, since those objects still exist. The
+ * high-water mark is reset to the current number of live bytes.
+ */
+void mtxprofreset(void)
+{
+    int i;
+
+    for(i=0; i<MTXOBJ_COUNT; i++) {
+        __atomic_store_n(&allocs[i], 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&frees[i], 0, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&peakbytes, __atomic_load_n(&livebytes, __ATOMIC_RELAXED),
+                     __ATOMIC_RELAXED);
+    for(i=0; i<MTXOP_COUNT; i++) {
+        __atomic_store_n(&calls[i], 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&nanoseconds[i], 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&flops[i], 0, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&nevents, 0, __ATOMIC_RELAXED);
+    epoch = clockns();
+}
+
+/**
+ * @brief Print a snapshot in human-readable form
+ * @param fp File to print to
+ * @param p Snapshot to print
+ */
+void mtxprofprint(FILE *fp, mtxprofile *p)
+{
+    int i;
+
+    fprintf(fp, "matricies: %llu created, %llu destroyed\n",
+            p->allocs[MTXOBJ_MATRIX], p->frees[MTXOBJ_MATRIX]);
+    fprintf(fp, "vectors: %llu created, %llu destroyed\n",
+            p->allocs[MTXOBJ_VECTOR], p->frees[MTXOBJ_VECTOR]);
+    fprintf(fp, "live bytes: %lld (peak %lld)\n", p->livebytes, p->peakbytes);
+    for(i=0; i<MTXOP_COUNT; i++) {
+        if(!p->ops[i].calls)
+            continue;
+        fprintf(fp, "%-20s %10llu calls %12.6f s %10.3f GFLOP/s\n",
+                mtxopname(i), p->ops[i].calls, p->ops[i].seconds,
+                (p->ops[i].seconds > 0) ?
+                    p->ops[i].flops/p->ops[i].seconds*1e-9 : 0);
+    }
+}
+
+/**
+ * @brief Start or stop recording trace events.
+ *
+ * Each timed operation is recorded as a complete ("X") event. Once the event
+ * buffer is full, further events are dropped. Turning tracing off discards the
+ * buffer.
+ *
+ * @param on Nonzero to start recording, zero to stop
+ * @returns 0 on success, -1 if the event buffer could not be allocated
+ */
+int mtxproftrace(int on)
+{
+    traceevent *buf;
+
+    buf = __atomic_exchange_n(&events, NULL, __ATOMIC_ACQ_REL);
+    free(buf);
+    maxevents = 0;
+    __atomic_store_n(&nevents, 0, __ATOMIC_RELAXED);
+
+    if(!on)
+        return 0;
+
+    buf = (traceevent*) calloc(MAXTRACEEVENTS, sizeof(traceevent));
+    if(!buf) {
+        fprintf(stderr, "Unable to allocate the trace event buffer.\n");
+        return -1;
+    }
+    maxevents = MAXTRACEEVENTS;
+    epoch = clockns();
+    __atomic_store_n(&events, buf, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/**
+ * @brief Write the recorded trace events to a file.
+ *
+ * The output uses the Chrome trace event format and can be loaded in
+ * chrome://tracing or Perfetto.
+ *
+ * @param filename File to write to
+ * @returns Number of events written, or -1 on error
+ */
+int mtxprofwritetrace(char *filename)
+{
+    FILE *fp;
+    int i, n;
+
+    fp = fopen(filename, "w");
+    if(!fp) {
+        fprintf(stderr, "Unable to open %s for writing.\n", filename);
+        return -1;
+    }
+
+    n = __atomic_load_n(&nevents, __ATOMIC_ACQUIRE);
+    if(n > maxevents)
+        n = maxevents;
+
+    fprintf(fp, "{\"traceEvents\":[\n");
+    for(i=0; i<n; i++) {
+        fprintf(fp, "{\"name\":\"%s\",\"cat\":\"matrix\",\"ph\":\"X\","
+                "\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%lu,"
+                "\"args\":{\"flops\":%.0f}}%s\n", mtxopname(events[i].op),
+                1e-3*(events[i].start - epoch), 1e-3*events[i].dur,
+                events[i].tid, events[i].flops, (i < n-1) ? "," : "");
+    }
+    fprintf(fp, "],\"displayTimeUnit\":\"ns\"}\n");
+    fclose(fp);
+
+    return n;
+}
+
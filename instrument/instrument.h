@@ -0,0 +1,159 @@
+/**
+ * @file instrument.h
+ * Optional allocation and timing instrumentation for the matrix library.
+ *
+ * The library is instrumented when it is compiled with MTX_INSTRUMENT defined
+ * ("make INSTRUMENT=1"). Otherwise the recording macros expand to nothing, and
+ * the snapshot functions below simply report zeros.
+ */
+
+#ifndef INSTRUMENT_H
+#define INSTRUMENT_H
+
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Operations that are timed by the instrumentation layer
+ */
+enum mtxop {
+    MTXOP_MTXMUL,
+    MTXOP_MTXTRN,
+    MTXOP_MTXMULCONST,
+    MTXOP_MTXADD,
+    MTXOP_MTXSUB,
+    MTXOP_COPYMATRIX,
+    MTXOP_CALCINV,
+    MTXOP_SOLVE,
+    MTXOP_CHOLESKY,
+    MTXOP_LDL,
+    MTXOP_QR,
+    MTXOP_LEASTSQUARES,
+    MTXOP_LOADCSV,
+    MTXOP_PRNTFILE,
+    MTXOP_PARSEMATRIX,
+    MTXOP_DOTV,
+    MTXOP_ADDV,
+    MTXOP_SUBTRACTV,
+    MTXOP_SCALARMULTV,
+    MTXOP_EVALGRID,
+    MTXOP_STENCIL,
+    MTXOP_MULTIGRID,
+    MTXOP_GEMV,
+    MTXOP_GEMVB,
+    MTXOP_GEMVF,
+    MTXOP_GEMMF,
+    MTXOP_LUFACTORF,
+    MTXOP_SOLVEMIXED,
+    MTXOP_SYMV,
+    MTXOP_SYMM,
+    MTXOP_SYRK,
+    MTXOP_TRSM,
+    MTXOP_TRMM,
+    MTXOP_GEMMOOC,
+    MTXOP_TRNOOC,
+    MTXOP_STATS,
+    MTXOP_INTERP1,
+    MTXOP_INTERP2,
+    MTXOP_LUFACTOR,
+    MTXOP_LUUPDATE,
+    MTXOP_CHOLUPDATE,
+    MTXOP_QRREPLACE,
+    MTXOP_COUNT
+};
+
+/**
+ * @brief Kinds of objects whose allocations are counted
+ */
+enum mtxobj {
+    MTXOBJ_MATRIX,
+    MTXOBJ_VECTOR,
+    MTXOBJ_COUNT
+};
+
+/**
+ * @struct mtxopstats
+ * @brief Accumulated statistics for one operation
+ * @var mtxopstats::calls
+ * Number of times the operation was called
+ * @var mtxopstats::seconds
+ * Total wall clock time spent in the operation
+ * @var mtxopstats::flops
+ * Estimated number of floating point operations performed
+ */
+typedef struct {
+    unsigned long long calls;
+    double seconds;
+    double flops;
+} mtxopstats;
+
+/**
+ * @struct mtxprofile
+ * @brief Snapshot of all instrumentation counters
+ * @var mtxprofile::allocs
+ * Number of objects created, by kind
+ * @var mtxprofile::frees
+ * Number of objects destroyed, by kind
+ * @var mtxprofile::livebytes
+ * Bytes currently held by live matricies and vectors
+ * @var mtxprofile::peakbytes
+ * High-water mark of livebytes since the last reset
+ * @var mtxprofile::ops
+ * Timing statistics, indexed by enum mtxop
+ */
+typedef struct {
+    unsigned long long allocs[MTXOBJ_COUNT];
+    unsigned long long frees[MTXOBJ_COUNT];
+    long long livebytes;
+    long long peakbytes;
+    mtxopstats ops[MTXOP_COUNT];
+} mtxprofile;
+
+int mtxprofenabled(void);
+const char* mtxopname(int);
+void mtxprofsnapshot(mtxprofile*);
+void mtxprofreset(void);
+void mtxprofprint(FILE*, mtxprofile*);
+int mtxproftrace(int);
+int mtxprofwritetrace(char*);
+
+/* Recording functions. These should only be called through the macros. */
+void mtxprofalloc(int, long long);
+void mtxproffree(int, long long);
+long long mtxprofbegin(void);
+void mtxprofend(int, long long, double);
+
+#ifdef MTX_INSTRUMENT
+/**
+ * @brief Record the creation of an object taking up BYTES bytes
+ */
+#define PROF_ALLOC(KIND, BYTES) mtxprofalloc((KIND), (BYTES))
+/**
+ * @brief Record the destruction of an object taking up BYTES bytes
+ */
+#define PROF_FREE(KIND, BYTES) mtxproffree((KIND), (BYTES))
+/**
+ * @brief Start timing an operation. Must appear with the declarations at the
+ * top of a block, and be paired with PROF_END in the same block.
+ */
+#define PROF_BEGIN(OP) long long _prof_t0 = mtxprofbegin()
+/**
+ * @brief Stop timing an operation and credit it with FLOPS operations
+ */
+#define PROF_END(OP, FLOPS) mtxprofend((OP), _prof_t0, (FLOPS))
+#else
+#define PROF_ALLOC(KIND, BYTES)
+#define PROF_FREE(KIND, BYTES)
+#define PROF_BEGIN(OP)
+#define PROF_END(OP, FLOPS)
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
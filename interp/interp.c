@@ -0,0 +1,540 @@
+/**
+ * @file interp.c
+ * Table lookups with linear and cubic interpolation.
+ *
+ * Cubic tables store the derivative at each point along with the value, so a
+ * lookup only has to evaluate a cubic Hermite polynomial (or a product of two
+ * in 2D) over the interval the point falls in. In 1D the derivatives are
+ * picked as in Fritsch and Carlson's method, which keeps the interpolant
+ * monotone wherever the data is. In 2D they're estimated with finite
+ * differences over the neighboring points.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+
+#include "interp.h"
+#include "../2dmatrix/mtxview.h"
+#include "../instrument/instrument.h"
+
+///Largest distance of a point from where equal spacing would put it, relative
+///to the spacing, for an axis to still count as equally spaced
+#define INTERPUNIFORMTOL 1e-9
+///Number of lookups above which a batch is split between threads
+#define PARALLELSIZE 1e4
+
+/* Copy n points, xs apart in memory, into an axis. Returns 0 on success. */
+static int InitAxis(interpaxis *a, const double *x, long xs, int n)
+{
+    double h;
+    int i;
+
+    if(n < 2) {
+        fprintf(stderr, "Error: An axis needs at least two points.\n");
+        return -1;
+    }
+    a->x = (double*) malloc(n*sizeof(double));
+    if(!a->x) {
+        fprintf(stderr, "Memory allocation error: %s\n", strerror(errno));
+        return -1;
+    }
+    for(i=0; i<n; i++) {
+        a->x[i] = x[i*xs];
+        /* Written this way so that NaNs fail too */
+        if(i > 0 && !(a->x[i] > a->x[i-1])) {
+            fprintf(stderr, "Error: Axis points must be in increasing order.\n");
+            free(a->x);
+            a->x = NULL;
+            return -1;
+        }
+    }
+    a->n = n;
+
+    h = (a->x[n-1] - a->x[0])/(n-1);
+    a->uniform = 1;
+    for(i=1; i<n-1 && a->uniform; i++)
+        if(fabs(a->x[i] - (a->x[0] + i*h)) > INTERPUNIFORMTOL*h)
+            a->uniform = 0;
+    a->rh = 1/h;
+
+    return 0;
+}
+
+/* Find the interval i, from x_i to x_(i+1), that x falls in. Points past the
+ * ends give the first or last interval. If hint isn't NULL, the interval it
+ * holds is checked first, along with its neighbors, and it's set to the one
+ * that was found. */
+static int Locate(const interpaxis *a, double x, int *hint)
+{
+    const double *p = a->x;
+    int lo = 0, hi = a->n-1, i, mid;
+    double t;
+
+    if(a->uniform) {
+        t = (x - p[0])*a->rh;
+        if(!(t > 0))
+            return 0;
+        if(t >= a->n-1)
+            return a->n-2;
+        i = (int) t;
+        /* The points can be a rounding error away from where the spacing
+         * puts them */
+        if(x < p[i] && i > 0)
+            i--;
+        else if(x >= p[i+1] && i < a->n-2)
+            i++;
+        return i;
+    }
+
+    /* Narrow [lo, hi] down using the hint, then finish with a binary search */
+    if(hint && *hint >= 0 && *hint < a->n-1) {
+        i = *hint;
+        if(x < p[i]) {
+            hi = i;
+            if(i > 0 && x >= p[i-1])
+                lo = i-1;
+        } else if(i+1 == a->n-1 || x < p[i+1]) {
+            lo = i;
+            hi = i+1;
+        } else if(i+2 == a->n-1 || x < p[i+2]) {
+            lo = i+1;
+            hi = i+2;
+        } else {
+            lo = i+2;
+        }
+    }
+    while(hi - lo > 1) {
+        mid = (lo + hi)/2;
+        if(x < p[mid])
+            hi = mid;
+        else
+            lo = mid;
+    }
+
+    if(hint)
+        *hint = lo;
+    return lo;
+}
+
+/* Position of x within interval i of a, from 0 to 1 */
+static double Fraction(const interpaxis *a, int i, double x)
+{
+    double t = (x - a->x[i])/(a->x[i+1] - a->x[i]);
+
+    if(t < 0)
+        t = 0;
+    else if(t > 1)
+        t = 1;
+    return t;
+}
+
+/* Weights of the values and derivatives at the start and end of an interval
+ * of width h for a cubic Hermite polynomial, at fraction t of the way along.
+ * w[0] and w[1] are for the values and w[2] and w[3] for the derivatives. */
+static void Hermite(double t, double h, double *w)
+{
+    double s = 1 - t;
+
+    w[0] = (1 + 2*t)*s*s;
+    w[1] = t*t*(3 - 2*t);
+    w[2] = h*t*s*s;
+    w[3] = -h*t*t*s;
+}
+
+/* Derivative at an end of the data for a monotone cubic, from the widths h0
+ * and h1 and slopes del0 and del1 of the two intervals nearest that end */
+static double EndSlope(double h0, double h1, double del0, double del1)
+{
+    double d = ((2*h0 + h1)*del0 - h0*del1)/(h0 + h1);
+
+    if(d*del0 <= 0)
+        return 0;
+    if(del0*del1 < 0 && fabs(d) > fabs(3*del0))
+        return 3*del0;
+    return d;
+}
+
+/* Fill in the derivatives of a 1D cubic table so the interpolant is monotone
+ * wherever the data is. c holds (value, derivative) pairs. */
+static void MonotoneSlopes(const double *x, double *c, int n)
+{
+    double hm, hp, dm, dp, w1, w2;
+    int k;
+
+    if(n == 2) {
+        c[1] = c[3] = (c[2] - c[0])/(x[1] - x[0]);
+        return;
+    }
+
+    for(k=1; k<n-1; k++) {
+        hm = x[k] - x[k-1];
+        hp = x[k+1] - x[k];
+        dm = (c[2*k] - c[2*k-2])/hm;
+        dp = (c[2*k+2] - c[2*k])/hp;
+        if(dm*dp <= 0) {
+            c[2*k+1] = 0;
+        } else {
+            w1 = 2*hp + hm;
+            w2 = hp + 2*hm;
+            c[2*k+1] = (w1 + w2)/(w1/dm + w2/dp);
+        }
+    }
+
+    c[1] = EndSlope(x[1]-x[0], x[2]-x[1],
+                    (c[2]-c[0])/(x[1]-x[0]), (c[4]-c[2])/(x[2]-x[1]));
+    k = n-1;
+    c[2*k+1] = EndSlope(x[k]-x[k-1], x[k-1]-x[k-2],
+                        (c[2*k]-c[2*k-2])/(x[k]-x[k-1]),
+                        (c[2*k-2]-c[2*k-4])/(x[k-1]-x[k-2]));
+}
+
+/* Estimate the derivative of n values f, fs apart in memory, at points x,
+ * and store them ds apart in d. Uses central differences inside and one-sided
+ * ones at the ends. */
+static void Gradient(const double *x, int n, const double *f, long fs,
+                     double *d, long ds)
+{
+    double hm, hp;
+    int k;
+
+    d[0] = (f[fs] - f[0])/(x[1] - x[0]);
+    d[(n-1)*ds] = (f[(n-1)*fs] - f[(n-2)*fs])/(x[n-1] - x[n-2]);
+    for(k=1; k<n-1; k++) {
+        hm = x[k] - x[k-1];
+        hp = x[k+1] - x[k];
+        d[k*ds] = (hm*hm*f[(k+1)*fs] + (hp*hp - hm*hm)*f[k*fs]
+                   - hp*hp*f[(k-1)*fs])/(hm*hp*(hm + hp));
+    }
+}
+
+/* Build a 1D table from n points and values, each a fixed distance apart in
+ * memory */
+static interp1* NewInterp1(const double *x, long xs, const double *y, long ys,
+                           int n, int method)
+{
+    interp1 *I;
+    int k = (method == INTERP_CUBIC) ? 2 : 1, i;
+
+    if(method != INTERP_LINEAR && method != INTERP_CUBIC) {
+        fprintf(stderr, "Error: Unknown interpolation method %d.\n", method);
+        return NULL;
+    }
+
+    I = (interp1*) calloc(1, sizeof(interp1));
+    if(!I) {
+        fprintf(stderr, "Memory allocation error: %s\n", strerror(errno));
+        return NULL;
+    }
+    if(InitAxis(&I->x, x, xs, n)) {
+        free(I);
+        return NULL;
+    }
+    I->c = (double*) malloc((long) k*n*sizeof(double));
+    if(!I->c) {
+        fprintf(stderr, "Memory allocation error: %s\n", strerror(errno));
+        DestroyInterp1(I);
+        return NULL;
+    }
+    I->method = method;
+
+    for(i=0; i<n; i++)
+        I->c[i*k] = y[i*ys];
+    if(method == INTERP_CUBIC)
+        MonotoneSlopes(I->x.x, I->c, n);
+
+    return I;
+}
+
+/**
+ * @brief Build a table of a function of one variable
+ * @param x Points the function is given at, in increasing order. At least
+ *      two are needed.
+ * @param y Value of the function at each point
+ * @param method INTERP_LINEAR or INTERP_CUBIC
+ * @returns The table, or NULL on failure. The data is copied, so x and y can
+ *      be destroyed afterwards.
+ */
+interp1* CreateInterp1(vector *x, vector *y, int method)
+{
+    if(len(x) != len(y)) {
+        fprintf(stderr, "Error: Incompatible vector lengths.\n");
+        return NULL;
+    }
+    return NewInterp1(x->v, 1, y->v, 1, len(x), method);
+}
+
+/**
+ * @brief Build a table of a function of one variable from two columns of a
+ * matrix, such as one loaded with mtxloadcsv
+ * @param T The matrix, in either layout
+ * @param xcol Column holding the points the function is given at, in
+ *      increasing order
+ * @param ycol Column holding the value of the function at each point
+ * @param method INTERP_LINEAR or INTERP_CUBIC
+ * @returns The table, or NULL on failure
+ */
+interp1* CreateInterp1Table(matrix *T, int xcol, int ycol, int method)
+{
+    mtxview v = ViewMatrix(T);
+
+    if(xcol < 0 || xcol >= v.cols || ycol < 0 || ycol >= v.cols) {
+        fprintf(stderr, "Error: Column index out of range.\n");
+        return NULL;
+    }
+    return NewInterp1(v.data + (long) xcol*v.cs, v.rs,
+                      v.data + (long) ycol*v.cs, v.rs, v.rows, method);
+}
+
+/**
+ * @brief Free a 1D table
+ * @param I The table
+ */
+void DestroyInterp1(interp1 *I)
+{
+    free(I->x.x);
+    free(I->c);
+    free(I);
+}
+
+/**
+ * @brief Look up a value in a 1D table
+ * @param I The table
+ * @param x Where to look it up
+ * @param hint Pointer to an int that holds the interval of the last lookup.
+ *      Set it to 0 before the first one. Lookups near the last one are faster
+ *      when it's given. Can be NULL.
+ * @returns The interpolated value
+ */
+double Interp1(interp1 *I, double x, int *hint)
+{
+    int i = Locate(&I->x, x, hint);
+    double t = Fraction(&I->x, i, x), w[4];
+    const double *c;
+
+    if(I->method == INTERP_LINEAR) {
+        c = I->c + i;
+        return c[0] + t*(c[1] - c[0]);
+    }
+
+    c = I->c + 2*i;
+    Hermite(t, I->x.x[i+1] - I->x.x[i], w);
+    return w[0]*c[0] + w[2]*c[1] + w[1]*c[2] + w[3]*c[3];
+}
+
+/**
+ * @brief Look up every component of a vector in a 1D table
+ * @param I The table
+ * @param x Where to look them up
+ * @returns A vector of interpolated values
+ */
+vector* Interp1V(interp1 *I, vector *x)
+{
+    vector *y;
+    y = CreateVector(len(x));
+    return Interp1Vinto(I, x, y);
+}
+
+/**
+ * @brief Look up every component of a vector in a 1D table, storing the
+ * results in an existing vector
+ *
+ * Large batches are split between threads. Each thread takes a consecutive
+ * run of the points and uses the interval of one as the hint for the next, so
+ * points that are in order are especially quick to look up.
+ *
+ * @param I The table
+ * @param x Where to look them up
+ * @param y Vector to store the results in. May be x.
+ * @returns y, or NULL if the lengths don't match
+ */
+vector* Interp1Vinto(interp1 *I, vector *x, vector *y)
+{
+    int k, n = len(x);
+
+    if(len(y) != n) {
+        fprintf(stderr, "Error: Incompatible vector lengths.\n");
+        return NULL;
+    }
+
+    PROF_BEGIN(MTXOP_INTERP1);
+    #pragma omp parallel if(n > PARALLELSIZE)
+    {
+        int hint = 0;
+
+        #pragma omp for schedule(static)
+        for(k=0; k<n; k++)
+            valV(y, k) = Interp1(I, valV(x, k), &hint);
+    }
+    PROF_END(MTXOP_INTERP1, n);
+
+    return y;
+}
+
+/**
+ * @brief Build a table of a function of two variables
+ *
+ * The table is laid out like the matricies made by meshgridX and meshgridY and
+ * by EvalGrid: Z(i, j) is the value at (x_j, y_i).
+ *
+ * @param x Points along the columns, in increasing order. At least two are
+ *      needed.
+ * @param y Points along the rows, in increasing order. At least two are
+ *      needed.
+ * @param Z A len(y) x len(x) matrix of values, in either layout
+ * @param method INTERP_LINEAR for bilinear interpolation or INTERP_CUBIC for
+ *      bicubic
+ * @returns The table, or NULL on failure
+ */
+interp2* CreateInterp2(vector *x, vector *y, matrix *Z, int method)
+{
+    mtxview v = ViewMatrix(Z);
+    interp2 *I;
+    int nx = len(x), ny = len(y), k = (method == INTERP_CUBIC) ? 4 : 1, i, j;
+    double *c;
+
+    if(v.rows != ny || v.cols != nx) {
+        fprintf(stderr, "Error: Incompatible matrix dimensions.\n");
+        return NULL;
+    }
+    if(method != INTERP_LINEAR && method != INTERP_CUBIC) {
+        fprintf(stderr, "Error: Unknown interpolation method %d.\n", method);
+        return NULL;
+    }
+
+    I = (interp2*) calloc(1, sizeof(interp2));
+    if(!I) {
+        fprintf(stderr, "Memory allocation error: %s\n", strerror(errno));
+        return NULL;
+    }
+    if(InitAxis(&I->x, x->v, 1, nx) || InitAxis(&I->y, y->v, 1, ny)) {
+        DestroyInterp2(I);
+        return NULL;
+    }
+    I->c = c = (double*) malloc((long) k*nx*ny*sizeof(double));
+    if(!c) {
+        fprintf(stderr, "Memory allocation error: %s\n", strerror(errno));
+        DestroyInterp2(I);
+        return NULL;
+    }
+    I->method = method;
+
+    for(i=0; i<ny; i++)
+        for(j=0; j<nx; j++)
+            c[((long) i*nx + j)*k] = valView(v, i, j);
+
+    if(method == INTERP_CUBIC) {
+        for(i=0; i<ny; i++)
+            Gradient(I->x.x, nx, c + (long) i*nx*4, 4, c + (long) i*nx*4 + 1, 4);
+        for(j=0; j<nx; j++) {
+            Gradient(I->y.x, ny, c + j*4, (long) nx*4, c + j*4 + 2, (long) nx*4);
+            Gradient(I->y.x, ny, c + j*4 + 1, (long) nx*4, c + j*4 + 3, (long) nx*4);
+        }
+    }
+
+    return I;
+}
+
+/**
+ * @brief Free a 2D table
+ * @param I The table
+ */
+void DestroyInterp2(interp2 *I)
+{
+    free(I->x.x);
+    free(I->y.x);
+    free(I->c);
+    free(I);
+}
+
+/**
+ * @brief Look up a value in a 2D table
+ * @param I The table
+ * @param x Position along the columns
+ * @param y Position along the rows
+ * @param hintx Hint for the x axis, as for Interp1. Can be NULL.
+ * @param hinty Hint for the y axis. Can be NULL.
+ * @returns The interpolated value
+ */
+double Interp2(interp2 *I, double x, double y, int *hintx, int *hinty)
+{
+    int j = Locate(&I->x, x, hintx), i = Locate(&I->y, y, hinty);
+    double t = Fraction(&I->x, j, x), u = Fraction(&I->y, i, y);
+    double wx[4], wy[4], z = 0;
+    long nx = I->x.n;
+    const double *c;
+    int r, s;
+
+    if(I->method == INTERP_LINEAR) {
+        c = I->c + i*nx + j;
+        return (1-u)*(c[0] + t*(c[1] - c[0])) + u*(c[nx] + t*(c[nx+1] - c[nx]));
+    }
+
+    Hermite(t, I->x.x[j+1] - I->x.x[j], wx);
+    Hermite(u, I->y.x[i+1] - I->y.x[i], wy);
+    for(r=0; r<2; r++) {
+        for(s=0; s<2; s++) {
+            c = I->c + ((i+r)*nx + j+s)*4;
+            z += wy[r]*(wx[s]*c[0] + wx[2+s]*c[1])
+                 + wy[2+r]*(wx[s]*c[2] + wx[2+s]*c[3]);
+        }
+    }
+    return z;
+}
+
+/**
+ * @brief Look up a list of points in a 2D table
+ * @param I The table
+ * @param x Position of each point along the columns
+ * @param y Position of each point along the rows
+ * @returns A vector of interpolated values, or NULL if x and y have different
+ *      lengths
+ */
+vector* Interp2V(interp2 *I, vector *x, vector *y)
+{
+    vector *z;
+    z = CreateVector(len(x));
+    if(!Interp2Vinto(I, x, y, z)) {
+        DestroyVector(z);
+        return NULL;
+    }
+    return z;
+}
+
+/**
+ * @brief Look up a list of points in a 2D table, storing the results in an
+ * existing vector
+ *
+ * Large batches are split between threads, as in Interp1Vinto.
+ *
+ * @param I The table
+ * @param x Position of each point along the columns
+ * @param y Position of each point along the rows
+ * @param z Vector to store the results in. May be x or y.
+ * @returns z, or NULL if the lengths don't match
+ */
+vector* Interp2Vinto(interp2 *I, vector *x, vector *y, vector *z)
+{
+    int k, n = len(x);
+
+    if(len(y) != n || len(z) != n) {
+        fprintf(stderr, "Error: Incompatible vector lengths.\n");
+        return NULL;
+    }
+
+    PROF_BEGIN(MTXOP_INTERP2);
+    #pragma omp parallel if(n > PARALLELSIZE)
+    {
+        int hintx = 0, hinty = 0;
+
+        #pragma omp for schedule(static)
+        for(k=0; k<n; k++)
+            valV(z, k) = Interp2(I, valV(x, k), valV(y, k), &hintx, &hinty);
+    }
+    PROF_END(MTXOP_INTERP2, n);
+
+    return z;
+}
+
@@ -0,0 +1,104 @@
+/**
+ * @file interp.h
+ * Interpolation in 1D and 2D tables.
+ *
+ * A table is built once from its axes and data and can then be looked up any
+ * number of times. Axes with equally spaced points, like those made by
+ * linspaceV, are detected when the table is built, and finding the interval a
+ * point falls in is then a single multiplication. Other axes are searched with
+ * a binary search that first tries the interval of the previous lookup, so
+ * points that are close together or in order are found in a few comparisons.
+ *
+ * Lookups outside the axes return the value at the nearest edge of the table,
+ * and NaNs give NaN.
+ */
+
+#ifndef INTERP_H
+#define INTERP_H
+
+#include "2dmatrix/2dmatrix.h"
+#include "vector/vector.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+///Linear interpolation in 1D, or bilinear in 2D
+#define INTERP_LINEAR 0
+///Monotone cubic (PCHIP) interpolation in 1D, or bicubic in 2D
+#define INTERP_CUBIC 1
+
+/**
+ * @struct interpaxis
+ * @brief The points along one axis of a table
+ * @var interpaxis::x
+ * The points, in increasing order
+ * @var interpaxis::n
+ * Number of points
+ * @var interpaxis::uniform
+ * Nonzero if the points are equally spaced
+ * @var interpaxis::rh
+ * One over the spacing of the points, if they're equally spaced
+ */
+typedef struct {
+    double *x;
+    int n;
+    int uniform;
+    double rh;
+} interpaxis;
+
+/**
+ * @struct interp1
+ * @brief A table of a function of one variable
+ * @var interp1::x
+ * The points the function is given at
+ * @var interp1::c
+ * The value at each point, followed by its derivative for INTERP_CUBIC
+ * @var interp1::method
+ * INTERP_LINEAR or INTERP_CUBIC
+ */
+typedef struct {
+    interpaxis x;
+    double *c;
+    int method;
+} interp1;
+
+/**
+ * @struct interp2
+ * @brief A table of a function of two variables
+ * @var interp2::x
+ * The points along the columns of the table
+ * @var interp2::y
+ * The points along the rows of the table
+ * @var interp2::c
+ * The value at each point, by rows. For INTERP_CUBIC, each value is followed
+ * by the derivatives with respect to x, y, and x and y.
+ * @var interp2::method
+ * INTERP_LINEAR or INTERP_CUBIC
+ */
+typedef struct {
+    interpaxis x;
+    interpaxis y;
+    double *c;
+    int method;
+} interp2;
+
+interp1* CreateInterp1(vector*, vector*, int);
+interp1* CreateInterp1Table(matrix*, int, int, int);
+void DestroyInterp1(interp1*);
+double Interp1(interp1*, double, int*);
+vector* Interp1V(interp1*, vector*);
+vector* Interp1Vinto(interp1*, vector*, vector*);
+
+interp2* CreateInterp2(vector*, vector*, matrix*, int);
+void DestroyInterp2(interp2*);
+double Interp2(interp2*, double, double, int*, int*);
+vector* Interp2V(interp2*, vector*, vector*);
+vector* Interp2Vinto(interp2*, vector*, vector*, vector*);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
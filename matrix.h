@@ -8,7 +8,23 @@
 
 #include "2dmatrix/2dmatrix.h"
 #include "2dmatrix/mtxsolver.h"
+#include "2dmatrix/mtxview.h"
+#include "2dmatrix/triangular.h"
 #include "vector/vector.h"
+#include "batch/batch.h"
+#include "stencil/stencil.h"
+#include "symmetric/symmatrix.h"
+#include "ooc/oocmatrix.h"
+#include "shm/shmmatrix.h"
+#include "pipeline/pipeline.h"
+#include "stats/stats.h"
+#include "interp/interp.h"
+#include "repro/repro.h"
+#include "instrument/instrument.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 matrix* CatColVector(int, ...);
 vector* ExtractColumnAsVector(matrix*, int);
@@ -16,6 +32,13 @@ vector* ExtractRowAsVector(matrix*, int);
 
 matrix* meshgridX(vector*, vector*);
 matrix* meshgridY(vector*, vector*);
+matrix* EvalGrid(vector*, vector*, double (*f)(double, double, void*), void*);
+matrix* EvalGridInto(vector*, vector*, double (*f)(double, double, void*),
+                     void*, matrix*);
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif
 
@@ -0,0 +1,818 @@
+/**
+ * @file multigrid.c
+ * Geometric multigrid for -div(a grad u) + c u = f on rectangular grids.
+ *
+ * The operator is discretized with the standard 5-point stencil. The
+ * coefficient on the face between two neighboring points is the harmonic
+ * mean of a at those points, which keeps the flux right where a jumps. Coarse
+ * grids take every other point of the fine grid. Their face coefficients are
+ * averaged from the fine faces they cover, so that a jump in a stays in the
+ * same place on every grid, and c is averaged by full weighting. Corrections
+ * are brought back to the fine grid by interpolation weighted by the face
+ * coefficients, which keeps the flux continuous across a jump, and residuals
+ * are moved to the coarse grid by its transpose. Where a is smooth, these are
+ * bilinear interpolation and full weighting.
+ *
+ * All of the grid loops work a row at a time and are split between threads on
+ * large grids. Red-black Gauss-Seidel updates all of the points of one color
+ * at once, so it parallelizes the same way Jacobi does. Post-smoothing visits
+ * the colors in the opposite order from pre-smoothing, which makes each cycle
+ * a symmetric operator that can be used to precondition conjugate gradients.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+
+#include "multigrid.h"
+#include "../2dmatrix/mtxview.h"
+#include "../repro/repro.h"
+#include "../instrument/instrument.h"
+
+///Largest amount of work (N*bandwidth^2) allowed for factoring the coarsest
+///grid directly. Coarser grids than this are smoothed instead.
+#define MGDIRECTFLOPS 1e8
+///Number of smoothing sweeps used on the coarsest grid when it isn't factored,
+///half forward and half backward
+#define MGCOARSESWEEPS 50
+///Damping factor for Jacobi smoothing. 4/5 is optimal for the 5-point Laplacian.
+#define MGJACOBIWEIGHT 0.8
+///Number of grid points above which the grid loops are multithreaded
+#define PARALLELSIZE 1e5
+
+/* Rough number of floating point operations in one cycle on an n x m grid:
+ * each sweep and residual is about 11 per point, and the coarse grids add a
+ * third again. */
+#define CYCLEFLOPS(MG, N, M) (11.0*((MG)->presmooth + (MG)->postsmooth + 2)*(N)*(M)*4/3)
+
+/* Harmonic mean of the coefficients at two neighboring points */
+static double FaceCoef(double a, double b)
+{
+    return 2*a*b/(a+b);
+}
+
+/* Allocate the operator and work space for an n x m grid. Returns 0 if any
+ * of it couldn't be allocated. */
+static int AllocLevel(mglevel *L, int n, int m)
+{
+    L->ax = CreateMatrix(n, m-1);
+    L->ay = CreateMatrix(n-1, m);
+    L->diag = CreateMatrix(n, m);
+    L->u = CreateMatrix(n, m);
+    L->f = CreateMatrix(n, m);
+    L->r = CreateMatrix(n, m);
+    return L->ax && L->ay && L->diag && L->u && L->f && L->r;
+}
+
+/* DestroyMatrix for matricies that might not have been allocated */
+static void FreeMatrix(matrix *A)
+{
+    if(A)
+        DestroyMatrix(A);
+}
+
+/* Free whatever AllocLevel managed to allocate */
+static void FreeLevel(mglevel *L)
+{
+    FreeMatrix(L->ax);
+    FreeMatrix(L->ay);
+    FreeMatrix(L->diag);
+    FreeMatrix(L->u);
+    FreeMatrix(L->f);
+    FreeMatrix(L->r);
+}
+
+/* Face coefficients on the finest grid from the coefficient a at each point
+ * and the spacing hx and hy */
+static void FineFaces(mglevel *L, matrix *a, double hx, double hy)
+{
+    int n = nRows(a), m = nCols(a), i, j;
+    double **A = a->array, **ax = L->ax->array, **ay = L->ay->array;
+
+    for(i=0; i<n; i++)
+        for(j=0; j<m-1; j++)
+            ax[i][j] = FaceCoef(A[i][j], A[i][j+1])/(hx*hx);
+    for(i=0; i<n-1; i++)
+        for(j=0; j<m; j++)
+            ay[i][j] = FaceCoef(A[i][j], A[i+1][j])/(hy*hy);
+}
+
+/* Face coefficients on the coarse grid C from those on the fine grid F. A
+ * coarse face spans two fine faces one after the other, which pass the flux
+ * in series and are combined by their harmonic mean, and it collects the flux
+ * from the fine faces beside them, which are averaged with weights 1/4, 1/2,
+ * 1/4. Doubling the spacing divides the result by 4. Working from the faces
+ * rather than from a at the coarse points keeps a jump in a where it is on
+ * every grid. */
+static void CoarseFaces(mglevel *F, mglevel *C)
+{
+    int n = nRows(F->u), m = nCols(F->u), N = nRows(C->u), M = nCols(C->u);
+    int I, J, i, j, k;
+    double **fx = F->ax->array, **fy = F->ay->array,
+           **cx = C->ax->array, **cy = C->ay->array;
+    double s, w;
+
+    for(I=0; I<N; I++) {
+        for(J=0; J<M-1; J++) {
+            s = w = 0;
+            for(k=-1; k<=1; k++) {
+                i = 2*I+k;
+                if(i < 0 || i >= n)
+                    continue;
+                s += (k ? 1 : 2)*FaceCoef(fx[i][2*J], fx[i][2*J+1]);
+                w += k ? 1 : 2;
+            }
+            cx[I][J] = s/w/4;
+        }
+    }
+    for(I=0; I<N-1; I++) {
+        for(J=0; J<M; J++) {
+            s = w = 0;
+            for(k=-1; k<=1; k++) {
+                j = 2*J+k;
+                if(j < 0 || j >= m)
+                    continue;
+                s += (k ? 1 : 2)*FaceCoef(fy[2*I][j], fy[2*I+1][j]);
+                w += k ? 1 : 2;
+            }
+            cy[I][J] = s/w/4;
+        }
+    }
+}
+
+/* Diagonal of the operator from the face coefficients and c (may be NULL) */
+static void SetDiag(mglevel *L, matrix *c)
+{
+    int n = nRows(L->u), m = nCols(L->u), i, j;
+    double **ax = L->ax->array, **ay = L->ay->array, **d = L->diag->array;
+
+    for(i=1; i<n-1; i++)
+        for(j=1; j<m-1; j++)
+            d[i][j] = ax[i][j-1] + ax[i][j] + ay[i-1][j] + ay[i][j]
+                    + (c ? c->array[i][j] : 0);
+}
+
+/* Average c onto a grid with every other point, with full weighting on the
+ * interior. Only the interior values are used. */
+static matrix* CoarsenCoef(matrix *c)
+{
+    int i, j, I, J, n = (nRows(c)-1)/2+1, m = (nCols(c)-1)/2+1;
+    double **a = c->array;
+    matrix *b;
+
+    b = CreateMatrix(n, m);
+    if(!b)
+        return NULL;
+    for(I=1; I<n-1; I++) {
+        for(J=1; J<m-1; J++) {
+            i = 2*I;
+            j = 2*J;
+            b->array[I][J] = (4*a[i][j]
+                              + 2*(a[i-1][j] + a[i+1][j] + a[i][j-1] + a[i][j+1])
+                              + a[i-1][j-1] + a[i-1][j+1] + a[i+1][j-1]
+                              + a[i+1][j+1]) / 16;
+        }
+    }
+    return b;
+}
+
+/* Assemble the operator on the interior points of a grid as a band matrix
+ * and factor it. Returns NULL if that would be too expensive. */
+static bndmatrix* CoarseFactor(mglevel *L)
+{
+    int n = nRows(L->u), m = nCols(L->u), mi = m-2;
+    int i, j, k, N = (n-2)*mi;
+    double **ax = L->ax->array, **ay = L->ay->array, **d = L->diag->array;
+    bndmatrix *B;
+
+    if((double) N*mi*mi > MGDIRECTFLOPS)
+        return NULL;
+
+    B = CreateBandMatrix(N, 2*mi+1);
+    for(i=1; i<n-1; i++) {
+        for(j=1; j<m-1; j++) {
+            k = (i-1)*mi + j-1;
+            setvalB(B, d[i][j], k, k);
+            if(j > 1) {
+                setvalB(B, -ax[i][j-1], k, k-1);
+                setvalB(B, -ax[i][j-1], k-1, k);
+            }
+            if(i > 1) {
+                setvalB(B, -ay[i-1][j], k, k-mi);
+                setvalB(B, -ay[i-1][j], k-mi, k);
+            }
+        }
+    }
+
+    if(CholeskyFactorB(B)) {
+        DestroyBandMatrix(B);
+        return NULL;
+    }
+    return B;
+}
+
+/* r = f - A*u on the interior points, or r = A*u if f is NULL. The boundary
+ * values of u are used, and the boundary of r is left alone. */
+static void Residual(mglevel *L, matrix *U, matrix *F, matrix *R)
+{
+    int n = nRows(U), m = nCols(U), i, j;
+    double **u = U->array, **ax = L->ax->array, **ay = L->ay->array,
+           **d = L->diag->array;
+
+    #pragma omp parallel for private(j) if((double) n*m > PARALLELSIZE) schedule(static)
+    for(i=1; i<n-1; i++) {
+        double *r = R->array[i], *f = F ? F->array[i] : NULL;
+        double *up = u[i-1], *uc = u[i], *un = u[i+1];
+        double *w = ax[i], *nn = ay[i-1], *ss = ay[i], *dd = d[i];
+
+        #pragma omp simd
+        for(j=1; j<m-1; j++)
+            r[j] = dd[j]*uc[j] - w[j-1]*uc[j-1] - w[j]*uc[j+1]
+                 - nn[j]*up[j] - ss[j]*un[j];
+        if(f) {
+            #pragma omp simd
+            for(j=1; j<m-1; j++)
+                r[j] = f[j] - r[j];
+        }
+    }
+}
+
+/* Do some smoothing sweeps. reverse flips the order of the colors for
+ * Gauss-Seidel. */
+static void Smooth(mgsolver *mg, mglevel *L, int sweeps, int reverse)
+{
+    int n = nRows(L->u), m = nCols(L->u), s, k, color, i, j;
+    double **u = L->u->array, **f = L->f->array, **r = L->r->array,
+           **ax = L->ax->array, **ay = L->ay->array, **d = L->diag->array;
+
+    for(s=0; s<sweeps; s++) {
+        if(mg->smoother == MG_JACOBI) {
+            Residual(L, L->u, L->f, L->r);
+            #pragma omp parallel for private(j) if((double) n*m > PARALLELSIZE) schedule(static)
+            for(i=1; i<n-1; i++)
+                for(j=1; j<m-1; j++)
+                    u[i][j] += MGJACOBIWEIGHT*r[i][j]/d[i][j];
+            continue;
+        }
+
+        for(k=0; k<2; k++) {
+            color = reverse ? 1-k : k;
+            #pragma omp parallel for private(j) if((double) n*m > PARALLELSIZE) schedule(static)
+            for(i=1; i<n-1; i++)
+                for(j=(i%2 == color) ? 2 : 1; j<m-1; j+=2)
+                    u[i][j] = (f[i][j] + ax[i][j-1]*u[i][j-1]
+                               + ax[i][j]*u[i][j+1] + ay[i-1][j]*u[i-1][j]
+                               + ay[i][j]*u[i+1][j]) / d[i][j];
+        }
+    }
+}
+
+/* Sum of the face coefficients around point (i, j) */
+static double FaceSum(mglevel *L, int i, int j)
+{
+    double **ax = L->ax->array, **ay = L->ay->array;
+
+    return ax[i][j-1] + ax[i][j] + ay[i-1][j] + ay[i][j];
+}
+
+/* Interpolate the coarse correction E and add it to the interior of the fine
+ * grid L. A fine point between two coarse points along a row or column takes
+ * their values weighted by the faces that join it to them, so the flux
+ * between them is continuous, and a point in the middle of a coarse cell is
+ * found from its four neighbors the same way. Where a is smooth, this is
+ * bilinear interpolation. L->r is used as work space, and its boundary is left
+ * at zero. */
+static void Prolong(mglevel *L, matrix *E)
+{
+    int n = nRows(L->u), m = nCols(L->u), i, j, I, J;
+    double **e = E->array, **u = L->u->array, **t = L->r->array,
+           **ax = L->ax->array, **ay = L->ay->array;
+
+    #pragma omp parallel for private(j, I, J) if((double) n*m > PARALLELSIZE) schedule(static)
+    for(i=1; i<n-1; i++) {
+        I = i/2;
+        for(j=1; j<m-1; j++) {
+            J = j/2;
+            if(i%2 == 0 && j%2 == 0)
+                t[i][j] = e[I][J];
+            else if(i%2 == 0)
+                t[i][j] = (ax[i][j-1]*e[I][J] + ax[i][j]*e[I][J+1])
+                          / (ax[i][j-1] + ax[i][j]);
+            else if(j%2 == 0)
+                t[i][j] = (ay[i-1][j]*e[I][J] + ay[i][j]*e[I+1][J])
+                          / (ay[i-1][j] + ay[i][j]);
+        }
+    }
+
+    #pragma omp parallel for private(j) if((double) n*m > PARALLELSIZE) schedule(static)
+    for(i=1; i<n-1; i+=2)
+        for(j=1; j<m-1; j+=2)
+            t[i][j] = (ax[i][j-1]*t[i][j-1] + ax[i][j]*t[i][j+1]
+                       + ay[i-1][j]*t[i-1][j] + ay[i][j]*t[i+1][j])
+                      / FaceSum(L, i, j);
+
+    #pragma omp parallel for private(j) if((double) n*m > PARALLELSIZE) schedule(static)
+    for(i=1; i<n-1; i++)
+        for(j=1; j<m-1; j++)
+            u[i][j] += t[i][j];
+}
+
+/* Move the fine residual L->r onto the interior of the coarse right-hand
+ * side F with the transpose of Prolong, divided by 4. This keeps each cycle
+ * symmetric, and is full weighting where a is smooth. The residual is
+ * overwritten. */
+static void Restrict(mglevel *L, matrix *F)
+{
+    int n = nRows(L->r), m = nCols(L->r), N = nRows(F), M = nCols(F);
+    int i, j, I, J;
+    double **r = L->r->array, **f = F->array,
+           **ax = L->ax->array, **ay = L->ay->array;
+
+    /* Points in the middle of a coarse cell pass their share to the points
+     * on its edges */
+    #pragma omp parallel for private(j) if((double) n*m > PARALLELSIZE) schedule(static)
+    for(i=1; i<n-1; i++) {
+        for(j=(i%2) ? 2 : 1; j<m-1; j+=2) {
+            if(i%2)
+                r[i][j] += ax[i][j-1]*r[i][j-1]/FaceSum(L, i, j-1)
+                         + ax[i][j]*r[i][j+1]/FaceSum(L, i, j+1);
+            else
+                r[i][j] += ay[i-1][j]*r[i-1][j]/FaceSum(L, i-1, j)
+                         + ay[i][j]*r[i+1][j]/FaceSum(L, i+1, j);
+        }
+    }
+
+    /* And those pass it on to the coarse points at either end */
+    #pragma omp parallel for private(J, i, j) if((double) N*M > PARALLELSIZE) schedule(static)
+    for(I=1; I<N-1; I++) {
+        for(J=1; J<M-1; J++) {
+            i = 2*I;
+            j = 2*J;
+            f[I][J] = (r[i][j]
+                       + ax[i][j-1]*r[i][j-1]/(ax[i][j-2] + ax[i][j-1])
+                       + ax[i][j]*r[i][j+1]/(ax[i][j] + ax[i][j+1])
+                       + ay[i-1][j]*r[i-1][j]/(ay[i-2][j] + ay[i-1][j])
+                       + ay[i][j]*r[i+1][j]/(ay[i][j] + ay[i+1][j])) / 4;
+        }
+    }
+}
+
+/* Solve on the coarsest grid, directly if it was factored */
+static void CoarseSolve(mgsolver *mg)
+{
+    mglevel *L = &mg->level[mg->nlevels-1];
+    int n = nRows(L->u), m = nCols(L->u), mi = m-2, i, j, k;
+    double **u = L->u->array, **f = L->f->array,
+           **ax = L->ax->array, **ay = L->ay->array;
+    matrix *b;
+
+    /* Sweep forward and then backward, so that this is a symmetric operator
+     * like the rest of the cycle */
+    if(!mg->coarse) {
+        Smooth(mg, L, MGCOARSESWEEPS/2, 0);
+        Smooth(mg, L, MGCOARSESWEEPS/2, 1);
+        return;
+    }
+
+    /* Move the known boundary values over to the right-hand side */
+    b = CreateMatrix((n-2)*mi, 1);
+    for(i=1; i<n-1; i++) {
+        for(j=1; j<m-1; j++) {
+            k = (i-1)*mi + j-1;
+            b->array[k][0] = f[i][j];
+            if(j == 1)
+                b->array[k][0] += ax[i][0]*u[i][0];
+            if(j == m-2)
+                b->array[k][0] += ax[i][m-2]*u[i][m-1];
+            if(i == 1)
+                b->array[k][0] += ay[0][j]*u[0][j];
+            if(i == n-2)
+                b->array[k][0] += ay[n-2][j]*u[n-1][j];
+        }
+    }
+
+    CholeskySolveB(mg->coarse, b);
+    for(i=1; i<n-1; i++)
+        for(j=1; j<m-1; j++)
+            u[i][j] = b->array[(i-1)*mi + j-1][0];
+    DestroyMatrix(b);
+}
+
+/* One cycle starting on grid l, improving level[l].u in place */
+static void Cycle(mgsolver *mg, int l, int type)
+{
+    mglevel *L = &mg->level[l], *C;
+    int g;
+
+    if(l == mg->nlevels-1) {
+        CoarseSolve(mg);
+        return;
+    }
+    C = &mg->level[l+1];
+
+    Smooth(mg, L, mg->presmooth, 0);
+    Residual(L, L->u, L->f, L->r);
+    Restrict(L, C->f);
+    memset(C->u->data, 0, nRows(C->u)*nCols(C->u)*sizeof(double));
+
+    if(type == MG_FCYCLE) {
+        Cycle(mg, l+1, MG_FCYCLE);
+        Cycle(mg, l+1, MG_VCYCLE);
+    } else {
+        for(g=0; g<((type == MG_WCYCLE) ? 2 : 1); g++)
+            Cycle(mg, l+1, type);
+    }
+
+    Prolong(L, C->u);
+    Smooth(mg, L, mg->postsmooth, 1);
+}
+
+/* 2-norm of the interior points of a grid */
+static double InteriorNorm(matrix *A)
+{
+    int n = nRows(A), m = nCols(A), i, j;
+    double s = 0;
+
+    if(mtxreproducible()) {
+        for(i=1; i<n-1; i++)
+            s += ReproDot(A->array[i]+1, 1, A->array[i]+1, 1, m-2);
+        return sqrt(s);
+    }
+
+    #pragma omp parallel for private(j) reduction(+:s) if((double) n*m > PARALLELSIZE) schedule(static)
+    for(i=1; i<n-1; i++)
+        for(j=1; j<m-1; j++)
+            s += A->array[i][j]*A->array[i][j];
+    return sqrt(s);
+}
+
+/* Dot product of two grids that are zero on the boundary */
+static double GridDot(matrix *A, matrix *B)
+{
+    long i, n = (long) nRows(A)*nCols(A);
+    double s = 0;
+
+    if(mtxreproducible())
+        return ReproDot(A->data, 1, B->data, 1, n);
+
+    #pragma omp parallel for simd reduction(+:s) if(n > PARALLELSIZE) schedule(static)
+    for(i=0; i<n; i++)
+        s += A->data[i]*B->data[i];
+    return s;
+}
+
+/* Check that U and F fit the finest grid and copy them into it */
+static int Load(mgsolver *mg, matrix *U, matrix *F)
+{
+    mglevel *L = &mg->level[0];
+
+    if(nRows(U) != nRows(L->u) || nCols(U) != nCols(L->u) ||
+       nRows(F) != nRows(L->u) || nCols(F) != nCols(L->u)) {
+        fprintf(stderr, "Error: Incompatible matrix dimensions.\n");
+        return 0;
+    }
+    CopyViewInto(ViewMatrix(U), L->u);
+    CopyViewInto(ViewMatrix(F), L->f);
+    return 1;
+}
+
+/* Z = M*R, where M is one cycle from a zero initial guess with zero boundary
+ * values, which approximates the inverse of the operator */
+static void Precondition(mgsolver *mg, matrix *R, matrix *Z)
+{
+    mglevel *L = &mg->level[0];
+    long n = (long) nRows(R)*nCols(R);
+
+    memcpy(L->f->data, R->data, n*sizeof(double));
+    memset(L->u->data, 0, n*sizeof(double));
+    Cycle(mg, 0, mg->cycle);
+    memcpy(Z->data, L->u->data, n*sizeof(double));
+}
+
+/**
+ * @brief Set up a multigrid solver for a grid
+ *
+ * Makes the hierarchy of coarse grids and the operators on them. The default
+ * settings are V-cycles with two sweeps of red-black Gauss-Seidel before and
+ * after each coarse grid correction.
+ *
+ * @param rows Number of points along y, including the two boundaries
+ * @param cols Number of points along x, including the two boundaries
+ * @param hx Spacing between points along x
+ * @param hy Spacing between points along y
+ * @param a Diffusion coefficient at each point (rows x cols), or NULL for one
+ *      everywhere. Must be positive.
+ * @param c Coefficient of the zeroth order term at each point, or NULL for
+ *      zero everywhere. Must not be negative. For a backward Euler step of
+ *      du/dt = div(a grad u), this is 1/dt.
+ * @returns The solver, or NULL on error
+ */
+mgsolver* CreateMultigrid(int rows, int cols, double hx, double hy,
+                          matrix *a, matrix *c)
+{
+    mgsolver *mg;
+    mglevel *L;
+    matrix *A, *Cc, *tmp;
+    int l, n, m, ok;
+
+    if(rows < 3 || cols < 3) {
+        fprintf(stderr, "CreateMultigrid(): The grid needs at least 3 points along each side.\n");
+        return NULL;
+    }
+    if((a && (nRows(a) != rows || nCols(a) != cols)) ||
+       (c && (nRows(c) != rows || nCols(c) != cols))) {
+        fprintf(stderr, "Error: Incompatible matrix dimensions.\n");
+        return NULL;
+    }
+
+    mg = (mgsolver*) calloc(1, sizeof(mgsolver));
+    if(!mg) {
+        fprintf(stderr, "Memory allocation error: %s\n", strerror(errno));
+        return NULL;
+    }
+    mg->cycle = MG_VCYCLE;
+    mg->smoother = MG_GAUSSSEIDEL;
+    mg->presmooth = 2;
+    mg->postsmooth = 2;
+
+    /* Halve the grid for as long as it divides evenly and has points left
+     * in the middle */
+    n = rows;
+    m = cols;
+    mg->nlevels = 1;
+    while(n >= 5 && m >= 5 && (n-1)%2 == 0 && (m-1)%2 == 0) {
+        n = (n-1)/2+1;
+        m = (m-1)/2+1;
+        mg->nlevels++;
+    }
+    mg->level = (mglevel*) calloc(mg->nlevels, sizeof(mglevel));
+    if(!mg->level) {
+        fprintf(stderr, "Memory allocation error: %s\n", strerror(errno));
+        free(mg);
+        return NULL;
+    }
+
+    A = a ? ConvertLayout(a, MTX_ROWMAJOR) : CreateOnesMatrix(rows, cols);
+    Cc = c ? ConvertLayout(c, MTX_ROWMAJOR) : NULL;
+    ok = A && (Cc || !c);
+    for(l=0; ok && l<mg->nlevels; l++) {
+        L = &mg->level[l];
+        if(l == 0) {
+            ok = AllocLevel(L, rows, cols);
+            if(ok)
+                FineFaces(L, A, hx, hy);
+        } else {
+            ok = AllocLevel(L, (nRows(L[-1].u)-1)/2+1, (nCols(L[-1].u)-1)/2+1);
+            if(ok)
+                CoarseFaces(L-1, L);
+            if(ok && Cc) {
+                tmp = CoarsenCoef(Cc);
+                DestroyMatrix(Cc);
+                Cc = tmp;
+                ok = (Cc != NULL);
+            }
+        }
+        if(ok)
+            SetDiag(L, Cc);
+    }
+    FreeMatrix(A);
+    FreeMatrix(Cc);
+    if(!ok) {
+        DestroyMultigrid(mg);
+        return NULL;
+    }
+
+    mg->coarse = CoarseFactor(&mg->level[mg->nlevels-1]);
+    return mg;
+}
+
+/**
+ * @brief Free a solver made by CreateMultigrid
+ * @param mg The solver to destroy
+ */
+void DestroyMultigrid(mgsolver *mg)
+{
+    int l;
+
+    for(l=0; l<mg->nlevels; l++)
+        FreeLevel(&mg->level[l]);
+    free(mg->level);
+    DestroyBandMatrix(mg->coarse);
+    free(mg);
+}
+
+/**
+ * @brief Change how the solver cycles through the grids
+ * @param mg The solver
+ * @param cycle MG_VCYCLE, MG_WCYCLE or MG_FCYCLE. Use a V- or W-cycle with
+ *      MultigridPCG, since the F-cycle isn't symmetric.
+ * @param smoother MG_GAUSSSEIDEL or MG_JACOBI
+ * @param presmooth Number of smoothing sweeps before each coarse grid
+ *      correction
+ * @param postsmooth Number of sweeps after it. Should equal presmooth when
+ *      preconditioning.
+ */
+void MultigridOptions(mgsolver *mg, int cycle, int smoother,
+                      int presmooth, int postsmooth)
+{
+    mg->cycle = cycle;
+    mg->smoother = smoother;
+    mg->presmooth = presmooth;
+    mg->postsmooth = postsmooth;
+}
+
+/**
+ * @brief Calculate the 2-norm of the residual f - (-div(a grad u) + c u)
+ * over the interior points
+ * @param mg The solver
+ * @param U Current solution, including the boundary values
+ * @param F Right-hand side
+ * @returns The norm, or -1 if the matricies are the wrong size
+ */
+double MultigridResidual(mgsolver *mg, matrix *U, matrix *F)
+{
+    mglevel *L = &mg->level[0];
+
+    if(!Load(mg, U, F))
+        return -1;
+    Residual(L, L->u, L->f, L->r);
+    return InteriorNorm(L->r);
+}
+
+/**
+ * @brief Do a single multigrid cycle
+ * @param mg The solver
+ * @param U Initial guess, including the boundary values. Overwritten with the
+ *      improved solution.
+ * @param F Right-hand side
+ * @returns 0 on success, or -1 if the matricies are the wrong size
+ */
+int MultigridCycle(mgsolver *mg, matrix *U, matrix *F)
+{
+    if(!Load(mg, U, F))
+        return -1;
+    Cycle(mg, 0, mg->cycle);
+    CopyViewInto(ViewMatrix(mg->level[0].u), U);
+    return 0;
+}
+
+/**
+ * @brief Solve by repeating multigrid cycles until the residual is small
+ * @param mg The solver
+ * @param U Initial guess, including the boundary values. Overwritten with the
+ *      solution.
+ * @param F Right-hand side
+ * @param tol Stop when the norm of the residual is less than tol times the
+ *      norm of F
+ * @param maxit Largest number of cycles to do
+ * @returns Number of cycles done, or -1 if it didn't converge or the
+ *      matricies are the wrong size
+ */
+int MultigridSolve(mgsolver *mg, matrix *U, matrix *F, double tol, int maxit)
+{
+    mglevel *L = &mg->level[0];
+    double fnorm;
+    int it;
+
+    if(!Load(mg, U, F))
+        return -1;
+
+    PROF_BEGIN(MTXOP_MULTIGRID);
+    fnorm = InteriorNorm(L->f);
+    if(fnorm == 0)
+        fnorm = 1;
+    for(it=0; ; it++) {
+        Residual(L, L->u, L->f, L->r);
+        if(InteriorNorm(L->r) <= tol*fnorm || it == maxit)
+            break;
+        Cycle(mg, 0, mg->cycle);
+    }
+    PROF_END(MTXOP_MULTIGRID, it*CYCLEFLOPS(mg, nRows(U), nCols(U)));
+
+    CopyViewInto(ViewMatrix(L->u), U);
+    return (InteriorNorm(L->r) <= tol*fnorm) ? it : -1;
+}
+
+/**
+ * @brief Apply one cycle as a preconditioner
+ *
+ * Calculates Z = M*R, where M approximates the inverse of the operator with
+ * zero boundary values. This is what an iterative method needs to use
+ * multigrid as a preconditioner.
+ *
+ * @param mg The solver
+ * @param R A residual. Its boundary values are ignored.
+ * @param Z Matrix to store the result in. Its boundary is set to zero.
+ * @returns 0 on success, or -1 if the matricies are the wrong size
+ */
+int MultigridPrecondition(mgsolver *mg, matrix *R, matrix *Z)
+{
+    mglevel *L = &mg->level[0];
+
+    if(nRows(R) != nRows(L->u) || nCols(R) != nCols(L->u) ||
+       nRows(Z) != nRows(L->u) || nCols(Z) != nCols(L->u)) {
+        fprintf(stderr, "Error: Incompatible matrix dimensions.\n");
+        return -1;
+    }
+
+    CopyViewInto(ViewMatrix(R), L->f);
+    memset(L->u->data, 0, nRows(R)*nCols(R)*sizeof(double));
+    Cycle(mg, 0, mg->cycle);
+    CopyViewInto(ViewMatrix(L->u), Z);
+    return 0;
+}
+
+/**
+ * @brief Solve with conjugate gradients, using one multigrid cycle per
+ * iteration as the preconditioner
+ *
+ * This converges in fewer iterations than MultigridSolve when a varies
+ * sharply, where plain cycles slow down.
+ *
+ * @param mg The solver. Should use a V- or W-cycle with the same number of
+ *      sweeps before and after.
+ * @param U Initial guess, including the boundary values. Overwritten with the
+ *      solution.
+ * @param F Right-hand side
+ * @param tol Stop when the norm of the residual is less than tol times the
+ *      norm of F
+ * @param maxit Largest number of iterations to do
+ * @returns Number of iterations done, or -1 if it didn't converge or the
+ *      matricies are the wrong size
+ */
+int MultigridPCG(mgsolver *mg, matrix *U, matrix *F, double tol, int maxit)
+{
+    mglevel *L = &mg->level[0];
+    int n = nRows(L->u), m = nCols(L->u), it, result;
+    long i, N = (long) n*m;
+    matrix *x, *f, *r, *z, *p, *q;
+    double fnorm, rz, rznew, alpha, beta;
+
+    if(nRows(U) != n || nCols(U) != m || nRows(F) != n || nCols(F) != m) {
+        fprintf(stderr, "Error: Incompatible matrix dimensions.\n");
+        return -1;
+    }
+
+    PROF_BEGIN(MTXOP_MULTIGRID);
+    x = ConvertLayout(U, MTX_ROWMAJOR);
+    f = ConvertLayout(F, MTX_ROWMAJOR);
+    r = CreateMatrix(n, m);
+    z = CreateMatrix(n, m);
+    p = CreateMatrix(n, m);
+    q = CreateMatrix(n, m);
+    if(!x || !f || !r || !z || !p || !q) {
+        PROF_END(MTXOP_MULTIGRID, 0);
+        FreeMatrix(x);
+        FreeMatrix(f);
+        FreeMatrix(r);
+        FreeMatrix(z);
+        FreeMatrix(p);
+        FreeMatrix(q);
+        return -1;
+    }
+
+    fnorm = InteriorNorm(f);
+    if(fnorm == 0)
+        fnorm = 1;
+
+    Residual(L, x, f, r);
+    Precondition(mg, r, z);
+    memcpy(p->data, z->data, N*sizeof(double));
+    rz = GridDot(r, z);
+
+    for(it=0; ; it++) {
+        if(sqrt(GridDot(r, r)) <= tol*fnorm || it == maxit)
+            break;
+
+        Residual(L, p, NULL, q);
+        alpha = rz/GridDot(p, q);
+        #pragma omp parallel for simd if(N > PARALLELSIZE) schedule(static)
+        for(i=0; i<N; i++) {
+            x->data[i] += alpha*p->data[i];
+            r->data[i] -= alpha*q->data[i];
+        }
+
+        Precondition(mg, r, z);
+        rznew = GridDot(r, z);
+        beta = rznew/rz;
+        rz = rznew;
+        #pragma omp parallel for simd if(N > PARALLELSIZE) schedule(static)
+        for(i=0; i<N; i++)
+            p->data[i] = z->data[i] + beta*p->data[i];
+    }
+    PROF_END(MTXOP_MULTIGRID, it*CYCLEFLOPS(mg, n, m));
+
+    CopyViewInto(ViewMatrix(x), U);
+    result = (sqrt(GridDot(r, r)) <= tol*fnorm) ? it : -1;
+
+    DestroyMatrix(x);
+    DestroyMatrix(f);
+    DestroyMatrix(r);
+    DestroyMatrix(z);
+    DestroyMatrix(p);
+    DestroyMatrix(q);
+    return result;
+}
+
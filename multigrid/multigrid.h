@@ -0,0 +1,113 @@
+/**
+ * @file multigrid.h
+ * Geometric multigrid solver for diffusion problems on rectangular grids.
+ *
+ * Solves
+ *
+ *     -div(a grad u) + c u = f
+ *
+ * on a grid of equally spaced points, where a > 0 and c >= 0 can vary from
+ * point to point. Grids are stored in matricies with rows running along y
+ * and columns along x, as made by meshgridX and meshgridY. The first and last
+ * rows and columns are the boundary: the values of u there are taken from the
+ * initial guess and held fixed (Dirichlet conditions).
+ *
+ * The grid is coarsened by a factor of two in each direction for as long as
+ * both dimensions are of the form 2k+1, so grids with 2^L*k+1 points along
+ * each side work best. Coarsening stops when it would leave no interior
+ * points, and the coarsest grid is solved directly if it is small enough.
+ */
+
+#ifndef MULTIGRID_H
+#define MULTIGRID_H
+
+#include "2dmatrix/2dmatrix.h"
+#include "bandmatrix/bandmatrix.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+///Visit each coarse grid once per cycle
+#define MG_VCYCLE 0
+///Visit each coarse grid twice per cycle
+#define MG_WCYCLE 1
+///An F-cycle followed by a V-cycle on each coarse grid
+#define MG_FCYCLE 2
+
+///Red-black Gauss-Seidel smoothing
+#define MG_GAUSSSEIDEL 0
+///Weighted Jacobi smoothing
+#define MG_JACOBI 1
+
+/**
+ * @struct mglevel
+ * @brief The discretized operator and work space for one grid
+ * @var mglevel::ax
+ * a/hx^2 on the face between each point and the next one along its row
+ * (rows x cols-1)
+ * @var mglevel::ay
+ * a/hy^2 on the face between each point and the one below it (rows-1 x cols)
+ * @var mglevel::diag
+ * Diagonal of the operator at each point
+ * @var mglevel::u
+ * Solution on the finest grid, or the correction to it on coarser ones
+ * @var mglevel::f
+ * Right-hand side
+ * @var mglevel::r
+ * Residual
+ */
+typedef struct {
+    matrix *ax;
+    matrix *ay;
+    matrix *diag;
+    matrix *u;
+    matrix *f;
+    matrix *r;
+} mglevel;
+
+/**
+ * @struct mgsolver
+ * @brief A grid hierarchy and the settings used to cycle through it
+ * @var mgsolver::level
+ * The grids, finest first
+ * @var mgsolver::nlevels
+ * Number of grids
+ * @var mgsolver::coarse
+ * Cholesky factor of the operator on the coarsest grid, or NULL if it is too
+ * large and is smoothed instead
+ * @var mgsolver::cycle
+ * MG_VCYCLE, MG_WCYCLE or MG_FCYCLE
+ * @var mgsolver::smoother
+ * MG_GAUSSSEIDEL or MG_JACOBI
+ * @var mgsolver::presmooth
+ * Number of smoothing sweeps before moving to a coarser grid
+ * @var mgsolver::postsmooth
+ * Number of smoothing sweeps after coming back from it
+ */
+typedef struct {
+    mglevel *level;
+    int nlevels;
+    bndmatrix *coarse;
+    int cycle;
+    int smoother;
+    int presmooth;
+    int postsmooth;
+} mgsolver;
+
+mgsolver* CreateMultigrid(int, int, double, double, matrix*, matrix*);
+void DestroyMultigrid(mgsolver*);
+void MultigridOptions(mgsolver*, int, int, int, int);
+
+double MultigridResidual(mgsolver*, matrix*, matrix*);
+int MultigridCycle(mgsolver*, matrix*, matrix*);
+int MultigridSolve(mgsolver*, matrix*, matrix*, double, int);
+int MultigridPrecondition(mgsolver*, matrix*, matrix*);
+int MultigridPCG(mgsolver*, matrix*, matrix*, double, int);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
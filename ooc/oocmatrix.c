@@ -0,0 +1,649 @@
+/**
+ * @file oocmatrix.c
+ * Backing file, tile cache and background prefetching for out-of-core
+ * matricies.
+ *
+ * The file starts with a OOCHEADER byte header giving the size of the matrix
+ * and its tiles, followed by the tiles in row-major order. Each tile is stored
+ * row-major. Tiles are read and written with pread and pwrite, so the
+ * background thread and the caller never share a file position, and the lock
+ * is never held during I/O. A slot that is being read or written is marked
+ * busy, and anyone who needs it waits until it's ready.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+
+#include "oocmatrix.h"
+#include "2dmatrix/mtxview.h"
+#include "../instrument/instrument.h"
+
+///Identifies a file as an out-of-core matrix
+#define OOCMAGIC "MTXOOC1"
+///Size of the file header in bytes
+#define OOCHEADER 64
+
+/* Number of bytes in one tile */
+#define TILEBYTES(A) ((size_t) (A)->tilerows*(A)->tilecols*sizeof(double))
+
+/* Position of tile T in the file */
+static off_t TileOffset(oocmatrix *A, long t)
+{
+    return OOCHEADER + (off_t) t*TILEBYTES(A);
+}
+
+/* pread and pwrite, retried until everything is transferred. Reading past the
+ * end of the file gives zeros. Return 0 on success. */
+static int ReadFull(int fd, void *buf, size_t n, off_t off)
+{
+    ssize_t r;
+    char *p = (char*) buf;
+
+    while(n > 0) {
+        r = pread(fd, p, n, off);
+        if(r < 0 && errno == EINTR)
+            continue;
+        if(r < 0)
+            return -1;
+        if(r == 0) {
+            memset(p, 0, n);
+            return 0;
+        }
+        p += r;
+        off += r;
+        n -= r;
+    }
+    return 0;
+}
+
+static int WriteFull(int fd, const void *buf, size_t n, off_t off)
+{
+    ssize_t r;
+    const char *p = (const char*) buf;
+
+    while(n > 0) {
+        r = pwrite(fd, p, n, off);
+        if(r < 0 && errno == EINTR)
+            continue;
+        if(r <= 0)
+            return -1;
+        p += r;
+        off += r;
+        n -= r;
+    }
+    return 0;
+}
+
+/* Find tile t in the cache, or bring it in. Must be called with the lock held,
+ * and returns with it held. pin is 1 to hand the tile out, or 0 when
+ * prefetching. mode is one of OOC_READ, OOC_READWRITE or OOC_OVERWRITE.
+ * Returns the slot, or -1 if every slot is pinned. */
+static int Acquire(oocmatrix *A, long t, int pin, int mode)
+{
+    int s, i, victim, busy, rerr = 0, werr = 0;
+    long old;
+    ooctile *p;
+
+    for(;;) {
+        s = A->slotof[t];
+        if(s >= 0) {
+            if(A->slots[s].busy) {
+                pthread_cond_wait(&A->ready, &A->lock);
+                continue;
+            }
+            A->slots[s].pins += pin;
+            A->slots[s].stamp = ++A->clock;
+            return s;
+        }
+
+        /* Pick the least recently used slot that's free. If this tile is
+         * still being written back from somewhere, wait for that first. */
+        victim = -1;
+        busy = 0;
+        for(i=0; i<A->nslots; i++) {
+            p = A->slots + i;
+            if(p->busy) {
+                busy = 1;
+                if(p->writeback == t)
+                    break;
+            } else if(p->pins == 0 &&
+                      (victim < 0 || p->stamp < A->slots[victim].stamp)) {
+                victim = i;
+            }
+        }
+        if(i == A->nslots && victim >= 0)
+            break;
+        if(i == A->nslots && !busy)
+            return -1;
+        pthread_cond_wait(&A->ready, &A->lock);
+    }
+
+    p = A->slots + victim;
+    old = p->tile;
+    if(old >= 0)
+        A->slotof[old] = -1;
+    p->writeback = p->dirty ? old : -1;
+    p->tile = t;
+    A->slotof[t] = victim;
+    p->busy = 1;
+    p->dirty = 0;
+    p->pins = pin;
+    p->stamp = ++A->clock;
+
+    pthread_mutex_unlock(&A->lock);
+    if(p->writeback >= 0)
+        werr = WriteFull(A->fd, p->data, TILEBYTES(A), TileOffset(A, p->writeback));
+    if(mode == OOC_OVERWRITE)
+        memset(p->data, 0, TILEBYTES(A));
+    else
+        rerr = ReadFull(A->fd, p->data, TILEBYTES(A), TileOffset(A, t));
+    pthread_mutex_lock(&A->lock);
+
+    if(werr)
+        fprintf(stderr, "Error: Unable to write tile %ld: %s\n", p->writeback, strerror(errno));
+    else if(p->writeback >= 0)
+        A->stores++;
+    if(rerr) {
+        fprintf(stderr, "Error: Unable to read tile %ld: %s\n", t, strerror(errno));
+        memset(p->data, 0, TILEBYTES(A));
+    } else if(mode != OOC_OVERWRITE) {
+        A->loads++;
+    }
+    p->writeback = -1;
+    p->busy = 0;
+    pthread_cond_broadcast(&A->ready);
+
+    return victim;
+}
+
+/* Background thread that reads the tiles in the prefetch queue */
+static void* Fetcher(void *arg)
+{
+    oocmatrix *A = (oocmatrix*) arg;
+    long t;
+
+    pthread_mutex_lock(&A->lock);
+    while(!A->stop) {
+        if(A->qlen == 0) {
+            pthread_cond_wait(&A->work, &A->lock);
+            continue;
+        }
+        t = A->queue[A->qhead];
+        A->qhead = (A->qhead+1) % OOCQUEUE;
+        A->qlen--;
+        /* If there's no room, the request is dropped */
+        Acquire(A, t, 0, OOC_READ);
+    }
+    pthread_mutex_unlock(&A->lock);
+
+    return NULL;
+}
+
+/* Allocate the cache and start the background thread for a matrix whose size
+ * and file are already set. Frees A and returns NULL on failure. */
+static oocmatrix* Setup(oocmatrix *A, size_t budget)
+{
+    long ntiles, i;
+    int err;
+    double *data;
+
+    A->ntr = (A->rows + A->tilerows - 1)/A->tilerows;
+    A->ntc = (A->cols + A->tilecols - 1)/A->tilecols;
+    ntiles = (long) A->ntr*A->ntc;
+
+    if(budget/TILEBYTES(A) < OOCMINTILES) {
+        fprintf(stderr, "Error: Memory budget of %lu bytes is less than %d tiles.\n",
+                (unsigned long) budget, OOCMINTILES);
+        close(A->fd);
+        free(A);
+        return NULL;
+    }
+    A->nslots = (budget/TILEBYTES(A) < (size_t) ntiles) ? budget/TILEBYTES(A) : ntiles;
+
+    A->slots = (ooctile*) calloc(A->nslots, sizeof(ooctile));
+    A->slotof = (int*) malloc(ntiles*sizeof(int));
+    data = (double*) malloc(A->nslots*TILEBYTES(A));
+    if(!A->slots || !A->slotof || !data) {
+        fprintf(stderr, "Memory allocation error: %s\n", strerror(errno));
+        free(A->slots);
+        free(A->slotof);
+        free(data);
+        close(A->fd);
+        free(A);
+        return NULL;
+    }
+    PROF_ALLOC(MTXOBJ_MATRIX, A->nslots*TILEBYTES(A));
+
+    for(i=0; i<ntiles; i++)
+        A->slotof[i] = -1;
+    for(i=0; i<A->nslots; i++) {
+        A->slots[i].data = data + i*A->tilerows*A->tilecols;
+        A->slots[i].tile = -1;
+        A->slots[i].writeback = -1;
+    }
+
+    pthread_mutex_init(&A->lock, NULL);
+    pthread_cond_init(&A->ready, NULL);
+    pthread_cond_init(&A->work, NULL);
+    /* Prefetching only saves time, so carry on without it if the thread
+     * can't be started */
+    err = pthread_create(&A->fetcher, NULL, Fetcher, A);
+    if(err)
+        fprintf(stderr, "Error: Unable to start the prefetch thread: %s\n", strerror(err));
+    A->fetching = !err;
+
+    return A;
+}
+
+/**
+ * @brief Create a new out-of-core matrix, filled with zeros
+ *
+ * Any existing file with the same name is replaced. The file is created
+ * sparse, so no disk space is used until tiles are written.
+ *
+ * @param file Name of the file to store the matrix in
+ * @param rows Number of rows
+ * @param cols Number of columns
+ * @param tilerows Number of rows in each tile
+ * @param tilecols Number of columns in each tile
+ * @param budget Largest number of bytes to use for cached tiles. Must allow
+ *      for at least OOCMINTILES tiles.
+ * @returns The new matrix, or NULL on failure
+ */
+oocmatrix* CreateOOCMatrix(const char *file, int rows, int cols,
+                           int tilerows, int tilecols, size_t budget)
+{
+    oocmatrix *A;
+    char header[OOCHEADER];
+    int dims[4] = {rows, cols, tilerows, tilecols};
+
+    if(rows <= 0 || cols <= 0 || tilerows <= 0 || tilecols <= 0) {
+        fprintf(stderr, "Error: Invalid matrix or tile size.\n");
+        return NULL;
+    }
+
+    A = (oocmatrix*) calloc(1, sizeof(oocmatrix));
+    if(!A) {
+        fprintf(stderr, "Memory allocation error: %s\n", strerror(errno));
+        return NULL;
+    }
+    A->rows = rows;
+    A->cols = cols;
+    A->tilerows = tilerows;
+    A->tilecols = tilecols;
+
+    A->fd = open(file, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if(A->fd < 0) {
+        fprintf(stderr, "Error: Unable to create %s: %s\n", file, strerror(errno));
+        free(A);
+        return NULL;
+    }
+
+    memset(header, 0, OOCHEADER);
+    memcpy(header, OOCMAGIC, sizeof(OOCMAGIC));
+    memcpy(header + 8, dims, sizeof(dims));
+    if(WriteFull(A->fd, header, OOCHEADER, 0) ||
+       ftruncate(A->fd, OOCHEADER + (off_t) ((rows+tilerows-1)/tilerows)
+                 *((cols+tilecols-1)/tilecols)*TILEBYTES(A))) {
+        fprintf(stderr, "Error: Unable to write %s: %s\n", file, strerror(errno));
+        close(A->fd);
+        free(A);
+        return NULL;
+    }
+
+    return Setup(A, budget);
+}
+
+/**
+ * @brief Open an existing out-of-core matrix
+ * @param file Name of the file made by CreateOOCMatrix or StoreOOCMatrix
+ * @param budget Largest number of bytes to use for cached tiles
+ * @returns The matrix, or NULL on failure
+ */
+oocmatrix* OpenOOCMatrix(const char *file, size_t budget)
+{
+    oocmatrix *A;
+    char header[OOCHEADER];
+    int dims[4];
+
+    A = (oocmatrix*) calloc(1, sizeof(oocmatrix));
+    if(!A) {
+        fprintf(stderr, "Memory allocation error: %s\n", strerror(errno));
+        return NULL;
+    }
+
+    A->fd = open(file, O_RDWR);
+    if(A->fd < 0) {
+        fprintf(stderr, "Error: Unable to open %s: %s\n", file, strerror(errno));
+        free(A);
+        return NULL;
+    }
+
+    if(ReadFull(A->fd, header, OOCHEADER, 0) ||
+       memcmp(header, OOCMAGIC, sizeof(OOCMAGIC))) {
+        fprintf(stderr, "Error: %s is not an out-of-core matrix.\n", file);
+        close(A->fd);
+        free(A);
+        return NULL;
+    }
+    memcpy(dims, header + 8, sizeof(dims));
+    A->rows = dims[0];
+    A->cols = dims[1];
+    A->tilerows = dims[2];
+    A->tilecols = dims[3];
+    if(A->rows <= 0 || A->cols <= 0 || A->tilerows <= 0 || A->tilecols <= 0) {
+        fprintf(stderr, "Error: %s is not an out-of-core matrix.\n", file);
+        close(A->fd);
+        free(A);
+        return NULL;
+    }
+
+    return Setup(A, budget);
+}
+
+/**
+ * @brief Write all modified tiles in the cache back to the file
+ *
+ * Waits for any tiles that are being read in the background first. The tiles
+ * stay in the cache.
+ *
+ * @param A The matrix to flush
+ */
+void FlushOOCMatrix(oocmatrix *A)
+{
+    int i, busy;
+    ooctile *p;
+
+    pthread_mutex_lock(&A->lock);
+    do {
+        busy = 0;
+        for(i=0; i<A->nslots; i++)
+            busy |= A->slots[i].busy;
+        if(busy)
+            pthread_cond_wait(&A->ready, &A->lock);
+    } while(busy);
+
+    for(i=0; i<A->nslots; i++) {
+        p = A->slots + i;
+        if(p->tile < 0 || !p->dirty)
+            continue;
+        if(WriteFull(A->fd, p->data, TILEBYTES(A), TileOffset(A, p->tile)))
+            fprintf(stderr, "Error: Unable to write tile %ld: %s\n", p->tile, strerror(errno));
+        else
+            A->stores++;
+        p->dirty = 0;
+    }
+    fsync(A->fd);
+    pthread_mutex_unlock(&A->lock);
+}
+
+/**
+ * @brief Write back any modified tiles, close the file, and free the cache
+ * @param A The matrix to close
+ */
+void CloseOOCMatrix(oocmatrix *A)
+{
+    pthread_mutex_lock(&A->lock);
+    A->stop = 1;
+    pthread_cond_signal(&A->work);
+    pthread_mutex_unlock(&A->lock);
+    if(A->fetching)
+        pthread_join(A->fetcher, NULL);
+
+    FlushOOCMatrix(A);
+    close(A->fd);
+
+    PROF_FREE(MTXOBJ_MATRIX, A->nslots*TILEBYTES(A));
+    free(A->slots[0].data);
+    free(A->slots);
+    free(A->slotof);
+    pthread_mutex_destroy(&A->lock);
+    pthread_cond_destroy(&A->ready);
+    pthread_cond_destroy(&A->work);
+    free(A);
+}
+
+/**
+ * @brief Get a tile of the matrix, reading it from disk if it isn't cached
+ *
+ * The tile stays in memory until it is handed back with OOCReleaseTile, so
+ * only a few should be held at once.
+ *
+ * @param A The matrix
+ * @param ti Row of the tile
+ * @param tj Column of the tile
+ * @param mode OOC_READ, OOC_READWRITE, or OOC_OVERWRITE if every element will
+ *      be replaced. The tile is written back later in the last two cases.
+ * @returns Pointer to the elements of the tile, stored row-major with tilecols
+ *      elements per row, or NULL if every tile in the cache is in use
+ */
+double* OOCGetTile(oocmatrix *A, int ti, int tj, int mode)
+{
+    int s;
+
+    if(ti < 0 || ti >= A->ntr || tj < 0 || tj >= A->ntc) {
+        fprintf(stderr, "Error: Tile (%d, %d) is out of range.\n", ti, tj);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&A->lock);
+    s = Acquire(A, (long) ti*A->ntc + tj, 1, mode);
+    if(s >= 0 && mode != OOC_READ)
+        A->slots[s].dirty = 1;
+    pthread_mutex_unlock(&A->lock);
+
+    if(s < 0) {
+        fprintf(stderr, "Error: All tiles in the cache are in use.\n");
+        return NULL;
+    }
+    return A->slots[s].data;
+}
+
+/**
+ * @brief Hand back a tile from OOCGetTile so that it can be evicted
+ * @param A The matrix
+ * @param ti Row of the tile
+ * @param tj Column of the tile
+ */
+void OOCReleaseTile(oocmatrix *A, int ti, int tj)
+{
+    int s;
+
+    pthread_mutex_lock(&A->lock);
+    s = A->slotof[(long) ti*A->ntc + tj];
+    if(s >= 0 && A->slots[s].pins > 0) {
+        A->slots[s].pins--;
+        pthread_cond_broadcast(&A->ready);
+    }
+    pthread_mutex_unlock(&A->lock);
+}
+
+/**
+ * @brief Start reading a tile in the background
+ *
+ * Returns immediately. Does nothing if the tile is already cached, if too
+ * many tiles are already waiting, or if the background thread couldn't be
+ * started.
+ *
+ * @param A The matrix
+ * @param ti Row of the tile
+ * @param tj Column of the tile
+ */
+void OOCPrefetchTile(oocmatrix *A, int ti, int tj)
+{
+    long t = (long) ti*A->ntc + tj;
+    int i;
+
+    if(ti < 0 || ti >= A->ntr || tj < 0 || tj >= A->ntc || !A->fetching)
+        return;
+
+    pthread_mutex_lock(&A->lock);
+    if(A->slotof[t] < 0 && A->qlen < OOCQUEUE) {
+        for(i=0; i<A->qlen; i++)
+            if(A->queue[(A->qhead+i) % OOCQUEUE] == t)
+                break;
+        if(i == A->qlen) {
+            A->queue[(A->qhead+A->qlen) % OOCQUEUE] = t;
+            A->qlen++;
+            pthread_cond_signal(&A->work);
+        }
+    }
+    pthread_mutex_unlock(&A->lock);
+}
+
+/**
+ * @brief Number of rows actually used in a row of tiles
+ * @param A The matrix
+ * @param ti Row of tiles
+ * @returns tilerows, or fewer for the last row of tiles
+ */
+int OOCTileRows(oocmatrix *A, int ti)
+{
+    int r = A->rows - ti*A->tilerows;
+    return (r < A->tilerows) ? r : A->tilerows;
+}
+
+/**
+ * @brief Number of columns actually used in a column of tiles
+ * @param A The matrix
+ * @param tj Column of tiles
+ * @returns tilecols, or fewer for the last column of tiles
+ */
+int OOCTileCols(oocmatrix *A, int tj)
+{
+    int c = A->cols - tj*A->tilecols;
+    return (c < A->tilecols) ? c : A->tilecols;
+}
+
+/**
+ * @brief Get one element of an out-of-core matrix
+ *
+ * This reads the whole tile if it isn't cached, so it's only suitable for
+ * occasional access.
+ *
+ * @param A The matrix
+ * @param row Row of the element
+ * @param col Column of the element
+ * @returns The value of the element, or 0 if it is out of range
+ */
+double valOOC(oocmatrix *A, int row, int col)
+{
+    double *t, x;
+
+    if(row < 0 || row >= A->rows || col < 0 || col >= A->cols) {
+        fprintf(stderr, "Error: Element (%d, %d) is out of range.\n", row, col);
+        return 0;
+    }
+    t = OOCGetTile(A, row/A->tilerows, col/A->tilecols, OOC_READ);
+    if(!t)
+        return 0;
+    x = t[(row%A->tilerows)*A->tilecols + col%A->tilecols];
+    OOCReleaseTile(A, row/A->tilerows, col/A->tilecols);
+    return x;
+}
+
+/**
+ * @brief Set one element of an out-of-core matrix
+ * @param A The matrix
+ * @param value The value to store
+ * @param row Row of the element
+ * @param col Column of the element
+ */
+void setvalOOC(oocmatrix *A, double value, int row, int col)
+{
+    double *t;
+
+    if(row < 0 || row >= A->rows || col < 0 || col >= A->cols) {
+        fprintf(stderr, "Error: Element (%d, %d) is out of range.\n", row, col);
+        return;
+    }
+    t = OOCGetTile(A, row/A->tilerows, col/A->tilecols, OOC_READWRITE);
+    if(!t)
+        return;
+    t[(row%A->tilerows)*A->tilecols + col%A->tilecols] = value;
+    OOCReleaseTile(A, row/A->tilerows, col/A->tilecols);
+}
+
+/**
+ * @brief Write an in-memory matrix to a new out-of-core matrix
+ * @param M The matrix to store. Either layout is fine.
+ * @param file Name of the file to create
+ * @param tilerows Number of rows in each tile
+ * @param tilecols Number of columns in each tile
+ * @param budget Largest number of bytes to use for cached tiles
+ * @returns The new out-of-core matrix, or NULL on failure
+ */
+oocmatrix* StoreOOCMatrix(matrix *M, const char *file, int tilerows,
+                          int tilecols, size_t budget)
+{
+    oocmatrix *A;
+    mtxview m = ViewMatrix(M);
+    int ti, tj, i, j, mi, mj;
+    double *t;
+
+    A = CreateOOCMatrix(file, nRows(M), nCols(M), tilerows, tilecols, budget);
+    if(!A)
+        return NULL;
+
+    for(ti=0; ti<A->ntr; ti++) {
+        mi = OOCTileRows(A, ti);
+        for(tj=0; tj<A->ntc; tj++) {
+            mj = OOCTileCols(A, tj);
+            t = OOCGetTile(A, ti, tj, OOC_OVERWRITE);
+            if(!t) {
+                CloseOOCMatrix(A);
+                return NULL;
+            }
+            for(i=0; i<mi; i++)
+                for(j=0; j<mj; j++)
+                    t[i*tilecols+j] = valView(m, ti*tilerows+i, tj*tilecols+j);
+            OOCReleaseTile(A, ti, tj);
+        }
+    }
+
+    return A;
+}
+
+/**
+ * @brief Read a whole out-of-core matrix into memory
+ * @param A The out-of-core matrix. It must fit in memory.
+ * @returns A new row-major matrix, or NULL on failure
+ */
+matrix* LoadOOCMatrix(oocmatrix *A)
+{
+    matrix *M;
+    int ti, tj, i, mi, mj;
+    double *t;
+
+    M = CreateMatrix(A->rows, A->cols);
+    if(!M)
+        return NULL;
+
+    for(ti=0; ti<A->ntr; ti++) {
+        mi = OOCTileRows(A, ti);
+        for(tj=0; tj<A->ntc; tj++) {
+            mj = OOCTileCols(A, tj);
+            if(tj+1 < A->ntc)
+                OOCPrefetchTile(A, ti, tj+1);
+            else
+                OOCPrefetchTile(A, ti+1, 0);
+            t = OOCGetTile(A, ti, tj, OOC_READ);
+            if(!t) {
+                DestroyMatrix(M);
+                return NULL;
+            }
+            for(i=0; i<mi; i++)
+                memcpy(M->array[ti*A->tilerows+i] + tj*A->tilecols,
+                       t + i*A->tilecols, mj*sizeof(double));
+            OOCReleaseTile(A, ti, tj);
+        }
+    }
+
+    return M;
+}
+
@@ -0,0 +1,172 @@
+/**
+ * @file oocmatrix.h
+ * Out-of-core matricies that are kept in a file on disk and brought into
+ * memory a tile at a time.
+ *
+ * The matrix is split into tiles of tilerows x tilecols elements, which are
+ * stored one after another in a binary file. Tiles on the bottom and right
+ * edges are padded out to the full size on disk. Only a fixed number of tiles
+ * are held in memory at once, set by the memory budget given when the matrix
+ * is opened. When the cache is full, the least recently used tile that isn't
+ * in use is written back if it was modified and replaced. Tiles can be
+ * requested ahead of time, in which case they are read by a background thread
+ * while the caller works on something else.
+ */
+
+#ifndef OOCMATRIX_H
+#define OOCMATRIX_H
+
+#include <stddef.h>
+#include <pthread.h>
+
+#include "2dmatrix/2dmatrix.h"
+#include "vector/vector.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+///Smallest number of tiles the memory budget must allow for
+#define OOCMINTILES 4
+///Largest number of tiles that can be waiting to be prefetched
+#define OOCQUEUE 64
+
+///The tile is only read
+#define OOC_READ 0
+///The tile is read and modified
+#define OOC_READWRITE 1
+///The whole tile is overwritten, so its old contents aren't read from disk
+#define OOC_OVERWRITE 2
+
+/**
+ * @struct ooctile
+ * @brief One slot in the tile cache
+ * @var ooctile::data
+ * The tile's elements, row-major with tilecols elements per row
+ * @var ooctile::tile
+ * Index of the tile held in the slot, or -1 if it's empty
+ * @var ooctile::writeback
+ * Index of the tile being written back to disk from this slot, or -1
+ * @var ooctile::pins
+ * Number of times the tile has been handed out and not released
+ * @var ooctile::busy
+ * Nonzero while the slot is being read or written
+ * @var ooctile::dirty
+ * Nonzero if the tile was modified since it was read
+ * @var ooctile::stamp
+ * Time of last use, for picking the least recently used tile
+ */
+typedef struct {
+    double *data;
+    long tile;
+    long writeback;
+    int pins;
+    int busy;
+    int dirty;
+    unsigned long stamp;
+} ooctile;
+
+/**
+ * @struct oocmatrix
+ * @brief A tiled matrix stored in a file
+ * @var oocmatrix::rows
+ * Number of rows
+ * @var oocmatrix::cols
+ * Number of columns
+ * @var oocmatrix::tilerows
+ * Number of rows in each tile
+ * @var oocmatrix::tilecols
+ * Number of columns in each tile
+ * @var oocmatrix::ntr
+ * Number of rows of tiles
+ * @var oocmatrix::ntc
+ * Number of columns of tiles
+ * @var oocmatrix::fd
+ * File descriptor of the backing file
+ * @var oocmatrix::nslots
+ * Number of tiles that fit in the memory budget
+ * @var oocmatrix::slots
+ * The tile cache
+ * @var oocmatrix::slotof
+ * Which slot each tile is in, or -1 if it isn't cached
+ * @var oocmatrix::clock
+ * Counter used to time stamp tile accesses
+ * @var oocmatrix::loads
+ * Number of tiles read from disk so far
+ * @var oocmatrix::stores
+ * Number of tiles written to disk so far
+ * @var oocmatrix::queue
+ * Tiles waiting to be prefetched
+ * @var oocmatrix::qhead
+ * Position of the next tile to prefetch in the queue
+ * @var oocmatrix::qlen
+ * Number of tiles in the queue
+ * @var oocmatrix::lock
+ * Protects the cache and the queue
+ * @var oocmatrix::ready
+ * Signaled when a slot finishes loading or is released
+ * @var oocmatrix::work
+ * Signaled when a tile is added to the queue
+ * @var oocmatrix::fetcher
+ * Background thread that reads prefetched tiles
+ * @var oocmatrix::fetching
+ * Nonzero if the background thread is running. If it couldn't be started,
+ * requests to prefetch tiles are ignored.
+ * @var oocmatrix::stop
+ * Set to tell the background thread to exit
+ */
+typedef struct {
+    int rows;
+    int cols;
+    int tilerows;
+    int tilecols;
+    int ntr;
+    int ntc;
+    int fd;
+    int nslots;
+    ooctile *slots;
+    int *slotof;
+    unsigned long clock;
+    long loads;
+    long stores;
+    long queue[OOCQUEUE];
+    int qhead;
+    int qlen;
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    pthread_cond_t work;
+    pthread_t fetcher;
+    int fetching;
+    int stop;
+} oocmatrix;
+
+oocmatrix* CreateOOCMatrix(const char*, int, int, int, int, size_t);
+oocmatrix* OpenOOCMatrix(const char*, size_t);
+void FlushOOCMatrix(oocmatrix*);
+void CloseOOCMatrix(oocmatrix*);
+
+double* OOCGetTile(oocmatrix*, int, int, int);
+void OOCReleaseTile(oocmatrix*, int, int);
+void OOCPrefetchTile(oocmatrix*, int, int);
+int OOCTileRows(oocmatrix*, int);
+int OOCTileCols(oocmatrix*, int);
+
+double valOOC(oocmatrix*, int, int);
+void setvalOOC(oocmatrix*, double, int, int);
+oocmatrix* StoreOOCMatrix(matrix*, const char*, int, int, size_t);
+matrix* LoadOOCMatrix(oocmatrix*);
+
+int gemmOOC(double, oocmatrix*, oocmatrix*, double, oocmatrix*);
+int mtxtrnOOC(oocmatrix*, oocmatrix*);
+int axpbyOOC(double, oocmatrix*, double, oocmatrix*);
+void MapOOC(oocmatrix*, double (*func)(double));
+vector* ColumnSumsOOC(oocmatrix*);
+vector* RowSumsOOC(oocmatrix*);
+double nrm2OOC(oocmatrix*);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
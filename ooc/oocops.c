@@ -0,0 +1,391 @@
+/**
+ * @file oocops.c
+ * Products, transposes, element-wise operations and reductions on
+ * out-of-core matricies.
+ *
+ * Every operation walks the tiles in an order chosen so that each tile is
+ * read as few times as the cache allows, and asks for the next tile it will
+ * need before working on the current one, so that reading from disk overlaps
+ * with the arithmetic. The work within a tile is split between threads when
+ * the tile is large enough.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "oocmatrix.h"
+#include "../instrument/instrument.h"
+
+///Number of floating point operations above which work on a tile is
+///multithreaded
+#define PARALLELFLOPS 1e6
+
+/* Request the tile after (ti, tj) in file order */
+static void PrefetchNext(oocmatrix *A, int ti, int tj)
+{
+    if(tj+1 < A->ntc)
+        OOCPrefetchTile(A, ti, tj+1);
+    else
+        OOCPrefetchTile(A, ti+1, 0);
+}
+
+/* c += alpha*a*b for an mi x mk tile a and an mk x mj tile b, where each tile
+ * has its own row length */
+static void MulTile(double alpha, const double *a, int lda, const double *b,
+                    int ldb, double *c, int ldc, int mi, int mk, int mj)
+{
+    int i, j, k;
+    double t;
+
+    #pragma omp parallel for private(j, k, t) if(2.0*mi*mk*mj > PARALLELFLOPS)
+    for(i=0; i<mi; i++) {
+        double *ci = c + (long) i*ldc;
+        for(k=0; k<mk; k++) {
+            const double *bk = b + (long) k*ldb;
+            t = alpha*a[(long) i*lda+k];
+            #pragma omp simd
+            for(j=0; j<mj; j++)
+                ci[j] += t*bk[j];
+        }
+    }
+}
+
+/**
+ * @brief Calculate C = alpha*A*B + beta*C for out-of-core matricies
+ *
+ * Each row of tiles of A is held in the cache in as few pieces as its memory
+ * budget allows, and all of B is streamed past it. When the whole row fits, A
+ * is read once, B once per row of tiles, and C once. Otherwise each tile of C
+ * is read once for each piece. The columns of B are swept in alternating
+ * directions so that the tiles used last are the first ones needed again.
+ *
+ * @param alpha Multiplier for A*B
+ * @param A An mxk matrix
+ * @param B A kxn matrix. Its tiles must have as many rows as A's have columns.
+ * @param beta Multiplier for C
+ * @param C An mxn matrix, with tiles as tall as A's and as wide as B's.
+ *      Overwritten with the result. Must be a different matrix from A and B.
+ * @returns 0 on success, or -1 on failure
+ */
+int gemmOOC(double alpha, oocmatrix *A, oocmatrix *B, double beta,
+            oocmatrix *C)
+{
+    int nk = A->ntc, kb, k0, k1, i, j, jj, k, mi, pass = 0, ret = 0;
+    double **a, *b, *c;
+
+    if(A->cols != B->rows || C->rows != A->rows || C->cols != B->cols) {
+        fprintf(stderr, "Error: Incompatible matrix dimensions.\n");
+        return -1;
+    }
+    if(A->tilecols != B->tilerows || C->tilerows != A->tilerows ||
+       C->tilecols != B->tilecols) {
+        fprintf(stderr, "Error: Incompatible tile sizes.\n");
+        return -1;
+    }
+
+    /* Leave one slot free for prefetching */
+    kb = (A->nslots-1 < nk) ? A->nslots-1 : nk;
+    if(kb < 1)
+        kb = 1;
+    a = (double**) calloc(kb, sizeof(double*));
+    if(!a)
+        return -1;
+
+    PROF_BEGIN(MTXOP_GEMMOOC);
+    for(i=0; i<A->ntr && !ret; i++) {
+        mi = OOCTileRows(A, i);
+        for(k0=0; k0<nk && !ret; k0+=kb, pass++) {
+            k1 = (k0+kb < nk) ? k0+kb : nk;
+            for(k=k0; k<k1; k++) {
+                if(k+1 < k1)
+                    OOCPrefetchTile(A, i, k+1);
+                else
+                    OOCPrefetchTile(A, (k1 == nk) ? i+1 : i, (k1 == nk) ? 0 : k1);
+                a[k-k0] = OOCGetTile(A, i, k, OOC_READ);
+                if(!a[k-k0]) {
+                    k1 = k;
+                    ret = -1;
+                    break;
+                }
+            }
+
+            for(jj=0; jj<C->ntc && !ret; jj++) {
+                j = (pass%2) ? C->ntc-1-jj : jj;
+                c = OOCGetTile(C, i, j, (k0 == 0 && beta == 0) ? OOC_OVERWRITE : OOC_READWRITE);
+                if(!c) {
+                    ret = -1;
+                    break;
+                }
+                /* A tile that was already cached keeps its contents even
+                 * when it is asked for to be overwritten, so clear it before
+                 * adding to it */
+                if(k0 == 0 && beta == 0)
+                    memset(c, 0, C->tilerows*C->tilecols*sizeof(double));
+                else if(k0 == 0 && beta != 1)
+                    for(k=0; k<C->tilerows*C->tilecols; k++)
+                        c[k] *= beta;
+
+                for(k=k0; k<k1; k++) {
+                    if(k+1 < k1) {
+                        OOCPrefetchTile(B, k+1, j);
+                    } else if(jj+1 < C->ntc) {
+                        OOCPrefetchTile(B, k0, (pass%2) ? j-1 : j+1);
+                        OOCPrefetchTile(C, i, (pass%2) ? j-1 : j+1);
+                    }
+                    b = OOCGetTile(B, k, j, OOC_READ);
+                    if(!b) {
+                        ret = -1;
+                        break;
+                    }
+                    MulTile(alpha, a[k-k0], A->tilecols, b, B->tilecols, c,
+                            C->tilecols, mi, OOCTileCols(A, k), OOCTileCols(C, j));
+                    OOCReleaseTile(B, k, j);
+                }
+                OOCReleaseTile(C, i, j);
+            }
+
+            for(k=k0; k<k1; k++)
+                OOCReleaseTile(A, i, k);
+        }
+    }
+    PROF_END(MTXOP_GEMMOOC, 2.0*A->rows*A->cols*B->cols);
+
+    free(a);
+    return ret;
+}
+
+/**
+ * @brief Transpose an out-of-core matrix into another
+ *
+ * Each tile of A is read once and each tile of At is written once.
+ *
+ * @param A The matrix to transpose
+ * @param At A matrix with as many rows as A has columns and the other way
+ *      around, and tiles of the transposed shape. Overwritten with A^T.
+ * @returns 0 on success, or -1 on failure
+ */
+int mtxtrnOOC(oocmatrix *A, oocmatrix *At)
+{
+    int ti, tj, i, j, mi, mj, ret = 0;
+    double *a, *t;
+
+    if(At->rows != A->cols || At->cols != A->rows) {
+        fprintf(stderr, "Error: Incompatible matrix dimensions.\n");
+        return -1;
+    }
+    if(At->tilerows != A->tilecols || At->tilecols != A->tilerows) {
+        fprintf(stderr, "Error: Incompatible tile sizes.\n");
+        return -1;
+    }
+
+    PROF_BEGIN(MTXOP_TRNOOC);
+    for(ti=0; ti<A->ntr && !ret; ti++) {
+        mi = OOCTileRows(A, ti);
+        for(tj=0; tj<A->ntc; tj++) {
+            mj = OOCTileCols(A, tj);
+            PrefetchNext(A, ti, tj);
+            a = OOCGetTile(A, ti, tj, OOC_READ);
+            t = OOCGetTile(At, tj, ti, OOC_OVERWRITE);
+            if(a && t)
+                for(j=0; j<mj; j++)
+                    for(i=0; i<mi; i++)
+                        t[(long) j*At->tilecols+i] = a[(long) i*A->tilecols+j];
+            else
+                ret = -1;
+            if(a)
+                OOCReleaseTile(A, ti, tj);
+            if(t)
+                OOCReleaseTile(At, tj, ti);
+            if(ret)
+                break;
+        }
+    }
+    PROF_END(MTXOP_TRNOOC, 0);
+
+    return ret;
+}
+
+/**
+ * @brief Calculate Y = alpha*X + beta*Y for out-of-core matricies
+ * @param alpha Multiplier for X
+ * @param X The first matrix
+ * @param beta Multiplier for Y
+ * @param Y A matrix the same size as X, with the same tile size. Overwritten
+ *      with the result.
+ * @returns 0 on success, or -1 on failure
+ */
+int axpbyOOC(double alpha, oocmatrix *X, double beta, oocmatrix *Y)
+{
+    int ti, tj, i, j, mi, mj, ret = 0;
+    double *x, *y;
+
+    if(X->rows != Y->rows || X->cols != Y->cols) {
+        fprintf(stderr, "Error: Incompatible matrix dimensions.\n");
+        return -1;
+    }
+    if(X->tilerows != Y->tilerows || X->tilecols != Y->tilecols) {
+        fprintf(stderr, "Error: Incompatible tile sizes.\n");
+        return -1;
+    }
+
+    for(ti=0; ti<X->ntr && !ret; ti++) {
+        mi = OOCTileRows(X, ti);
+        for(tj=0; tj<X->ntc; tj++) {
+            mj = OOCTileCols(X, tj);
+            PrefetchNext(X, ti, tj);
+            PrefetchNext(Y, ti, tj);
+            x = OOCGetTile(X, ti, tj, OOC_READ);
+            y = OOCGetTile(Y, ti, tj, OOC_READWRITE);
+            if(x && y) {
+                #pragma omp parallel for private(j) if((double) mi*mj > PARALLELFLOPS)
+                for(i=0; i<mi; i++)
+                    for(j=0; j<mj; j++)
+                        y[(long) i*Y->tilecols+j] = alpha*x[(long) i*X->tilecols+j]
+                                                  + beta*y[(long) i*Y->tilecols+j];
+            } else {
+                ret = -1;
+            }
+            if(x)
+                OOCReleaseTile(X, ti, tj);
+            if(y)
+                OOCReleaseTile(Y, ti, tj);
+            if(ret)
+                break;
+        }
+    }
+
+    return ret;
+}
+
+/**
+ * @brief Apply a function to every element of an out-of-core matrix in place
+ * @param A The matrix
+ * @param func The function to apply
+ */
+void MapOOC(oocmatrix *A, double (*func)(double))
+{
+    int ti, tj, i, j, mi, mj;
+    double *a;
+
+    for(ti=0; ti<A->ntr; ti++) {
+        mi = OOCTileRows(A, ti);
+        for(tj=0; tj<A->ntc; tj++) {
+            mj = OOCTileCols(A, tj);
+            PrefetchNext(A, ti, tj);
+            a = OOCGetTile(A, ti, tj, OOC_READWRITE);
+            if(!a)
+                return;
+            for(i=0; i<mi; i++)
+                for(j=0; j<mj; j++)
+                    a[(long) i*A->tilecols+j] = (*func)(a[(long) i*A->tilecols+j]);
+            OOCReleaseTile(A, ti, tj);
+        }
+    }
+}
+
+/**
+ * @brief Sum each column of an out-of-core matrix
+ * @param A The matrix
+ * @returns A vector with one sum per column, or NULL on failure
+ */
+vector* ColumnSumsOOC(oocmatrix *A)
+{
+    int ti, tj, i, j, mi, mj;
+    double *a, *s;
+    vector *sums;
+
+    sums = CreateVector(A->cols);
+    if(!sums)
+        return NULL;
+
+    for(ti=0; ti<A->ntr; ti++) {
+        mi = OOCTileRows(A, ti);
+        for(tj=0; tj<A->ntc; tj++) {
+            mj = OOCTileCols(A, tj);
+            PrefetchNext(A, ti, tj);
+            a = OOCGetTile(A, ti, tj, OOC_READ);
+            if(!a) {
+                DestroyVector(sums);
+                return NULL;
+            }
+            s = sums->v + (long) tj*A->tilecols;
+            for(i=0; i<mi; i++)
+                for(j=0; j<mj; j++)
+                    s[j] += a[(long) i*A->tilecols+j];
+            OOCReleaseTile(A, ti, tj);
+        }
+    }
+
+    return sums;
+}
+
+/**
+ * @brief Sum each row of an out-of-core matrix
+ * @param A The matrix
+ * @returns A vector with one sum per row, or NULL on failure
+ */
+vector* RowSumsOOC(oocmatrix *A)
+{
+    int ti, tj, i, j, mi, mj;
+    double *a, *s, t;
+    vector *sums;
+
+    sums = CreateVector(A->rows);
+    if(!sums)
+        return NULL;
+
+    for(ti=0; ti<A->ntr; ti++) {
+        mi = OOCTileRows(A, ti);
+        s = sums->v + (long) ti*A->tilerows;
+        for(tj=0; tj<A->ntc; tj++) {
+            mj = OOCTileCols(A, tj);
+            PrefetchNext(A, ti, tj);
+            a = OOCGetTile(A, ti, tj, OOC_READ);
+            if(!a) {
+                DestroyVector(sums);
+                return NULL;
+            }
+            for(i=0; i<mi; i++) {
+                t = 0;
+                for(j=0; j<mj; j++)
+                    t += a[(long) i*A->tilecols+j];
+                s[i] += t;
+            }
+            OOCReleaseTile(A, ti, tj);
+        }
+    }
+
+    return sums;
+}
+
+/**
+ * @brief Calculate the Frobenius norm of an out-of-core matrix
+ * @param A The matrix
+ * @returns The square root of the sum of the squares of the elements, or NaN
+ *      on failure
+ */
+double nrm2OOC(oocmatrix *A)
+{
+    int ti, tj, i, j, mi, mj;
+    double *a, s = 0;
+
+    for(ti=0; ti<A->ntr; ti++) {
+        mi = OOCTileRows(A, ti);
+        for(tj=0; tj<A->ntc; tj++) {
+            mj = OOCTileCols(A, tj);
+            PrefetchNext(A, ti, tj);
+            a = OOCGetTile(A, ti, tj, OOC_READ);
+            if(!a)
+                return NAN;
+            for(i=0; i<mi; i++)
+                for(j=0; j<mj; j++)
+                    s += a[(long) i*A->tilecols+j]*a[(long) i*A->tilecols+j];
+            OOCReleaseTile(A, ti, tj);
+        }
+    }
+
+    return sqrt(s);
+}
+
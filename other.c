@@ -1,14 +1,17 @@
 /**
  * @file other.c
- * Functions that don't belong in any of the subdirectories. Currently,
- * there's just one.
+ * Functions that don't belong in any of the subdirectories.
  */
 
 #include <stdarg.h>
+#include <stdio.h>
 #include <stdlib.h>
 
 #include "matrix.h"
 
+///Number of grid points above which EvalGrid is multithreaded
+#define GRIDPARALLEL 1e4
+
 /**
  * @brief Smash several vectors together as column vectors into a matrix.
  *
@@ -54,15 +57,7 @@ matrix* CatColVector(int n, ...)
  */
 vector* ExtractColumnAsVector(matrix *A, int col)
 {
-    vector *v;
-    int i;
-
-    v = CreateVector(nRows(A));
-
-    for(i=0; i<len(v); i++)
-        setvalV(v, i, val(A, i, col));
-
-    return v;
+    return CopyVecView(ViewColumnAsVector(A, col));
 }
 
 /**
@@ -73,36 +68,103 @@ vector* ExtractColumnAsVector(matrix *A, int col)
  */
 vector* ExtractRowAsVector(matrix *A, int row)
 {
-    vector *v;
-    int i;
-
-    v = CreateVector(nCols(A));
-
-    for(i=0; i<len(v); i++)
-        setvalV(v, i, val(A, row, i));
-
-    return v;
+    return CopyVecView(ViewRowAsVector(A, row));
 }
 
+/**
+ * @brief Build a matrix of x coordinates for a grid, like MATLAB's meshgrid.
+ *
+ * Every row is a copy of x. ViewMeshgridX gives the same thing without
+ * allocating it, and EvalGrid evaluates a function over the grid directly.
+ *
+ * @param x Coordinates along the columns
+ * @param y Coordinates along the rows. Only the length is used.
+ * @returns A len(y) x len(x) matrix
+ */
 matrix* meshgridX(vector* x, vector *y)
 {
-    int i, j;
-    matrix *X;
-    X = CreateMatrix(len(y), len(x));
-    for(i=0; i<len(y); i++)
-        for(j=0; j<len(x); j++)
-            setval(X, valV(x, j), i, j);
-    return X;
+    return CopyView(ViewMeshgridX(x, y));
 }
 
+/**
+ * @brief Build a matrix of y coordinates for a grid, like MATLAB's meshgrid.
+ *
+ * Every column is a copy of y. ViewMeshgridY gives the same thing without
+ * allocating it.
+ *
+ * @param x Coordinates along the columns. Only the length is used.
+ * @param y Coordinates along the rows
+ * @returns A len(y) x len(x) matrix
+ */
 matrix* meshgridY(vector* x, vector *y)
 {
-    int i, j;
-    matrix *Y;
-    Y = CreateMatrix(len(y), len(x));
-    for(i=0; i<len(y); i++)
-        for(j=0; j<len(x); j++)
-            setval(Y, valV(y, i), i, j);
-    return Y;
+    return CopyView(ViewMeshgridY(x, y));
 }
 
+/**
+ * @brief Evaluate a function at every point of a grid.
+ *
+ * Calculates Z(i, j) = f(x_j, y_i, data), which is what applying f to the
+ * output of meshgridX and meshgridY would give, but without building either
+ * of them. Large grids are split between threads, so f must be safe to call
+ * from more than one thread at a time.
+ *
+ * @param x Coordinates along the columns
+ * @param y Coordinates along the rows
+ * @param f The function to evaluate
+ * @param data Passed through to f as its last argument. Can be NULL.
+ * @returns A len(y) x len(x) matrix of function values
+ */
+matrix* EvalGrid(vector *x, vector *y,
+                 double (*f)(double, double, void*), void *data)
+{
+    matrix *Z;
+    Z = CreateMatrix(len(y), len(x));
+    return EvalGridInto(x, y, f, data, Z);
+}
+
+/**
+ * @brief Evaluate a function at every point of a grid, storing the result in
+ * an existing matrix
+ * @param x Coordinates along the columns
+ * @param y Coordinates along the rows
+ * @param f The function to evaluate
+ * @param data Passed through to f as its last argument. Can be NULL.
+ * @param Z A len(y) x len(x) matrix to store the results in. Either layout
+ *      works, and it is filled in memory order.
+ * @returns Z, or NULL if it is the wrong size
+ */
+matrix* EvalGridInto(vector *x, vector *y,
+                     double (*f)(double, double, void*), void *data, matrix *Z)
+{
+    int i, j, m = len(y), n = len(x);
+    double *z, t;
+
+    if(nRows(Z) != m || nCols(Z) != n) {
+        fprintf(stderr, "Error: Incompatible matrix dimensions.\n");
+        return NULL;
+    }
+
+    UnshareMatrix(Z);
+    PROF_BEGIN(MTXOP_EVALGRID);
+    if(Z->layout == MTX_COLMAJOR) {
+        #pragma omp parallel for private(i, z, t) if((double) m*n > GRIDPARALLEL) schedule(static)
+        for(j=0; j<n; j++) {
+            z = Z->array[j];
+            t = valV(x, j);
+            for(i=0; i<m; i++)
+                z[i] = (*f)(t, valV(y, i), data);
+        }
+    } else {
+        #pragma omp parallel for private(j, z, t) if((double) m*n > GRIDPARALLEL) schedule(static)
+        for(i=0; i<m; i++) {
+            z = Z->array[i];
+            t = valV(y, i);
+            for(j=0; j<n; j++)
+                z[j] = (*f)(valV(x, j), t, data);
+        }
+    }
+    PROF_END(MTXOP_EVALGRID, (double) m*n);
+
+    return Z;
+}
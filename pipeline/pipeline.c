@@ -0,0 +1,369 @@
+/**
+ * @file pipeline.c
+ * Background loading and saving of CSV files.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "pipeline.h"
+
+/* Background thread for a loader. Takes the next file in the list, as long as
+ * that doesn't put it more than depth files ahead of the caller. */
+static void* LoadWorker(void *arg)
+{
+    csvloader *L = (csvloader*) arg;
+    csvslot *s;
+    matrix *A;
+    int i, err;
+
+    pthread_mutex_lock(&L->lock);
+    for(;;) {
+        while(!L->stop && L->claimed < L->nfiles &&
+              L->claimed >= L->next + L->depth)
+            pthread_cond_wait(&L->space, &L->lock);
+        if(L->stop || L->claimed >= L->nfiles)
+            break;
+        i = L->claimed++;
+        pthread_mutex_unlock(&L->lock);
+
+        errno = 0;
+        A = mtxloadcsv(L->files[i], L->row0);
+        err = A ? 0 : (errno ? errno : EINVAL);
+
+        pthread_mutex_lock(&L->lock);
+        s = L->slots + i%L->depth;
+        s->A = A;
+        s->error = err;
+        s->done = 1;
+        pthread_cond_broadcast(&L->ready);
+    }
+    pthread_mutex_unlock(&L->lock);
+
+    return NULL;
+}
+
+/**
+ * @brief Start loading a list of CSV files in the background
+ *
+ * Loading starts right away. Take the files in order with CSVLoaderNext.
+ *
+ * @param files Names of the files to load. The names are copied.
+ * @param nfiles Number of files
+ * @param row0 First row of each file to load, as for mtxloadcsv
+ * @param depth Largest number of files to load ahead of the caller. This
+ *      limits how many loaded matricies are held at once.
+ * @param nthreads Number of files to load at the same time. At most depth.
+ * @returns The loader, or NULL on failure
+ */
+csvloader* CreateCSVLoader(char **files, int nfiles, int row0, int depth,
+                           int nthreads)
+{
+    csvloader *L;
+    int i;
+
+    if(depth < 1)
+        depth = 1;
+    if(nthreads < 1)
+        nthreads = 1;
+    if(nthreads > depth)
+        nthreads = depth;
+
+    L = (csvloader*) calloc(1, sizeof(csvloader));
+    if(!L) {
+        fprintf(stderr, "Memory allocation error: %s\n", strerror(errno));
+        return NULL;
+    }
+    L->files = (char**) calloc(nfiles > 0 ? nfiles : 1, sizeof(char*));
+    L->slots = (csvslot*) calloc(depth, sizeof(csvslot));
+    L->threads = (pthread_t*) calloc(nthreads, sizeof(pthread_t));
+    if(!L->files || !L->slots || !L->threads) {
+        fprintf(stderr, "Memory allocation error: %s\n", strerror(errno));
+        free(L->files);
+        free(L->slots);
+        free(L->threads);
+        free(L);
+        return NULL;
+    }
+    for(i=0; i<nfiles; i++)
+        L->files[i] = strdup(files[i]);
+    L->nfiles = nfiles;
+    L->row0 = row0;
+    L->depth = depth;
+
+    pthread_mutex_init(&L->lock, NULL);
+    pthread_cond_init(&L->ready, NULL);
+    pthread_cond_init(&L->space, NULL);
+    for(i=0; i<nthreads; i++)
+        if(!pthread_create(L->threads + L->nthreads, NULL, LoadWorker, L))
+            L->nthreads++;
+    if(!L->nthreads) {
+        fprintf(stderr, "Error: Unable to start loader threads.\n");
+        DestroyCSVLoader(L);
+        return NULL;
+    }
+
+    return L;
+}
+
+/**
+ * @brief Get the next file from a loader, waiting for it if necessary
+ * @param L The loader
+ * @param index Set to the position of the file in the list, or -1 if there
+ *      are no more files. Can be NULL.
+ * @param error Set to 0 if the file was loaded, or to an errno value saying
+ *      why it wasn't. Can be NULL.
+ * @returns The matrix, which the caller must destroy, or NULL if the file
+ *      couldn't be loaded or there are no more files
+ */
+matrix* CSVLoaderNext(csvloader *L, int *index, int *error)
+{
+    csvslot *s;
+    matrix *A;
+    int i, err;
+
+    pthread_mutex_lock(&L->lock);
+    if(L->next >= L->nfiles) {
+        pthread_mutex_unlock(&L->lock);
+        if(index)
+            *index = -1;
+        if(error)
+            *error = 0;
+        return NULL;
+    }
+
+    s = L->slots + L->next%L->depth;
+    while(!s->done)
+        pthread_cond_wait(&L->ready, &L->lock);
+    A = s->A;
+    err = s->error;
+    s->A = NULL;
+    s->done = 0;
+    i = L->next++;
+    pthread_cond_broadcast(&L->space);
+    pthread_mutex_unlock(&L->lock);
+
+    if(index)
+        *index = i;
+    if(error)
+        *error = err;
+    return A;
+}
+
+/**
+ * @brief Stop a loader and free everything it holds
+ *
+ * Files being loaded are finished first. Files that were loaded but never
+ * taken are destroyed.
+ *
+ * @param L The loader
+ */
+void DestroyCSVLoader(csvloader *L)
+{
+    int i;
+
+    pthread_mutex_lock(&L->lock);
+    L->stop = 1;
+    pthread_cond_broadcast(&L->space);
+    pthread_mutex_unlock(&L->lock);
+    for(i=0; i<L->nthreads; i++)
+        pthread_join(L->threads[i], NULL);
+
+    for(i=0; i<L->depth; i++)
+        if(L->slots[i].done && L->slots[i].A)
+            DestroyMatrix(L->slots[i].A);
+    for(i=0; i<L->nfiles; i++)
+        free(L->files[i]);
+
+    pthread_mutex_destroy(&L->lock);
+    pthread_cond_destroy(&L->ready);
+    pthread_cond_destroy(&L->space);
+    free(L->files);
+    free(L->slots);
+    free(L->threads);
+    free(L);
+}
+
+/* Background thread for a writer. Exits once it's been told to stop and
+ * there's nothing left to write. */
+static void* WriteWorker(void *arg)
+{
+    csvwriter *W = (csvwriter*) arg;
+    csvslot s;
+    int err;
+
+    pthread_mutex_lock(&W->lock);
+    for(;;) {
+        while(!W->stop && W->len == 0)
+            pthread_cond_wait(&W->work, &W->lock);
+        if(W->len == 0)
+            break;
+        s = W->queue[W->head];
+        W->head = (W->head+1) % W->depth;
+        W->len--;
+        pthread_cond_broadcast(&W->space);
+        pthread_mutex_unlock(&W->lock);
+
+        errno = 0;
+        err = mtxprntfile(s.A, s.file) ? (errno ? errno : EIO) : 0;
+        DestroyMatrix(s.A);
+        free(s.file);
+
+        pthread_mutex_lock(&W->lock);
+        W->status[s.ticket] = err;
+        if(err)
+            W->failed++;
+        pthread_cond_broadcast(&W->space);
+    }
+    pthread_mutex_unlock(&W->lock);
+
+    return NULL;
+}
+
+/**
+ * @brief Start a background writer for CSV files
+ * @param depth Largest number of matricies waiting to be written. Submitting
+ *      more waits until there's room.
+ * @param nthreads Number of files to write at the same time
+ * @returns The writer, or NULL on failure
+ */
+csvwriter* CreateCSVWriter(int depth, int nthreads)
+{
+    csvwriter *W;
+    int i;
+
+    if(depth < 1)
+        depth = 1;
+    if(nthreads < 1)
+        nthreads = 1;
+
+    W = (csvwriter*) calloc(1, sizeof(csvwriter));
+    if(!W) {
+        fprintf(stderr, "Memory allocation error: %s\n", strerror(errno));
+        return NULL;
+    }
+    W->queue = (csvslot*) calloc(depth, sizeof(csvslot));
+    W->threads = (pthread_t*) calloc(nthreads, sizeof(pthread_t));
+    if(!W->queue || !W->threads) {
+        fprintf(stderr, "Memory allocation error: %s\n", strerror(errno));
+        free(W->queue);
+        free(W->threads);
+        free(W);
+        return NULL;
+    }
+    W->depth = depth;
+
+    pthread_mutex_init(&W->lock, NULL);
+    pthread_cond_init(&W->work, NULL);
+    pthread_cond_init(&W->space, NULL);
+    for(i=0; i<nthreads; i++)
+        if(!pthread_create(W->threads + W->nthreads, NULL, WriteWorker, W))
+            W->nthreads++;
+    if(!W->nthreads) {
+        fprintf(stderr, "Error: Unable to start writer threads.\n");
+        DestroyCSVWriter(W);
+        return NULL;
+    }
+
+    return W;
+}
+
+/**
+ * @brief Queue a matrix to be written to a CSV file
+ *
+ * Waits if the queue is full.
+ *
+ * @param W The writer
+ * @param A The matrix to write. The writer takes it over and destroys it once
+ *      it's written, so the caller must not use it afterwards.
+ * @param file Name of the file to write. The name is copied.
+ * @returns A ticket that can be passed to CSVWriterWait, or -1 on failure
+ */
+long CSVWriterSubmit(csvwriter *W, matrix *A, const char *file)
+{
+    csvslot *s;
+    int *status;
+    long ticket;
+
+    pthread_mutex_lock(&W->lock);
+    while(W->len == W->depth)
+        pthread_cond_wait(&W->space, &W->lock);
+
+    if(W->nstatus == W->capacity) {
+        status = (int*) realloc(W->status, (W->capacity ? 2*W->capacity : 64)*sizeof(int));
+        if(!status) {
+            pthread_mutex_unlock(&W->lock);
+            fprintf(stderr, "Memory allocation error: %s\n", strerror(errno));
+            return -1;
+        }
+        W->status = status;
+        W->capacity = W->capacity ? 2*W->capacity : 64;
+    }
+    ticket = W->nstatus++;
+    W->status[ticket] = -1;
+
+    s = W->queue + (W->head+W->len) % W->depth;
+    s->A = A;
+    s->file = strdup(file);
+    s->ticket = ticket;
+    W->len++;
+    pthread_cond_signal(&W->work);
+    pthread_mutex_unlock(&W->lock);
+
+    return ticket;
+}
+
+/**
+ * @brief Wait for a queued write to finish
+ * @param W The writer
+ * @param ticket Ticket returned by CSVWriterSubmit
+ * @returns 0 if the file was written, or an errno value saying why it wasn't
+ */
+int CSVWriterWait(csvwriter *W, long ticket)
+{
+    int err;
+
+    pthread_mutex_lock(&W->lock);
+    if(ticket < 0 || ticket >= W->nstatus) {
+        pthread_mutex_unlock(&W->lock);
+        fprintf(stderr, "Error: Invalid ticket %ld.\n", ticket);
+        return EINVAL;
+    }
+    while(W->status[ticket] == -1)
+        pthread_cond_wait(&W->space, &W->lock);
+    err = W->status[ticket];
+    pthread_mutex_unlock(&W->lock);
+
+    return err;
+}
+
+/**
+ * @brief Finish all queued writes and stop a writer
+ * @param W The writer
+ * @returns Number of files that couldn't be written
+ */
+int DestroyCSVWriter(csvwriter *W)
+{
+    int i, failed;
+
+    pthread_mutex_lock(&W->lock);
+    W->stop = 1;
+    pthread_cond_broadcast(&W->work);
+    pthread_mutex_unlock(&W->lock);
+    for(i=0; i<W->nthreads; i++)
+        pthread_join(W->threads[i], NULL);
+
+    failed = W->failed;
+    pthread_mutex_destroy(&W->lock);
+    pthread_cond_destroy(&W->work);
+    pthread_cond_destroy(&W->space);
+    free(W->queue);
+    free(W->status);
+    free(W->threads);
+    free(W);
+
+    return failed;
+}
+
@@ -0,0 +1,158 @@
+/**
+ * @file pipeline.h
+ * Loading and saving sequences of CSV files in the background.
+ *
+ * A CSV loader is given a list of files and parses them with mtxloadcsv on
+ * background threads, a few files ahead of the caller, and hands them back in
+ * the order they were listed. A CSV writer takes finished matricies and writes
+ * them out with mtxprntfile on background threads while the caller goes on to
+ * the next one. Both hold at most a fixed number of matricies at a time, so
+ * memory stays bounded however long the list is. A file that fails to load or
+ * save is reported by itself and doesn't stop the others.
+ */
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <pthread.h>
+
+#include "2dmatrix/2dmatrix.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @struct csvslot
+ * @brief A file that has been loaded, or a matrix waiting to be written
+ * @var csvslot::A
+ * The matrix
+ * @var csvslot::file
+ * File it's to be written to. Only used by the writer.
+ * @var csvslot::ticket
+ * Number identifying the write. Only used by the writer.
+ * @var csvslot::error
+ * 0, or the errno value describing why the file couldn't be loaded
+ * @var csvslot::done
+ * Nonzero once the file has been loaded
+ */
+typedef struct {
+    matrix *A;
+    char *file;
+    long ticket;
+    int error;
+    int done;
+} csvslot;
+
+/**
+ * @struct csvloader
+ * @brief Background loader for a list of CSV files
+ * @var csvloader::files
+ * Names of the files to load
+ * @var csvloader::nfiles
+ * Number of files
+ * @var csvloader::row0
+ * First row of each file to load, as for mtxloadcsv
+ * @var csvloader::depth
+ * Largest number of files loaded, or being loaded, ahead of the caller
+ * @var csvloader::slots
+ * Loaded files, with file i in slot i%depth
+ * @var csvloader::claimed
+ * Number of files handed out to the background threads so far
+ * @var csvloader::next
+ * Index of the next file to give to the caller
+ * @var csvloader::stop
+ * Set to tell the background threads to exit
+ * @var csvloader::nthreads
+ * Number of background threads
+ * @var csvloader::threads
+ * The background threads
+ * @var csvloader::lock
+ * Protects everything above
+ * @var csvloader::ready
+ * Signaled when a file finishes loading
+ * @var csvloader::space
+ * Signaled when the caller takes a file
+ */
+typedef struct {
+    char **files;
+    int nfiles;
+    int row0;
+    int depth;
+    csvslot *slots;
+    int claimed;
+    int next;
+    int stop;
+    int nthreads;
+    pthread_t *threads;
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    pthread_cond_t space;
+} csvloader;
+
+/**
+ * @struct csvwriter
+ * @brief Background writer for CSV files
+ * @var csvwriter::depth
+ * Largest number of matricies waiting to be written, not counting the ones
+ * being written
+ * @var csvwriter::queue
+ * Matricies waiting to be written
+ * @var csvwriter::head
+ * Position of the next matrix to write in the queue
+ * @var csvwriter::len
+ * Number of matricies in the queue
+ * @var csvwriter::status
+ * Result of each write, by ticket: -1 if it hasn't finished, 0 if it
+ * succeeded, or an errno value
+ * @var csvwriter::nstatus
+ * Number of tickets given out
+ * @var csvwriter::capacity
+ * Space allocated for status
+ * @var csvwriter::failed
+ * Number of writes that failed
+ * @var csvwriter::stop
+ * Set to tell the background threads to exit once the queue is empty
+ * @var csvwriter::nthreads
+ * Number of background threads
+ * @var csvwriter::threads
+ * The background threads
+ * @var csvwriter::lock
+ * Protects everything above
+ * @var csvwriter::work
+ * Signaled when a matrix is queued
+ * @var csvwriter::space
+ * Signaled when a matrix is taken from the queue or a write finishes
+ */
+typedef struct {
+    int depth;
+    csvslot *queue;
+    int head;
+    int len;
+    int *status;
+    long nstatus;
+    long capacity;
+    int failed;
+    int stop;
+    int nthreads;
+    pthread_t *threads;
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+    pthread_cond_t space;
+} csvwriter;
+
+csvloader* CreateCSVLoader(char**, int, int, int, int);
+matrix* CSVLoaderNext(csvloader*, int*, int*);
+void DestroyCSVLoader(csvloader*);
+
+csvwriter* CreateCSVWriter(int, int);
+long CSVWriterSubmit(csvwriter*, matrix*, const char*);
+int CSVWriterWait(csvwriter*, long);
+int DestroyCSVWriter(csvwriter*);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
@@ -0,0 +1,147 @@
+/**
+ * @file repro.c
+ * Fixed-order dot products and sums, and the switch for reproducible mode.
+ *
+ * The blocks are divided into at most REPROCHUNKS chunks, which are handed out
+ * to threads. How the blocks are divided depends only on the number of them,
+ * so the threads only change who does the work, not the order it's added up
+ * in. This file is compiled with -ffp-contract=off so that the products aren't
+ * fused into the sums on some machines and not on others.
+ */
+
+#include <stdlib.h>
+
+#include "repro.h"
+
+///Largest number of chunks the blocks are split into
+#define REPROCHUNKS 64
+///Number of elements above which the chunks are split between threads
+#define PARALLELSIZE 1e5
+
+static int reproducible = 0;
+
+/**
+ * @brief Turn reproducible mode on or off
+ *
+ * This affects every thread, so it shouldn't be changed while other threads
+ * are in the middle of a library call.
+ *
+ * @param on Nonzero to turn it on, or 0 to turn it off
+ * @returns Whether it was on before
+ */
+int mtxsetreproducible(int on)
+{
+    return __atomic_exchange_n(&reproducible, on != 0, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Check whether reproducible mode is on
+ * @returns Nonzero if it is
+ */
+int mtxreproducible(void)
+{
+    return __atomic_load_n(&reproducible, __ATOMIC_RELAXED);
+}
+
+/* Add up n partial sums, pairing neighbors at each step. Overwrites s. */
+static double Pairwise(double *s, int n)
+{
+    int step, i;
+
+    for(step=1; step<n; step*=2)
+        for(i=0; i+step<n; i+=2*step)
+            s[i] += s[i+step];
+    return s[0];
+}
+
+/* Dot product of one block of at most REPROBLOCK elements. Element k goes into
+ * lane k%REPROLANES. If y is NULL, the elements of x are summed instead. */
+static double Block(const double *x, long incx, const double *y, long incy,
+                    int n)
+{
+    double s[REPROLANES] = {0};
+    int k = 0, l;
+
+    if(!y) {
+        for(; k+REPROLANES<=n; k+=REPROLANES)
+            for(l=0; l<REPROLANES; l++)
+                s[l] += x[(long) (k+l)*incx];
+        for(l=0; k+l<n; l++)
+            s[l] += x[(long) (k+l)*incx];
+    } else if(incx == 1 && incy == 1) {
+        /* The lanes are independent, so vectorizing this doesn't change the
+         * order anything is added in */
+        for(; k+REPROLANES<=n; k+=REPROLANES) {
+            #pragma omp simd
+            for(l=0; l<REPROLANES; l++)
+                s[l] += x[k+l]*y[k+l];
+        }
+        for(l=0; k+l<n; l++)
+            s[l] += x[k+l]*y[k+l];
+    } else {
+        for(; k+REPROLANES<=n; k+=REPROLANES)
+            for(l=0; l<REPROLANES; l++)
+                s[l] += x[(long) (k+l)*incx]*y[(long) (k+l)*incy];
+        for(l=0; k+l<n; l++)
+            s[l] += x[(long) (k+l)*incx]*y[(long) (k+l)*incy];
+    }
+
+    return Pairwise(s, REPROLANES);
+}
+
+/* Fixed-order reduction of n elements, as a dot product or a sum */
+static double Reduce(const double *x, long incx, const double *y, long incy,
+                     long n)
+{
+    double part[REPROCHUNKS];
+    long nb = (n + REPROBLOCK - 1)/REPROBLOCK, b, b1, k;
+    int nc, c;
+
+    if(nb <= 1)
+        return (n > 0) ? Block(x, incx, y, incy, n) : 0;
+
+    nc = (nb < REPROCHUNKS) ? nb : REPROCHUNKS;
+    #pragma omp parallel for private(b, b1, k) if(n > PARALLELSIZE) schedule(static)
+    for(c=0; c<nc; c++) {
+        part[c] = 0;
+        b1 = nb*(c+1)/nc;
+        for(b=nb*c/nc; b<b1; b++) {
+            k = b*REPROBLOCK;
+            part[c] += Block(x + k*incx, incx, y ? y + k*incy : NULL, incy,
+                             (n-k < REPROBLOCK) ? n-k : REPROBLOCK);
+        }
+    }
+
+    return Pairwise(part, nc);
+}
+
+/**
+ * @brief Dot product that comes out the same for any number of threads
+ *
+ * Used by the library in reproducible mode, but can be called directly either
+ * way.
+ *
+ * @param x The first vector
+ * @param incx Distance in memory between elements of x
+ * @param y The second vector
+ * @param incy Distance in memory between elements of y
+ * @param n Number of elements
+ * @returns x dot y
+ */
+double ReproDot(const double *x, long incx, const double *y, long incy, long n)
+{
+    return Reduce(x, incx, y, incy, n);
+}
+
+/**
+ * @brief Sum that comes out the same for any number of threads
+ * @param x The elements to sum
+ * @param incx Distance in memory between them
+ * @param n Number of elements
+ * @returns The sum
+ */
+double ReproSum(const double *x, long incx, long n)
+{
+    return Reduce(x, incx, NULL, 0, n);
+}
+
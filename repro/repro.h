@@ -0,0 +1,44 @@
+/**
+ * @file repro.h
+ * Reductions that give the same bits on every run.
+ *
+ * Floating point addition isn't associative, so a sum split between threads,
+ * or between the lanes of a SIMD register, rounds differently depending on
+ * how many of them there are. In reproducible mode, the dot products and sums
+ * inside the library are done in an order that only depends on the length of
+ * the data: it's split into blocks of REPROBLOCK elements, each block is
+ * summed in REPROLANES interleaved partial sums, and the partial sums and
+ * blocks are combined in a fixed tree. The results are then bit-for-bit the
+ * same for any number of threads and any vector width.
+ *
+ * Reproducible mode is off by default. It covers dotV, dotView, mtxmul and the
+ * other products built on MulView, mtxgemv, symvS, syrkS, gemvB and the
+ * multigrid solver. The statistics in stats.h are always reproducible. Builds
+ * that contract multiplies and adds into fused multiply-adds (the default for
+ * gcc when targeting a CPU that has them) round differently from builds that
+ * don't, so build with -ffp-contract=off to compare results across machines.
+ */
+
+#ifndef REPRO_H
+#define REPRO_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+///Number of elements in each block that is summed in a fixed order
+#define REPROBLOCK 2048
+///Number of interleaved partial sums within a block
+#define REPROLANES 8
+
+int mtxsetreproducible(int);
+int mtxreproducible(void);
+double ReproDot(const double*, long, const double*, long, long);
+double ReproSum(const double*, long, long);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
@@ -0,0 +1,340 @@
+/**
+ * @file shmmatrix.c
+ * Publishing and attaching to matricies in POSIX shared memory.
+ *
+ * The version segment holds two counters. next is bumped by each publisher to
+ * reserve a version number, and current is only ever raised, with a
+ * compare-and-swap, once the data for that version is in place. A process
+ * attaching reads current and opens that version. If it was replaced and
+ * unlinked in between, the open fails and it simply tries again.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "shmmatrix.h"
+
+///Identifies a shared memory segment as a published matrix
+#define SHMMAGIC "MTXSHM1"
+///Offset of the data from the start of a segment. Keeps the data aligned to
+///a cache line.
+#define SHMDATAOFFSET 64
+
+/* Header at the start of each version's segment */
+typedef struct {
+    char magic[8];
+    long version;
+    int rows;
+    int cols;
+    int layout;
+} shmheader;
+
+/* Contents of the segment holding the current version number */
+typedef struct {
+    char magic[8];
+    long current;
+    long next;
+} shmversion;
+
+/* Put the name of version v of name into buf. Returns 0 if it fits. */
+static int SegmentName(char *buf, const char *name, long v)
+{
+    if(name[0] != '/' || strchr(name+1, '/')) {
+        fprintf(stderr, "Error: Shared memory name %s must start with / and contain no others.\n", name);
+        return -1;
+    }
+    if(snprintf(buf, SHMNAMELEN, "%s.%ld", name, v) >= SHMNAMELEN) {
+        fprintf(stderr, "Error: Shared memory name %s is too long.\n", name);
+        return -1;
+    }
+    return 0;
+}
+
+/* Map the version segment for name. If create is set, it is made if it
+ * doesn't exist and mapped for writing. Returns NULL on failure. */
+static shmversion* MapVersion(const char *name, int create)
+{
+    shmversion *sv;
+    struct stat st;
+    int fd;
+
+    fd = shm_open(name, create ? O_RDWR | O_CREAT : O_RDONLY, 0644);
+    if(fd < 0) {
+        if(!create && errno == ENOENT)
+            fprintf(stderr, "Error: Nothing has been published as %s.\n", name);
+        else
+            fprintf(stderr, "Error: Unable to open %s: %s\n", name, strerror(errno));
+        return NULL;
+    }
+    /* Whoever creates it first sets the size. The new memory is zeroed. */
+    if(fstat(fd, &st) || (st.st_size < (off_t) sizeof(shmversion) &&
+                          (!create || ftruncate(fd, sizeof(shmversion))))) {
+        fprintf(stderr, "Error: Unable to set up %s: %s\n", name, strerror(errno));
+        close(fd);
+        return NULL;
+    }
+
+    sv = (shmversion*) mmap(NULL, sizeof(shmversion),
+                            create ? PROT_READ | PROT_WRITE : PROT_READ,
+                            MAP_SHARED, fd, 0);
+    close(fd);
+    if(sv == MAP_FAILED) {
+        fprintf(stderr, "Error: Unable to map %s: %s\n", name, strerror(errno));
+        return NULL;
+    }
+    if(create)
+        memcpy(sv->magic, SHMMAGIC, sizeof(SHMMAGIC));
+    return sv;
+}
+
+/**
+ * @brief Publish a copy of a matrix in shared memory
+ *
+ * If a version of the matrix is already published under the same name, this
+ * becomes the new version. Processes attached to the old version aren't
+ * affected, and processes that attach afterwards get the new one.
+ *
+ * @param name Name to publish it under. Must start with a / and contain no
+ *      others, as for shm_open.
+ * @param A The matrix to publish. Either layout is fine, and is kept.
+ * @returns The version number of the published matrix, or -1 on failure
+ */
+long PublishMatrix(const char *name, matrix *A)
+{
+    char seg[SHMNAMELEN];
+    size_t size = SHMDATAOFFSET + (size_t) A->rows*A->cols*sizeof(double);
+    shmversion *sv;
+    shmheader *h;
+    long v, old;
+    int fd;
+
+    sv = MapVersion(name, 1);
+    if(!sv)
+        return -1;
+    v = __atomic_add_fetch(&sv->next, 1, __ATOMIC_SEQ_CST);
+    if(SegmentName(seg, name, v)) {
+        munmap(sv, sizeof(shmversion));
+        return -1;
+    }
+
+    fd = shm_open(seg, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if(fd < 0 || ftruncate(fd, size)) {
+        fprintf(stderr, "Error: Unable to create %s: %s\n", seg, strerror(errno));
+        if(fd >= 0) {
+            close(fd);
+            shm_unlink(seg);
+        }
+        munmap(sv, sizeof(shmversion));
+        return -1;
+    }
+    h = (shmheader*) mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(h == MAP_FAILED) {
+        fprintf(stderr, "Error: Unable to map %s: %s\n", seg, strerror(errno));
+        shm_unlink(seg);
+        munmap(sv, sizeof(shmversion));
+        return -1;
+    }
+
+    memcpy(h->magic, SHMMAGIC, sizeof(SHMMAGIC));
+    h->version = v;
+    h->rows = A->rows;
+    h->cols = A->cols;
+    h->layout = A->layout;
+    memcpy((char*) h + SHMDATAOFFSET, A->data, size - SHMDATAOFFSET);
+    munmap(h, size);
+
+    /* Make this the current version, unless a later one beat it there */
+    old = __atomic_load_n(&sv->current, __ATOMIC_ACQUIRE);
+    while(old < v && !__atomic_compare_exchange_n(&sv->current, &old, v, 0,
+                                                  __ATOMIC_ACQ_REL,
+                                                  __ATOMIC_ACQUIRE))
+        ;
+    munmap(sv, sizeof(shmversion));
+
+    /* Whichever version lost is no longer reachable by name */
+    if(old > v)
+        SegmentName(seg, name, v);
+    else if(old > 0)
+        SegmentName(seg, name, old);
+    if(old > 0)
+        shm_unlink(seg);
+
+    return v;
+}
+
+/**
+ * @brief Remove a published matrix
+ *
+ * Processes that are attached to it can keep using it until they detach.
+ *
+ * @param name Name the matrix was published under
+ * @returns 0 on success, or -1 if nothing was published under that name
+ */
+int UnpublishMatrix(const char *name)
+{
+    char seg[SHMNAMELEN];
+    long v = ShmMatrixVersion(name);
+
+    if(v < 0)
+        return -1;
+    if(v > 0 && !SegmentName(seg, name, v))
+        shm_unlink(seg);
+    shm_unlink(name);
+    return 0;
+}
+
+/**
+ * @brief Get the current version number of a published matrix
+ *
+ * Compare with shmmatrix::version to see whether an attached matrix has been
+ * replaced.
+ *
+ * @param name Name the matrix was published under
+ * @returns The version, 0 if publishing hasn't finished yet, or -1 if nothing
+ *      was published under that name
+ */
+long ShmMatrixVersion(const char *name)
+{
+    shmversion *sv;
+    long v;
+
+    sv = MapVersion(name, 0);
+    if(!sv)
+        return -1;
+    v = __atomic_load_n(&sv->current, __ATOMIC_ACQUIRE);
+    munmap(sv, sizeof(shmversion));
+    return v;
+}
+
+/**
+ * @brief Attach to the current version of a published matrix
+ *
+ * The data is mapped read-only and isn't copied. Use ShmMatrix to get a
+ * matrix that uses it.
+ *
+ * @param name Name the matrix was published under
+ * @returns The attachment, or NULL on failure
+ */
+shmmatrix* AttachMatrix(const char *name)
+{
+    char seg[SHMNAMELEN];
+    shmmatrix *S;
+    shmheader *h = NULL;
+    struct stat st;
+    long v = 0;
+    int fd = -1, tries, i, n, len;
+
+    for(tries=0; tries<SHMRETRIES && fd < 0; tries++) {
+        v = ShmMatrixVersion(name);
+        if(v < 0)
+            return NULL;
+        if(v == 0 || SegmentName(seg, name, v))
+            break;
+        fd = shm_open(seg, O_RDONLY, 0);
+        if(fd < 0 && errno != ENOENT)
+            break;
+    }
+    if(fd < 0) {
+        fprintf(stderr, "Error: Unable to attach to %s.\n", name);
+        return NULL;
+    }
+
+    if(fstat(fd, &st) || st.st_size < SHMDATAOFFSET) {
+        fprintf(stderr, "Error: %s is not a published matrix.\n", seg);
+        close(fd);
+        return NULL;
+    }
+    h = (shmheader*) mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(h == MAP_FAILED) {
+        fprintf(stderr, "Error: Unable to map %s: %s\n", seg, strerror(errno));
+        return NULL;
+    }
+    if(memcmp(h->magic, SHMMAGIC, sizeof(SHMMAGIC)) || h->version != v ||
+       h->rows <= 0 || h->cols <= 0 ||
+       (size_t) st.st_size < SHMDATAOFFSET + (size_t) h->rows*h->cols*sizeof(double)) {
+        fprintf(stderr, "Error: %s is not a published matrix.\n", seg);
+        munmap(h, st.st_size);
+        return NULL;
+    }
+
+    S = (shmmatrix*) calloc(1, sizeof(shmmatrix));
+    if(!S) {
+        fprintf(stderr, "Memory allocation error: %s\n", strerror(errno));
+        munmap(h, st.st_size);
+        return NULL;
+    }
+    S->base = h;
+    S->size = st.st_size;
+    S->version = v;
+    S->m.rows = h->rows;
+    S->m.cols = h->cols;
+    S->m.layout = (h->layout == MTX_COLMAJOR) ? MTX_COLMAJOR : MTX_ROWMAJOR;
+    S->m.data = (double*) ((char*) h + SHMDATAOFFSET);
+
+    /* The row (or column) pointers are local to this process. Holding a
+     * reference means any matrix that modifies the data gets its own copy
+     * first. */
+    n = (S->m.layout == MTX_ROWMAJOR) ? S->m.rows : S->m.cols;
+    len = S->m.rows*S->m.cols/n;
+    S->m.array = (double**) malloc(n*sizeof(double*));
+    S->m.refs = (int*) malloc(sizeof(int));
+    if(!S->m.array || !S->m.refs) {
+        fprintf(stderr, "Memory allocation error: %s\n", strerror(errno));
+        free(S->m.array);
+        free(S->m.refs);
+        munmap(h, st.st_size);
+        free(S);
+        return NULL;
+    }
+    for(i=0; i<n; i++)
+        S->m.array[i] = S->m.data + (size_t) i*len;
+    *S->m.refs = 1;
+
+    return S;
+}
+
+/**
+ * @brief Get a matrix that uses the data of an attached matrix
+ *
+ * No data is copied. The matrix behaves like one from ShareMatrix: it gets
+ * its own copy of the data the first time it's modified, and must be passed
+ * to DestroyMatrix before DetachMatrix is called. Writing through its array
+ * or data pointers without calling UnshareMatrix first will crash, since the
+ * shared data is read-only.
+ *
+ * @param S The attachment
+ * @returns A new matrix, or NULL on failure
+ */
+matrix* ShmMatrix(shmmatrix *S)
+{
+    return ShareMatrix(&S->m);
+}
+
+/**
+ * @brief Detach from a published matrix
+ * @param S The attachment
+ * @returns 0 on success, or -1 if matricies from ShmMatrix still use it, in
+ *      which case nothing is done
+ */
+int DetachMatrix(shmmatrix *S)
+{
+    if(__atomic_load_n(S->m.refs, __ATOMIC_ACQUIRE) > 1) {
+        fprintf(stderr, "Error: Shared matrix is still in use.\n");
+        return -1;
+    }
+
+    free(S->m.array);
+    free(S->m.refs);
+    munmap(S->base, S->size);
+    free(S);
+    return 0;
+}
+
@@ -0,0 +1,65 @@
+/**
+ * @file shmmatrix.h
+ * Publishing matricies in POSIX shared memory so that other processes on the
+ * same host can use them without loading or copying them.
+ *
+ * Each published version of a matrix is a separate segment named
+ * "<name>.<version>", holding a small header followed by the data in the
+ * matrix's own layout. A segment called "<name>" holds the number of the
+ * current version. A new version is written in full before that number is
+ * changed, so a process attaching always sees a complete matrix. Processes
+ * that attached to an older version keep using it until they detach, and its
+ * memory is returned to the system after the last one does.
+ */
+
+#ifndef SHMMATRIX_H
+#define SHMMATRIX_H
+
+#include <stddef.h>
+
+#include "2dmatrix/2dmatrix.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+///Longest allowed name for a published matrix, including the version suffix
+#define SHMNAMELEN 256
+///Number of times to try attaching if new versions keep replacing the one
+///being attached to
+#define SHMRETRIES 100
+
+/**
+ * @struct shmmatrix
+ * @brief A read-only attachment to a published matrix
+ * @var shmmatrix::m
+ * The matrix, with its data in the shared segment. The attachment holds one
+ * reference to it, so the shared data is never modified or freed through it.
+ * @var shmmatrix::base
+ * Start of the mapped segment
+ * @var shmmatrix::size
+ * Size of the mapped segment in bytes
+ * @var shmmatrix::version
+ * Version of the matrix that was attached
+ */
+typedef struct {
+    matrix m;
+    void *base;
+    size_t size;
+    long version;
+} shmmatrix;
+
+long PublishMatrix(const char*, matrix*);
+int UnpublishMatrix(const char*);
+long ShmMatrixVersion(const char*);
+
+shmmatrix* AttachMatrix(const char*);
+matrix* ShmMatrix(shmmatrix*);
+int DetachMatrix(shmmatrix*);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
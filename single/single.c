@@ -0,0 +1,488 @@
+/**
+ * @file single.c
+ * Storage, conversions and products for single precision matricies and
+ * vectors.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+
+#include "single.h"
+#include "../instrument/instrument.h"
+
+///Number of elements above which the kernels are multithreaded
+#define PARALLELSIZE 1e5
+///Number of rows of B kept in cache at a time by gemmF
+#define GEMMKBLOCK 128
+///Number of components of y each thread works on at a time in gemvTF
+#define GEMVBLOCK 4096
+
+/* Allocate rows*cols floats along with pointers to the start of each row.
+ * Returns NULL if either allocation fails. */
+static float** AllocRows(int rows, int cols, float **data)
+{
+    float **array;
+    int i;
+
+    array = (float**) calloc(rows, sizeof(float*));
+    *data = (float*) calloc((size_t) rows*cols, sizeof(float));
+    if(!array || !*data) {
+        fprintf(stderr, "Memory allocation error: %s\n", strerror(errno));
+        fprintf(stderr, "Attempted to create a %dx%d matrix and failed.\n", rows, cols);
+        free(array);
+        free(*data);
+        return NULL;
+    }
+
+    for(i=0; i<rows; i++)
+        array[i] = *data + (size_t) i*cols;
+    return array;
+}
+
+/**
+ * @brief Make a single precision matrix with all elements set to zero
+ * @param rows Number of rows
+ * @param cols Number of columns
+ * @returns The new matrix, or NULL if it couldn't be allocated
+ */
+fmatrix* CreateMatrixF(int rows, int cols)
+{
+    fmatrix *A;
+
+    if(rows <= 0 || cols <= 0) {
+        fprintf(stderr, "Error: Matrix too small.\n");
+        return NULL;
+    }
+
+    A = (fmatrix*) malloc(sizeof(fmatrix));
+    if(!A)
+        return NULL;
+    A->rows = rows;
+    A->cols = cols;
+    A->array = AllocRows(rows, cols, &A->data);
+    if(!A->array) {
+        free(A);
+        return NULL;
+    }
+
+    PROF_ALLOC(MTXOBJ_MATRIX, sizeof(fmatrix) + rows*sizeof(float*) + (long long) rows*cols*sizeof(float));
+    return A;
+}
+
+/**
+ * @brief Free a single precision matrix
+ * @param A The matrix to destroy. Can be NULL.
+ */
+void DestroyMatrixF(fmatrix *A)
+{
+    if(!A)
+        return;
+    PROF_FREE(MTXOBJ_MATRIX, sizeof(fmatrix) + A->rows*sizeof(float*) + (long long) A->rows*A->cols*sizeof(float));
+    free(A->array);
+    free(A->data);
+    free(A);
+}
+
+/**
+ * @brief Make a single precision vector with all components set to zero
+ * @param length Number of components
+ * @returns The new vector, or NULL if it couldn't be allocated
+ */
+fvector* CreateVectorF(int length)
+{
+    fvector *x;
+
+    x = (fvector*) malloc(sizeof(fvector));
+    if(!x)
+        return NULL;
+    x->length = length;
+    x->v = (float*) calloc(length, sizeof(float));
+    if(!x->v) {
+        fprintf(stderr, "Memory allocation error: %s\n", strerror(errno));
+        free(x);
+        return NULL;
+    }
+
+    PROF_ALLOC(MTXOBJ_VECTOR, sizeof(fvector) + (long long) length*sizeof(float));
+    return x;
+}
+
+/**
+ * @brief Free a single precision vector
+ * @param x The vector to destroy. Can be NULL.
+ */
+void DestroyVectorF(fvector *x)
+{
+    if(!x)
+        return;
+    PROF_FREE(MTXOBJ_VECTOR, sizeof(fvector) + (long long) x->length*sizeof(float));
+    free(x->v);
+    free(x);
+}
+
+/**
+ * @brief Make a single precision band matrix with all elements set to zero
+ * @param rows Number of rows (and columns)
+ * @param bandwidth Number of elements stored for each row
+ * @returns The new band matrix, or NULL if it couldn't be allocated
+ */
+fbndmatrix* CreateBandMatrixF(int rows, int bandwidth)
+{
+    fbndmatrix *A;
+    float *data;
+
+    A = (fbndmatrix*) malloc(sizeof(fbndmatrix));
+    if(!A)
+        return NULL;
+    A->r = rows;
+    A->w = bandwidth;
+    A->data = AllocRows(rows, bandwidth, &data);
+    if(!A->data) {
+        free(A);
+        return NULL;
+    }
+    return A;
+}
+
+/**
+ * @brief Free a single precision band matrix
+ * @param A The band matrix to destroy. Can be NULL.
+ */
+void DestroyBandMatrixF(fbndmatrix *A)
+{
+    if(!A)
+        return;
+    free(A->data[0]);
+    free(A->data);
+    free(A);
+}
+
+/**
+ * @brief Round a matrix to single precision
+ * @param A The matrix to convert. Can have either layout.
+ * @returns A new single precision copy of A
+ */
+fmatrix* SingleMatrix(matrix *A)
+{
+    fmatrix *F;
+    int i, j, rows = nRows(A), cols = nCols(A);
+
+    F = CreateMatrixF(rows, cols);
+    if(!F)
+        return NULL;
+
+    if(A->layout == MTX_COLMAJOR) {
+        for(j=0; j<cols; j++)
+            for(i=0; i<rows; i++)
+                F->array[i][j] = (float) A->array[j][i];
+    } else {
+        #pragma omp parallel for simd if((double) rows*cols > PARALLELSIZE) schedule(static)
+        for(i=0; i<rows*cols; i++)
+            F->data[i] = (float) A->data[i];
+    }
+    return F;
+}
+
+/**
+ * @brief Convert a single precision matrix back to double precision
+ * @param F The matrix to convert
+ * @returns A new row-major matrix
+ */
+matrix* DoubleMatrix(fmatrix *F)
+{
+    matrix *A;
+    int i, n = F->rows*F->cols;
+
+    A = CreateMatrix(F->rows, F->cols);
+    if(!A)
+        return NULL;
+
+    #pragma omp parallel for simd if(n > PARALLELSIZE) schedule(static)
+    for(i=0; i<n; i++)
+        A->data[i] = F->data[i];
+    return A;
+}
+
+/**
+ * @brief Round a vector to single precision
+ * @param x The vector to convert
+ * @returns A new single precision copy of x
+ */
+fvector* SingleVector(vector *x)
+{
+    fvector *f;
+    int i;
+
+    f = CreateVectorF(len(x));
+    if(!f)
+        return NULL;
+    for(i=0; i<len(x); i++)
+        f->v[i] = (float) x->v[i];
+    return f;
+}
+
+/**
+ * @brief Convert a single precision vector back to double precision
+ * @param f The vector to convert
+ * @returns A new vector
+ */
+vector* DoubleVector(fvector *f)
+{
+    vector *x;
+    int i;
+
+    x = CreateVector(f->length);
+    for(i=0; i<f->length; i++)
+        x->v[i] = f->v[i];
+    return x;
+}
+
+/**
+ * @brief Round a band matrix to single precision
+ * @param A The band matrix to convert
+ * @returns A new single precision copy of A
+ */
+fbndmatrix* SingleBandMatrix(bndmatrix *A)
+{
+    fbndmatrix *F;
+    int i, j;
+
+    F = CreateBandMatrixF(A->r, A->w);
+    if(!F)
+        return NULL;
+    for(i=0; i<A->r; i++)
+        for(j=0; j<A->w; j++)
+            F->data[i][j] = (float) A->data[i][j];
+    return F;
+}
+
+/**
+ * @brief Dot product of two single precision vectors
+ * @param x A vector
+ * @param y Another vector of the same length
+ * @returns x dot y, or 0 if the lengths differ
+ */
+float dotF(fvector *x, fvector *y)
+{
+    int i, n = x->length;
+    float s = 0;
+
+    if(y->length != n) {
+        fprintf(stderr, "Error: Incompatible vector lengths.\n");
+        return 0;
+    }
+
+    #pragma omp parallel for simd reduction(+:s) if(n > PARALLELSIZE) schedule(static)
+    for(i=0; i<n; i++)
+        s += x->v[i]*y->v[i];
+    return s;
+}
+
+/**
+ * @brief 2-norm of a single precision vector
+ *
+ * The squares are summed in double precision so that long vectors don't lose
+ * accuracy or overflow.
+ *
+ * @param x The vector
+ * @returns The length of x
+ */
+float nrm2F(fvector *x)
+{
+    int i, n = x->length;
+    double s = 0;
+
+    #pragma omp parallel for simd reduction(+:s) if(n > PARALLELSIZE) schedule(static)
+    for(i=0; i<n; i++)
+        s += (double) x->v[i]*x->v[i];
+    return (float) sqrt(s);
+}
+
+/**
+ * @brief Calculate y = a*x + y
+ * @param a Multiplier for x
+ * @param x A vector
+ * @param y Vector of the same length to add a*x to
+ */
+void axpyF(float a, fvector *x, fvector *y)
+{
+    int i, n = x->length;
+
+    if(y->length != n) {
+        fprintf(stderr, "Error: Incompatible vector lengths.\n");
+        return;
+    }
+
+    #pragma omp parallel for simd if(n > PARALLELSIZE) schedule(static)
+    for(i=0; i<n; i++)
+        y->v[i] += a*x->v[i];
+}
+
+/**
+ * @brief Multiply a single precision vector by a constant in place
+ * @param a The constant
+ * @param x The vector to scale
+ */
+void scalF(float a, fvector *x)
+{
+    int i, n = x->length;
+
+    #pragma omp parallel for simd if(n > PARALLELSIZE) schedule(static)
+    for(i=0; i<n; i++)
+        x->v[i] *= a;
+}
+
+/**
+ * @brief Calculate y = alpha*A*x + beta*y in single precision
+ * @param alpha Multiplier for A*x
+ * @param A The matrix
+ * @param x Vector with one component per column of A
+ * @param beta Multiplier for the original y. If it's zero, y is only written
+ *      to.
+ * @param y Vector with one component per row of A. Must not be x.
+ * @returns y, or NULL if the dimensions don't agree
+ */
+fvector* gemvF(float alpha, fmatrix *A, fvector *x, float beta, fvector *y)
+{
+    int i, j, rows = A->rows, cols = A->cols;
+    float s;
+
+    if(x->length != cols || y->length != rows || x->v == y->v) {
+        fprintf(stderr, "Error: Incompatible matrix dimensions.\n");
+        return NULL;
+    }
+
+    PROF_BEGIN(MTXOP_GEMVF);
+    #pragma omp parallel for private(j, s) if((double) rows*cols > PARALLELSIZE) schedule(static)
+    for(i=0; i<rows; i++) {
+        const float *a = A->array[i];
+        s = 0;
+        #pragma omp simd reduction(+:s)
+        for(j=0; j<cols; j++)
+            s += a[j]*x->v[j];
+        y->v[i] = (beta == 0) ? alpha*s : alpha*s + beta*y->v[i];
+    }
+    PROF_END(MTXOP_GEMVF, 2.0*rows*cols);
+
+    return y;
+}
+
+/**
+ * @brief Calculate y = alpha*A^T*x + beta*y in single precision
+ *
+ * y is built up from the rows of A, with each thread working on its own
+ * block of y so that A is still read a row at a time.
+ *
+ * @param alpha Multiplier for A^T*x
+ * @param A The matrix
+ * @param x Vector with one component per row of A
+ * @param beta Multiplier for the original y. If it's zero, y is only written
+ *      to.
+ * @param y Vector with one component per column of A. Must not be x.
+ * @returns y, or NULL if the dimensions don't agree
+ */
+fvector* gemvTF(float alpha, fmatrix *A, fvector *x, float beta, fvector *y)
+{
+    int i, j, jb, jend, rows = A->rows, cols = A->cols;
+    float t;
+
+    if(x->length != rows || y->length != cols || x->v == y->v) {
+        fprintf(stderr, "Error: Incompatible matrix dimensions.\n");
+        return NULL;
+    }
+
+    PROF_BEGIN(MTXOP_GEMVF);
+    #pragma omp parallel for private(i, j, jend, t) if((double) rows*cols > PARALLELSIZE) schedule(static)
+    for(jb=0; jb<cols; jb+=GEMVBLOCK) {
+        float *yb = y->v + jb;
+        jend = (cols-jb < GEMVBLOCK) ? cols-jb : GEMVBLOCK;
+
+        for(j=0; j<jend; j++)
+            yb[j] = (beta == 0) ? 0 : beta*yb[j];
+        for(i=0; i<rows; i++) {
+            const float *a = A->array[i] + jb;
+            t = alpha*x->v[i];
+            #pragma omp simd
+            for(j=0; j<jend; j++)
+                yb[j] += a[j]*t;
+        }
+    }
+    PROF_END(MTXOP_GEMVF, 2.0*rows*cols);
+
+    return y;
+}
+
+/**
+ * @brief Calculate C = alpha*A*B + beta*C in single precision
+ *
+ * Each row of C is built up from rows of B four at a time. B is worked
+ * through in blocks of rows that stay in cache while every row of C uses
+ * them, and the rows of C are split between threads.
+ *
+ * @param alpha Multiplier for A*B
+ * @param A The first matrix
+ * @param B The second matrix
+ * @param beta Multiplier for the original C. If it's zero, C is only written
+ *      to.
+ * @param C Matrix to store the result in. Must not be A or B.
+ * @returns C, or NULL if the dimensions don't agree
+ */
+fmatrix* gemmF(float alpha, fmatrix *A, fmatrix *B, float beta, fmatrix *C)
+{
+    int i, j, k, kb, kend, n = C->rows, m = C->cols, l = A->cols;
+
+    if(B->rows != l || A->rows != n || B->cols != m || C == A || C == B) {
+        fprintf(stderr, "Error: Incompatible matrix dimensions.\n");
+        return NULL;
+    }
+
+    PROF_BEGIN(MTXOP_GEMMF);
+    #pragma omp parallel private(i, j, k, kb, kend) if(2.0*n*m*l > PARALLELSIZE)
+    {
+        #pragma omp for schedule(static)
+        for(i=0; i<n; i++) {
+            float *c = C->array[i];
+            if(beta == 0) {
+                for(j=0; j<m; j++)
+                    c[j] = 0;
+            } else if(beta != 1) {
+                #pragma omp simd
+                for(j=0; j<m; j++)
+                    c[j] *= beta;
+            }
+        }
+
+        for(kb=0; kb<l; kb+=GEMMKBLOCK) {
+            kend = (l-kb < GEMMKBLOCK) ? l : kb+GEMMKBLOCK;
+            /* Every thread keeps the same rows, so no barrier is needed */
+            #pragma omp for schedule(static) nowait
+            for(i=0; i<n; i++) {
+                float *c = C->array[i];
+                const float *a = A->array[i];
+                for(k=kb; k+3<kend; k+=4) {
+                    const float *b0 = B->array[k], *b1 = B->array[k+1],
+                                *b2 = B->array[k+2], *b3 = B->array[k+3];
+                    float a0 = alpha*a[k], a1 = alpha*a[k+1],
+                          a2 = alpha*a[k+2], a3 = alpha*a[k+3];
+                    #pragma omp simd
+                    for(j=0; j<m; j++)
+                        c[j] += a0*b0[j] + a1*b1[j] + a2*b2[j] + a3*b3[j];
+                }
+                for(; k<kend; k++) {
+                    const float *b0 = B->array[k];
+                    float a0 = alpha*a[k];
+                    #pragma omp simd
+                    for(j=0; j<m; j++)
+                        c[j] += a0*b0[j];
+                }
+            }
+        }
+    }
+    PROF_END(MTXOP_GEMMF, 2.0*n*m*l);
+
+    return C;
+}
+
@@ -0,0 +1,122 @@
+/**
+ * @file single.h
+ * Single precision matricies, vectors and band matricies.
+ *
+ * These hold the same kinds of data as matrix, vector and bndmatrix, but in
+ * float instead of double, which halves the memory used and the bandwidth
+ * needed to stream them. They come with the kernels that are limited by
+ * memory speed (products, factorizations and vector operations) and with
+ * conversions to and from the double precision types.
+ *
+ * SolveMatrixEquationMixed and SolveBandMixed use the single precision
+ * factorizations to solve double precision systems. They factor in single
+ * precision, then refine the answer with residuals calculated in double
+ * precision, which gives double precision accuracy for systems that aren't
+ * too badly conditioned.
+ */
+
+#ifndef SINGLE_H
+#define SINGLE_H
+
+#include "2dmatrix/2dmatrix.h"
+#include "vector/vector.h"
+#include "bandmatrix/bandmatrix.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @struct fmatrix
+ * @brief A row-major single precision matrix
+ * @var fmatrix::array
+ * Pointers to the start of each row
+ * @var fmatrix::data
+ * All of the elements, one row after another
+ * @var fmatrix::rows
+ * Number of rows
+ * @var fmatrix::cols
+ * Number of columns
+ */
+typedef struct {
+    float **array;
+    float *data;
+    int rows;
+    int cols;
+} fmatrix;
+
+/**
+ * @struct fvector
+ * @brief A single precision vector
+ * @var fvector::v
+ * The components
+ * @var fvector::length
+ * Number of components
+ */
+typedef struct {
+    float *v;
+    int length;
+} fvector;
+
+/**
+ * @struct fbndmatrix
+ * @brief A single precision band matrix, stored the same way as bndmatrix
+ * @var fbndmatrix::data
+ * Row i holds the elements from column i-w/2 to i+w/2. The rows are
+ * allocated together.
+ * @var fbndmatrix::r
+ * Number of rows
+ * @var fbndmatrix::w
+ * Bandwidth
+ */
+typedef struct {
+    float **data;
+    int r;
+    int w;
+} fbndmatrix;
+
+/**
+ * @brief Access an element of a single precision matrix. Can also be assigned
+ * to.
+ * @param A The matrix
+ * @param ROW Row
+ * @param COL Column
+ */
+#define valF(A, ROW, COL) (A)->array[(ROW)][(COL)]
+
+fmatrix* CreateMatrixF(int, int);
+void DestroyMatrixF(fmatrix*);
+fvector* CreateVectorF(int);
+void DestroyVectorF(fvector*);
+fbndmatrix* CreateBandMatrixF(int, int);
+void DestroyBandMatrixF(fbndmatrix*);
+
+fmatrix* SingleMatrix(matrix*);
+matrix* DoubleMatrix(fmatrix*);
+fvector* SingleVector(vector*);
+vector* DoubleVector(fvector*);
+fbndmatrix* SingleBandMatrix(bndmatrix*);
+
+float dotF(fvector*, fvector*);
+float nrm2F(fvector*);
+void axpyF(float, fvector*, fvector*);
+void scalF(float, fvector*);
+
+fvector* gemvF(float, fmatrix*, fvector*, float, fvector*);
+fvector* gemvTF(float, fmatrix*, fvector*, float, fvector*);
+fmatrix* gemmF(float, fmatrix*, fmatrix*, float, fmatrix*);
+
+int LUFactorF(fmatrix*, int*);
+void LUSolveF(fmatrix*, int*, fmatrix*);
+int LUFactorBF(fbndmatrix*);
+void LUSolveBF(fbndmatrix*, fmatrix*);
+
+matrix* SolveMatrixEquationMixed(matrix*, matrix*);
+matrix* SolveBandMixed(bndmatrix*, matrix*);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
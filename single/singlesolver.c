@@ -0,0 +1,490 @@
+/**
+ * @file singlesolver.c
+ * Single precision LU factorizations, and mixed precision solvers built on
+ * them.
+ *
+ * Factoring in single precision takes half the memory traffic of double, but
+ * only gives an answer good to about cond(A)*1e-7. The mixed precision
+ * solvers recover the rest with iterative refinement: the residual
+ * r = b - A*x is calculated in double precision, the correction is solved
+ * for with the single precision factors, and the two steps are repeated. Each
+ * pass shrinks the error by about cond(A)*1e-7, so a few passes reach double
+ * precision accuracy as long as A isn't close to singular in single
+ * precision.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <float.h>
+
+#include "single.h"
+#include "../2dmatrix/mtxsolver.h"
+#include "../2dmatrix/mtxview.h"
+#include "../instrument/instrument.h"
+
+///Number of columns factored at a time before updating the rest of the matrix
+#define LUBLOCK 64
+///Number of elements above which the trailing update is multithreaded
+#define PARALLELSIZE 1e5
+///Most refinement steps taken before giving up
+#define REFINEMAXITER 30
+
+/* Access the (I,J) element of band matrix M with P subdiagonals, without
+ * bounds checking. J must lie within the band of row I. */
+#define BAND(M, P, I, J) (M)->data[(I)][(J) + (P) - (I)]
+
+/* Swap rows i and j of a matrix */
+static void SwapRows(fmatrix *A, int i, int j)
+{
+    int k;
+    float t, *a = A->array[i], *b = A->array[j];
+
+    for(k=0; k<A->cols; k++) {
+        t = a[k];
+        a[k] = b[k];
+        b[k] = t;
+    }
+}
+
+/* Subtract L21*U12 from the trailing block A22, where the panel holds columns
+ * kb to kend-1. Each row of A22 is updated from rows of U12 four at a time. */
+static void UpdateTrailing(fmatrix *A, int kb, int kend)
+{
+    int i, j, k, n = A->rows;
+
+    #pragma omp parallel for private(j, k) if((double) (n-kend)*(n-kend) > PARALLELSIZE) schedule(static)
+    for(i=kend; i<n; i++) {
+        float *a = A->array[i];
+        for(k=kb; k+3<kend; k+=4) {
+            const float *u0 = A->array[k], *u1 = A->array[k+1],
+                        *u2 = A->array[k+2], *u3 = A->array[k+3];
+            float l0 = a[k], l1 = a[k+1], l2 = a[k+2], l3 = a[k+3];
+            #pragma omp simd
+            for(j=kend; j<n; j++)
+                a[j] -= l0*u0[j] + l1*u1[j] + l2*u2[j] + l3*u3[j];
+        }
+        for(; k<kend; k++) {
+            const float *u0 = A->array[k];
+            float l0 = a[k];
+            #pragma omp simd
+            for(j=kend; j<n; j++)
+                a[j] -= l0*u0[j];
+        }
+    }
+}
+
+/**
+ * @brief Factor a square single precision matrix as P*A = L*U in place
+ *
+ * Uses partial pivoting. The columns are factored in panels of LUBLOCK, and
+ * the rest of the matrix is updated once per panel with a multithreaded
+ * product, so most of the work is done a row at a time.
+ *
+ * @param A Matrix to factor. On return, it holds the unit lower triangular L
+ *      below the diagonal and U on and above it.
+ * @param perm Array of nRows(A) ints. Row i was swapped with row perm[i] at
+ *      step i.
+ * @returns 0 on success, or k if the k-th pivot is zero
+ */
+int LUFactorF(fmatrix *A, int *perm)
+{
+    int n = A->rows, i, j, k, p, kb, kend;
+    float l, *a, *u;
+
+    if(A->cols != n) {
+        fprintf(stderr, "Error: Incompatible matrix dimensions.\n");
+        return -1;
+    }
+
+    PROF_BEGIN(MTXOP_LUFACTORF);
+    for(kb=0; kb<n; kb+=LUBLOCK) {
+        kend = (n-kb < LUBLOCK) ? n : kb+LUBLOCK;
+
+        /* Factor the panel, swapping whole rows as the pivots are chosen */
+        for(k=kb; k<kend; k++) {
+            p = k;
+            for(i=k+1; i<n; i++)
+                if(fabsf(A->array[i][k]) > fabsf(A->array[p][k]))
+                    p = i;
+            perm[k] = p;
+            if(A->array[p][k] == 0) {
+                PROF_END(MTXOP_LUFACTORF, 2.0/3.0*((double) n*n*n - (double) (n-k)*(n-k)*(n-k)));
+                return k+1;
+            }
+            if(p != k)
+                SwapRows(A, p, k);
+
+            u = A->array[k];
+            for(i=k+1; i<n; i++) {
+                a = A->array[i];
+                l = a[k] /= u[k];
+                for(j=k+1; j<kend; j++)
+                    a[j] -= l*u[j];
+            }
+        }
+
+        /* U12 = L11^-1 * A12 */
+        for(k=kb; k<kend; k++) {
+            u = A->array[k];
+            for(i=k+1; i<kend; i++) {
+                a = A->array[i];
+                l = a[k];
+                #pragma omp simd
+                for(j=kend; j<n; j++)
+                    a[j] -= l*u[j];
+            }
+        }
+
+        UpdateTrailing(A, kb, kend);
+    }
+    PROF_END(MTXOP_LUFACTORF, 2.0/3.0*n*n*n);
+
+    return 0;
+}
+
+/**
+ * @brief Solve A*X = B using the factors from LUFactorF
+ * @param LU The factored matrix
+ * @param perm Row swaps from LUFactorF
+ * @param B Right-hand sides, one per column. Overwritten with the solution.
+ */
+void LUSolveF(fmatrix *LU, int *perm, fmatrix *B)
+{
+    int n = LU->rows, m = B->cols, i, j, k;
+    float l, *b, *x;
+
+    if(B->rows != n) {
+        fprintf(stderr, "Error: Incompatible matrix dimensions.\n");
+        return;
+    }
+
+    for(i=0; i<n; i++)
+        if(perm[i] != i)
+            SwapRows(B, i, perm[i]);
+
+    /* Each row of the solution is its right-hand side minus a combination of
+     * the rows already found */
+    for(i=0; i<n; i++) {
+        x = B->array[i];
+        for(k=0; k<i; k++) {
+            l = LU->array[i][k];
+            b = B->array[k];
+            #pragma omp simd
+            for(j=0; j<m; j++)
+                x[j] -= l*b[j];
+        }
+    }
+    for(i=n-1; i>=0; i--) {
+        x = B->array[i];
+        for(k=i+1; k<n; k++) {
+            l = LU->array[i][k];
+            b = B->array[k];
+            #pragma omp simd
+            for(j=0; j<m; j++)
+                x[j] -= l*b[j];
+        }
+        l = LU->array[i][i];
+        for(j=0; j<m; j++)
+            x[j] /= l;
+    }
+}
+
+/**
+ * @brief Factor a single precision band matrix as L*U in place, without
+ * pivoting
+ *
+ * L and U have the same bandwidth as A, so they fit in its storage. Without
+ * pivoting, this is only stable for matricies that are diagonally dominant or
+ * symmetric positive definite, which covers most discretized differential
+ * equations.
+ *
+ * @param A Band matrix to factor. On return, it holds the unit lower
+ *      triangular L below the diagonal and U on and above it.
+ * @returns 0 on success, or k if the k-th pivot is zero
+ */
+int LUFactorBF(fbndmatrix *A)
+{
+    int n = A->r, pl = A->w/2, pu = A->w-1-A->w/2, i, j, k, iend, jend;
+    float l, *a, *u;
+
+    for(k=0; k<n; k++) {
+        if(BAND(A, pl, k, k) == 0)
+            return k+1;
+        iend = (k+pl < n) ? k+pl : n-1;
+        jend = (k+pu < n) ? k+pu : n-1;
+        u = &BAND(A, pl, k, 0);
+        for(i=k+1; i<=iend; i++) {
+            a = &BAND(A, pl, i, 0);
+            l = a[k] /= u[k];
+            #pragma omp simd
+            for(j=k+1; j<=jend; j++)
+                a[j] -= l*u[j];
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Solve A*X = B using the factors from LUFactorBF
+ * @param LU The factored band matrix
+ * @param B Right-hand sides, one per column. Overwritten with the solution.
+ */
+void LUSolveBF(fbndmatrix *LU, fmatrix *B)
+{
+    int n = LU->r, pl = LU->w/2, pu = LU->w-1-LU->w/2, m = B->cols;
+    int i, j, k, k0, k1;
+    float l, *b, *x;
+
+    if(B->rows != n) {
+        fprintf(stderr, "Error: Incompatible matrix dimensions.\n");
+        return;
+    }
+
+    for(i=0; i<n; i++) {
+        x = B->array[i];
+        k0 = (i-pl > 0) ? i-pl : 0;
+        for(k=k0; k<i; k++) {
+            l = BAND(LU, pl, i, k);
+            b = B->array[k];
+            for(j=0; j<m; j++)
+                x[j] -= l*b[j];
+        }
+    }
+    for(i=n-1; i>=0; i--) {
+        x = B->array[i];
+        k1 = (i+pu < n) ? i+pu : n-1;
+        for(k=i+1; k<=k1; k++) {
+            l = BAND(LU, pl, i, k);
+            b = B->array[k];
+            for(j=0; j<m; j++)
+                x[j] -= l*b[j];
+        }
+        l = BAND(LU, pl, i, i);
+        for(j=0; j<m; j++)
+            x[j] /= l;
+    }
+}
+
+/* Largest magnitude of the elements of a matrix */
+static double MaxAbs(matrix *A)
+{
+    int i, n = nRows(A)*nCols(A);
+    double m = 0;
+
+    for(i=0; i<n; i++)
+        if(fabs(A->data[i]) > m)
+            m = fabs(A->data[i]);
+    return m;
+}
+
+/* Round the column-major matrix R into the single precision matrix D */
+static void RoundInto(matrix *R, fmatrix *D)
+{
+    int i, j;
+
+    for(j=0; j<nCols(R); j++)
+        for(i=0; i<nRows(R); i++)
+            D->array[i][j] = (float) R->array[j][i];
+}
+
+/* Add the single precision correction D to the column-major matrix X */
+static void AddCorrection(matrix *X, fmatrix *D)
+{
+    int i, j;
+
+    for(j=0; j<nCols(X); j++)
+        for(i=0; i<nRows(X); i++)
+            X->array[j][i] += D->array[i][j];
+}
+
+/* Calculate R = B - A*X one column at a time. X and R are column-major, so
+ * each column is contiguous and can be treated as a vector. Dense A uses
+ * mtxgemv, and band A uses gemvB. */
+static void Residual(matrix *A, bndmatrix *Ab, matrix *B, matrix *X, matrix *R)
+{
+    int j, n = nRows(X);
+    vector x, r;
+
+    CopyViewInto(ViewMatrix(B), R);
+    x.length = r.length = n;
+    for(j=0; j<nCols(X); j++) {
+        x.v = X->array[j];
+        r.v = R->array[j];
+        if(A)
+            mtxgemv(-1, A, &x, 1, &r);
+        else
+            gemvB(-1, Ab, &x, 1, &r);
+    }
+}
+
+/* Refine X until the residual is down to rounding error. anorm is the
+ * infinity norm of A. Returns the number of steps taken, or -1 if it didn't
+ * converge. */
+static int Refine(matrix *A, bndmatrix *Ab, fmatrix *LU, int *perm,
+                  fbndmatrix *LUb, double anorm, matrix *B, matrix *X)
+{
+    int n = nRows(X), it;
+    matrix *R;
+    fmatrix *D;
+    double tol = anorm*DBL_EPSILON*sqrt(n);
+
+    R = CreateMatrixLayout(n, nCols(X), MTX_COLMAJOR);
+    D = CreateMatrixF(n, nCols(X));
+
+    for(it=0; it<=REFINEMAXITER; it++) {
+        Residual(A, Ab, B, X, R);
+        if(MaxAbs(R) <= tol*MaxAbs(X))
+            break;
+        if(it == REFINEMAXITER) {
+            it = -1;
+            break;
+        }
+        RoundInto(R, D);
+        if(LU)
+            LUSolveF(LU, perm, D);
+        else
+            LUSolveBF(LUb, D);
+        AddCorrection(X, D);
+    }
+
+    DestroyMatrix(R);
+    DestroyMatrixF(D);
+    return it;
+}
+
+/* Solve with the single precision factors for the starting guess. Returns a
+ * column-major matrix. */
+static matrix* FirstGuess(fmatrix *LU, int *perm, fbndmatrix *LUb, matrix *B)
+{
+    int i, j, n = nRows(B), m = nCols(B);
+    fmatrix *D;
+    matrix *X;
+
+    D = CreateMatrixF(n, m);
+    for(i=0; i<n; i++)
+        for(j=0; j<m; j++)
+            D->array[i][j] = (float) val(B, i, j);
+    if(LU)
+        LUSolveF(LU, perm, D);
+    else
+        LUSolveBF(LUb, D);
+
+    X = CreateMatrixLayout(n, m, MTX_COLMAJOR);
+    for(j=0; j<m; j++)
+        for(i=0; i<n; i++)
+            X->array[j][i] = D->array[i][j];
+    DestroyMatrixF(D);
+    return X;
+}
+
+/**
+ * @brief Solve A*X = B to double precision accuracy using a single precision
+ * factorization
+ *
+ * A is factored with LUFactorF, and the solution is refined with residuals
+ * calculated in double precision. If the single precision factorization
+ * fails or refinement doesn't converge, which happens when A is badly
+ * conditioned, the system is solved with SolveMatrixEquation instead.
+ *
+ * @param A Square coefficient matrix
+ * @param B Right-hand sides, one per column
+ * @returns X, in the same layout as B, or NULL on error
+ */
+matrix* SolveMatrixEquationMixed(matrix *A, matrix *B)
+{
+    int n = nRows(A), i, j, it = -1;
+    int *perm;
+    double anorm = 0, s;
+    fmatrix *LU;
+    matrix *X;
+
+    if(nCols(A) != n || nRows(B) != n) {
+        fprintf(stderr, "Error: Incompatible matrix dimensions.\n");
+        return NULL;
+    }
+
+    PROF_BEGIN(MTXOP_SOLVEMIXED);
+    for(i=0; i<n; i++) {
+        s = 0;
+        for(j=0; j<n; j++)
+            s += fabs(val(A, i, j));
+        if(s > anorm)
+            anorm = s;
+    }
+
+    LU = SingleMatrix(A);
+    perm = (int*) malloc(n*sizeof(int));
+    X = NULL;
+    if(LUFactorF(LU, perm) == 0) {
+        X = FirstGuess(LU, perm, NULL, B);
+        it = Refine(A, NULL, LU, perm, NULL, anorm, B, X);
+    }
+    DestroyMatrixF(LU);
+    free(perm);
+    PROF_END(MTXOP_SOLVEMIXED, 2.0/3.0*n*n*n + (it+2)*4.0*n*n*nCols(B));
+
+    if(it < 0) {
+        if(X)
+            DestroyMatrix(X);
+        return SolveMatrixEquation(A, B);
+    }
+
+    mtxsetlayout(X, B->layout);
+    return X;
+}
+
+/**
+ * @brief Solve A*X = B for a band matrix A to double precision accuracy
+ * using a single precision factorization
+ *
+ * A is factored with LUFactorBF, so it should be diagonally dominant or
+ * symmetric positive definite, and the solution is refined with residuals
+ * calculated in double precision.
+ *
+ * @param A Band coefficient matrix
+ * @param B Right-hand sides, one per column
+ * @returns X, in the same layout as B, or NULL if A has a zero pivot or
+ *      refinement didn't converge
+ */
+matrix* SolveBandMixed(bndmatrix *A, matrix *B)
+{
+    int i, j, it;
+    double anorm = 0, s;
+    fbndmatrix *LU;
+    matrix *X;
+
+    if(nRows(B) != A->r) {
+        fprintf(stderr, "Error: Incompatible matrix dimensions.\n");
+        return NULL;
+    }
+
+    for(i=0; i<A->r; i++) {
+        s = 0;
+        for(j=0; j<A->w; j++)
+            s += fabs(A->data[i][j]);
+        if(s > anorm)
+            anorm = s;
+    }
+
+    LU = SingleBandMatrix(A);
+    if(LUFactorBF(LU)) {
+        fprintf(stderr, "Error: Zero pivot in band LU factorization.\n");
+        DestroyBandMatrixF(LU);
+        return NULL;
+    }
+    X = FirstGuess(NULL, NULL, LU, B);
+    it = Refine(NULL, A, NULL, NULL, LU, anorm, B, X);
+    DestroyBandMatrixF(LU);
+
+    if(it < 0) {
+        fprintf(stderr, "Error: Iterative refinement did not converge.\n");
+        DestroyMatrix(X);
+        return NULL;
+    }
+
+    mtxsetlayout(X, B->layout);
+    return X;
+}
+
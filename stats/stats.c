@@ -0,0 +1,396 @@
+/**
+ * @file stats.c
+ * One-pass, multithreaded per-column statistics.
+ *
+ * The rows are split into blocks of about STATBLOCK elements. The blocks are
+ * divided into at most STATCHUNKS chunks of consecutive blocks, which are
+ * handed out to threads. Within a chunk, block results are combined like a
+ * binary counter: a new block is merged with the previous one, the pair with
+ * the previous pair, and so on. The chunk results are then merged in a fixed
+ * tree. Since none of this depends on the number of threads, the results
+ * don't either.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+
+#include "stats.h"
+#include "../instrument/instrument.h"
+
+///Number of elements in each block of rows
+#define STATBLOCK 8192
+///Fewest rows in a block
+#define STATMINROWS 8
+///Largest number of chunks the blocks are split into
+#define STATCHUNKS 64
+///Deepest the merge tree within a chunk can get
+#define STATLEVELS 48
+///Number of elements above which the chunks are split between threads
+#define PARALLELSIZE 1e5
+
+/* Reset every statistic to its value for no data */
+static void Clear(mtxstats *S)
+{
+    int j;
+
+    for(j=0; j<S->cols; j++) {
+        S->count[j] = 0;
+        S->nans[j] = 0;
+        S->mean[j] = 0;
+        S->m2[j] = 0;
+        S->min[j] = INFINITY;
+        S->max[j] = -INFINITY;
+        S->absmax[j] = 0;
+    }
+}
+
+/**
+ * @brief Create a set of statistics with no data in it yet
+ * @param cols Number of columns
+ * @param which Statistics to keep, as a combination of STAT_MINMAX and
+ *      STAT_VARIANCE, or STAT_MEAN for just the counts and means
+ * @returns The statistics, or NULL on failure
+ */
+mtxstats* CreateStats(int cols, int which)
+{
+    mtxstats *S;
+
+    if(cols <= 0) {
+        fprintf(stderr, "Error: Invalid number of columns.\n");
+        return NULL;
+    }
+
+    S = (mtxstats*) calloc(1, sizeof(mtxstats));
+    if(!S) {
+        fprintf(stderr, "Memory allocation error: %s\n", strerror(errno));
+        return NULL;
+    }
+    S->cols = cols;
+    S->which = which & STAT_ALL;
+    S->count = (long*) malloc(2*cols*sizeof(long));
+    S->mean = (double*) malloc(5*cols*sizeof(double));
+    if(!S->count || !S->mean) {
+        fprintf(stderr, "Memory allocation error: %s\n", strerror(errno));
+        free(S->count);
+        free(S->mean);
+        free(S);
+        return NULL;
+    }
+    S->nans = S->count + cols;
+    S->m2 = S->mean + cols;
+    S->min = S->mean + 2*cols;
+    S->max = S->mean + 3*cols;
+    S->absmax = S->mean + 4*cols;
+    Clear(S);
+
+    return S;
+}
+
+/**
+ * @brief Free a set of statistics
+ * @param S The statistics to free
+ */
+void DestroyStats(mtxstats *S)
+{
+    free(S->count);
+    free(S->mean);
+    free(S);
+}
+
+/* Work out the statistics for rows i0 to i1-1 of v from scratch. The block is
+ * small enough to stay in cache, so each statistic gets its own sweep over
+ * it, with the columns in the inner loop. */
+static void BlockStats(mtxstats *B, mtxview v, int i0, int i1)
+{
+    int i, j, n = v.cols;
+    const double *x;
+    double y, d;
+
+    Clear(B);
+    for(i=i0; i<i1; i++) {
+        x = v.data + (long) i*v.rs;
+        for(j=0; j<n; j++) {
+            y = x[(long) j*v.cs];
+            if(isnan(y)) {
+                B->nans[j]++;
+            } else {
+                B->count[j]++;
+                B->mean[j] += y;
+            }
+        }
+    }
+    for(j=0; j<n; j++)
+        if(B->count[j])
+            B->mean[j] /= B->count[j];
+
+    /* Comparisons with NaN are false, so NaNs drop out by themselves */
+    if(B->which & STAT_MINMAX) {
+        for(i=i0; i<i1; i++) {
+            x = v.data + (long) i*v.rs;
+            for(j=0; j<n; j++) {
+                y = x[(long) j*v.cs];
+                if(y < B->min[j])
+                    B->min[j] = y;
+                if(y > B->max[j])
+                    B->max[j] = y;
+                if(fabs(y) > fabs(B->absmax[j]))
+                    B->absmax[j] = y;
+            }
+        }
+    }
+
+    if(B->which & STAT_VARIANCE) {
+        for(i=i0; i<i1; i++) {
+            x = v.data + (long) i*v.rs;
+            for(j=0; j<n; j++) {
+                y = x[(long) j*v.cs];
+                if(!isnan(y)) {
+                    d = y - B->mean[j];
+                    B->m2[j] += d*d;
+                }
+            }
+        }
+    }
+}
+
+/**
+ * @brief Add one set of statistics into another
+ *
+ * The result is the same as if all the rows behind B had been added to A.
+ *
+ * @param A The statistics to add to
+ * @param B The statistics to add. Not changed.
+ * @returns 0 on success, or -1 if the number of columns differ
+ */
+int StatsMerge(mtxstats *A, mtxstats *B)
+{
+    int j;
+    long na, nb, n;
+    double d;
+
+    if(A->cols != B->cols) {
+        fprintf(stderr, "Error: Incompatible matrix dimensions.\n");
+        return -1;
+    }
+
+    for(j=0; j<A->cols; j++) {
+        A->nans[j] += B->nans[j];
+        nb = B->count[j];
+        if(nb == 0)
+            continue;
+        na = A->count[j];
+        n = na + nb;
+
+        d = B->mean[j] - A->mean[j];
+        A->mean[j] += d*((double) nb/n);
+        A->m2[j] += B->m2[j] + d*d*((double) na*nb/n);
+        A->count[j] = n;
+
+        if(B->min[j] < A->min[j])
+            A->min[j] = B->min[j];
+        if(B->max[j] > A->max[j])
+            A->max[j] = B->max[j];
+        if(fabs(B->absmax[j]) > fabs(A->absmax[j]))
+            A->absmax[j] = B->absmax[j];
+    }
+
+    return 0;
+}
+
+/* Statistics for blocks b0 to b1-1 of br rows each, merged as a binary
+ * counter. Returns NULL on failure. */
+static mtxstats* ChunkStats(mtxview v, int which, int br, int b0, int b1)
+{
+    mtxstats *level[STATLEVELS] = {NULL}, *carry, *t, *total = NULL;
+    int used[STATLEVELS] = {0};
+    int b, l, i1, fail = 0;
+
+    carry = CreateStats(v.cols, which);
+    if(!carry)
+        return NULL;
+
+    for(b=b0; b<b1 && !fail; b++) {
+        i1 = ((b+1)*br < v.rows) ? (b+1)*br : v.rows;
+        BlockStats(carry, v, b*br, i1);
+
+        /* The rows in level l come before the ones being carried */
+        for(l=0; l<STATLEVELS-1 && used[l]; l++) {
+            StatsMerge(level[l], carry);
+            t = level[l];
+            level[l] = carry;
+            carry = t;
+            used[l] = 0;
+        }
+        if(used[l]) {
+            StatsMerge(level[l], carry);
+            continue;
+        }
+        if(!level[l])
+            level[l] = CreateStats(v.cols, which);
+        if(!level[l]) {
+            fail = 1;
+            break;
+        }
+        t = level[l];
+        level[l] = carry;
+        carry = t;
+        used[l] = 1;
+    }
+
+    /* Fold the levels together, earliest rows first */
+    for(l=STATLEVELS-1; l>=0 && !fail; l--) {
+        if(!used[l])
+            continue;
+        if(!total) {
+            total = level[l];
+            level[l] = NULL;
+        } else {
+            StatsMerge(total, level[l]);
+        }
+    }
+
+    for(l=0; l<STATLEVELS; l++)
+        if(level[l])
+            DestroyStats(level[l]);
+    DestroyStats(carry);
+
+    return total;
+}
+
+/**
+ * @brief Add the rows of a view to a set of statistics
+ *
+ * Use this to add row blocks of a larger data set as they arrive.
+ *
+ * @param S The statistics to add to
+ * @param v The rows to add. Must have the same number of columns as S.
+ * @returns 0 on success, or -1 on failure
+ */
+int StatsUpdateView(mtxstats *S, mtxview v)
+{
+    mtxstats *chunk[STATCHUNKS];
+    int br, nb, nc, c, step, ret = 0;
+
+    if(v.cols != S->cols) {
+        fprintf(stderr, "Error: Incompatible matrix dimensions.\n");
+        return -1;
+    }
+    if(v.rows <= 0)
+        return 0;
+
+    PROF_BEGIN(MTXOP_STATS);
+    br = STATBLOCK/v.cols;
+    if(br < STATMINROWS)
+        br = STATMINROWS;
+    nb = (v.rows + br - 1)/br;
+    nc = (nb < STATCHUNKS) ? nb : STATCHUNKS;
+
+    #pragma omp parallel for if((double) v.rows*v.cols > PARALLELSIZE) schedule(dynamic, 1)
+    for(c=0; c<nc; c++)
+        chunk[c] = ChunkStats(v, S->which, br, (long) nb*c/nc, (long) nb*(c+1)/nc);
+
+    for(c=0; c<nc; c++)
+        if(!chunk[c])
+            ret = -1;
+
+    /* Merge neighboring chunks pairwise */
+    for(step=1; step<nc && !ret; step*=2) {
+        for(c=0; c+step<nc; c+=2*step) {
+            StatsMerge(chunk[c], chunk[c+step]);
+            DestroyStats(chunk[c+step]);
+            chunk[c+step] = NULL;
+        }
+    }
+    if(!ret)
+        StatsMerge(S, chunk[0]);
+    for(c=0; c<nc; c++)
+        if(chunk[c])
+            DestroyStats(chunk[c]);
+    PROF_END(MTXOP_STATS, (double) v.rows*v.cols);
+
+    return ret;
+}
+
+/**
+ * @brief Add the rows of a matrix to a set of statistics
+ * @param S The statistics to add to
+ * @param A The rows to add, in either layout. Must have the same number of
+ *      columns as S.
+ * @returns 0 on success, or -1 on failure
+ */
+int StatsUpdate(mtxstats *S, matrix *A)
+{
+    return StatsUpdateView(S, ViewMatrix(A));
+}
+
+/**
+ * @brief Calculate statistics for each column of a matrix
+ * @param A The matrix
+ * @param which Statistics to calculate, as for CreateStats
+ * @returns The statistics, or NULL on failure
+ */
+mtxstats* ColumnStats(matrix *A, int which)
+{
+    mtxstats *S;
+
+    S = CreateStats(nCols(A), which);
+    if(S && StatsUpdate(S, A)) {
+        DestroyStats(S);
+        return NULL;
+    }
+    return S;
+}
+
+/**
+ * @brief Combine the statistics for each column into ones for the whole
+ * matrix
+ * @param S The statistics for each column
+ * @returns Statistics with a single column covering every element, or NULL
+ *      on failure
+ */
+mtxstats* StatsOverall(mtxstats *S)
+{
+    mtxstats *T, *col;
+    int j;
+
+    T = CreateStats(1, S->which);
+    col = CreateStats(1, S->which);
+    if(!T || !col) {
+        if(T)
+            DestroyStats(T);
+        if(col)
+            DestroyStats(col);
+        return NULL;
+    }
+
+    for(j=0; j<S->cols; j++) {
+        col->count[0] = S->count[j];
+        col->nans[0] = S->nans[j];
+        col->mean[0] = S->mean[j];
+        col->m2[0] = S->m2[j];
+        col->min[0] = S->min[j];
+        col->max[0] = S->max[j];
+        col->absmax[0] = S->absmax[j];
+        StatsMerge(T, col);
+    }
+    DestroyStats(col);
+
+    return T;
+}
+
+/**
+ * @brief Get the sample variance of a column
+ * @param S Statistics that include STAT_VARIANCE
+ * @param col The column
+ * @returns The variance, or NaN if the column has fewer than two numbers
+ */
+double StatsVariance(mtxstats *S, int col)
+{
+    if(col < 0 || col >= S->cols || S->count[col] < 2)
+        return NAN;
+    return S->m2[col]/(S->count[col]-1);
+}
+
@@ -0,0 +1,86 @@
+/**
+ * @file stats.h
+ * Per-column statistics computed in one pass over a matrix.
+ *
+ * The rows are read in blocks small enough to stay in cache. The statistics
+ * for each block are worked out exactly, and then merged with those of the
+ * blocks before it in a balanced tree, using the pairwise update of Chan,
+ * Golub and LeVeque for the mean and variance. This keeps the rounding error
+ * growing with the logarithm of the number of rows instead of the number of
+ * rows itself. The blocks are split between threads, and more rows can be
+ * added at any time, so the statistics can be kept up to date as data arrives.
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include "2dmatrix/2dmatrix.h"
+#include "2dmatrix/mtxview.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+///Count the numbers and NaNs in each column and find the mean. Always done.
+#define STAT_MEAN 0
+///Find the smallest, largest and largest magnitude element of each column
+#define STAT_MINMAX 1
+///Find the variance of each column
+#define STAT_VARIANCE 2
+///Everything
+#define STAT_ALL (STAT_MINMAX | STAT_VARIANCE)
+
+/**
+ * @struct mtxstats
+ * @brief Statistics for each column of a matrix
+ *
+ * NaNs are counted but otherwise left out of every statistic.
+ *
+ * @var mtxstats::cols
+ * Number of columns
+ * @var mtxstats::which
+ * Which statistics are kept, as a combination of the STAT_ flags
+ * @var mtxstats::count
+ * Number of elements in each column that aren't NaN
+ * @var mtxstats::nans
+ * Number of NaNs in each column
+ * @var mtxstats::mean
+ * Mean of each column, or 0 if it has no numbers
+ * @var mtxstats::m2
+ * Sum of the squares of the differences from the mean. Divide by count-1
+ * to get the sample variance, or use StatsVariance.
+ * @var mtxstats::min
+ * Smallest element of each column, or INFINITY if it has no numbers
+ * @var mtxstats::max
+ * Largest element of each column, or -INFINITY if it has no numbers
+ * @var mtxstats::absmax
+ * Element of each column with the largest magnitude, or 0 if it has no
+ * numbers
+ */
+typedef struct {
+    int cols;
+    int which;
+    long *count;
+    long *nans;
+    double *mean;
+    double *m2;
+    double *min;
+    double *max;
+    double *absmax;
+} mtxstats;
+
+mtxstats* CreateStats(int, int);
+void DestroyStats(mtxstats*);
+int StatsUpdate(mtxstats*, matrix*);
+int StatsUpdateView(mtxstats*, mtxview);
+int StatsMerge(mtxstats*, mtxstats*);
+mtxstats* ColumnStats(matrix*, int);
+mtxstats* StatsOverall(mtxstats*);
+double StatsVariance(mtxstats*, int);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
@@ -0,0 +1,545 @@
+/**
+ * @file stencil.c
+ * Cache-blocked, multithreaded stencil application.
+ *
+ * The grid is split into tiles that are handed out to threads. Each tile is
+ * copied into a small buffer along with a halo of the points around it, the
+ * stencil is applied within the buffer, and the middle of the result is
+ * written out. Points past the edges of the grid are filled in from the
+ * boundary conditions as the halo is loaded, so the inner loops never check
+ * for the edges and can be vectorized.
+ *
+ * When the stencil is applied several times in a row, a few sweeps can be done
+ * on each tile before moving on to the next one (time tiling). The halo is
+ * made wide enough for all of them, and shrinks by the radius of the stencil
+ * with each sweep. This costs a little extra arithmetic around the edges of
+ * each tile, but the whole grid is only read and written once per group of
+ * sweeps instead of once per sweep.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+
+#include "stencil.h"
+#include "../2dmatrix/mtxview.h"
+#include "../instrument/instrument.h"
+
+///Number of grid rows in each tile
+#define STENCILTILEROWS 64
+///Number of grid columns in each tile
+#define STENCILTILECOLS 256
+///Number of sweeps done on each tile at once by default
+#define STENCILDEPTH 4
+///Number of grid points above which the work is split between threads
+#define PARALLELSIZE 1e5
+
+/* A nonzero weight and the distance in memory to the point it applies to */
+typedef struct {
+    long off;
+    double w;
+} stenciltap;
+
+/**
+ * @brief Make a stencil with all of its weights set to zero
+ *
+ * The boundary conditions default to STENCIL_DIRICHLET with a value of zero on
+ * all four sides.
+ *
+ * @param radius Largest offset from the center point in either direction. A
+ *      5- or 9-point stencil has a radius of 1.
+ * @returns A new stencil, or NULL if the radius is negative or there isn't
+ *      enough memory
+ */
+stencil* CreateStencil(int radius)
+{
+    stencil *s;
+    int i, n = 2*radius+1;
+
+    if(radius < 0) {
+        fprintf(stderr, "CreateStencil(): Invalid radius %d.\n", radius);
+        return NULL;
+    }
+
+    s = (stencil*) malloc(sizeof(stencil));
+    if(s)
+        s->w = (double*) calloc(n*n, sizeof(double));
+    if(!s || !s->w) {
+        fprintf(stderr, "Memory allocation error: %s\n", strerror(errno));
+        free(s);
+        return NULL;
+    }
+    s->radius = radius;
+    for(i=0; i<4; i++) {
+        s->bc[i] = STENCIL_DIRICHLET;
+        s->bcval[i] = 0;
+    }
+
+    return s;
+}
+
+/**
+ * @brief Make the standard 5-point stencil for the Laplacian
+ * @param hx Grid spacing along the columns (x)
+ * @param hy Grid spacing along the rows (y)
+ * @returns A new stencil, or NULL if there isn't enough memory
+ */
+stencil* CreateLaplacian5(double hx, double hy)
+{
+    stencil *s = CreateStencil(1);
+    double ax = 1/(hx*hx), ay = 1/(hy*hy);
+
+    if(!s)
+        return NULL;
+    setvalStencil(s, ay, -1, 0);
+    setvalStencil(s, ax, 0, -1);
+    setvalStencil(s, -2*ax - 2*ay, 0, 0);
+    setvalStencil(s, ax, 0, 1);
+    setvalStencil(s, ay, 1, 0);
+
+    return s;
+}
+
+/**
+ * @brief Make the isotropic 9-point stencil for the Laplacian
+ * @param h Grid spacing, which must be the same in both directions
+ * @returns A new stencil, or NULL if there isn't enough memory
+ */
+stencil* CreateLaplacian9(double h)
+{
+    stencil *s = CreateStencil(1);
+    double a = 1/(6*h*h);
+    int i, j;
+
+    if(!s)
+        return NULL;
+    for(i=-1; i<=1; i++)
+        for(j=-1; j<=1; j++)
+            setvalStencil(s, (i && j) ? a : 4*a, i, j);
+    setvalStencil(s, -20*a, 0, 0);
+
+    return s;
+}
+
+/**
+ * @brief Free a stencil made by CreateStencil
+ * @param s The stencil to destroy
+ */
+void DestroyStencil(stencil *s)
+{
+    free(s->w);
+    free(s);
+}
+
+/**
+ * @brief Get one of the weights of a stencil
+ * @param s The stencil
+ * @param di Row offset from the center point
+ * @param dj Column offset from the center point
+ * @returns The weight, or zero if the offset is outside the stencil
+ */
+double valStencil(stencil *s, int di, int dj)
+{
+    int r = s->radius;
+    if(di < -r || di > r || dj < -r || dj > r)
+        return 0;
+    return s->w[(di+r)*(2*r+1) + dj+r];
+}
+
+/**
+ * @brief Set one of the weights of a stencil
+ * @param s The stencil
+ * @param value The new weight
+ * @param di Row offset from the center point
+ * @param dj Column offset from the center point
+ */
+void setvalStencil(stencil *s, double value, int di, int dj)
+{
+    int r = s->radius;
+    if(di < -r || di > r || dj < -r || dj > r) {
+        fprintf(stderr, "setvalStencil(): Offset (%d, %d) is outside the stencil.\n", di, dj);
+        return;
+    }
+    s->w[(di+r)*(2*r+1) + dj+r] = value;
+}
+
+/**
+ * @brief Set the boundary condition on one side of the grid
+ * @param s The stencil
+ * @param side STENCIL_TOP, STENCIL_BOTTOM, STENCIL_LEFT or STENCIL_RIGHT
+ * @param type STENCIL_DIRICHLET, STENCIL_NEUMANN or STENCIL_PERIODIC
+ * @param value The fixed value used outside the grid with STENCIL_DIRICHLET.
+ *      Ignored otherwise.
+ */
+void StencilBoundary(stencil *s, int side, int type, double value)
+{
+    if(side < 0 || side > 3 || type < 0 || type > 2) {
+        fprintf(stderr, "StencilBoundary(): Invalid side or boundary type.\n");
+        return;
+    }
+    s->bc[side] = type;
+    s->bcval[side] = value;
+}
+
+/* Reflect an index outside [0, n) back across the nearest edge */
+static int Mirror(int k, int n)
+{
+    return (k < 0) ? -k : 2*(n-1) - k;
+}
+
+/* Value of point (i, j) of the grid u, which may be outside it */
+static double Fetch(stencil *s, mtxview u, int i, int j)
+{
+    int side;
+
+    if(i < 0 || i >= u.rows) {
+        side = (i < 0) ? STENCIL_TOP : STENCIL_BOTTOM;
+        if(s->bc[side] == STENCIL_DIRICHLET)
+            return s->bcval[side];
+        if(s->bc[side] == STENCIL_NEUMANN)
+            i = Mirror(i, u.rows);
+        else
+            i = (i%u.rows + u.rows) % u.rows;
+    }
+    if(j < 0 || j >= u.cols) {
+        side = (j < 0) ? STENCIL_LEFT : STENCIL_RIGHT;
+        if(s->bc[side] == STENCIL_DIRICHLET)
+            return s->bcval[side];
+        if(s->bc[side] == STENCIL_NEUMANN)
+            j = Mirror(j, u.cols);
+        else
+            j = (j%u.cols + u.cols) % u.cols;
+    }
+
+    return valView(u, i, j);
+}
+
+/* Value of a point in a tile buffer that lies past a non-periodic edge of the
+ * grid, taken from the points inside the grid at the same sweep. (gi, gj) is
+ * the point in grid coordinates, and (gi0, gj0) is the grid position of the
+ * first element of the buffer. */
+static double Ghost(stencil *s, const double *buf, long ld, int n, int m,
+                    int gi, int gj, int gi0, int gj0)
+{
+    int side;
+
+    if(s->bc[STENCIL_TOP] != STENCIL_PERIODIC && (gi < 0 || gi >= n)) {
+        side = (gi < 0) ? STENCIL_TOP : STENCIL_BOTTOM;
+        if(s->bc[side] == STENCIL_DIRICHLET)
+            return s->bcval[side];
+        gi = Mirror(gi, n);
+    }
+    if(s->bc[STENCIL_LEFT] != STENCIL_PERIODIC && (gj < 0 || gj >= m)) {
+        side = (gj < 0) ? STENCIL_LEFT : STENCIL_RIGHT;
+        if(s->bc[side] == STENCIL_DIRICHLET)
+            return s->bcval[side];
+        gj = Mirror(gj, m);
+    }
+
+    return buf[(gi-gi0)*ld + gj-gj0];
+}
+
+/* Do depth sweeps over the bi x bj tile of u with its corner at (i0, j0) and
+ * store the result in the same place in v. a and b are buffers with room for
+ * the tile plus a halo of depth*radius points on each side, with rows ld
+ * elements apart. */
+static void SweepTile(stencil *s, stenciltap *taps, int ntaps,
+                      mtxview u, mtxview v, int i0, int j0, int bi, int bj,
+                      int depth, double *a, double *b, long ld)
+{
+    int n = u.rows, m = u.cols;
+    int h = depth*s->radius, rows = bi+2*h, cols = bj+2*h;
+    int gi0 = i0-h, gj0 = j0-h;
+    int prow = (s->bc[STENCIL_TOP] == STENCIL_PERIODIC),
+        pcol = (s->bc[STENCIL_LEFT] == STENCIL_PERIODIC);
+    int r0, r1, c0, c1, lo, rlo, rhi, clo, chi;
+    int x, y, k, t, gi, inside;
+    double *o, *in, *tmp, w;
+    long off;
+
+    /* Rows and columns of the buffer that are computed with the stencil.
+     * Everything else lies past an edge that isn't periodic. */
+    r0 = (prow || gi0 >= 0) ? 0 : -gi0;
+    r1 = (prow || gi0+rows <= n) ? rows : n-gi0;
+    c0 = (pcol || gj0 >= 0) ? 0 : -gj0;
+    c1 = (pcol || gj0+cols <= m) ? cols : m-gj0;
+
+    /* Load the tile and its halo */
+    for(x=0; x<rows; x++) {
+        gi = gi0+x;
+        if(u.cs == 1 && gi >= 0 && gi < n && gj0 >= 0 && gj0+cols <= m)
+            memcpy(a + x*ld, u.data + (long) gi*u.rs + gj0,
+                   cols*sizeof(double));
+        else
+            for(y=0; y<cols; y++)
+                a[x*ld + y] = Fetch(s, u, gi, gj0+y);
+    }
+
+    for(k=1; k<=depth; k++) {
+        /* Only the points whose neighbors were all valid after the last sweep
+         * are still valid after this one */
+        lo = k*s->radius;
+        rlo = (lo > r0) ? lo : r0;
+        rhi = (rows-lo < r1) ? rows-lo : r1;
+        clo = (lo > c0) ? lo : c0;
+        chi = (cols-lo < c1) ? cols-lo : c1;
+
+        for(x=rlo; x<rhi; x++) {
+            o = b + x*ld;
+            in = a + x*ld;
+            off = taps[0].off;
+            w = taps[0].w;
+            #pragma omp simd
+            for(y=clo; y<chi; y++)
+                o[y] = w*in[y+off];
+            for(t=1; t<ntaps; t++) {
+                off = taps[t].off;
+                w = taps[t].w;
+                #pragma omp simd
+                for(y=clo; y<chi; y++)
+                    o[y] += w*in[y+off];
+            }
+        }
+
+        /* Fill in the points past the edges from the ones just computed */
+        if(r0 > lo || r1 < rows-lo || c0 > lo || c1 < cols-lo) {
+            for(x=lo; x<rows-lo; x++) {
+                inside = (x >= r0 && x < r1);
+                for(y=lo; y<cols-lo; y++)
+                    if(!inside || y < c0 || y >= c1)
+                        b[x*ld + y] = Ghost(s, b, ld, n, m, gi0+x, gj0+y,
+                                            gi0, gj0);
+            }
+        }
+
+        tmp = a;
+        a = b;
+        b = tmp;
+    }
+
+    /* Write out the middle of the tile */
+    for(x=0; x<bi; x++) {
+        in = a + (x+h)*ld + h;
+        if(v.cs == 1) {
+            memcpy(v.data + (long) (i0+x)*v.rs + j0, in, bj*sizeof(double));
+        } else {
+            for(y=0; y<bj; y++)
+                valView(v, i0+x, j0+y) = in[y];
+        }
+    }
+}
+
+#ifdef MTX_INSTRUMENT
+/* Number of nonzero weights in a stencil, for the FLOP counts */
+static int CountTaps(stencil *s)
+{
+    int i, n = 2*s->radius+1, count = 0;
+    for(i=0; i<n*n; i++)
+        if(s->w[i] != 0)
+            count++;
+    return count;
+}
+#endif
+
+/* Do depth sweeps of the stencil over the grid u, storing the result in v.
+ * The tiles are split between threads. Returns 0 if the buffers couldn't be
+ * allocated, in which case v is left partly written. */
+static int Pass(stencil *s, mtxview u, mtxview v, int depth)
+{
+    int n = u.rows, m = u.cols, r = s->radius, h = depth*r;
+    int ti = (n+STENCILTILEROWS-1)/STENCILTILEROWS,
+        tj = (m+STENCILTILECOLS-1)/STENCILTILECOLS;
+    int t, di, dj, ntaps = 0, failed = 0;
+    long ld, size;
+    stenciltap *taps;
+
+    ld = ((m < STENCILTILECOLS) ? m : STENCILTILECOLS) + 2*h;
+    size = (((n < STENCILTILEROWS) ? n : STENCILTILEROWS) + 2*h) * ld;
+
+    /* A stencil of all zeros still needs one tap to clear the output */
+    taps = (stenciltap*) malloc(((2*r+1)*(2*r+1)) * sizeof(stenciltap));
+    if(!taps) {
+        fprintf(stderr, "Memory allocation error: %s\n", strerror(errno));
+        return 0;
+    }
+    for(di=-r; di<=r; di++) {
+        for(dj=-r; dj<=r; dj++) {
+            if(valStencil(s, di, dj) != 0 || (ntaps == 0 && di == r && dj == r)) {
+                taps[ntaps].off = di*ld + dj;
+                taps[ntaps].w = valStencil(s, di, dj);
+                ntaps++;
+            }
+        }
+    }
+
+    #pragma omp parallel private(t) if((double) n*m > PARALLELSIZE)
+    {
+        double *a = (double*) malloc(size*sizeof(double)),
+               *b = (double*) malloc(size*sizeof(double));
+        int i0, j0;
+
+        if(!a || !b) {
+            fprintf(stderr, "Memory allocation error: %s\n", strerror(errno));
+            #pragma omp atomic write
+            failed = 1;
+        }
+        #pragma omp barrier
+
+        if(!failed) {
+            #pragma omp for schedule(static)
+            for(t=0; t<ti*tj; t++) {
+                i0 = (t/tj)*STENCILTILEROWS;
+                j0 = (t%tj)*STENCILTILECOLS;
+                SweepTile(s, taps, ntaps, u, v, i0, j0,
+                          (n-i0 < STENCILTILEROWS) ? n-i0 : STENCILTILEROWS,
+                          (m-j0 < STENCILTILECOLS) ? m-j0 : STENCILTILECOLS,
+                          depth, a, b, ld);
+            }
+        }
+
+        free(a);
+        free(b);
+    }
+
+    free(taps);
+    return !failed;
+}
+
+/* Check that the boundary conditions make sense for U, and find the largest
+ * number of sweeps that can be done on a tile at once. Mirrored points have
+ * to land inside the grid, which limits how wide the halo can be. Returns 0
+ * if the stencil can't be applied at all. */
+static int MaxDepth(stencil *s, matrix *U)
+{
+    int lim = INT_MAX;
+
+    if((s->bc[STENCIL_TOP] == STENCIL_PERIODIC) !=
+       (s->bc[STENCIL_BOTTOM] == STENCIL_PERIODIC) ||
+       (s->bc[STENCIL_LEFT] == STENCIL_PERIODIC) !=
+       (s->bc[STENCIL_RIGHT] == STENCIL_PERIODIC)) {
+        fprintf(stderr, "Error: Periodic boundaries must be set on both opposite sides.\n");
+        return 0;
+    }
+
+    if(s->bc[STENCIL_TOP] == STENCIL_NEUMANN ||
+       s->bc[STENCIL_BOTTOM] == STENCIL_NEUMANN)
+        lim = nRows(U)-1;
+    if((s->bc[STENCIL_LEFT] == STENCIL_NEUMANN ||
+        s->bc[STENCIL_RIGHT] == STENCIL_NEUMANN) && nCols(U)-1 < lim)
+        lim = nCols(U)-1;
+
+    if(s->radius == 0)
+        return INT_MAX;
+    if(lim < s->radius) {
+        fprintf(stderr, "Error: Grid is too small for the stencil.\n");
+        return 0;
+    }
+    return lim/s->radius;
+}
+
+/**
+ * @brief Apply a stencil to a grid
+ * @param s The stencil
+ * @param U The grid
+ * @returns A new matrix of the same size and layout as U, or NULL on error
+ */
+matrix* ApplyStencil(stencil *s, matrix *U)
+{
+    matrix *V;
+    V = CreateMatrixLayout(nRows(U), nCols(U), U->layout);
+    if(!V)
+        return NULL;
+    if(!ApplyStencilInto(s, U, V)) {
+        DestroyMatrix(V);
+        return NULL;
+    }
+    return V;
+}
+
+/**
+ * @brief Apply a stencil to a grid, storing the result in an existing matrix
+ * @param s The stencil
+ * @param U The grid
+ * @param V Matrix to store the result in. Must be the same size as U. If it
+ *      is U, the grid is updated in place.
+ * @returns V, or NULL on error
+ */
+matrix* ApplyStencilInto(stencil *s, matrix *U, matrix *V)
+{
+    int ok;
+
+    if(nRows(V) != nRows(U) || nCols(V) != nCols(U)) {
+        fprintf(stderr, "Error: Incompatible matrix dimensions.\n");
+        return NULL;
+    }
+    if(V == U)
+        return ApplyStencilSteps(s, U, 1, 1);
+    if(!MaxDepth(s, U))
+        return NULL;
+
+    UnshareMatrix(V);
+    PROF_BEGIN(MTXOP_STENCIL);
+    ok = Pass(s, ViewMatrix(U), ViewMatrix(V), 1);
+    PROF_END(MTXOP_STENCIL, 2.0*CountTaps(s)*nRows(U)*nCols(U));
+
+    return ok ? V : NULL;
+}
+
+/**
+ * @brief Apply a stencil to a grid several times over, in place
+ *
+ * This is how an explicit time stepping scheme advances: for example, with
+ * the weights of dt*L plus one at the center, each sweep is a forward Euler
+ * step of du/dt = L u.
+ *
+ * @param s The stencil
+ * @param U The grid. Overwritten with the result.
+ * @param steps Number of times to apply the stencil
+ * @param depth Number of sweeps to do on each tile before moving on to the
+ *      next one. 1 turns time tiling off, and 0 picks a default. It is
+ *      reduced if the grid is too small for it.
+ * @returns U, or NULL on error. If the work space runs out partway through,
+ *      U is left after the last group of sweeps that finished.
+ */
+matrix* ApplyStencilSteps(stencil *s, matrix *U, int steps, int depth)
+{
+    matrix *T, *src, *dst, *tmp;
+    int maxdepth, d, done, ok = 1;
+
+    maxdepth = MaxDepth(s, U);
+    if(!maxdepth)
+        return NULL;
+    if(depth < 1)
+        depth = STENCILDEPTH;
+    if(depth > maxdepth)
+        depth = maxdepth;
+    if(steps < 1)
+        return U;
+
+    UnshareMatrix(U);
+    T = CreateMatrixLayout(nRows(U), nCols(U), U->layout);
+    if(!T)
+        return NULL;
+
+    PROF_BEGIN(MTXOP_STENCIL);
+    src = U;
+    dst = T;
+    for(done=0; done<steps; done+=d) {
+        d = (steps-done < depth) ? steps-done : depth;
+        ok = Pass(s, ViewMatrix(src), ViewMatrix(dst), d);
+        if(!ok)
+            break;
+        tmp = src;
+        src = dst;
+        dst = tmp;
+    }
+    if(src != U)
+        CopyViewInto(ViewMatrix(src), U);
+    PROF_END(MTXOP_STENCIL, 2.0*CountTaps(s)*nRows(U)*nCols(U)*steps);
+
+    DestroyMatrix(T);
+    return ok ? U : NULL;
+}
+
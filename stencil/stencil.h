@@ -0,0 +1,77 @@
+/**
+ * @file stencil.h
+ * Apply finite difference stencils to grids stored in matricies.
+ *
+ * A stencil is a small square table of weights. Applying it to a grid U gives
+ * a grid V of the same size where
+ *
+ *     V(i, j) = sum over di, dj of w(di, dj) * U(i+di, j+dj)
+ *
+ * Rows of the grid run along y and columns along x, the same as the matricies
+ * made by meshgridX and meshgridY. Points that fall outside the grid are
+ * filled in according to the boundary condition set for each side.
+ */
+
+#ifndef STENCIL_H
+#define STENCIL_H
+
+#include "2dmatrix/2dmatrix.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+///Points outside the grid are held at a fixed value
+#define STENCIL_DIRICHLET 0
+///Points outside the grid mirror the ones inside, for a zero normal derivative
+#define STENCIL_NEUMANN 1
+///The grid wraps around. Must be set on both opposite sides.
+#define STENCIL_PERIODIC 2
+
+///The side before row 0
+#define STENCIL_TOP 0
+///The side after the last row
+#define STENCIL_BOTTOM 1
+///The side before column 0
+#define STENCIL_LEFT 2
+///The side after the last column
+#define STENCIL_RIGHT 3
+
+/**
+ * @struct stencil
+ * @brief Weights and boundary conditions for a stencil
+ * @var stencil::w
+ * The (2*radius+1) x (2*radius+1) table of weights, stored by rows. The weight
+ * for offset (di, dj) is w[(di+radius)*(2*radius+1) + dj+radius].
+ * @var stencil::radius
+ * Largest offset used in either direction
+ * @var stencil::bc
+ * Type of boundary condition on each side, indexed by STENCIL_TOP and friends
+ * @var stencil::bcval
+ * Value used outside each side with STENCIL_DIRICHLET
+ */
+typedef struct {
+    double *w;
+    int radius;
+    int bc[4];
+    double bcval[4];
+} stencil;
+
+stencil* CreateStencil(int);
+stencil* CreateLaplacian5(double, double);
+stencil* CreateLaplacian9(double);
+void DestroyStencil(stencil*);
+double valStencil(stencil*, int, int);
+void setvalStencil(stencil*, double, int, int);
+void StencilBoundary(stencil*, int, int, double);
+
+matrix* ApplyStencil(stencil*, matrix*);
+matrix* ApplyStencilInto(stencil*, matrix*, matrix*);
+matrix* ApplyStencilSteps(stencil*, matrix*, int, int);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
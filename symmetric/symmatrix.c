@@ -0,0 +1,428 @@
+/**
+ * @file symmatrix.c
+ * Storage, conversions and products for packed symmetric matricies.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "symmatrix.h"
+#include "../2dmatrix/mtxview.h"
+#include "../repro/repro.h"
+#include "../instrument/instrument.h"
+
+///Number of multiplications above which the products are multithreaded
+#define PARALLELFLOPS 1e6
+///Number of rows handed to a thread at a time. Rows have different lengths,
+///so they are handed out as the threads finish.
+#define SYMBLOCK 64
+///Number of rows of A kept in cache at a time by syrkS
+#define SYRKBLOCK 64
+
+/* Number of values stored for an nxn symmetric matrix */
+#define PACKEDSIZE(N) ((size_t) (N)*((N)+1)/2)
+
+/**
+ * @brief Make a symmetric matrix with all elements set to zero
+ * @param n Number of rows (and columns)
+ * @returns The new matrix, or NULL if it couldn't be allocated
+ */
+symmatrix* CreateSymMatrix(int n)
+{
+    symmatrix *S;
+    int i;
+
+    if(n <= 0) {
+        fprintf(stderr, "Error: Matrix too small.\n");
+        return NULL;
+    }
+
+    S = (symmatrix*) malloc(sizeof(symmatrix));
+    if(!S)
+        return NULL;
+    S->n = n;
+    S->array = (double**) calloc(n, sizeof(double*));
+    S->data = (double*) calloc(PACKEDSIZE(n), sizeof(double));
+    if(!S->array || !S->data) {
+        fprintf(stderr, "Memory allocation error: %s\n", strerror(errno));
+        fprintf(stderr, "Attempted to create a %dx%d symmetric matrix and failed.\n", n, n);
+        free(S->array);
+        free(S->data);
+        free(S);
+        return NULL;
+    }
+
+    for(i=0; i<n; i++)
+        S->array[i] = S->data + PACKEDSIZE(i);
+
+    PROF_ALLOC(MTXOBJ_MATRIX, sizeof(symmatrix) + n*sizeof(double*) + PACKEDSIZE(n)*sizeof(double));
+    return S;
+}
+
+/**
+ * @brief Free a symmetric matrix
+ * @param S The matrix to destroy. Can be NULL.
+ */
+void DestroySymMatrix(symmatrix *S)
+{
+    if(!S)
+        return;
+    PROF_FREE(MTXOBJ_MATRIX, sizeof(symmatrix) + S->n*sizeof(double*) + PACKEDSIZE(S->n)*sizeof(double));
+    free(S->array);
+    free(S->data);
+    free(S);
+}
+
+/**
+ * @brief Copy a symmetric matrix
+ * @param S The matrix to copy
+ * @returns A new copy of S
+ */
+symmatrix* CopySymMatrix(symmatrix *S)
+{
+    symmatrix *C;
+
+    C = CreateSymMatrix(S->n);
+    if(C)
+        memcpy(C->data, S->data, PACKEDSIZE(S->n)*sizeof(double));
+    return C;
+}
+
+/**
+ * @brief Get an element of a symmetric matrix
+ * @param S The matrix
+ * @param row Row. Can be on either side of the diagonal.
+ * @param col Column
+ * @returns The value of S(row, col), or 0 if it's out of bounds
+ */
+double valS(symmatrix *S, int row, int col)
+{
+    if(row < 0 || col < 0 || row >= S->n || col >= S->n) {
+        fprintf(stderr, "Error: index out of bounds. (%d, %d)\n", row, col);
+        return 0;
+    }
+    return (col <= row) ? S->array[row][col] : S->array[col][row];
+}
+
+/**
+ * @brief Set an element of a symmetric matrix. This also sets S(col, row).
+ * @param S The matrix
+ * @param value The value to store
+ * @param row Row
+ * @param col Column
+ */
+void setvalS(symmatrix *S, double value, int row, int col)
+{
+    if(row < 0 || col < 0 || row >= S->n || col >= S->n) {
+        fprintf(stderr, "Error: index out of bounds. (%d, %d)\n", row, col);
+        return;
+    }
+    if(col <= row)
+        S->array[row][col] = value;
+    else
+        S->array[col][row] = value;
+}
+
+/**
+ * @brief Pack the lower triangle of a square matrix into a symmetric matrix
+ * @param A The matrix to pack. Can have either layout. The strict upper
+ *      triangle is ignored.
+ * @returns A new symmetric matrix, or NULL if A isn't square
+ */
+symmatrix* PackSymmetric(matrix *A)
+{
+    symmatrix *S;
+    mtxview a;
+    int i, j, n = nRows(A);
+
+    if(nCols(A) != n) {
+        fprintf(stderr, "Error: Incompatible matrix dimensions.\n");
+        return NULL;
+    }
+
+    S = CreateSymMatrix(n);
+    if(!S)
+        return NULL;
+    a = ViewMatrix(A);
+    for(i=0; i<n; i++)
+        for(j=0; j<=i; j++)
+            S->array[i][j] = valView(a, i, j);
+    return S;
+}
+
+/**
+ * @brief Expand a symmetric matrix into a full square matrix
+ * @param S The matrix to expand
+ * @returns A new row-major matrix with both triangles filled in
+ */
+matrix* UnpackSymmetric(symmatrix *S)
+{
+    matrix *A;
+    int i, j, n = S->n;
+
+    A = CreateMatrix(n, n);
+    if(!A)
+        return NULL;
+    for(i=0; i<n; i++) {
+        for(j=0; j<=i; j++) {
+            A->array[i][j] = S->array[i][j];
+            A->array[j][i] = S->array[i][j];
+        }
+    }
+    return A;
+}
+
+/**
+ * @brief Calculate y = alpha*S*x + beta*y
+ *
+ * Each stored element is read once and used for both of the places it
+ * appears in S: row i of the lower triangle gives a dot product for y_i and
+ * is added, times x_i, to the first i components of y. Threads each add up
+ * their own copy of y, and the copies are summed at the end. In reproducible
+ * mode, a single thread adds everything up in order instead.
+ *
+ * @param alpha Multiplier for S*x
+ * @param S The symmetric matrix
+ * @param x Vector with one component per row of S
+ * @param beta Multiplier for the original y. If it's zero, y is only written
+ *      to.
+ * @param y Vector to store the result in. Must not be x.
+ * @returns y, or NULL if the dimensions don't agree or memory couldn't be
+ *      allocated
+ */
+vector* symvS(double alpha, symmatrix *S, vector *x, double beta, vector *y)
+{
+    int n = S->n, i, j;
+    double *t, s, xi;
+
+    if(len(x) != n || len(y) != n || x->v == y->v) {
+        fprintf(stderr, "Error: Incompatible matrix dimensions.\n");
+        return NULL;
+    }
+
+    t = (double*) calloc(n, sizeof(double));
+    if(!t) {
+        fprintf(stderr, "Memory allocation error: %s\n", strerror(errno));
+        return NULL;
+    }
+
+    PROF_BEGIN(MTXOP_SYMV);
+
+    if(mtxreproducible()) {
+        for(i=0; i<n; i++) {
+            const double *a = S->array[i];
+            xi = x->v[i];
+            s = 0;
+            for(j=0; j<i; j++) {
+                s += a[j]*x->v[j];
+                t[j] += a[j]*xi;
+            }
+            t[i] += s + a[i]*xi;
+        }
+    } else {
+        #pragma omp parallel for private(j, s, xi) reduction(+:t[:n]) if((double) n*n > PARALLELFLOPS) schedule(dynamic, SYMBLOCK)
+        for(i=0; i<n; i++) {
+            const double *a = S->array[i];
+            xi = x->v[i];
+            s = 0;
+            #pragma omp simd reduction(+:s)
+            for(j=0; j<i; j++) {
+                s += a[j]*x->v[j];
+                t[j] += a[j]*xi;
+            }
+            t[i] += s + a[i]*xi;
+        }
+    }
+
+    for(i=0; i<n; i++)
+        y->v[i] = (beta == 0) ? alpha*t[i] : alpha*t[i] + beta*y->v[i];
+    free(t);
+    PROF_END(MTXOP_SYMV, 2.0*n*n);
+
+    return y;
+}
+
+/**
+ * @brief Calculate C = alpha*S*B + beta*C, where S is symmetric
+ *
+ * Each row of S is unpacked into a buffer and then used like a row of a
+ * row-major matrix, so the products are accumulated a row of B at a time.
+ * Rows of C are split between threads.
+ *
+ * @param alpha Multiplier for S*B
+ * @param S The symmetric matrix
+ * @param B Matrix with one row per row of S. Can have either layout.
+ * @param beta Multiplier for the original C. If it's zero, C is only written
+ *      to.
+ * @param C Matrix to store the result in. Must not be B.
+ * @returns C, or NULL if the dimensions don't agree or memory couldn't be
+ *      allocated. C is left unchanged in either case.
+ */
+matrix* symmS(double alpha, symmatrix *S, matrix *B, double beta, matrix *C)
+{
+    int n = S->n, m = nCols(B), i, j, k, layout, failed = 0;
+    matrix *Br = NULL;
+
+    if(nRows(B) != n || nRows(C) != n || nCols(C) != m || B == C) {
+        fprintf(stderr, "Error: Incompatible matrix dimensions.\n");
+        return NULL;
+    }
+
+    PROF_BEGIN(MTXOP_SYMM);
+    if(B->layout != MTX_ROWMAJOR)
+        B = Br = ConvertLayout(B, MTX_ROWMAJOR);
+    layout = C->layout;
+    mtxsetlayout(C, MTX_ROWMAJOR);
+    UnshareMatrix(C);
+
+    #pragma omp parallel private(i, j, k) if((double) n*n*m > PARALLELFLOPS)
+    {
+        double *srow = (double*) malloc(n*sizeof(double));
+
+        /* Every thread has to get its buffer before any of them starts, so
+         * that they can all give up together if one can't */
+        if(!srow) {
+            fprintf(stderr, "Memory allocation error: %s\n", strerror(errno));
+            #pragma omp atomic write
+            failed = 1;
+        }
+        #pragma omp barrier
+
+        if(!failed) {
+            #pragma omp for schedule(static)
+            for(i=0; i<n; i++) {
+                double *c = C->array[i];
+
+                memcpy(srow, S->array[i], (i+1)*sizeof(double));
+                for(k=i+1; k<n; k++)
+                    srow[k] = S->array[k][i];
+
+                if(beta == 0) {
+                    for(j=0; j<m; j++)
+                        c[j] = 0;
+                } else if(beta != 1) {
+                    for(j=0; j<m; j++)
+                        c[j] *= beta;
+                }
+
+                for(k=0; k+3<n; k+=4) {
+                    const double *b0 = B->array[k], *b1 = B->array[k+1],
+                                 *b2 = B->array[k+2], *b3 = B->array[k+3];
+                    double s0 = alpha*srow[k], s1 = alpha*srow[k+1],
+                           s2 = alpha*srow[k+2], s3 = alpha*srow[k+3];
+                    #pragma omp simd
+                    for(j=0; j<m; j++)
+                        c[j] += s0*b0[j] + s1*b1[j] + s2*b2[j] + s3*b3[j];
+                }
+                for(; k<n; k++) {
+                    const double *b0 = B->array[k];
+                    double s0 = alpha*srow[k];
+                    #pragma omp simd
+                    for(j=0; j<m; j++)
+                        c[j] += s0*b0[j];
+                }
+            }
+        }
+
+        free(srow);
+    }
+
+    mtxsetlayout(C, layout);
+    if(Br)
+        DestroyMatrix(Br);
+    PROF_END(MTXOP_SYMM, 2.0*n*n*m);
+
+    return failed ? NULL : C;
+}
+
+/**
+ * @brief Symmetric rank-k update C = alpha*A^T*A + beta*C
+ *
+ * Only the lower triangle of the product is calculated, which is half the
+ * work of mtxmul(mtxtrn(A), A), and A is never transposed. When A is
+ * row-major, each row of A adds a scaled copy of itself to every row of C;
+ * the rows of A are taken in blocks that stay in cache. When A is
+ * column-major, each element of C is a contiguous dot product of two columns.
+ * For A*A^T, flip A with mtxtrnflip first.
+ *
+ * @param alpha Multiplier for A^T*A
+ * @param A A kxn matrix
+ * @param beta Multiplier for the original C. Ignored if C is NULL.
+ * @param C An nxn symmetric matrix to update, or NULL to make a new one
+ * @returns C, or NULL if the dimensions don't agree
+ */
+symmatrix* syrkS(double alpha, matrix *A, double beta, symmatrix *C)
+{
+    int n = nCols(A), kr = nRows(A), i, j, k, kb, kend, repro = mtxreproducible();
+    double s;
+
+    if(C && C->n != n) {
+        fprintf(stderr, "Error: Incompatible matrix dimensions.\n");
+        return NULL;
+    }
+    if(!C) {
+        C = CreateSymMatrix(n);
+        if(!C)
+            return NULL;
+        beta = 0;
+    }
+
+    PROF_BEGIN(MTXOP_SYRK);
+    if(A->layout == MTX_COLMAJOR) {
+        #pragma omp parallel for private(j, k, s) if((double) n*n*kr/2 > PARALLELFLOPS) schedule(dynamic, SYMBLOCK)
+        for(i=0; i<n; i++) {
+            const double *ai = A->array[i];
+            double *c = C->array[i];
+            for(j=0; j<=i; j++) {
+                const double *aj = A->array[j];
+                s = 0;
+                if(repro) {
+                    s = ReproDot(ai, 1, aj, 1, kr);
+                } else {
+                    #pragma omp simd reduction(+:s)
+                    for(k=0; k<kr; k++)
+                        s += ai[k]*aj[k];
+                }
+                c[j] = (beta == 0) ? alpha*s : alpha*s + beta*c[j];
+            }
+        }
+    } else {
+        #pragma omp parallel private(i, j, k, kb, kend) if((double) n*n*kr/2 > PARALLELFLOPS)
+        {
+            #pragma omp for schedule(static)
+            for(i=0; i<n; i++) {
+                double *c = C->array[i];
+                for(j=0; j<=i; j++)
+                    c[j] = (beta == 0) ? 0 : beta*c[j];
+            }
+
+            for(kb=0; kb<kr; kb+=SYRKBLOCK) {
+                kend = (kr-kb < SYRKBLOCK) ? kr : kb+SYRKBLOCK;
+                #pragma omp for schedule(dynamic, SYMBLOCK)
+                for(i=0; i<n; i++) {
+                    double *c = C->array[i];
+                    for(k=kb; k+1<kend; k+=2) {
+                        const double *a0 = A->array[k], *a1 = A->array[k+1];
+                        double t0 = alpha*a0[i], t1 = alpha*a1[i];
+                        #pragma omp simd
+                        for(j=0; j<=i; j++)
+                            c[j] += t0*a0[j] + t1*a1[j];
+                    }
+                    for(; k<kend; k++) {
+                        const double *a0 = A->array[k];
+                        double t0 = alpha*a0[i];
+                        #pragma omp simd
+                        for(j=0; j<=i; j++)
+                            c[j] += t0*a0[j];
+                    }
+                }
+            }
+        }
+    }
+    PROF_END(MTXOP_SYRK, (double) n*(n+1)*kr);
+
+    return C;
+}
+
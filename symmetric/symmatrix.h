@@ -0,0 +1,61 @@
+/**
+ * @file symmatrix.h
+ * Symmetric matricies stored as their packed lower triangle.
+ *
+ * Only the elements on and below the diagonal are stored, one row after
+ * another, so an nxn symmetric matrix takes n(n+1)/2 values instead of n^2.
+ * Row i of the lower triangle is contiguous, so element (i, j) with j <= i can
+ * be reached as array[i][j], the same as in a row-major matrix. The kernels
+ * below use each stored element for both (i, j) and (j, i), which halves the
+ * memory traffic of the dense products.
+ */
+
+#ifndef SYMMATRIX_H
+#define SYMMATRIX_H
+
+#include "2dmatrix/2dmatrix.h"
+#include "vector/vector.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @struct symmatrix
+ * @brief A symmetric matrix in packed lower triangular storage
+ * @var symmatrix::array
+ * Pointers to the start of each row of the lower triangle. Row i has i+1
+ * elements.
+ * @var symmatrix::data
+ * The lower triangle, one row after another
+ * @var symmatrix::n
+ * Number of rows (and columns)
+ */
+typedef struct {
+    double **array;
+    double *data;
+    int n;
+} symmatrix;
+
+symmatrix* CreateSymMatrix(int);
+void DestroySymMatrix(symmatrix*);
+symmatrix* CopySymMatrix(symmatrix*);
+double valS(symmatrix*, int, int);
+void setvalS(symmatrix*, double, int, int);
+symmatrix* PackSymmetric(matrix*);
+matrix* UnpackSymmetric(symmatrix*);
+
+vector* symvS(double, symmatrix*, vector*, double, vector*);
+matrix* symmS(double, symmatrix*, matrix*, double, matrix*);
+symmatrix* syrkS(double, matrix*, double, symmatrix*);
+
+int CholeskyFactorS(symmatrix*);
+void CholeskySolveS(symmatrix*, matrix*);
+int ConjugateGradientS(symmatrix*, vector*, vector*, double, int);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
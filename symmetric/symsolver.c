@@ -0,0 +1,195 @@
+/**
+ * @file symsolver.c
+ * Cholesky factorization and conjugate gradients for packed symmetric
+ * matricies.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "symmatrix.h"
+#include "../instrument/instrument.h"
+
+///Block size used by the blocked factorization
+#define CHOLBLOCK 64
+///Number of rows in the trailing submatrix above which its update is
+///multithreaded
+#define PARALLELROWS 256
+
+/**
+ * @brief Factor a symmetric positive definite matrix as L*L^T in place
+ *
+ * This is the same blocked factorization as CholeskyFactor. Since it only
+ * ever touches the lower triangle, it runs on the packed rows unchanged. The
+ * update of the trailing submatrix after each block is split between threads.
+ *
+ * @param S Matrix to factor. Replaced with L.
+ * @returns 0 on success, or k if the leading minor of order k is not positive
+ *      definite. In that case S is left partially factored.
+ */
+int CholeskyFactorS(symmatrix *S)
+{
+    int n = S->n, kb, nb, i, j, k, kend;
+    double **a = S->array;
+    double s;
+
+    PROF_BEGIN(MTXOP_CHOLESKY);
+    for(kb=0; kb<n; kb+=CHOLBLOCK) {
+        nb = (n-kb < CHOLBLOCK) ? n-kb : CHOLBLOCK;
+        kend = kb+nb;
+
+        /* Diagonal block and the panel below it */
+        for(j=kb; j<kend; j++) {
+            s = a[j][j];
+            for(k=kb; k<j; k++)
+                s -= a[j][k]*a[j][k];
+            if(s <= 0 || !isfinite(s)) {
+                PROF_END(MTXOP_CHOLESKY, ((double) n*n*n - (double) (n-j)*(n-j)*(n-j))/3.0);
+                return j+1;
+            }
+            a[j][j] = sqrt(s);
+
+            for(i=j+1; i<n; i++) {
+                s = a[i][j];
+                for(k=kb; k<j; k++)
+                    s -= a[i][k]*a[j][k];
+                a[i][j] = s/a[j][j];
+            }
+        }
+
+        /* Symmetric rank-nb update of the trailing submatrix. Each row only
+         * writes to itself. */
+        #pragma omp parallel for private(j, k, s) if(n-kend > PARALLELROWS) schedule(dynamic, CHOLBLOCK)
+        for(i=kend; i<n; i++) {
+            const double *ai = a[i] + kb;
+            for(j=kend; j<=i; j++) {
+                const double *aj = a[j] + kb;
+                s = 0;
+                #pragma omp simd reduction(+:s)
+                for(k=0; k<nb; k++)
+                    s += ai[k]*aj[k];
+                a[i][j] -= s;
+            }
+        }
+    }
+    PROF_END(MTXOP_CHOLESKY, n*(double)n*n/3.0);
+
+    return 0;
+}
+
+/**
+ * @brief Solve A*X = B in place using the output of CholeskyFactorS
+ * @param L Cholesky factor of A
+ * @param B Matrix of right-hand sides. Overwritten with X.
+ */
+void CholeskySolveS(symmatrix *L, matrix *B)
+{
+    int n = L->n, m = nCols(B), i, j, k, layout = B->layout;
+    double **l = L->array, **b, t;
+
+    if(nRows(B) != n) {
+        fprintf(stderr, "CholeskySolveS(): Incompatible matrix dimensions.\n");
+        return;
+    }
+    mtxsetlayout(B, MTX_ROWMAJOR);
+    UnshareMatrix(B);
+    b = B->array;
+
+    /* Forward substitution: L*Y = B */
+    for(i=0; i<n; i++) {
+        for(k=0; k<i; k++) {
+            t = l[i][k];
+            for(j=0; j<m; j++)
+                b[i][j] -= t*b[k][j];
+        }
+        for(j=0; j<m; j++)
+            b[i][j] /= l[i][i];
+    }
+
+    /* Back substitution: L^T*X = Y. Row i of L is column i of L^T. */
+    for(i=n-1; i>=0; i--) {
+        for(j=0; j<m; j++)
+            b[i][j] /= l[i][i];
+        for(k=0; k<i; k++) {
+            t = l[i][k];
+            for(j=0; j<m; j++)
+                b[k][j] -= t*b[i][j];
+        }
+    }
+
+    mtxsetlayout(B, layout);
+}
+
+/**
+ * @brief Solve A*x = b with the conjugate gradient method
+ *
+ * Uses the diagonal of A as a preconditioner. Each iteration does one
+ * product with symvS, which reads the packed matrix once.
+ *
+ * @param A Symmetric positive definite matrix
+ * @param b Right-hand side
+ * @param x Initial guess. Overwritten with the solution.
+ * @param tol Stop when the norm of the residual is less than tol times the
+ *      norm of b
+ * @param maxit Largest number of iterations to do
+ * @returns Number of iterations done, or -1 if it didn't converge or the
+ *      dimensions don't agree
+ */
+int ConjugateGradientS(symmatrix *A, vector *b, vector *x, double tol,
+                       int maxit)
+{
+    int n = A->n, i, it;
+    vector *r, *z, *p, *q;
+    double bnorm, rz, rznew, alpha, beta, rr;
+
+    if(len(b) != n || len(x) != n) {
+        fprintf(stderr, "Error: Incompatible matrix dimensions.\n");
+        return -1;
+    }
+
+    r = CreateVector(n);
+    z = CreateVector(n);
+    p = CreateVector(n);
+    q = CreateVector(n);
+
+    bnorm = sqrt(dotV(b, b));
+    if(bnorm == 0)
+        bnorm = 1;
+
+    /* r = b - A*x */
+    symvS(-1, A, x, 0, r);
+    for(i=0; i<n; i++) {
+        r->v[i] += b->v[i];
+        z->v[i] = r->v[i]/A->array[i][i];
+        p->v[i] = z->v[i];
+    }
+    rz = dotV(r, z);
+
+    for(it=0; ; it++) {
+        rr = sqrt(dotV(r, r));
+        if(rr <= tol*bnorm || it == maxit)
+            break;
+
+        symvS(1, A, p, 0, q);
+        alpha = rz/dotV(p, q);
+        for(i=0; i<n; i++) {
+            x->v[i] += alpha*p->v[i];
+            r->v[i] -= alpha*q->v[i];
+            z->v[i] = r->v[i]/A->array[i][i];
+        }
+
+        rznew = dotV(r, z);
+        beta = rznew/rz;
+        rz = rznew;
+        for(i=0; i<n; i++)
+            p->v[i] = z->v[i] + beta*p->v[i];
+    }
+
+    DestroyVector(r);
+    DestroyVector(z);
+    DestroyVector(p);
+    DestroyVector(q);
+    return (rr <= tol*bnorm) ? it : -1;
+}
+
@@ -0,0 +1,88 @@
+/**
+ * @file cpptest.cpp
+ * Checks for the C++ wrappers in cpp/matrix.hpp.
+ *
+ * Run with "make test". Each check prints a line and the program exits with a
+ * nonzero status if any of them fail. The error messages printed by the
+ * library for the deliberately mismatched operands are expected.
+ */
+
+#include <cstdio>
+
+#include "cpp/matrix.hpp"
+
+using namespace mtx;
+
+static int nfailed = 0;
+
+/* Report the result of one check */
+static void check(const char *name, bool ok)
+{
+    printf("%-40s %s\n", name, ok ? "ok" : "FAILED");
+    if(!ok)
+        nfailed++;
+}
+
+/* Operations chained after one that failed should give empty results
+ * instead of passing a null matrix on to the C functions. */
+static void testchainedmatrix()
+{
+    Matrix A(2, 2), B(3, 3), C(2, 2);
+    Matrix D;
+
+    check("(A + B) + C", !((A + B) + C));
+    check("C + (A + B)", !(C + (A + B)));
+    check("(A + B) + (A - B)", !((A + B) + (A - B)));
+    check("(A - B) - C", !((A - B) - C));
+    check("C - (A - B)", !(C - (A - B)));
+    check("2.0*(A + B)", !(2.0*(A + B)));
+    check("(A + B)*2.0", !((A + B)*2.0));
+    check("-(A - B)", !(-(A - B)));
+    check("(A + B)*C", !((A + B)*C));
+    check("transpose(A + B)", !transpose(A + B));
+
+    D = A + B;
+    check("D + C", !(D + C));
+    D *= 2.0;
+    check("D *= 2", !D);
+    D += C;
+    check("D += C", !D);
+    C -= D;
+    check("C -= D", !C);
+    check("multiply(D, A, C)", !multiply(D, A, C));
+
+    check("A + (Z + A) still works", (bool)(A + (Matrix(2, 2) + A)));
+}
+
+static void testchainedvector()
+{
+    Vector a(2), b(3), c(2);
+    Vector d;
+
+    check("(a + b) + c", !((a + b) + c));
+    check("c + (a + b)", !(c + (a + b)));
+    check("(a - b) - c", !((a - b) - c));
+    check("c - (a - b)", !(c - (a - b)));
+    check("2.0*(a + b)", !(2.0*(a + b)));
+    check("-(a - b)", !(-(a - b)));
+
+    d = a + b;
+    d *= 2.0;
+    check("d *= 2", !d);
+    d += c;
+    check("d += c", !d);
+    c -= d;
+    check("c -= d", !c);
+
+    check("a + (z + a) still works", (bool)(a + (Vector(2) + a)));
+}
+
+int main()
+{
+    testchainedmatrix();
+    testchainedvector();
+
+    if(nfailed)
+        printf("%d checks failed\n", nfailed);
+    return nfailed ? 1 : 0;
+}
@@ -6,6 +6,7 @@
 #include <stdlib.h>
 
 #include "vector.h"
+#include "../instrument/instrument.h"
 
 /**
  * @brief Create a 1d vector of length n
@@ -20,6 +21,8 @@ vector* CreateVector(int n)
     v->v = (double*) calloc(n, sizeof(double));
     v->length = n;
 
+    PROF_ALLOC(MTXOBJ_VECTOR, sizeof(vector) + n*sizeof(double));
+
     return v;
 }
 
@@ -29,6 +32,7 @@ vector* CreateVector(int n)
  */
 void DestroyVector(vector *v)
 {
+    PROF_FREE(MTXOBJ_VECTOR, sizeof(vector) + v->length*sizeof(double));
     free(v->v);
     free(v);
     return;
@@ -6,6 +6,10 @@
 #ifndef VECTOR_H
 #define VECTOR_H
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 /**
  * @struct vector
  * @brief A data structure for a vector of abitrary length
@@ -33,6 +37,9 @@ vector* addV(vector*, vector*);
 vector* subtractV(vector*, vector*);
 double dotV(vector*, vector*);
 vector* scalarmultV(double, vector*);
+vector* addVinto(vector*, vector*, vector*);
+vector* subtractVinto(vector*, vector*, vector*);
+vector* scalarmultVinto(double, vector*, vector*);
 int equalV(vector*, vector*);
 
 /**
@@ -42,5 +49,9 @@ int equalV(vector*, vector*);
  */
 #define valV(VECTOR, INDEX) (VECTOR)->v[(INDEX)]
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif
 
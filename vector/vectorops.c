@@ -3,9 +3,15 @@
  * Mathematical operations for vectors.
  */
 
+#include <stdio.h>
 #include <math.h>
 
 #include "vector.h"
+#include "../repro/repro.h"
+#include "../instrument/instrument.h"
+
+///Number of components above which dotV is multithreaded
+#define PARALLELSIZE 1e5
 
 /**
  * Add two vectors together, element by element
@@ -14,17 +20,41 @@
  *
  * @param a The first vector
  * @param b Second vector
- * @returns a+b
+ * @returns a+b, or NULL if the lengths don't match
  */
 vector* addV(vector *a, vector *b)
 {
-    int i;
     vector *c;
     c = CreateVector(len(a));
+    if(!addVinto(a, b, c)) {
+        DestroyVector(c);
+        return NULL;
+    }
+    return c;
+}
+
+/**
+ * Add two vectors together, storing the result in an existing vector
+ *
+ * @param a The first vector
+ * @param b Second vector
+ * @param c Vector to store a+b in. May be a or b.
+ * @returns c, or NULL if the lengths don't match
+ */
+vector* addVinto(vector *a, vector *b, vector *c)
+{
+    int i;
+
+    if(len(b) != len(a) || len(c) != len(a)) {
+        fprintf(stderr, "Error: Incompatible vector lengths.\n");
+        return NULL;
+    }
 
+    PROF_BEGIN(MTXOP_ADDV);
     for(i=0; i<len(a); i++) {
-        setvalV(c, i, valV(a, i) + valV(b, i));
+        valV(c, i) = valV(a, i) + valV(b, i);
     }
+    PROF_END(MTXOP_ADDV, len(a));
     return c;
 }
 
@@ -33,17 +63,41 @@ vector* addV(vector *a, vector *b)
  *
  * @param a The first vector
  * @param b The vector subtracted from a
- * @returns a-b
+ * @returns a-b, or NULL if the lengths don't match
  */
 vector* subtractV(vector *a, vector *b)
 {
-    int i;
     vector *c;
     c = CreateVector(len(a));
+    if(!subtractVinto(a, b, c)) {
+        DestroyVector(c);
+        return NULL;
+    }
+    return c;
+}
 
+/**
+ * Subtract vector b from vector a, storing the result in an existing vector
+ *
+ * @param a The first vector
+ * @param b The vector subtracted from a
+ * @param c Vector to store a-b in. May be a or b.
+ * @returns c, or NULL if the lengths don't match
+ */
+vector* subtractVinto(vector *a, vector *b, vector *c)
+{
+    int i;
+
+    if(len(b) != len(a) || len(c) != len(a)) {
+        fprintf(stderr, "Error: Incompatible vector lengths.\n");
+        return NULL;
+    }
+
+    PROF_BEGIN(MTXOP_SUBTRACTV);
     for(i=0; i<len(a); i++) {
-        setvalV(c, i, valV(a, i) - valV(b, i));
+        valV(c, i) = valV(a, i) - valV(b, i);
     }
+    PROF_END(MTXOP_SUBTRACTV, len(a));
     return c;
 }
 
@@ -55,12 +109,18 @@ vector* subtractV(vector *a, vector *b)
  */
 double dotV(vector *a, vector *b)
 {
-    int i;
+    int i, n = len(a);
     double result = 0;
-
-    for(i=0; i<len(a); i++) {
-        result += valV(a, i) * valV(b, i);
+    PROF_BEGIN(MTXOP_DOTV);
+
+    if(mtxreproducible()) {
+        result = ReproDot(a->v, 1, b->v, 1, n);
+    } else {
+        #pragma omp parallel for simd reduction(+:result) if(n > PARALLELSIZE) schedule(static)
+        for(i=0; i<n; i++)
+            result += valV(a, i) * valV(b, i);
     }
+    PROF_END(MTXOP_DOTV, 2.0*n);
     return result;
 }
 
@@ -72,15 +132,33 @@ double dotV(vector *a, vector *b)
  */
 vector* scalarmultV(double k, vector *v)
 {
-    int i;
     vector *c;
+    c = CreateVector(len(v));
+    return scalarmultVinto(k, v, c);
+}
+
+/**
+ * @brief Multiply a vector by a scalar, storing the result in an existing
+ * vector
+ * @param k The constant to multiply each component by
+ * @param v The vector to multiply
+ * @param c Vector to store k*v in. May be v.
+ * @returns c, or NULL if the lengths don't match
+ */
+vector* scalarmultVinto(double k, vector *v, vector *c)
+{
+    int i;
 
-    c = CreateVector(v->length);
+    if(len(c) != len(v)) {
+        fprintf(stderr, "Error: Incompatible vector lengths.\n");
+        return NULL;
+    }
 
+    PROF_BEGIN(MTXOP_SCALARMULTV);
     for(i=0; i<len(v); i++) {
-        setvalV(c, i, k*valV(v, i));
+        valV(c, i) = k*valV(v, i);
     }
-
+    PROF_END(MTXOP_SCALARMULTV, len(v));
     return c;
 }
 